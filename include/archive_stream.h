@@ -0,0 +1,72 @@
+#ifndef OPENCLI_ARCHIVE_STREAM_H
+#define OPENCLI_ARCHIVE_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Built on zlib, which the Linux and macOS builds link
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define ARCHIVE_STREAM_SUPPORTED 1
+#endif
+
+typedef enum {
+    ARCHIVE_TGZ,
+    ARCHIVE_ZIP
+} ArchiveFormat;
+
+typedef struct ArchiveStream ArchiveStream;
+
+/**
+ * Decide whether an archive entry is wanted and under what name, relative
+ * to the destination. name has any leading "./" removed
+ *
+ * @return false to leave the entry out
+ */
+typedef bool (*ArchiveEntryMap)(const char *name, char *mapped, size_t mapped_size, void *map_data);
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+
+/**
+ * Start extracting an archive into dest_dir as its bytes arrive. Entries
+ * are written as soon as their data is decoded, so the archive itself is
+ * never stored. Entries that would land outside dest_dir are refused
+ *
+ * @return NULL when out of memory
+ */
+ArchiveStream *archive_stream_create(ArchiveFormat format, const char *dest_dir);
+
+/**
+ * Extract only the files map accepts, under the names it gives them.
+ * Directories and symlinks are left out. Call before the first write
+ */
+void archive_stream_set_map(ArchiveStream *stream, ArchiveEntryMap map, void *map_data);
+
+/**
+ * Feed the next bytes of the archive
+ *
+ * @return false once the archive is found to be broken; the reason is printed
+ */
+bool archive_stream_write(ArchiveStream *stream, const void *data, size_t length);
+
+/**
+ * Check that the archive ended where it should have, after the last write
+ */
+bool archive_stream_finish(ArchiveStream *stream);
+
+// Number of files written so far
+uint64_t archive_stream_file_count(const ArchiveStream *stream);
+
+void archive_stream_free(ArchiveStream *stream);
+
+/**
+ * Extract an archive file, only the entries map accepts if it is not NULL.
+ * A zip is read through its central directory and its entries are
+ * inflated in parallel; a .tar.gz goes through an ArchiveStream
+ */
+bool archive_extract_file(ArchiveFormat format, const char *archive_path, const char *dest_dir,
+                          ArchiveEntryMap map, void *map_data);
+
+#endif
+
+#endif /* OPENCLI_ARCHIVE_STREAM_H */
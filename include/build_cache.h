@@ -0,0 +1,53 @@
+#ifndef OPENCLI_BUILD_CACHE_H
+#define OPENCLI_BUILD_CACHE_H
+
+#include <stdbool.h>
+#include "include_utils.h"
+
+#define BUILD_CACHE_KEY_LENGTH 65
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stores;
+} BuildCacheStats;
+
+/**
+ * Compute the cache key of a compilation: a SHA256 digest over the compiler
+ * version and binary, the final argument vector and the contents of every
+ * file in dependencies (the entry file first, then its includes)
+ */
+bool build_cache_compute_key(const char *compiler_version, const char *compiler_path,
+                             char *const args[], const IncludeFileList *dependencies,
+                             char key[BUILD_CACHE_KEY_LENGTH]);
+
+/**
+ * Restore the .amx stored under key to output_file. On success *diagnostics
+ * receives the recorded compiler output, which the caller must free
+ */
+bool build_cache_restore(const char *key, const char *output_file, char **diagnostics);
+
+/**
+ * Store output_file and the compiler output under key. Safe to race with
+ * other processes storing the same key; the first one wins
+ */
+bool build_cache_store(const char *key, const char *output_file, const char *diagnostics);
+
+/**
+ * Count a lookup in the persistent hit/miss statistics
+ */
+void build_cache_record_lookup(bool hit);
+
+/**
+ * Read the persistent hit/miss statistics
+ */
+bool build_cache_get_stats(BuildCacheStats *stats);
+
+/**
+ * Directory holding the cache (<appdata>/opencli/cache/build). It is
+ * filled in on the first call, which must come before worker threads use
+ * the cache
+ */
+const char *build_cache_get_dir(void);
+
+#endif /* OPENCLI_BUILD_CACHE_H */
@@ -1,9 +1,18 @@
 #ifndef OPENCLI_COMMANDS_H
 #define OPENCLI_COMMANDS_H
 
+#include "toml_utils.h"
+
 int command_run(int argc, char *argv[]);
 int command_build(int argc, char *argv[]);
+
+/**
+ * command_build() with opencli.toml already loaded, as the compile daemon
+ * keeps it. A NULL config is loaded from the current directory
+ */
+int command_build_with_config(int argc, char *argv[], const ProjectConfig *config);
 int command_install(int argc, char *argv[]);
 int command_setup(int argc, char *argv[]);
+int command_daemon(int argc, char *argv[]);
 
 #endif /* OPENCLI_COMMANDS_H */ 
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef OPENCLI_COMPILER_MANIFEST_H
+#define OPENCLI_COMPILER_MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "archive_stream.h"
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+
+/**
+ * The section of compilers.toml for one platform: how its release archive
+ * is packed and which archive paths (POSIX extended regexes, matched
+ * against the whole path) are installed under which names
+ */
+typedef struct CompilerManifest CompilerManifest;
+
+// The compilers.toml section this build installs from, such as "linux"
+const char *compiler_manifest_platform(void);
+
+/**
+ * Load the section of platform from the compilers.toml at toml_path,
+ * through its compiled snapshot. A missing, broken or incomplete file
+ * falls back to the built-in manifest. A section is incomplete unless its
+ * paths install both the file named by its binary key and a library
+ *
+ * @return NULL when out of memory or there is no section for platform
+ */
+CompilerManifest *compiler_manifest_load(const char *toml_path, const char *platform);
+
+ArchiveFormat compiler_manifest_format(const CompilerManifest *manifest);
+
+// Installed names of the compiler binary and of libpawnc
+const char *compiler_manifest_binary(const CompilerManifest *manifest);
+const char *compiler_manifest_library(const CompilerManifest *manifest);
+
+/**
+ * Map an archive path to its installed name; an ArchiveEntryMap taking
+ * the manifest as map_data
+ */
+bool compiler_manifest_map(const char *name, char *mapped, size_t mapped_size, void *manifest);
+
+void compiler_manifest_free(CompilerManifest *manifest);
+
+#endif
+
+#endif /* OPENCLI_COMPILER_MANIFEST_H */
@@ -7,7 +7,25 @@ void set_compiler_verbose_logging(bool verbose);
 bool init_compiler_dir(void);
 bool is_compiler_installed(const char *version);
 char *get_compiler_path(const char *version);
+char *get_compiler_library_path(const char *version);
+
+/**
+ * Put the directory of the compiler library on the dynamic loader's search
+ * path when pawncc cannot find it on its own, as in the flat layout
+ * compilers.toml installs use. Call before starting threads that run pawncc
+ */
+void add_compiler_library_search_path(const char *version);
 bool install_compiler(const char *version);
+
+/**
+ * Install several versions at once: every archive downloads concurrently
+ * and each is extracted as soon as it arrives. installed[i] receives the
+ * result for versions[i]
+ *
+ * @return true if every version was installed
+ */
+bool install_compilers(const char *const *versions, int count, bool *installed);
 const char *get_appdata_path(void);
+bool ensure_directory_exists(const char *path);
 
 #endif /* OPENCLI_COMPILER_UTILS_H */ 
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef OPENCLI_CONFIG_SNAPSHOT_H
+#define OPENCLI_CONFIG_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Compiled TOML files (<appdata>/opencli/cache/config/<hash>.snap).
+ *
+ * The first load of a TOML file parses it with tomlc99 and writes its
+ * tables to a flat blob that uses offsets instead of pointers. The blob
+ * records the source's absolute path, size, mtime and content hash. Later
+ * loads map the blob and read values straight from it, with no tokenising
+ * and no allocation, for as long as the source matches those.
+ */
+
+typedef enum {
+    CONFIG_NODE_TABLE,
+    CONFIG_NODE_ARRAY,
+    CONFIG_NODE_STRING,     // also dates and times, as written in the file
+    CONFIG_NODE_INT,
+    CONFIG_NODE_DOUBLE,
+    CONFIG_NODE_BOOL
+} ConfigNodeType;
+
+// One value of the blob. The children of a table or array are stored one
+// after another, a table's sorted by key
+typedef struct {
+    uint32_t key;           // string pool offset of the key, 0 ("") in arrays
+    uint32_t type;          // ConfigNodeType
+    uint32_t first;         // index of the first child, or pool offset of a string
+    uint32_t count;         // number of children, or length of a string
+    int64_t value;          // integer, boolean, or the bits of a double
+} ConfigNode;
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    const ConfigNode *nodes;
+    uint32_t node_count;
+    const char *strings;
+    uint32_t strings_size;
+    void *buffer;           // heap copy when the blob could not be stored or mapped
+} ConfigSnapshot;
+
+typedef enum {
+    CONFIG_SNAPSHOT_OK,
+    CONFIG_SNAPSHOT_MISSING,    // the TOML file does not exist
+    CONFIG_SNAPSHOT_ERROR       // unreadable or invalid; the reason is printed
+} ConfigSnapshotStatus;
+
+/**
+ * Load a TOML file through its compiled snapshot, compiling it first if
+ * there is no up-to-date one. Release with config_snapshot_close
+ */
+ConfigSnapshotStatus config_snapshot_open(ConfigSnapshot *snapshot, const char *toml_path);
+void config_snapshot_close(ConfigSnapshot *snapshot);
+
+const ConfigNode *config_snapshot_root(const ConfigSnapshot *snapshot);
+
+// Child of a table by key, or NULL
+const ConfigNode *config_node_get(const ConfigSnapshot *snapshot, const ConfigNode *table, const char *key);
+
+// Element of an array or table by position, or NULL
+const ConfigNode *config_node_at(const ConfigSnapshot *snapshot, const ConfigNode *node, uint32_t index);
+
+const char *config_node_key(const ConfigSnapshot *snapshot, const ConfigNode *node);
+
+/**
+ * Typed accessors. They fail on a NULL node or one of another type; the
+ * string accessor points into the snapshot
+ */
+bool config_node_string(const ConfigSnapshot *snapshot, const ConfigNode *node, const char **value, size_t *length);
+bool config_node_int(const ConfigNode *node, int64_t *value);
+bool config_node_double(const ConfigNode *node, double *value);
+bool config_node_bool(const ConfigNode *node, bool *value);
+
+#endif /* OPENCLI_CONFIG_SNAPSHOT_H */
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #define SHA256_BLOCK_SIZE 32
 #define SHA256_DIGEST_LENGTH 32
@@ -0,0 +1,52 @@
+#ifndef OPENCLI_DAEMON_UTILS_H
+#define OPENCLI_DAEMON_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame types of the compile daemon protocol. Every frame is a type byte,
+// a 32-bit big-endian payload length and the payload
+#define DAEMON_FRAME_BUILD  'B'   // client: cwd, argc in decimal, argv, then the environment; each \0-terminated
+#define DAEMON_FRAME_STATUS 'Q'   // client: ask for a status report
+#define DAEMON_FRAME_STOP   'S'   // client: ask the daemon to exit
+#define DAEMON_FRAME_STDOUT 'O'   // daemon: output for the client's stdout
+#define DAEMON_FRAME_STDERR 'E'   // daemon: output for the client's stderr
+#define DAEMON_FRAME_EXIT   'X'   // daemon: 32-bit exit code, last frame of a reply
+
+#define DAEMON_MAX_FRAME (1024 * 1024)
+
+/**
+ * Path of the daemon socket (<appdata>/opencli/compiled.sock)
+ */
+const char *daemon_get_socket_path(void);
+
+/**
+ * Whether the compile daemon is available on this platform
+ */
+bool daemon_supported(void);
+
+/**
+ * Connect to a running daemon. Returns the socket, or -1 if none is running
+ */
+int daemon_connect(void);
+
+bool daemon_send_frame(int fd, char type, const void *payload, uint32_t length);
+
+/**
+ * Receive one frame. *payload is malloc'd (NUL-terminated for convenience)
+ * and must be freed by the caller
+ */
+bool daemon_recv_frame(int fd, char *type, char **payload, uint32_t *length);
+
+/**
+ * Send a build request for the current directory and environment to a
+ * running daemon and relay its output.
+ *
+ * @param handled Set to false when no daemon answered and the caller
+ *                should build locally
+ * @return the build's exit code
+ */
+int daemon_client_build(int argc, char *argv[], bool *handled);
+
+#endif /* OPENCLI_DAEMON_UTILS_H */
@@ -2,8 +2,40 @@
 #define OPENCLI_DOWNLOAD_UTILS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 bool download_file(const char *url, const char *dest_path);
+
+/**
+ * Receives the body of a download as it arrives
+ *
+ * @return false to abort the download
+ */
+typedef bool (*DownloadSink)(const void *data, size_t length, void *sink_data);
+
+typedef struct DownloadRequest {
+    const char *url;
+    const char *dest_path;
+    bool ok;                // set once the download has finished
+    void *user_data;
+    // Where libcurl is available, a sink takes the body instead of
+    // dest_path; nothing is written to disk and nothing can be resumed
+    DownloadSink sink;
+    void *sink_data;
+} DownloadRequest;
+
+// Called as each download finishes, while the others are still running
+typedef void (*DownloadDoneCallback)(DownloadRequest *request);
+
+/**
+ * Download several files at once, over a single curl multi handle where
+ * libcurl is available and one after the other elsewhere. on_done, if not
+ * NULL, is called for every request from the calling thread; it should
+ * hand long work to another thread so the remaining downloads keep going
+ *
+ * @return true if every download succeeded
+ */
+bool download_files(DownloadRequest *requests, int count, DownloadDoneCallback on_done);
 bool extract_zip(const char *zip_path, const char *dest_dir);
 bool extract_tgz(const char *tgz_path, const char *dest_dir);
 
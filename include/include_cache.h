@@ -0,0 +1,66 @@
+#ifndef OPENCLI_INCLUDE_CACHE_H
+#define OPENCLI_INCLUDE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Resolutions kept in the cache file; beyond this the least recently used
+// are dropped
+#define INCLUDE_CACHE_MAX_ENTRIES 65536
+
+/**
+ * Persistent include resolution cache (<appdata>/opencli/cache/includes.cache).
+ *
+ * Every stored resolution, found or not, records the directories whose
+ * listing decided it together with their mtimes. A resolution is reused
+ * only while all of those directories are unchanged, which is checked with
+ * one stat per directory per pass rather than one probe per candidate.
+ * Resolutions stored within a second of a directory's mtime are not
+ * written out, since a change in that second would keep the same mtime.
+ */
+
+/**
+ * Start a resolution pass: re-read the cache file if another process
+ * updated it, and re-check directory mtimes on their next use
+ */
+void include_cache_begin_pass(void);
+
+/**
+ * Id of a resolution context: everything besides the include itself that
+ * decides where it resolves (working directory, search directories, auto
+ * extensions). Returns -1 if the cache is unavailable
+ */
+int include_cache_context(const char *context);
+
+/**
+ * Look an include up. include is the include path prefixed with its
+ * bracket, e.g. "<a_samp" or "\"utils"
+ *
+ * @return true on a valid hit; *found tells a positive result from a
+ *         negative one
+ */
+bool include_cache_lookup(int context, const char *include, bool *found,
+                          char *resolved_path, size_t resolved_path_size);
+
+/**
+ * Record a resolution. resolved_path is NULL for an include that was not
+ * found; dirs are the directories whose contents decided the outcome
+ */
+void include_cache_store(int context, const char *include, const char *resolved_path,
+                         const char *const *dirs, int dir_count);
+
+/**
+ * Write the cache file if it changed, atomically replacing the old one.
+ * Resolutions other processes saved since it was loaded are merged in
+ * under a lock, and stale entries and directory records are dropped
+ */
+bool include_cache_save(void);
+
+/**
+ * Drop the in-memory copy of the cache
+ */
+void include_cache_clear(void);
+
+const char *include_cache_get_path(void);
+
+#endif /* OPENCLI_INCLUDE_CACHE_H */
@@ -0,0 +1,40 @@
+#ifndef OPENCLI_INCLUDE_INDEX_H
+#define OPENCLI_INCLUDE_INDEX_H
+
+#include <stdbool.h>
+
+// Directories with more files than this are not indexed; lookups in such a
+// directory fall back to probing the file system
+#define INCLUDE_INDEX_MAX_FILES 65536
+
+typedef enum {
+    INCLUDE_INDEX_MISSING,
+    INCLUDE_INDEX_FOUND,
+    INCLUDE_INDEX_UNAVAILABLE   // no usable index, probe the file system instead
+} IncludeIndexResult;
+
+/**
+ * Start a resolution pass. Each index checks its directory mtime once per
+ * pass and is re-read if it changed, so a long-running process (--watch,
+ * the compile daemon) calls this once per build
+ */
+void include_index_begin_pass(void);
+
+/**
+ * Look relative_path (e.g. "a_samp.inc" or "YSI/y_hooks.inc") up in the
+ * index of the directory it names below dir, reading that directory on
+ * first use
+ */
+IncludeIndexResult include_index_lookup(const char *dir, const char *relative_path);
+
+/**
+ * Read dir into its index ahead of the first lookup
+ */
+bool include_index_warm(const char *dir);
+
+/**
+ * Drop every index
+ */
+void include_index_clear(void);
+
+#endif /* OPENCLI_INCLUDE_INDEX_H */
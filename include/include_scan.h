@@ -0,0 +1,44 @@
+#ifndef OPENCLI_INCLUDE_SCAN_H
+#define OPENCLI_INCLUDE_SCAN_H
+
+#include <stdbool.h>
+#include "include_utils.h"
+
+typedef struct {
+    char *path;
+    IncludeType type;
+    bool optional;      // #tryinclude
+    int line;
+} ScannedInclude;
+
+typedef struct {
+    ScannedInclude *items;
+    int count;
+    int capacity;
+} ScannedIncludeList;
+
+/**
+ * Find the #include and #tryinclude directives of a source file. The file
+ * is memory-mapped and searched for the bytes that can start a directive,
+ * comment or literal with SSE2/AVX2/NEON where available, so directives
+ * inside comments and strings are not reported and lines of any length
+ * are handled. Bare includes (#include a_samp) count as angle includes
+ *
+ * @return false if the file could not be read
+ */
+bool include_scan_file(const char *path, ScannedIncludeList *list);
+
+/**
+ * Same as include_scan_file, over a buffer already in memory
+ */
+bool include_scan_buffer(const char *data, size_t size, ScannedIncludeList *list);
+
+void scanned_include_list_free(ScannedIncludeList *list);
+
+/**
+ * Name of the search routine picked for this CPU ("avx2", "sse2", "neon"
+ * or "scalar")
+ */
+const char *include_scan_implementation(void);
+
+#endif /* OPENCLI_INCLUDE_SCAN_H */
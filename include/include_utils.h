@@ -3,10 +3,11 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 #define MAX_INCLUDE_PATH_LEN 1024
-#define MAX_INCLUDE_CACHE_SIZE 256
+#define DEFAULT_INCLUDE_CACHE_SIZE 256
 #define MAX_INCLUDE_DEPTH 32
 
 typedef enum {
@@ -18,28 +19,62 @@ typedef struct {
     char path[MAX_INCLUDE_PATH_LEN];
     IncludeType type;
     bool is_absolute;
+    bool optional;                  // #tryinclude
     char resolved_path[MAX_INCLUDE_PATH_LEN];
 } IncludeInfo;
 
-typedef struct {
-    char include_path[MAX_INCLUDE_PATH_LEN];
-    char resolved_path[MAX_INCLUDE_PATH_LEN];
-    bool exists;
-    time_t cached_time;
-} IncludeCacheEntry;
+// Resolution cache of a resolver: hashed lookups, least recently used
+// eviction and paths interned in an arena (include_utils.c)
+typedef struct IncludeResolverCache IncludeResolverCache;
 
 typedef struct {
     const char **include_dirs;
     int include_dirs_count;
     const char *base_dir;
-    IncludeCacheEntry cache[MAX_INCLUDE_CACHE_SIZE];
-    int cache_count;
+    IncludeResolverCache *cache;    // allocated on first use
+    int cache_capacity;             // entries kept before evicting
     bool enable_cache;
     bool auto_append_inc;
     const char **auto_extensions;
     int auto_extensions_count;
+    bool use_dir_index;             // probe include_index listings instead of access()
+    bool use_persistent_cache;      // consult and update include_cache
+    int cache_contexts[2];          // include_cache context per include type, -2 until looked up
 } IncludeResolver;
 
+// Hashed lookup of the paths held by a file list or graph (include_utils.c)
+typedef struct {
+    uint32_t *slots;        // path index + 1, 0 marks an empty slot
+    size_t slot_count;
+} IncludePathIndex;
+
+typedef struct {
+    char **files;
+    int count;
+    int capacity;
+    IncludePathIndex index;
+} IncludeFileList;
+
+typedef struct {
+    char *path;             // first, see include_path_index_find
+    char *dir;              // directory quoted includes resolve against
+    int *edges;             // indices of the nodes this file includes
+    int edge_count;
+    int edge_capacity;
+    bool visiting;          // on the current walk path, used to spot cycles
+} IncludeGraphNode;
+
+typedef struct {
+    IncludeGraphNode *nodes;    // nodes[0] is the source file
+    int count;
+    int capacity;
+    IncludePathIndex index;
+    int missing_count;          // includes that could not be resolved
+    int root_missing_count;     // of those, the ones in the source file itself
+    int cycle_count;            // includes that lead back into the walk path
+    bool depth_exceeded;        // nesting went past MAX_INCLUDE_DEPTH
+} IncludeGraph;
+
 IncludeResolver* include_resolver_create(const char **include_dirs, int include_dirs_count, 
                                         const char *base_dir, bool enable_cache);
 
@@ -66,7 +101,45 @@ bool make_absolute_path(const char *relative_path, const char *base_dir,
                        char *absolute_path, size_t path_size);
 bool validate_include_path(const char *path);
 void clear_include_cache(IncludeResolver *resolver);
+// Entries a resolver caches; shrinking below the current size clears it
+void set_include_cache_capacity(IncludeResolver *resolver, int capacity);
+// Capacity given to resolvers created from now on
+void set_default_include_cache_capacity(int capacity);
 void set_auto_append_inc(IncludeResolver *resolver, bool enabled);
+// Switch the directory quoted includes are relative to, keeping the cache
+void set_base_dir(IncludeResolver *resolver, const char *base_dir);
 void set_auto_extensions(IncludeResolver *resolver, const char **extensions, int count);
+// Resolve against cached directory listings (see include_index.h)
+void set_dir_index(IncludeResolver *resolver, bool enabled);
+// Share resolutions across runs through the cache file (see include_cache.h)
+void set_persistent_cache(IncludeResolver *resolver, bool enabled);
+
+/**
+ * Receives one line about a problem found while building an include graph
+ */
+typedef void (*IncludeReport)(const char *message, void *report_data);
+
+/**
+ * Build the transitive include graph of source_file. Each file is read once
+ * and cycles are recorded rather than followed. With report set, missing
+ * includes are passed to it with their location: errors for the source
+ * file, warnings for nested files, since those may be in inactive #if
+ * blocks. The graph must be freed with include_graph_free even on failure
+ *
+ * @return false if the source file could not be read
+ */
+bool include_graph_build(IncludeGraph *graph, const char *source_file, const char **include_dirs,
+                         int include_dirs_count, IncludeReport report, void *report_data);
+void include_graph_free(IncludeGraph *graph);
+
+/**
+ * Write a Make/Ninja depfile listing every file in the graph as a
+ * prerequisite of target, plus an empty rule per include
+ */
+bool include_graph_write_depfile(const IncludeGraph *graph, const char *target, const char *depfile_path);
+
+// Adds path unless the list already holds it
+bool include_file_list_append(IncludeFileList *list, const char *path);
+void include_file_list_free(IncludeFileList *list);
 
 #endif /* OPENCLI_INCLUDE_UTILS_H */
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef OPENCLI_PAWNC_UTILS_H
+#define OPENCLI_PAWNC_UTILS_H
+
+#include <stdbool.h>
+
+/**
+ * Receives one line of compiler output, without the trailing newline
+ */
+typedef void (*PawncDiagnosticCallback)(const char *line, void *user_data);
+
+/**
+ * Load libpawnc and resolve pc_compile, making it the library pawnc_compile
+ * uses. Libraries stay loaded, so switching back to a path loaded before
+ * is free
+ */
+bool pawnc_library_load(const char *library_path);
+
+/**
+ * Whether in-process compilation is available on this platform
+ */
+bool pawnc_in_process_supported(void);
+
+/**
+ * Compile with the loaded library and the given argument vector (args[0]
+ * is the compiler path, NULL-terminated), in this process. Everything the
+ * compiler prints is passed to callback line by line as it is printed, from
+ * another thread; stdout and stderr lead to the compiler for the duration,
+ * so the callback must not write to them.
+ *
+ * The compiler keeps global state, so its writable data is put back as it
+ * was when the library was loaded before every compile, and calls are
+ * serialised
+ *
+ * @return the compiler's return code, or -1 if the library is not loaded
+ */
+int pawnc_compile(char *const args[], PawncDiagnosticCallback callback, void *user_data);
+
+/**
+ * Unload every loaded libpawnc
+ */
+void pawnc_library_unload(void);
+
+#endif /* OPENCLI_PAWNC_UTILS_H */
@@ -8,6 +8,19 @@
  */
 int run_process(const char *command, char *const args[], bool wait_for_exit);
 
+/**
+ * Run a process and wait for it, collecting everything it writes to stdout
+ * and stderr into a malloc'd string (*output, may be NULL if capture is not
+ * supported on this platform). Output is echoed as it arrives when
+ * echo_output is set.
+ */
+int run_process_capture(const char *command, char *const args[], char **output, bool echo_output);
+
+/**
+ * Number of online processors, at least 1
+ */
+int get_cpu_count(void);
+
 /**
  * Check if a process with given name is running
  */
@@ -3,20 +3,58 @@
 
 #include <stdbool.h>
 
-char *read_toml_entry_file(const char *toml_path);
-char *read_toml_output_file(const char *toml_path);
-char *read_toml_compiler_version(const char *toml_path);
+typedef struct {
+    char *name;
+    char *entry_file;
+    char *output_file;
+    char **include_paths;   // NULL when the target inherits [build.includes]
+    int include_count;
+    char **args;            // NULL when the target inherits [build.args]
+    int args_count;
+} BuildTarget;
 
-// Returns a NULL-terminated array of strings that must be freed by caller
-char **read_toml_include_paths(const char *toml_path, int *count);
+/**
+ * Settings of opencli.toml, validated and with the defaults filled in.
+ * Every string and list is owned by the config; lists are NULL-terminated
+ */
+typedef struct {
+    bool found;                 // false when there is no opencli.toml
+    char *entry_file;
+    char *output_file;
+    char *compiler_version;
+    char **include_paths;       // [build.includes] paths, NULL when not set
+    int include_count;
+    char **compiler_args;       // [build.args] args or the default flags, NULL without opencli.toml
+    int args_count;
+    int include_cache_size;     // [build] include_cache_size, or 0 when not set
+    BuildTarget *targets;       // [[build.targets]], NULL when there are none
+    int target_count;
+} ProjectConfig;
 
-// Returns a NULL-terminated array of strings that must be freed by caller
-char **read_toml_compiler_args(const char *toml_path, int *count);
+/**
+ * Read and validate a project file in one parse. A missing file yields
+ * the defaults with found set to false
+ *
+ * @return NULL if the file cannot be read or parsed or has an invalid
+ *         setting; the reason is printed
+ */
+ProjectConfig *project_config_load(const char *toml_path);
+void project_config_free(ProjectConfig *config);
 
-// Get the directory part of a file path
-char *get_directory_path(const char *file_path);
+/**
+ * Get the directory part of a file path, with its trailing separator, or
+ * "./" when it has none. Safe to call from any thread
+ *
+ * @return a string the caller frees, or NULL when out of memory
+ */
+char *dup_directory_path(const char *file_path);
 
-// Get the relative include path for quoted includes
-char *get_relative_include_path(const char *base_file, const char *include_file);
+/**
+ * Get the relative include path for quoted includes: include_file in the
+ * directory of base_file
+ *
+ * @return a string the caller frees, or NULL when out of memory
+ */
+char *dup_relative_include_path(const char *base_file, const char *include_file);
 
 #endif /* OPENCLI_TOML_UTILS_H */
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef OPENCLI_TOOLCHAIN_STORE_H
+#define OPENCLI_TOOLCHAIN_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Only where compilers are extracted natively, which never writes through
+// an existing file and so never into a stored copy
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#define TOOLCHAIN_STORE_SUPPORTED 1
+#endif
+
+#ifdef TOOLCHAIN_STORE_SUPPORTED
+
+typedef struct {
+    uint64_t files;
+    uint64_t shared;            // files whose content was already stored
+    uint64_t shared_bytes;
+} ToolchainStoreStats;
+
+/**
+ * Put every regular file under dir into the content-addressed store at
+ * store_dir, keyed by SHA-256 and mode. A file that is already stored is
+ * replaced by a hardlink to the stored copy; where it cannot be linked it
+ * stays a copy. Stored files are read-only, as are the links to them
+ *
+ * @return false if a file could not be read or stored; the rest are still done
+ */
+bool toolchain_store_adopt_tree(const char *store_dir, const char *dir, ToolchainStoreStats *stats);
+
+/**
+ * Remove the stored files no install links to any more, as left behind
+ * when a version is removed or reinstalled
+ *
+ * @return the number of files removed
+ */
+uint64_t toolchain_store_sweep(const char *store_dir);
+
+#endif
+
+#endif /* OPENCLI_TOOLCHAIN_STORE_H */
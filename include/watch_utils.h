@@ -0,0 +1,39 @@
+#ifndef OPENCLI_WATCH_UTILS_H
+#define OPENCLI_WATCH_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "include_utils.h"
+
+typedef struct FileWatcher FileWatcher;
+
+/**
+ * Create a watcher. Uses inotify on Linux and stat polling elsewhere
+ */
+FileWatcher *file_watcher_create(void);
+
+/**
+ * Replace the watched set. Content hashes of files are recorded so later
+ * changes can be told apart from writes that leave a file unchanged.
+ * Changes to dirs (files added or removed) only count when waiting with
+ * watch_dirs set.
+ *
+ * Files already watched keep the state recorded before the build that
+ * produced the set, which started at since; anything changed after that
+ * makes the next wait return straight away
+ */
+bool file_watcher_set(FileWatcher *watcher, const IncludeFileList *files, const IncludeFileList *dirs,
+                      time_t since);
+
+/**
+ * Block until the content of a watched file changes. Bursts of events are
+ * coalesced until nothing happens for debounce_ms. The first changed path
+ * is copied to changed_file
+ */
+bool file_watcher_wait(FileWatcher *watcher, int debounce_ms, bool watch_dirs,
+                       char *changed_file, size_t changed_file_size);
+
+void file_watcher_destroy(FileWatcher *watcher);
+
+#endif /* OPENCLI_WATCH_UTILS_H */
@@ -0,0 +1,673 @@
+/*
+  Throughput benchmark for tomlc99.
+
+  Generates synthetic corpora, plus the stdex samples, and measures each
+  parse entry point and the accessor APIs over them: MB/s of TOML text,
+  allocations and peak heap per parse, and peak RSS.
+
+  usage: bench_toml [--json] [--scale N] [--time SECONDS] [--corpus NAME]
+                    [--stdex DIR]
+
+  --json prints one JSON object per measurement and line, for regression
+  tracking. On POSIX systems every measurement runs in a child process of
+  its own so that its peak RSS is not hidden by the ones before it; the
+  RSS includes the corpus text itself.
+*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE /* wait4 */
+#define _DARWIN_C_SOURCE
+#include "toml.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifndef BENCH_TOML_STDEX
+#define BENCH_TOML_STDEX "stdex"
+#endif
+
+/*-----------------------------------------------------------------
+ * counting allocator
+ */
+static long nalloc;
+static size_t live, peak;
+
+typedef union {
+  size_t size;
+  max_align_t align;
+} header_t;
+
+static void *count_malloc(size_t sz) {
+  header_t *h = malloc(sizeof(header_t) + sz);
+  if (!h)
+    return 0;
+  h->size = sz;
+  nalloc++;
+  live += sz;
+  if (live > peak)
+    peak = live;
+  return h + 1;
+}
+
+static void count_free(void *p) {
+  if (!p)
+    return;
+  header_t *h = (header_t *)p - 1;
+  live -= h->size;
+  free(h);
+}
+
+static void count_reset(void) {
+  nalloc = 0;
+  peak = live;
+}
+
+/*-----------------------------------------------------------------
+ * corpora
+ */
+typedef struct {
+  char *text;
+  size_t len;
+  char path[64]; /* temporary copy for toml_parse_file */
+} doc_t;
+
+typedef struct {
+  const char *name;
+  int ndoc;
+  doc_t *doc;
+  size_t bytes;
+} corpus_t;
+
+typedef struct {
+  char *p;
+  size_t len, cap;
+} buf_t;
+
+static void die(const char *msg) {
+  fprintf(stderr, "bench_toml: %s\n", msg);
+  exit(1);
+}
+
+static void put(buf_t *b, const char *fmt, ...) {
+  for (;;) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->p + b->len, b->cap - b->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      die("format error");
+    if (b->len + (size_t)n < b->cap) {
+      b->len += (size_t)n;
+      return;
+    }
+    b->cap = b->cap ? 2 * b->cap + (size_t)n : 4096 + (size_t)n;
+    if (!(b->p = realloc(b->p, b->cap)))
+      die("out of memory");
+  }
+}
+
+static void add_doc(corpus_t *c, char *text, size_t len) {
+  c->doc = realloc(c->doc, sizeof(doc_t) * (c->ndoc + 1));
+  if (!c->doc)
+    die("out of memory");
+  memset(&c->doc[c->ndoc], 0, sizeof(doc_t));
+  c->doc[c->ndoc].text = text;
+  c->doc[c->ndoc].len = len;
+  c->ndoc++;
+  c->bytes += len;
+}
+
+static void add_buf(corpus_t *c, buf_t *b) {
+  put(b, "%s", ""); /* make sure there is a buffer to terminate */
+  add_doc(c, b->p, b->len);
+}
+
+/* one table with many keys of every scalar type */
+static void gen_wide(corpus_t *c, int scale) {
+  buf_t b = {0};
+  put(&b, "[wide]\n");
+  for (int i = 0; i < 20000 * scale; i++) {
+    switch (i % 5) {
+    case 0:
+      put(&b, "int_%d = %d\n", i, i * 7919);
+      break;
+    case 1:
+      put(&b, "str_%d = \"value number %d\"\n", i, i);
+      break;
+    case 2:
+      put(&b, "dbl_%d = %d.%03d\n", i, i, i % 1000);
+      break;
+    case 3:
+      put(&b, "bool_%d = %s\n", i, i & 8 ? "true" : "false");
+      break;
+    case 4:
+      put(&b, "lit_%d = 'C:\\path\\%d'\n", i, i);
+      break;
+    }
+  }
+  add_buf(c, &b);
+}
+
+/* dotted keys eight levels deep, sharing their prefixes */
+static void gen_dotted(corpus_t *c, int scale) {
+  buf_t b = {0};
+  for (int i = 0; i < 10000 * scale; i++)
+    put(&b, "a%d.b%d.c%d.d.e.f.g.key_%d = %d\n", i % 10, i % 7, i % 3, i, i);
+  add_buf(c, &b);
+}
+
+/* a long array of tables */
+static void gen_aot(corpus_t *c, int scale) {
+  buf_t b = {0};
+  for (int i = 0; i < 10000 * scale; i++)
+    put(&b,
+        "[[entry]]\nname = \"entry %d\"\nid = %d\n"
+        "tags = [\"alpha\", \"beta\", \"gamma\"]\nenabled = true\n\n",
+        i, i);
+  add_buf(c, &b);
+}
+
+/* long multi-line strings, basic with escapes and literal */
+static void gen_multiline(corpus_t *c, int scale) {
+  buf_t b = {0};
+  for (int i = 0; i < 100 * scale; i++) {
+    put(&b, "basic_%d = \"\"\"\n", i);
+    for (int j = 0; j < 200; j++)
+      put(&b, "line %d of a long text\\twith an escape, caf\\u00E9 \\\n", j);
+    put(&b, "\"\"\"\nliteral_%d = '''\n", i);
+    for (int j = 0; j < 200; j++)
+      put(&b, "C:\\pawno\\include\\file_%d.inc is included here\n", j);
+    put(&b, "'''\n");
+  }
+  add_buf(c, &b);
+}
+
+/* a compilers.toml that lists every release for every platform */
+static void gen_manifest(corpus_t *c, int scale) {
+  static const char *platform[] = {"linux", "windows", "darwin",
+                                   "android-arm32", "android-arm64"};
+  static const char *method[] = {"tgz", "zip", "zip", "zip", "zip"};
+  static const char *ext[] = {"tar.gz", "zip", "zip", "zip", "zip"};
+  buf_t b = {0};
+
+  for (int r = 0; r < 1000 * scale; r++) {
+    int major = 3 + r / 1000, minor = r / 100 % 10, patch = r % 100;
+    put(&b, "[releases.\"v%d.%d.%d\"]\ndate = 2020-01-%02dT12:00:00Z\n",
+        major, minor, patch, 1 + r % 28);
+    put(&b, "prerelease = %s\n\n", r % 10 ? "false" : "true");
+    for (int p = 0; p < 5; p++) {
+      put(&b, "[releases.\"v%d.%d.%d\".%s]\n", major, minor, patch,
+          platform[p]);
+      put(&b,
+          "url = \"https://github.com/pawn-lang/compiler/releases/download/"
+          "v%d.%d.%d/pawnc-%d.%d.%d-%s.%s\"\n",
+          major, minor, patch, major, minor, patch, platform[p], ext[p]);
+      put(&b, "sha256 = \"");
+      for (int h = 0; h < 8; h++)
+        put(&b, "%08x", (unsigned)(r * 2654435761u + p * 40503u + h));
+      put(&b, "\"\nsize = %d\nmatch = \"pawnc-(.+)-(%s)\\\\.%s\"\n",
+          500000 + r * 13 + p, platform[p], ext[p]);
+      put(&b, "method = \"%s\"\nbinary = \"pawncc%s\"\n\n", method[p],
+          p == 1 ? ".exe" : "");
+      put(&b, "[releases.\"v%d.%d.%d\".%s.paths]\n", major, minor, patch,
+          platform[p]);
+      put(&b, "\"(pawnc-(.+)/)?bin/pawncc\" = \"pawncc\"\n");
+      put(&b, "\"(pawnc-(.+)/)?lib/libpawnc.so\" = \"libpawnc.so\"\n\n");
+    }
+  }
+  add_buf(c, &b);
+}
+
+static char *read_all(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return 0;
+  buf_t b = {0};
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    put(&b, "%.*s", (int)n, chunk);
+  fclose(fp);
+  put(&b, "%s", "");
+  *len = b.len;
+  return b.p;
+}
+
+/* the stdex samples that parse: the others would only time errors */
+static void add_stdex_file(corpus_t *c, const char *dir, const char *name) {
+  size_t n = strlen(name);
+  if (n < 5 || strcmp(name + n - 5, ".toml"))
+    return;
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  size_t len;
+  char *text = read_all(path, &len);
+  if (!text || strlen(text) != len) {
+    free(text);
+    return;
+  }
+  char errbuf[200];
+  toml_table_t *tab = toml_parse_n(text, len, errbuf, sizeof(errbuf));
+  if (!tab) {
+    free(text);
+    return;
+  }
+  toml_free(tab);
+  add_doc(c, text, len);
+}
+
+static void gen_stdex(corpus_t *c, const char *dir) {
+#ifdef _WIN32
+  char pattern[1024];
+  WIN32_FIND_DATAA fd;
+  snprintf(pattern, sizeof(pattern), "%s\\*.toml", dir);
+  HANDLE h = FindFirstFileA(pattern, &fd);
+  if (h == INVALID_HANDLE_VALUE)
+    return;
+  do
+    add_stdex_file(c, dir, fd.cFileName);
+  while (FindNextFileA(h, &fd));
+  FindClose(h);
+#else
+  DIR *d = opendir(dir);
+  if (!d)
+    return;
+  struct dirent *e;
+  while ((e = readdir(d)) != 0)
+    add_stdex_file(c, dir, e->d_name);
+  closedir(d);
+#endif
+}
+
+typedef struct {
+  const char *name;
+  void (*gen)(corpus_t *c, int scale);
+} generator_t;
+
+static const generator_t generators[] = {
+    {"wide", gen_wide},           {"dotted", gen_dotted},
+    {"aot", gen_aot},             {"multiline", gen_multiline},
+    {"manifest", gen_manifest},   {"stdex", 0},
+};
+#define NGEN ((int)(sizeof(generators) / sizeof(generators[0])))
+
+static void make_corpus(corpus_t *c, int g, int scale, const char *stdex) {
+  memset(c, 0, sizeof(*c));
+  c->name = generators[g].name;
+  if (generators[g].gen)
+    generators[g].gen(c, scale);
+  else
+    gen_stdex(c, stdex);
+}
+
+static void free_corpus(corpus_t *c) {
+  for (int i = 0; i < c->ndoc; i++) {
+    if (c->doc[i].path[0])
+      remove(c->doc[i].path);
+    free(c->doc[i].text);
+  }
+  free(c->doc);
+}
+
+/*-----------------------------------------------------------------
+ * the APIs under test. Each runs once over every document of a corpus.
+ */
+static double now(void) {
+#ifdef _WIN32
+  LARGE_INTEGER f, t;
+  QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return (double)t.QuadPart / (double)f.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static void parse_failed(const char *api, const char *errbuf) {
+  fprintf(stderr, "bench_toml: %s: %s\n", api, errbuf);
+  exit(1);
+}
+
+static void run_parse(corpus_t *c) {
+  char errbuf[200];
+  for (int i = 0; i < c->ndoc; i++) {
+    toml_table_t *tab = toml_parse(c->doc[i].text, errbuf, sizeof(errbuf));
+    if (!tab)
+      parse_failed("toml_parse", errbuf);
+    toml_free(tab);
+  }
+}
+
+static void run_parse_file(corpus_t *c) {
+  char errbuf[200];
+  for (int i = 0; i < c->ndoc; i++) {
+    FILE *fp = fopen(c->doc[i].path, "rb");
+    if (!fp)
+      die("cannot open a temporary file");
+    toml_table_t *tab = toml_parse_file(fp, errbuf, sizeof(errbuf));
+    fclose(fp);
+    if (!tab)
+      parse_failed("toml_parse_file", errbuf);
+    toml_free(tab);
+  }
+}
+
+static void run_parse_arena(corpus_t *c) {
+  char errbuf[200];
+  for (int i = 0; i < c->ndoc; i++) {
+    toml_table_t *tab =
+        toml_parse_arena(c->doc[i].text, errbuf, sizeof(errbuf));
+    if (!tab)
+      parse_failed("toml_parse_arena", errbuf);
+    toml_free(tab);
+  }
+}
+
+static void run_parse_n(corpus_t *c) {
+  char errbuf[200];
+  for (int i = 0; i < c->ndoc; i++) {
+    toml_table_t *tab =
+        toml_parse_n(c->doc[i].text, c->doc[i].len, errbuf, sizeof(errbuf));
+    if (!tab)
+      parse_failed("toml_parse_n", errbuf);
+    toml_free(tab);
+  }
+}
+
+static int on_event(const toml_event_t *ev, void *ud) {
+  (void)ev;
+  ++*(long *)ud;
+  return 0;
+}
+
+static void run_events(corpus_t *c) {
+  char errbuf[200];
+  long n = 0;
+  for (int i = 0; i < c->ndoc; i++) {
+    if (toml_parse_events(c->doc[i].text, c->doc[i].len, on_event, &n,
+                          errbuf, sizeof(errbuf)))
+      parse_failed("toml_parse_events", errbuf);
+  }
+}
+
+/* Read every value of the tree. borrow picks toml_string_ref_in/_at over
+ * toml_string_in/_at. */
+static long walk_tab(const toml_table_t *tab, int borrow);
+
+static long walk_arr(const toml_array_t *arr, int borrow) {
+  long n = 0;
+  for (int i = 0; i < toml_array_nelem(arr); i++) {
+    const toml_array_t *a;
+    const toml_table_t *t;
+    const char *s;
+    toml_datum_t d;
+    if ((a = toml_array_at(arr, i)) != 0)
+      n += walk_arr(a, borrow);
+    else if ((t = toml_table_at(arr, i)) != 0)
+      n += walk_tab(t, borrow);
+    else if (borrow && 0 == toml_string_ref_at(arr, i, &s, 0))
+      n++;
+    else if (!borrow && (d = toml_string_at(arr, i)).ok)
+      n++, count_free(d.u.s);
+    else if ((d = toml_int_at(arr, i)).ok || (d = toml_double_at(arr, i)).ok ||
+             (d = toml_bool_at(arr, i)).ok)
+      n++;
+    else if ((d = toml_timestamp_at(arr, i)).ok)
+      n++, count_free(d.u.ts);
+  }
+  return n;
+}
+
+static long walk_tab(const toml_table_t *tab, int borrow) {
+  long n = 0;
+  const char *key;
+  for (int i = 0; (key = toml_key_in(tab, i)) != 0; i++) {
+    const toml_array_t *a;
+    const toml_table_t *t;
+    const char *s;
+    toml_datum_t d;
+    if ((a = toml_array_in(tab, key)) != 0)
+      n += walk_arr(a, borrow);
+    else if ((t = toml_table_in(tab, key)) != 0)
+      n += walk_tab(t, borrow);
+    else if (borrow && 0 == toml_string_ref_in(tab, key, &s, 0))
+      n++;
+    else if (!borrow && (d = toml_string_in(tab, key)).ok)
+      n++, count_free(d.u.s);
+    else if ((d = toml_int_in(tab, key)).ok ||
+             (d = toml_double_in(tab, key)).ok ||
+             (d = toml_bool_in(tab, key)).ok)
+      n++;
+    else if ((d = toml_timestamp_in(tab, key)).ok)
+      n++, count_free(d.u.ts);
+  }
+  return n;
+}
+
+/* the accessor runs read trees parsed beforehand, outside the timing */
+static toml_table_t **trees;
+
+static void run_accessors(corpus_t *c) {
+  for (int i = 0; i < c->ndoc; i++)
+    walk_tab(trees[i], 0);
+}
+
+static void run_accessors_ref(corpus_t *c) {
+  for (int i = 0; i < c->ndoc; i++)
+    walk_tab(trees[i], 1);
+}
+
+typedef struct {
+  const char *name;
+  void (*run)(corpus_t *c);
+} api_t;
+
+static const api_t apis[] = {
+    {"toml_parse", run_parse},
+    {"toml_parse_file", run_parse_file},
+    {"toml_parse_arena", run_parse_arena},
+    {"toml_parse_n", run_parse_n},
+    {"toml_parse_events", run_events},
+    {"accessors", run_accessors},
+    {"accessors_ref", run_accessors_ref},
+};
+#define NAPI ((int)(sizeof(apis) / sizeof(apis[0])))
+
+/*-----------------------------------------------------------------
+ * measuring
+ */
+typedef struct {
+  double bytes;
+  double mb_per_s;
+  double allocs; /* per run over the corpus */
+  double peak_heap_kb;
+  long peak_rss_kb; /* -1 if not measured */
+  int iterations;
+} result_t;
+
+static void write_temp_files(corpus_t *c) {
+  for (int i = 0; i < c->ndoc; i++) {
+#ifdef _WIN32
+    snprintf(c->doc[i].path, sizeof(c->doc[i].path), "bench_toml_%lu_%d.toml",
+             (unsigned long)GetCurrentProcessId(), i);
+#else
+    snprintf(c->doc[i].path, sizeof(c->doc[i].path),
+             "/tmp/bench_toml_%ld_%d.toml", (long)getpid(), i);
+#endif
+    FILE *fp = fopen(c->doc[i].path, "wb");
+    if (!fp || fwrite(c->doc[i].text, 1, c->doc[i].len, fp) != c->doc[i].len)
+      die("cannot write a temporary file");
+    fclose(fp);
+  }
+}
+
+static result_t measure(int g, int api, int scale, const char *stdex,
+                        double min_time) {
+  corpus_t c;
+  result_t r;
+  char errbuf[200];
+
+  memset(&r, 0, sizeof(r));
+  r.peak_rss_kb = -1;
+  make_corpus(&c, g, scale, stdex);
+  r.bytes = (double)c.bytes;
+  if (c.ndoc == 0) {
+    free_corpus(&c);
+    return r;
+  }
+  if (apis[api].run == run_parse_file)
+    write_temp_files(&c);
+  if (apis[api].run == run_accessors || apis[api].run == run_accessors_ref) {
+    trees = malloc(sizeof(*trees) * c.ndoc);
+    if (!trees)
+      die("out of memory");
+    for (int i = 0; i < c.ndoc; i++) {
+      if (!(trees[i] = toml_parse(c.doc[i].text, errbuf, sizeof(errbuf))))
+        parse_failed("toml_parse", errbuf);
+    }
+  }
+
+  /* one counted run, then timed ones */
+  count_reset();
+  apis[api].run(&c);
+  r.allocs = (double)nalloc;
+  r.peak_heap_kb = (double)(peak - live) / 1024;
+
+  double best = 1e30, total = 0;
+  while (r.iterations < 3 || total < min_time) {
+    double t0 = now();
+    apis[api].run(&c);
+    double t = now() - t0;
+    total += t;
+    if (t < best)
+      best = t;
+    r.iterations++;
+  }
+  r.mb_per_s = best > 0 ? r.bytes / best / 1e6 : 0;
+
+  if (trees) {
+    for (int i = 0; i < c.ndoc; i++)
+      toml_free(trees[i]);
+    free(trees);
+    trees = 0;
+  }
+  free_corpus(&c);
+  return r;
+}
+
+#ifndef _WIN32
+/* measure() in a child, which reports back through a pipe */
+static result_t measure_isolated(int g, int api, int scale, const char *stdex,
+                                 double min_time) {
+  result_t r;
+  int fd[2];
+  memset(&r, 0, sizeof(r));
+  if (pipe(fd))
+    die("pipe failed");
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0)
+    die("fork failed");
+  if (pid == 0) {
+    close(fd[0]);
+    r = measure(g, api, scale, stdex, min_time);
+    if (write(fd[1], &r, sizeof(r)) != (ssize_t)sizeof(r))
+      _exit(1);
+    _exit(0);
+  }
+  close(fd[1]);
+  ssize_t n = read(fd[0], &r, sizeof(r));
+  close(fd[0]);
+  int status;
+  struct rusage ru;
+  if (wait4(pid, &status, 0, &ru) < 0 || n != (ssize_t)sizeof(r) ||
+      !WIFEXITED(status) || WEXITSTATUS(status))
+    die("a measurement failed");
+#ifdef __APPLE__
+  r.peak_rss_kb = ru.ru_maxrss / 1024; /* bytes on macOS */
+#else
+  r.peak_rss_kb = ru.ru_maxrss;
+#endif
+  return r;
+}
+#endif
+
+static void usage(void) {
+  fprintf(stderr, "usage: bench_toml [--json] [--scale N] [--time SECONDS] "
+                  "[--corpus NAME] [--stdex DIR]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int json = 0;
+  int scale = 1;
+  double min_time = 0.5;
+  const char *only = 0;
+  const char *stdex = BENCH_TOML_STDEX;
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp(argv[i], "--json"))
+      json = 1;
+    else if (0 == strcmp(argv[i], "--scale") && i + 1 < argc)
+      scale = atoi(argv[++i]);
+    else if (0 == strcmp(argv[i], "--time") && i + 1 < argc)
+      min_time = atof(argv[++i]);
+    else if (0 == strcmp(argv[i], "--corpus") && i + 1 < argc)
+      only = argv[++i];
+    else if (0 == strcmp(argv[i], "--stdex") && i + 1 < argc)
+      stdex = argv[++i];
+    else
+      usage();
+  }
+  if (scale < 1)
+    usage();
+
+  toml_set_memutil(count_malloc, count_free);
+
+  if (!json)
+    printf("%-10s %-18s %9s %10s %12s %14s %12s\n", "corpus", "api", "KB",
+           "MB/s", "allocs/run", "peak heap KB", "peak RSS KB");
+
+  for (int g = 0; g < NGEN; g++) {
+    if (only && strcmp(only, generators[g].name))
+      continue;
+    for (int api = 0; api < NAPI; api++) {
+#ifdef _WIN32
+      result_t r = measure(g, api, scale, stdex, min_time);
+#else
+      result_t r = measure_isolated(g, api, scale, stdex, min_time);
+#endif
+      if (r.bytes == 0) {
+        fprintf(stderr, "bench_toml: %s: no documents\n", generators[g].name);
+        break;
+      }
+      if (json)
+        printf("{\"corpus\":\"%s\",\"api\":\"%s\",\"scale\":%d,\"bytes\":%.0f,"
+               "\"iterations\":%d,\"mb_per_s\":%.2f,\"allocs_per_run\":%.0f,"
+               "\"peak_heap_kb\":%.1f,\"peak_rss_kb\":%ld}\n",
+               generators[g].name, apis[api].name, scale, r.bytes,
+               r.iterations, r.mb_per_s, r.allocs, r.peak_heap_kb,
+               r.peak_rss_kb);
+      else
+        printf("%-10s %-18s %9.0f %10.1f %12.0f %14.1f %12ld\n",
+               generators[g].name, apis[api].name, r.bytes / 1024,
+               r.mb_per_s, r.allocs, r.peak_heap_kb, r.peak_rss_kb);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
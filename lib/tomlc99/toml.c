@@ -29,11 +29,38 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOML_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define TOML_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define TOML_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 static void *(*ppmalloc)(size_t) = malloc;
 static void (*ppfree)(void *) = free;
@@ -46,8 +73,80 @@ void toml_set_memutil(void *(*xxmalloc)(size_t), void (*xxfree)(void *)) {
 }
 
 #define ALIGN8(sz) (((sz) + 7) & ~7)
-#define MALLOC(a) ppmalloc(a)
-#define FREE(a) ppfree(a)
+
+/*
+ * Arena mode (toml_parse_arena). While an arena parse runs, every
+ * allocation is carved from a list of chunks obtained through ppmalloc,
+ * FREE does nothing, and toml_free later releases the chunks in one go
+ * instead of walking the tree.
+ */
+#if defined(_MSC_VER)
+#define TOML_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define TOML_THREAD_LOCAL __thread
+#else
+#define TOML_THREAD_LOCAL
+#endif
+
+typedef struct toml_chunk_t toml_chunk_t;
+struct toml_chunk_t {
+  toml_chunk_t *prev; /* previously filled chunk */
+  size_t size;        /* bytes in data[] */
+  size_t used;
+  size_t last; /* offset of the most recent allocation */
+  char data[];
+};
+
+/* newest chunk of the arena parse running on this thread, if any */
+static TOML_THREAD_LOCAL toml_chunk_t *arena_chunk = 0;
+
+static toml_chunk_t *arena_new_chunk(toml_chunk_t *prev, size_t size) {
+  toml_chunk_t *c = ppmalloc(sizeof(toml_chunk_t) + size);
+  if (c) {
+    c->prev = prev;
+    c->size = size;
+    c->used = 0;
+    c->last = 0;
+  }
+  return c;
+}
+
+static void arena_release(toml_chunk_t *c) {
+  while (c) {
+    toml_chunk_t *prev = c->prev;
+    ppfree(c);
+    c = prev;
+  }
+}
+
+static void *arena_alloc(size_t sz) {
+  toml_chunk_t *c = arena_chunk;
+  sz = ALIGN8(sz);
+  if (c->size - c->used < sz) {
+    size_t size = c->size * 2;
+    if (size < sz)
+      size = sz;
+    if (!(c = arena_new_chunk(arena_chunk, size)))
+      return 0;
+    arena_chunk = c;
+  }
+  c->last = c->used;
+  c->used += sz;
+  return c->data + c->last;
+}
+
+/* Grow p in place if it is the latest allocation and the chunk has room */
+static int arena_grow(void *p, size_t newsz) {
+  toml_chunk_t *c = arena_chunk;
+  newsz = ALIGN8(newsz);
+  if ((char *)p != c->data + c->last || c->size - c->last < newsz)
+    return 0;
+  c->used = c->last + newsz;
+  return 1;
+}
+
+#define MALLOC(a) (arena_chunk ? arena_alloc(a) : ppmalloc(a))
+#define FREE(a) (arena_chunk ? (void)0 : ppfree(a))
 
 #define malloc(x) error - forbidden - use MALLOC instead
 #define free(x) error - forbidden - use FREE instead
@@ -282,7 +381,11 @@ int toml_ucs_to_utf8(int64_t code, char buf[6]) {
 typedef struct toml_keyval_t toml_keyval_t;
 struct toml_keyval_t {
   const char *key; /* key to this value */
-  const char *val; /* the raw value */
+  const char *val; /* the raw value; 0 if parsed by toml_parse_n */
+  const char *raw; /* the raw value as a view: val, or the source text */
+  int rawlen;
+  char *str; /* a string value, unescaped at parse time; 0 if not one */
+  int slen;
 };
 
 typedef struct toml_arritem_t toml_arritem_t;
@@ -290,6 +393,10 @@ struct toml_arritem_t {
   int valtype; /* for value kind: 'i'nt, 'd'ouble, 'b'ool, 's'tring, 't'ime,
                   'D'ate, 'T'imestamp */
   char *val;
+  const char *raw; /* as for toml_keyval_t */
+  int rawlen;
+  char *str;
+  int slen;
   toml_array_t *arr;
   toml_table_t *tab;
 };
@@ -320,6 +427,18 @@ struct toml_table_t {
   /* tables in the table */
   int ntab;
   toml_table_t **tab;
+
+  /* root of an arena parse: the chunks holding the whole tree */
+  toml_chunk_t *arena;
+
+  /* root of toml_parse_mapped: the file mapping the values point into */
+  void *map;
+  size_t maplen;
+
+  /* hash index over all the keys above, once there are TOML_INDEX_MIN of
+     them. Each slot holds a key reference (see keyref) or 0 if empty. */
+  int nslot;
+  int *slot;
 };
 
 static inline void xfree(const void *x) {
@@ -354,6 +473,12 @@ typedef struct context_t context_t;
 struct context_t {
   char *start;
   char *stop;
+  int views; /* leave values in the text instead of copying them */
+
+  /* toml_parse_events: the callback, and whether it asked to stop */
+  toml_event_cb event;
+  void *event_ud;
+  int stopped;
   char *errbuf;
   int errbufsz;
 
@@ -373,6 +498,7 @@ struct context_t {
 #define FLINE __FILE__ ":" TOSTRING(__LINE__)
 
 static int next_token(context_t *ctx, int dotisspecial);
+static int rtos_n(const char *src, int srclen, char **ret, int *retlen);
 
 /*
   Error reporting. Call when an error is detected. Always return -1.
@@ -408,6 +534,9 @@ static int e_forbid(context_t *ctx, int lineno, const char *msg) {
 }
 
 static void *expand(void *p, int sz, int newsz) {
+  if (p && arena_chunk && arena_grow(p, newsz))
+    return p;
+
   void *s = MALLOC(newsz);
   if (!s)
     return 0;
@@ -419,8 +548,22 @@ static void *expand(void *p, int sz, int newsz) {
   return s;
 }
 
+/* Room for n elements of a pointer array or array item list that only
+ * ever grows by one: capacity doubles, so appending is amortised O(1). */
+static int grow_capacity(int n) {
+  if (n & (n - 1))
+    return 0; /* n is not a power of two: there is room left */
+  return n ? 2 * n : 1;
+}
+
 static void **expand_ptrarr(void **p, int n) {
-  void **s = MALLOC((n + 1) * sizeof(void *));
+  int cap = grow_capacity(n);
+  if (p && !cap) {
+    p[n] = 0;
+    return p;
+  }
+
+  void **s = MALLOC(cap * sizeof(void *));
   if (!s)
     return 0;
 
@@ -433,16 +576,20 @@ static void **expand_ptrarr(void **p, int n) {
 }
 
 static toml_arritem_t *expand_arritem(toml_arritem_t *p, int n) {
-  toml_arritem_t *pp = expand(p, n * sizeof(*p), (n + 1) * sizeof(*p));
-  if (!pp)
-    return 0;
+  int cap = grow_capacity(n);
+  toml_arritem_t *pp = p;
+  if (!p || cap) {
+    pp = expand(p, n * sizeof(*p), cap * sizeof(*p));
+    if (!pp)
+      return 0;
+  }
 
   memset(&pp[n], 0, sizeof(pp[n]));
   return pp;
 }
 
 static char *norm_lit_str(const char *src, int srclen, int multiline,
-                          char *errbuf, int errbufsz) {
+                          int *dstlen, char *errbuf, int errbufsz) {
   char *dst = 0; /* will write to dst[] and return it */
   int max = 0;   /* max size of dst[] */
   int off = 0;   /* cur offset in dst[] */
@@ -453,7 +600,8 @@ static char *norm_lit_str(const char *src, int srclen, int multiline,
   /* scan forward on src */
   for (;;) {
     if (off >= max - 10) { /* have some slack for misc stuff */
-      int newmax = max + 50;
+      /* dst is never longer than src: one allocation is enough */
+      int newmax = max ? max * 2 : srclen + 11;
       char *x = expand(dst, max, newmax);
       if (!x) {
         xfree(dst);
@@ -482,6 +630,8 @@ static char *norm_lit_str(const char *src, int srclen, int multiline,
     dst[off++] = ch;
   }
 
+  if (dstlen)
+    *dstlen = off;
   dst[off++] = 0;
   return dst;
 }
@@ -491,7 +641,7 @@ static char *norm_lit_str(const char *src, int srclen, int multiline,
  * Returns NULL if error with errmsg in errbuf.
  */
 static char *norm_basic_str(const char *src, int srclen, int multiline,
-                            char *errbuf, int errbufsz) {
+                            int *dstlen, char *errbuf, int errbufsz) {
   char *dst = 0; /* will write to dst[] and return it */
   int max = 0;   /* max size of dst[] */
   int off = 0;   /* cur offset in dst[] */
@@ -502,7 +652,8 @@ static char *norm_basic_str(const char *src, int srclen, int multiline,
   /* scan forward on src */
   for (;;) {
     if (off >= max - 10) { /* have some slack for misc stuff */
-      int newmax = max + 50;
+      /* dst is never longer than src: one allocation is enough */
+      int newmax = max ? max * 2 : srclen + 11;
       char *x = expand(dst, max, newmax);
       if (!x) {
         xfree(dst);
@@ -618,6 +769,8 @@ static char *norm_basic_str(const char *src, int srclen, int multiline,
   }
 
   // Cap with NUL and return it.
+  if (dstlen)
+    *dstlen = off;
   dst[off++] = 0;
   return dst;
 }
@@ -633,13 +786,18 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
 
   /* handle quoted string */
   if (ch == '\'' || ch == '\"') {
-    /* if ''' or """, take 3 chars off front and back. Else, take 1 char off. */
+    /* if ''' or """, take 3 chars off front and back. Else, take 1 char off.
+     * The token may end where the text does, so look no further than it. */
     int multiline = 0;
-    if (sp[1] == ch && sp[2] == ch) {
+    if (strtok.len >= 6 && sp[1] == ch && sp[2] == ch) {
       sp += 3, sq -= 3;
       multiline = 1;
-    } else
+    } else if (strtok.len >= 2)
       sp++, sq--;
+    else {
+      e_badkey(ctx, lineno);
+      return 0;
+    }
 
     if (ch == '\'') {
       /* for single quote, take it verbatim. */
@@ -649,7 +807,7 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
       }
     } else {
       /* for double quote, we need to normalize */
-      ret = norm_basic_str(sp, sq - sp, multiline, ebuf, sizeof(ebuf));
+      ret = norm_basic_str(sp, sq - sp, multiline, 0, ebuf, sizeof(ebuf));
       if (!ret) {
         e_syntax(ctx, lineno, ebuf);
         return 0;
@@ -685,6 +843,119 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
   return ret;
 }
 
+/*
+ * Tables with fewer keys are searched linearly, which beats hashing for
+ * the handful of keys most tables have.
+ */
+#define TOML_INDEX_MIN 16
+
+/* A key reference packs the kind of an element (1 = value, 2 = array,
+ * 3 = table) with its position in kval[], arr[] or tab[]. */
+static int keyref(int kind, int idx) { return (idx << 2) | kind; }
+
+static const char *keyref_key(const toml_table_t *tab, int ref) {
+  int idx = ref >> 2;
+  switch (ref & 3) {
+  case 1:
+    return tab->kval[idx]->key;
+  case 2:
+    return tab->arr[idx]->key;
+  default:
+    return tab->tab[idx]->key;
+  }
+}
+
+static uint32_t key_hash(const char *key) {
+  uint32_t h = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+    h ^= *p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void index_insert(int *slot, int nslot, uint32_t hash, int ref) {
+  uint32_t mask = (uint32_t)nslot - 1;
+  uint32_t i = hash & mask;
+  while (slot[i])
+    i = (i + 1) & mask;
+  slot[i] = ref;
+}
+
+/* (Re)build the index of tab with nslot slots. If memory runs out the
+ * index is dropped and lookups fall back to linear search. */
+static void index_build(toml_table_t *tab, int nslot) {
+  int *slot = (int *)CALLOC(nslot, sizeof(int));
+  xfree(tab->slot);
+  tab->slot = slot;
+  tab->nslot = slot ? nslot : 0;
+  if (!slot)
+    return;
+
+  for (int i = 0; i < tab->nkval; i++)
+    index_insert(slot, nslot, key_hash(tab->kval[i]->key), keyref(1, i));
+  for (int i = 0; i < tab->narr; i++)
+    index_insert(slot, nslot, key_hash(tab->arr[i]->key), keyref(2, i));
+  for (int i = 0; i < tab->ntab; i++)
+    index_insert(slot, nslot, key_hash(tab->tab[i]->key), keyref(3, i));
+}
+
+/* Record a key just appended to tab, keeping the index at most half full.
+ * kind and idx locate it as in keyref(). */
+static void index_add(toml_table_t *tab, int kind, int idx) {
+  int nkey = tab->nkval + tab->narr + tab->ntab;
+  if (nkey < TOML_INDEX_MIN)
+    return;
+
+  if (nkey * 2 > tab->nslot) {
+    int nslot = tab->nslot ? tab->nslot : 2 * TOML_INDEX_MIN;
+    while (nkey * 2 > nslot)
+      nslot *= 2;
+    index_build(tab, nslot);
+    return;
+  }
+
+  const char *key = keyref_key(tab, keyref(kind, idx));
+  index_insert(tab->slot, tab->nslot, key_hash(key), keyref(kind, idx));
+}
+
+/* Find key in tab. Return 0 if not found, or 1 (value), 2 (array) or
+ * 3 (table) with its position in *idx. */
+static int find_key(const toml_table_t *tab, const char *key, int *idx) {
+  if (tab->nslot) {
+    uint32_t mask = (uint32_t)tab->nslot - 1;
+    for (uint32_t i = key_hash(key) & mask; tab->slot[i]; i = (i + 1) & mask) {
+      int ref = tab->slot[i];
+      if (0 == strcmp(key, keyref_key(tab, ref))) {
+        *idx = ref >> 2;
+        return ref & 3;
+      }
+    }
+    return 0;
+  }
+
+  int i;
+  for (i = 0; i < tab->nkval; i++) {
+    if (0 == strcmp(key, tab->kval[i]->key)) {
+      *idx = i;
+      return 1;
+    }
+  }
+  for (i = 0; i < tab->narr; i++) {
+    if (0 == strcmp(key, tab->arr[i]->key)) {
+      *idx = i;
+      return 2;
+    }
+  }
+  for (i = 0; i < tab->ntab; i++) {
+    if (0 == strcmp(key, tab->tab[i]->key)) {
+      *idx = i;
+      return 3;
+    }
+  }
+  return 0;
+}
+
 /*
  * Look up key in tab. Return 0 if not found, or
  * 'v'alue, 'a'rray or 't'able depending on the element.
@@ -692,8 +963,8 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
 static int check_key(toml_table_t *tab, const char *key,
                      toml_keyval_t **ret_val, toml_array_t **ret_arr,
                      toml_table_t **ret_tab) {
-  int i;
   void *dummy;
+  int idx;
 
   if (!ret_tab)
     ret_tab = (toml_table_t **)&dummy;
@@ -706,23 +977,16 @@ static int check_key(toml_table_t *tab, const char *key,
   *ret_arr = 0;
   *ret_val = 0;
 
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key)) {
-      *ret_val = tab->kval[i];
-      return 'v';
-    }
-  }
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key)) {
-      *ret_arr = tab->arr[i];
-      return 'a';
-    }
-  }
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key)) {
-      *ret_tab = tab->tab[i];
-      return 't';
-    }
+  switch (find_key(tab, key, &idx)) {
+  case 1:
+    *ret_val = tab->kval[idx];
+    return 'v';
+  case 2:
+    *ret_arr = tab->arr[idx];
+    return 'a';
+  case 3:
+    *ret_tab = tab->tab[idx];
+    return 't';
   }
   return 0;
 }
@@ -769,6 +1033,7 @@ static toml_keyval_t *create_keyval_in_table(context_t *ctx, toml_table_t *tab,
 
   /* save the key in the new value struct */
   dest->key = newkey;
+  index_add(tab, 1, tab->nkval - 1);
   return dest;
 }
 
@@ -817,6 +1082,7 @@ static toml_table_t *create_keytable_in_table(context_t *ctx, toml_table_t *tab,
 
   /* save the key in the new table struct */
   dest->key = newkey;
+  index_add(tab, 3, tab->ntab - 1);
   return dest;
 }
 
@@ -858,6 +1124,7 @@ static toml_array_t *create_keyarray_in_table(context_t *ctx, toml_table_t *tab,
   /* save the key in the new array struct */
   dest->key = newkey;
   dest->kind = kind;
+  index_add(tab, 2, tab->narr - 1);
   return dest;
 }
 
@@ -982,10 +1249,35 @@ static int parse_inline_table(context_t *ctx, toml_table_t *tab) {
   return 0;
 }
 
-static int valtype(const char *val) {
+/* Copy a raw value into buf as a C string for the toml_rto* converters.
+ * A value that does not fit is no bool, number or timestamp, and is
+ * passed on as "" so that they reject it too. */
+static const char *raw_cstr(const char *raw, int len, char *buf, int bufsz) {
+  if (!raw)
+    return 0;
+  if (len >= bufsz)
+    len = 0;
+  memcpy(buf, raw, len);
+  buf[len] = 0;
+  return buf;
+}
+
+/* Unescape a string value once, for toml_string_ref_in() and _at(). A
+ * string that does not unescape is left for the accessors to fail on. */
+static void unescape_value(const char *raw, int rawlen, char **str,
+                           int *slen) {
+  if (*raw == '\'' || *raw == '"') {
+    if (rtos_n(raw, rawlen, str, slen))
+      *str = 0;
+  }
+}
+
+static int valtype(const char *raw, int len) {
   toml_timestamp_t ts;
-  if (*val == '\'' || *val == '"')
+  char buf[128];
+  if (*raw == '\'' || *raw == '"')
     return 's';
+  const char *val = raw_cstr(raw, len, buf, sizeof(buf));
   if (0 == toml_rtob(val, 0))
     return 'b';
   if (0 == toml_rtoi(val, 0))
@@ -1031,10 +1323,19 @@ static int parse_array(context_t *ctx, toml_array_t *arr) {
       if (!newval)
         return e_outofmemory(ctx, FLINE);
 
-      if (!(newval->val = STRNDUP(val, vlen)))
-        return e_outofmemory(ctx, FLINE);
+      if (ctx->views) {
+        newval->raw = val;
+      } else {
+        if (!(newval->val = STRNDUP(val, vlen)))
+          return e_outofmemory(ctx, FLINE);
+        newval->raw = newval->val;
+      }
+      newval->rawlen = vlen;
 
-      newval->valtype = valtype(newval->val);
+      newval->valtype = valtype(newval->raw, newval->rawlen);
+      if (newval->valtype == 's')
+        unescape_value(newval->raw, newval->rawlen, &newval->str,
+                       &newval->slen);
 
       /* set array type if this is the first entry */
       if (arr->nitem == 1)
@@ -1155,8 +1456,15 @@ static int parse_keyval(context_t *ctx, toml_table_t *tab) {
     token_t val = ctx->tok;
 
     assert(keyval->val == 0);
-    if (!(keyval->val = STRNDUP(val.ptr, val.len)))
-      return e_outofmemory(ctx, FLINE);
+    if (ctx->views) {
+      keyval->raw = val.ptr;
+    } else {
+      if (!(keyval->val = STRNDUP(val.ptr, val.len)))
+        return e_outofmemory(ctx, FLINE);
+      keyval->raw = keyval->val;
+    }
+    keyval->rawlen = val.len;
+    unescape_value(keyval->raw, keyval->rawlen, &keyval->str, &keyval->slen);
 
     if (next_token(ctx, 1))
       return -1;
@@ -1292,6 +1600,7 @@ static int walk_tabpath(context_t *ctx) {
         return e_outofmemory(ctx, FLINE);
 
       nexttab = curtab->tab[curtab->ntab++];
+      index_add(curtab, 3, curtab->ntab - 1);
 
       /* tabs created by walk_tabpath are considered implicit */
       nexttab->implicit = true;
@@ -1399,7 +1708,10 @@ static int parse_select(context_t *ctx) {
   return 0;
 }
 
-toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
+/* Parse the len bytes at conf. With views set the values are not copied
+ * out of conf, which must then outlive the returned table. */
+static toml_table_t *parse_text(char *conf, size_t len, int views,
+                                char *errbuf, int errbufsz) {
   context_t ctx;
 
   // clear errbuf
@@ -1411,7 +1723,8 @@ toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
   // init context
   memset(&ctx, 0, sizeof(ctx));
   ctx.start = conf;
-  ctx.stop = ctx.start + strlen(conf);
+  ctx.stop = ctx.start + len;
+  ctx.views = views;
   ctx.errbuf = errbuf;
   ctx.errbufsz = errbufsz;
 
@@ -1477,7 +1790,12 @@ fail:
   return 0;
 }
 
-toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
+toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
+  return parse_text(conf, strlen(conf), 0, errbuf, errbufsz);
+}
+
+/* Read all of fp into a NUL-terminated buffer, which the caller FREEs */
+static char *read_file(FILE *fp, char *errbuf, int errbufsz) {
   int bufsz = 0;
   char *buf = 0;
   int off = 0;
@@ -1486,7 +1804,7 @@ toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
   while (!feof(fp)) {
 
     if (off == bufsz) {
-      int xsz = bufsz + 1000;
+      int xsz = bufsz ? bufsz * 2 : 4096;
       char *x = expand(buf, bufsz, xsz);
       if (!x) {
         snprintf(errbuf, errbufsz, "out of memory");
@@ -1521,6 +1839,13 @@ toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
     bufsz = xsz;
   }
   buf[off] = 0;
+  return buf;
+}
+
+toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
+  char *buf = read_file(fp, errbuf, errbufsz);
+  if (!buf)
+    return 0;
 
   /* parse it, cleanup and finish */
   toml_table_t *ret = toml_parse(buf, errbuf, errbufsz);
@@ -1528,145 +1853,806 @@ toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
   return ret;
 }
 
-static void xfree_kval(toml_keyval_t *p) {
-  if (!p)
-    return;
-  xfree(p->key);
-  xfree(p->val);
-  xfree(p);
-}
-
-static void xfree_tab(toml_table_t *p);
+static toml_table_t *parse_in_arena(char *conf, size_t len, int views,
+                                    char *errbuf, int errbufsz) {
+  /* A parsed tree takes up to about four times the size of its text; the
+   * first chunk is sized for that so most configs need no second one. */
+  toml_chunk_t *first = arena_new_chunk(0, len * 4 + 4096);
+  if (!first) {
+    if (errbufsz > 0)
+      snprintf(errbuf, errbufsz, "out of memory");
+    return 0;
+  }
 
-static void xfree_arr(toml_array_t *p) {
-  if (!p)
-    return;
+  arena_chunk = first;
+  toml_table_t *ret = parse_text(conf, len, views, errbuf, errbufsz);
+  toml_chunk_t *last = arena_chunk;
+  arena_chunk = 0;
 
-  xfree(p->key);
-  const int n = p->nitem;
-  for (int i = 0; i < n; i++) {
-    toml_arritem_t *a = &p->item[i];
-    if (a->val)
-      xfree(a->val);
-    else if (a->arr)
-      xfree_arr(a->arr);
-    else if (a->tab)
-      xfree_tab(a->tab);
+  if (!ret) {
+    arena_release(last);
+    return 0;
   }
-  xfree(p->item);
-  xfree(p);
+  ret->arena = last;
+  return ret;
 }
 
-static void xfree_tab(toml_table_t *p) {
-  int i;
-
-  if (!p)
-    return;
-
-  xfree(p->key);
-
-  for (i = 0; i < p->nkval; i++)
-    xfree_kval(p->kval[i]);
-  xfree(p->kval);
-
-  for (i = 0; i < p->narr; i++)
-    xfree_arr(p->arr[i]);
-  xfree(p->arr);
+toml_table_t *toml_parse_arena(char *conf, char *errbuf, int errbufsz) {
+  return parse_in_arena(conf, strlen(conf), 0, errbuf, errbufsz);
+}
 
-  for (i = 0; i < p->ntab; i++)
-    xfree_tab(p->tab[i]);
-  xfree(p->tab);
+toml_table_t *toml_parse_file_arena(FILE *fp, char *errbuf, int errbufsz) {
+  char *buf = read_file(fp, errbuf, errbufsz);
+  if (!buf)
+    return 0;
 
-  xfree(p);
+  toml_table_t *ret = toml_parse_arena(buf, errbuf, errbufsz);
+  xfree(buf);
+  return ret;
 }
 
-void toml_free(toml_table_t *tab) { xfree_tab(tab); }
+/* Check text to be parsed in place: token lengths are ints, and the
+ * scanner takes a NUL for the end */
+static int check_text(const char *conf, size_t len, char *errbuf,
+                      int errbufsz) {
+  if (errbufsz > 0)
+    errbuf[0] = 0;
 
-static void set_token(context_t *ctx, tokentype_t tok, int lineno, char *ptr,
-                      int len) {
-  token_t t;
-  t.tok = tok;
-  t.lineno = lineno;
-  t.ptr = ptr;
-  t.len = len;
-  t.eof = 0;
-  ctx->tok = t;
+  if (len > INT_MAX || memchr(conf, 0, len)) {
+    if (errbufsz > 0)
+      snprintf(errbuf, errbufsz, "%s",
+               len > INT_MAX ? "input too large" : "NUL character in input");
+    return -1;
+  }
+  return 0;
 }
 
-static void set_eof(context_t *ctx, int lineno) {
-  set_token(ctx, NEWLINE, lineno, ctx->stop, 0);
-  ctx->tok.eof = 1;
-}
+toml_table_t *toml_parse_n(const char *conf, size_t len, char *errbuf,
+                           int errbufsz) {
+  if (check_text(conf, len, errbuf, errbufsz))
+    return 0;
 
-/* Scan p for n digits compositing entirely of [0-9] */
-static int scan_digits(const char *p, int n) {
-  int ret = 0;
-  for (; n > 0 && isdigit(*p); n--, p++) {
-    ret = 10 * ret + (*p - '0');
-  }
-  return n ? -1 : ret;
+  /* the parser only reads conf */
+  return parse_in_arena((char *)conf, len, 1, errbuf, errbufsz);
 }
 
-static int scan_date(const char *p, int *YY, int *MM, int *DD) {
-  int year, month, day;
-  year = scan_digits(p, 4);
-  month = (year >= 0 && p[4] == '-') ? scan_digits(p + 5, 2) : -1;
-  day = (month >= 0 && p[7] == '-') ? scan_digits(p + 8, 2) : -1;
-  if (YY)
-    *YY = year;
-  if (MM)
-    *MM = month;
-  if (DD)
-    *DD = day;
-  return (year >= 0 && month >= 0 && day >= 0) ? 0 : -1;
+/* Map path read-only. An empty file gives *map == 0 and *len == 0. */
+static int map_file(const char *path, void **map, size_t *len, char *errbuf,
+                    int errbufsz) {
+  *map = 0;
+  *len = 0;
+#ifdef _WIN32
+  HANDLE fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (fh == INVALID_HANDLE_VALUE) {
+    snprintf(errbuf, errbufsz, "cannot open %s", path);
+    return -1;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(fh, &size) || size.QuadPart > INT_MAX) {
+    snprintf(errbuf, errbufsz, "cannot map %s", path);
+    CloseHandle(fh);
+    return -1;
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(fh);
+    return 0;
+  }
+  HANDLE mh = CreateFileMappingA(fh, 0, PAGE_READONLY, 0, 0, 0);
+  CloseHandle(fh);
+  if (mh)
+    *map = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+  if (mh)
+    CloseHandle(mh);
+  if (!*map) {
+    snprintf(errbuf, errbufsz, "cannot map %s", path);
+    return -1;
+  }
+  *len = (size_t)size.QuadPart;
+  return 0;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    snprintf(errbuf, errbufsz, "%s: %s", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  errno = 0;
+  if (fstat(fd, &st) || st.st_size > INT_MAX) {
+    snprintf(errbuf, errbufsz, "%s: %s", path,
+             errno ? strerror(errno) : "file too large");
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    snprintf(errbuf, errbufsz, "%s: %s", path, strerror(errno));
+    return -1;
+  }
+  posix_madvise(p, st.st_size, POSIX_MADV_SEQUENTIAL);
+  *map = p;
+  *len = st.st_size;
+  return 0;
+#endif
 }
 
-static int scan_time(const char *p, int *hh, int *mm, int *ss) {
-  int hour, minute, second;
-  hour = scan_digits(p, 2);
-  minute = (hour >= 0 && p[2] == ':') ? scan_digits(p + 3, 2) : -1;
-  second = (minute >= 0 && p[5] == ':') ? scan_digits(p + 6, 2) : -1;
-  if (hh)
-    *hh = hour;
-  if (mm)
-    *mm = minute;
-  if (ss)
-    *ss = second;
-  return (hour >= 0 && minute >= 0 && second >= 0) ? 0 : -1;
+static void unmap_file(void *map, size_t len) {
+#ifdef _WIN32
+  (void)len;
+  UnmapViewOfFile(map);
+#else
+  munmap(map, len);
+#endif
 }
 
-static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
-  char *orig = p;
-  if (0 == strncmp(p, "'''", 3)) {
-    char *q = p + 3;
+toml_table_t *toml_parse_mapped(const char *path, char *errbuf,
+                                int errbufsz) {
+  void *map;
+  size_t len;
 
-    while (1) {
-      q = strstr(q, "'''");
-      if (0 == q) {
-        return e_syntax(ctx, lineno, "unterminated triple-s-quote");
-      }
-      while (q[3] == '\'')
-        q++;
-      break;
-    }
+  if (errbufsz <= 0)
+    errbufsz = 0;
+  if (map_file(path, &map, &len, errbuf, errbufsz))
+    return 0;
 
-    set_token(ctx, STRING, lineno, orig, q + 3 - orig);
+  toml_table_t *ret = toml_parse_n(map ? map : "", len, errbuf, errbufsz);
+  if (!ret) {
+    if (map)
+      unmap_file(map, len);
     return 0;
   }
+  ret->map = map;
+  ret->maplen = len;
+  return ret;
+}
 
-  if (0 == strncmp(p, "\"\"\"", 3)) {
-    char *q = p + 3;
+/*
+ * Streaming events (toml_parse_events). The same scanner drives a parser
+ * that builds no tree: each table header, key, value and bracket is handed
+ * to the callback as it is read. Only the key path being read is held, so
+ * memory does not grow with the text.
+ */
 
-    while (1) {
-      q = strstr(q, "\"\"\"");
-      if (0 == q) {
-        return e_syntax(ctx, lineno, "unterminated triple-d-quote");
-      }
-      if (q[-1] == '\\') {
+/* Hand an event to the callback. A nonzero return stops the parse, and
+ * unwinds it like an error. */
+static int emit(context_t *ctx, toml_event_type_t type, int lineno,
+                const char *const *key, int nkey) {
+  toml_event_t ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = type;
+  ev.lineno = lineno;
+  ev.key = key;
+  ev.nkey = nkey;
+  if (type == TOML_VALUE) {
+    ev.raw.ptr = ctx->tok.ptr;
+    ev.raw.len = ctx->tok.len;
+  }
+  if (ctx->event(&ev, ctx->event_ud)) {
+    ctx->stopped = 1;
+    return -1;
+  }
+  return 0;
+}
+
+static int event_keyval(context_t *ctx);
+
+/* We are at '{ ... }' */
+static int event_inline_table(context_t *ctx) {
+  if (emit(ctx, TOML_INLINE_TABLE_BEGIN, ctx->tok.lineno, 0, 0))
+    return -1;
+  if (eat_token(ctx, LBRACE, 1, FLINE))
+    return -1;
+
+  for (;;) {
+    if (ctx->tok.tok == NEWLINE)
+      return e_syntax(ctx, ctx->tok.lineno,
+                      "newline not allowed in inline table");
+
+    /* until } */
+    if (ctx->tok.tok == RBRACE)
+      break;
+
+    if (ctx->tok.tok != STRING)
+      return e_syntax(ctx, ctx->tok.lineno, "expect a string");
+
+    if (event_keyval(ctx))
+      return -1;
+
+    if (ctx->tok.tok == NEWLINE)
+      return e_syntax(ctx, ctx->tok.lineno,
+                      "newline not allowed in inline table");
+
+    /* on comma, continue to scan for next keyval */
+    if (ctx->tok.tok == COMMA) {
+      if (eat_token(ctx, COMMA, 1, FLINE))
+        return -1;
+      continue;
+    }
+    break;
+  }
+
+  if (emit(ctx, TOML_INLINE_TABLE_END, ctx->tok.lineno, 0, 0))
+    return -1;
+  return eat_token(ctx, RBRACE, 1, FLINE);
+}
+
+/* We are at '[...]' */
+static int event_array(context_t *ctx) {
+  if (emit(ctx, TOML_ARRAY_BEGIN, ctx->tok.lineno, 0, 0))
+    return -1;
+  if (eat_token(ctx, LBRACKET, 0, FLINE))
+    return -1;
+
+  for (;;) {
+    if (skip_newlines(ctx, 0))
+      return -1;
+
+    /* until ] */
+    if (ctx->tok.tok == RBRACKET)
+      break;
+
+    switch (ctx->tok.tok) {
+    case STRING:
+      if (emit(ctx, TOML_VALUE, ctx->tok.lineno, 0, 0))
+        return -1;
+      if (eat_token(ctx, STRING, 0, FLINE))
+        return -1;
+      break;
+
+    case LBRACKET:
+      if (event_array(ctx))
+        return -1;
+      break;
+
+    case LBRACE:
+      if (event_inline_table(ctx))
+        return -1;
+      break;
+
+    default:
+      return e_syntax(ctx, ctx->tok.lineno, "syntax error");
+    }
+
+    if (skip_newlines(ctx, 0))
+      return -1;
+
+    /* on comma, continue to scan for next element */
+    if (ctx->tok.tok == COMMA) {
+      if (eat_token(ctx, COMMA, 0, FLINE))
+        return -1;
+      continue;
+    }
+    break;
+  }
+
+  if (ctx->tok.tok != RBRACKET)
+    return e_syntax(ctx, ctx->tok.lineno, "expects ]");
+  if (emit(ctx, TOML_ARRAY_END, ctx->tok.lineno, 0, 0))
+    return -1;
+  return eat_token(ctx, RBRACKET, 1, FLINE);
+}
+
+/* key.path = value */
+static int event_keyval(context_t *ctx) {
+  char *key[10];
+  int nkey = 0;
+  int lineno = ctx->tok.lineno;
+  int ret = -1;
+
+  for (;;) {
+    if (nkey >= 10) {
+      e_syntax(ctx, lineno, "key path is too deep; max allowed is 10.");
+      goto done;
+    }
+    if (ctx->tok.tok != STRING) {
+      e_syntax(ctx, lineno, "invalid key");
+      goto done;
+    }
+    if (!(key[nkey] = normalize_key(ctx, ctx->tok)))
+      goto done;
+    nkey++;
+
+    if (next_token(ctx, 1))
+      goto done;
+    if (ctx->tok.tok != DOT)
+      break;
+    if (next_token(ctx, 1))
+      goto done;
+  }
+
+  if (ctx->tok.tok != EQUAL) {
+    e_syntax(ctx, ctx->tok.lineno, "missing =");
+    goto done;
+  }
+  if (emit(ctx, TOML_KEY, lineno, (const char *const *)key, nkey))
+    goto done;
+  if (next_token(ctx, 0))
+    goto done;
+
+  switch (ctx->tok.tok) {
+  case STRING:
+    if (emit(ctx, TOML_VALUE, ctx->tok.lineno, 0, 0))
+      goto done;
+    ret = next_token(ctx, 1);
+    break;
+
+  case LBRACKET:
+    ret = event_array(ctx);
+    break;
+
+  case LBRACE:
+    ret = event_inline_table(ctx);
+    break;
+
+  default:
+    e_syntax(ctx, ctx->tok.lineno, "syntax error");
+  }
+
+done:
+  for (int i = 0; i < nkey; i++)
+    xfree(key[i]);
+  return ret;
+}
+
+/* [x.y.z] or [[x.y.z]] */
+static int event_select(context_t *ctx) {
+  int lineno = ctx->tok.lineno;
+
+  /* true if [[; see parse_select */
+  int llb = (ctx->tok.ptr + 1 < ctx->stop && ctx->tok.ptr[1] == '[');
+
+  if (eat_token(ctx, LBRACKET, 1, FLINE))
+    return -1;
+  if (llb) {
+    assert(ctx->tok.tok == LBRACKET);
+    if (eat_token(ctx, LBRACKET, 1, FLINE))
+      return -1;
+  }
+
+  if (fill_tabpath(ctx))
+    return -1;
+
+  if (ctx->tok.tok != RBRACKET)
+    return e_syntax(ctx, ctx->tok.lineno, "expects ]");
+  if (llb) {
+    if (!(ctx->tok.ptr + 1 < ctx->stop && ctx->tok.ptr[1] == ']'))
+      return e_syntax(ctx, ctx->tok.lineno, "expects ]]");
+    if (eat_token(ctx, RBRACKET, 1, FLINE))
+      return -1;
+  }
+  if (eat_token(ctx, RBRACKET, 1, FLINE))
+    return -1;
+
+  if (ctx->tok.tok != NEWLINE)
+    return e_syntax(ctx, ctx->tok.lineno, "extra chars after ] or ]]");
+
+  return emit(ctx, llb ? TOML_ARRAY_TABLE : TOML_TABLE, lineno,
+              (const char *const *)ctx->tpath.key, ctx->tpath.top);
+}
+
+int toml_parse_events(const char *conf, size_t len, toml_event_cb cb,
+                      void *ud, char *errbuf, int errbufsz) {
+  context_t ctx;
+  int ret = -1;
+
+  if (errbufsz <= 0)
+    errbufsz = 0;
+  if (check_text(conf, len, errbuf, errbufsz))
+    return -1;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.start = (char *)conf; /* only read */
+  ctx.stop = ctx.start + len;
+  ctx.views = 1;
+  ctx.errbuf = errbuf;
+  ctx.errbufsz = errbufsz;
+  ctx.event = cb;
+  ctx.event_ud = ud;
+
+  // start with an artificial newline of length 0
+  ctx.tok.tok = NEWLINE;
+  ctx.tok.lineno = 1;
+  ctx.tok.ptr = ctx.start;
+  ctx.tok.len = 0;
+
+  for (token_t tok = ctx.tok; !tok.eof; tok = ctx.tok) {
+    switch (tok.tok) {
+
+    case NEWLINE:
+      if (next_token(&ctx, 1))
+        goto done;
+      break;
+
+    case STRING:
+      if (event_keyval(&ctx))
+        goto done;
+
+      if (ctx.tok.tok != NEWLINE) {
+        e_syntax(&ctx, ctx.tok.lineno, "extra chars after value");
+        goto done;
+      }
+
+      if (eat_token(&ctx, NEWLINE, 1, FLINE))
+        goto done;
+      break;
+
+    case LBRACKET:
+      if (event_select(&ctx))
+        goto done;
+      break;
+
+    default:
+      e_syntax(&ctx, tok.lineno, "syntax error");
+      goto done;
+    }
+  }
+  ret = 0;
+
+done:
+  for (int i = 0; i < ctx.tpath.top; i++)
+    xfree(ctx.tpath.key[i]);
+  if (ctx.stopped) {
+    if (errbufsz > 0)
+      errbuf[0] = 0;
+    return 1;
+  }
+  return ret;
+}
+
+int toml_parse_events_mapped(const char *path, toml_event_cb cb, void *ud,
+                             char *errbuf, int errbufsz) {
+  void *map;
+  size_t len;
+
+  if (errbufsz <= 0)
+    errbufsz = 0;
+  if (map_file(path, &map, &len, errbuf, errbufsz))
+    return -1;
+
+  int ret = toml_parse_events(map ? map : "", len, cb, ud, errbuf, errbufsz);
+  if (map)
+    unmap_file(map, len);
+  return ret;
+}
+
+static void xfree_kval(toml_keyval_t *p) {
+  if (!p)
+    return;
+  xfree(p->key);
+  xfree(p->val);
+  xfree(p->str);
+  xfree(p);
+}
+
+static void xfree_tab(toml_table_t *p);
+
+static void xfree_arr(toml_array_t *p) {
+  if (!p)
+    return;
+
+  xfree(p->key);
+  const int n = p->nitem;
+  for (int i = 0; i < n; i++) {
+    toml_arritem_t *a = &p->item[i];
+    if (a->val || a->str) {
+      xfree(a->val);
+      xfree(a->str);
+    } else if (a->arr)
+      xfree_arr(a->arr);
+    else if (a->tab)
+      xfree_tab(a->tab);
+  }
+  xfree(p->item);
+  xfree(p);
+}
+
+static void xfree_tab(toml_table_t *p) {
+  int i;
+
+  if (!p)
+    return;
+
+  xfree(p->key);
+
+  for (i = 0; i < p->nkval; i++)
+    xfree_kval(p->kval[i]);
+  xfree(p->kval);
+
+  for (i = 0; i < p->narr; i++)
+    xfree_arr(p->arr[i]);
+  xfree(p->arr);
+
+  for (i = 0; i < p->ntab; i++)
+    xfree_tab(p->tab[i]);
+  xfree(p->tab);
+
+  xfree(p->slot);
+  xfree(p);
+}
+
+void toml_free(toml_table_t *tab) {
+  if (tab && tab->arena) {
+    /* the root itself lives in the arena */
+    void *map = tab->map;
+    size_t maplen = tab->maplen;
+    arena_release(tab->arena);
+    if (map)
+      unmap_file(map, maplen);
+    return;
+  }
+  xfree_tab(tab);
+}
+
+static void set_token(context_t *ctx, tokentype_t tok, int lineno, char *ptr,
+                      int len) {
+  token_t t;
+  t.tok = tok;
+  t.lineno = lineno;
+  t.ptr = ptr;
+  t.len = len;
+  t.eof = 0;
+  ctx->tok = t;
+}
+
+static void set_eof(context_t *ctx, int lineno) {
+  set_token(ctx, NEWLINE, lineno, ctx->stop, 0);
+  ctx->tok.eof = 1;
+}
+
+/* Scan p for n digits compositing entirely of [0-9] */
+static int scan_digits(const char *p, int n) {
+  int ret = 0;
+  for (; n > 0 && isdigit(*p); n--, p++) {
+    ret = 10 * ret + (*p - '0');
+  }
+  return n ? -1 : ret;
+}
+
+static int scan_date(const char *p, int *YY, int *MM, int *DD) {
+  int year, month, day;
+  year = scan_digits(p, 4);
+  month = (year >= 0 && p[4] == '-') ? scan_digits(p + 5, 2) : -1;
+  day = (month >= 0 && p[7] == '-') ? scan_digits(p + 8, 2) : -1;
+  if (YY)
+    *YY = year;
+  if (MM)
+    *MM = month;
+  if (DD)
+    *DD = day;
+  return (year >= 0 && month >= 0 && day >= 0) ? 0 : -1;
+}
+
+static int scan_time(const char *p, int *hh, int *mm, int *ss) {
+  int hour, minute, second;
+  hour = scan_digits(p, 2);
+  minute = (hour >= 0 && p[2] == ':') ? scan_digits(p + 3, 2) : -1;
+  second = (minute >= 0 && p[5] == ':') ? scan_digits(p + 6, 2) : -1;
+  if (hh)
+    *hh = hour;
+  if (mm)
+    *mm = minute;
+  if (ss)
+    *ss = second;
+  return (hour >= 0 && minute >= 0 && second >= 0) ? 0 : -1;
+}
+
+/*
+ * Byte search for the scanner: find the first byte in [p, end) that is
+ * one of the four in set, or is not ASCII. SSE2 or AVX2 is picked at run
+ * time on x86, NEON is used on arm64, and anything else gets the scalar
+ * loop.
+ */
+typedef const char *(*find_byte_fn)(const char *p, const char *end,
+                                    const char *set);
+
+static inline int lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+static const char *find_byte_scalar(const char *p, const char *end,
+                                    const char *set) {
+  for (; p < end; p++) {
+    int ch = *p;
+    if (ch == set[0] || ch == set[1] || ch == set[2] || ch == set[3] ||
+        (ch & 0x80))
+      break;
+  }
+  return p;
+}
+
+#ifdef TOML_HAVE_SSE2
+static const char *find_byte_sse2(const char *p, const char *end,
+                                  const char *set) {
+  const __m128i a = _mm_set1_epi8(set[0]);
+  const __m128i b = _mm_set1_epi8(set[1]);
+  const __m128i c = _mm_set1_epi8(set[2]);
+  const __m128i d = _mm_set1_epi8(set[3]);
+
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i ab = _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b));
+    __m128i cd = _mm_or_si128(_mm_cmpeq_epi8(v, c), _mm_cmpeq_epi8(v, d));
+    __m128i m = _mm_or_si128(ab, cd);
+    /* the high bit of v itself flags the non-ASCII bytes */
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(m, v));
+    if (mask)
+      return p + lowest_bit(mask);
+  }
+  return find_byte_scalar(p, end, set);
+}
+#endif
+
+#ifdef TOML_HAVE_AVX2
+__attribute__((target("avx2"))) static const char *
+find_byte_avx2(const char *p, const char *end, const char *set) {
+  const __m256i a = _mm256_set1_epi8(set[0]);
+  const __m256i b = _mm256_set1_epi8(set[1]);
+  const __m256i c = _mm256_set1_epi8(set[2]);
+  const __m256i d = _mm256_set1_epi8(set[3]);
+
+  for (; end - p >= 32; p += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i ab =
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, b));
+    __m256i cd =
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, c), _mm256_cmpeq_epi8(v, d));
+    __m256i m = _mm256_or_si256(ab, cd);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(m, v));
+    if (mask)
+      return p + lowest_bit(mask);
+  }
+  return find_byte_scalar(p, end, set);
+}
+#endif
+
+#ifdef TOML_HAVE_NEON
+static const char *find_byte_neon(const char *p, const char *end,
+                                  const char *set) {
+  const uint8x16_t a = vdupq_n_u8((uint8_t)set[0]);
+  const uint8x16_t b = vdupq_n_u8((uint8_t)set[1]);
+  const uint8x16_t c = vdupq_n_u8((uint8_t)set[2]);
+  const uint8x16_t d = vdupq_n_u8((uint8_t)set[3]);
+  const uint8x16_t high = vdupq_n_u8(0x80);
+
+  for (; end - p >= 16; p += 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)p);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, a), vceqq_u8(v, b)),
+                            vorrq_u8(vceqq_u8(v, c), vceqq_u8(v, d)));
+    if (vmaxvq_u8(vorrq_u8(m, vandq_u8(v, high))))
+      return find_byte_scalar(p, p + 16, set);
+  }
+  return find_byte_scalar(p, end, set);
+}
+#endif
+
+static const char *find_byte_init(const char *p, const char *end,
+                                  const char *set);
+
+/* Set on first use. Racing threads store the same pointer. */
+static find_byte_fn find_byte = find_byte_init;
+
+static const char *find_byte_init(const char *p, const char *end,
+                                  const char *set) {
+  find_byte_fn fn = find_byte_scalar;
+#if defined(TOML_HAVE_SSE2)
+  fn = find_byte_sse2;
+#endif
+#if defined(TOML_HAVE_AVX2)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    fn = find_byte_avx2;
+#endif
+#if defined(TOML_HAVE_NEON)
+  fn = find_byte_neon;
+#endif
+  find_byte = fn;
+  return fn(p, end, set);
+}
+
+/* Length of the UTF-8 sequence at p, or 0 if it is not valid: truncated,
+ * overlong, a surrogate or above U+10FFFF. */
+static int utf8_len(const char *p, const char *end) {
+  const unsigned char *s = (const unsigned char *)p;
+  long avail = end - p;
+  int n;
+  uint32_t min;
+  uint32_t v;
+
+  if (s[0] < 0x80)
+    return 1;
+  if ((s[0] & 0xE0) == 0xC0)
+    n = 2, min = 0x80, v = s[0] & 0x1F;
+  else if ((s[0] & 0xF0) == 0xE0)
+    n = 3, min = 0x800, v = s[0] & 0x0F;
+  else if ((s[0] & 0xF8) == 0xF0)
+    n = 4, min = 0x10000, v = s[0] & 0x07;
+  else
+    return 0;
+
+  if (avail < n)
+    return 0;
+  for (int i = 1; i < n; i++) {
+    if ((s[i] & 0xC0) != 0x80)
+      return 0;
+    v = (v << 6) | (s[i] & 0x3F);
+  }
+  if (v < min || v > 0x10FFFF || (0xD800 <= v && v <= 0xDFFF))
+    return 0;
+  return n;
+}
+
+/* Return the first byte of [p, end) that is not valid UTF-8, or 0 */
+static const char *utf8_invalid(const char *p, const char *end) {
+  /* ASCII runs are skipped in bulk; "\x7f" only pads the set */
+  while ((p = find_byte(p, end, "\x7f\x7f\x7f\x7f")) < end) {
+    int n = (*p & 0x80) ? utf8_len(p, end) : 1;
+    if (!n)
+      return p;
+    p += n;
+  }
+  return 0;
+}
+
+/* Find three qchar in a row in [p, end) */
+static char *find_triple(char *p, char *end, int qchar) {
+  for (; end - p >= 3; p++) {
+    if (!(p = memchr(p, qchar, end - p - 2)))
+      return 0;
+    if (p[1] == qchar && p[2] == qchar)
+      return p;
+  }
+  return 0;
+}
+
+/* The text is not NUL-terminated in a view parse: every look ahead is
+ * bounded by ctx->stop. */
+static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
+  char *orig = p;
+  char *end = ctx->stop;
+  if (end - p >= 3 && 0 == strncmp(p, "'''", 3)) {
+    char *q = p + 3;
+
+    while (1) {
+      q = find_triple(q, end, '\'');
+      if (0 == q) {
+        return e_syntax(ctx, lineno, "unterminated triple-s-quote");
+      }
+      while (q + 3 < end && q[3] == '\'')
+        q++;
+      break;
+    }
+
+    if (utf8_invalid(p + 3, q))
+      return e_syntax(ctx, lineno, "invalid UTF-8 in string");
+
+    set_token(ctx, STRING, lineno, orig, q + 3 - orig);
+    return 0;
+  }
+
+  if (end - p >= 3 && 0 == strncmp(p, "\"\"\"", 3)) {
+    char *q = p + 3;
+
+    while (1) {
+      q = find_triple(q, end, '"');
+      if (0 == q) {
+        return e_syntax(ctx, lineno, "unterminated triple-d-quote");
+      }
+      if (q[-1] == '\\') {
         q++;
         continue;
       }
-      while (q[3] == '\"')
+      while (q + 3 < end && q[3] == '\"')
         q++;
       break;
     }
@@ -1676,6 +2662,18 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
     int hexreq = 0; /* #hex required */
     int escape = 0;
     for (p += 3; p < q; p++) {
+      if (!escape && !hexreq) {
+        /* nothing to check up to the next backslash */
+        if ((p = (char *)find_byte(p, q, "\\\\\\\\")) == q)
+          break;
+        if (*p & 0x80) {
+          int n = utf8_len(p, q);
+          if (!n)
+            return e_syntax(ctx, lineno, "invalid UTF-8 in string");
+          p += n - 1;
+          continue;
+        }
+      }
       if (escape) {
         escape = 0;
         if (strchr("btnfr\"\\", *p))
@@ -1713,9 +2711,13 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
   }
 
   if ('\'' == *p) {
-    for (p++; *p && *p != '\n' && *p != '\''; p++)
-      ;
-    if (*p != '\'') {
+    for (p++; (p = (char *)find_byte(p, end, "'\n'\n")) < end && (*p & 0x80);) {
+      int n = utf8_len(p, end);
+      if (!n)
+        return e_syntax(ctx, lineno, "invalid UTF-8 in string");
+      p += n;
+    }
+    if (p == end || *p != '\'') {
       return e_syntax(ctx, lineno, "unterminated s-quote");
     }
 
@@ -1726,7 +2728,20 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
   if ('\"' == *p) {
     int hexreq = 0; /* #hex required */
     int escape = 0;
-    for (p++; *p; p++) {
+    for (p++; p < end; p++) {
+      if (!escape && !hexreq) {
+        /* skip to the next byte that ends, escapes or may break the
+         * string */
+        if ((p = (char *)find_byte(p, end, "\"\\\n'")) == end)
+          break;
+        if (*p & 0x80) {
+          int n = utf8_len(p, end);
+          if (!n)
+            return e_syntax(ctx, lineno, "invalid UTF-8 in string");
+          p += n - 1;
+          continue;
+        }
+      }
       if (escape) {
         escape = 0;
         if (strchr("btnfr\"\\", *p))
@@ -1752,7 +2767,7 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
         continue;
       }
       if (*p == '\'') {
-        if (p[1] == '\'' && p[2] == '\'') {
+        if (end - p >= 3 && p[1] == '\'' && p[2] == '\'') {
           return e_syntax(ctx, lineno, "triple-s-quote inside string lit");
         }
         continue;
@@ -1762,7 +2777,7 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
       if (*p == '"')
         break;
     }
-    if (*p != '"') {
+    if (p == end || *p != '"') {
       return e_syntax(ctx, lineno, "unterminated quote");
     }
 
@@ -1770,10 +2785,19 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
     return 0;
   }
 
-  /* check for timestamp without quotes */
-  if (0 == scan_date(p, 0, 0, 0) || 0 == scan_time(p, 0, 0, 0)) {
+  /* check for timestamp without quotes. scan_date and scan_time look up to
+   * 10 chars ahead, so near the end they get a NUL-terminated copy. */
+  const char *ts = p;
+  char head[11];
+  if (end - p < 10) {
+    memcpy(head, p, end - p);
+    head[end - p] = 0;
+    ts = head;
+  }
+  if (0 == scan_date(ts, 0, 0, 0) || 0 == scan_time(ts, 0, 0, 0)) {
     // forward thru the timestamp
-    p += strspn(p, "0123456789.:+-Tt Zz");
+    while (p < end && *p && strchr("0123456789.:+-Tt Zz", *p))
+      p++;
     // squeeze out any spaces at end of string
     for (; p[-1] == ' '; p--)
       ;
@@ -1783,7 +2807,7 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
   }
 
   /* literals */
-  for (; *p && *p != '\n'; p++) {
+  for (; p < end && *p && *p != '\n'; p++) {
     int ch = *p;
     if (ch == '.' && dotisspecial)
       break;
@@ -1803,20 +2827,21 @@ static int scan_string(context_t *ctx, char *p, int lineno, int dotisspecial) {
 static int next_token(context_t *ctx, int dotisspecial) {
   int lineno = ctx->tok.lineno;
   char *p = ctx->tok.ptr;
-  int i;
 
   /* eat this tok */
-  for (i = 0; i < ctx->tok.len; i++) {
-    if (*p++ == '\n')
-      lineno++;
+  char *tokend = p + ctx->tok.len;
+  while ((p = memchr(p, '\n', tokend - p)) != 0) {
+    lineno++;
+    p++;
   }
+  p = tokend;
 
   /* make next tok */
   while (p < ctx->stop) {
     /* skip comment. stop just before the \n. */
     if (*p == '#') {
-      for (p++; p < ctx->stop && *p != '\n'; p++)
-        ;
+      char *nl = memchr(p, '\n', ctx->stop - p);
+      p = nl ? nl : ctx->stop;
       continue;
     }
 
@@ -1878,53 +2903,48 @@ const char *toml_key_in(const toml_table_t *tab, int keyidx) {
 }
 
 int toml_key_exists(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key))
-      return 1;
-  }
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key))
-      return 1;
-  }
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key))
-      return 1;
-  }
-  return 0;
+  int idx;
+  return find_key(tab, key, &idx) != 0;
 }
 
 toml_raw_t toml_raw_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key))
-      return tab->kval[i]->val;
+  int idx;
+  return find_key(tab, key, &idx) == 1 ? tab->kval[idx]->val : 0;
+}
+
+toml_rawview_t toml_raw_view_in(const toml_table_t *tab, const char *key) {
+  toml_rawview_t ret = {0, 0};
+  int idx;
+  if (find_key(tab, key, &idx) == 1) {
+    ret.ptr = tab->kval[idx]->raw;
+    ret.len = tab->kval[idx]->rawlen;
   }
-  return 0;
+  return ret;
 }
 
 toml_array_t *toml_array_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key))
-      return tab->arr[i];
-  }
-  return 0;
+  int idx;
+  return find_key(tab, key, &idx) == 2 ? tab->arr[idx] : 0;
 }
 
 toml_table_t *toml_table_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key))
-      return tab->tab[i];
-  }
-  return 0;
+  int idx;
+  return find_key(tab, key, &idx) == 3 ? tab->tab[idx] : 0;
 }
 
 toml_raw_t toml_raw_at(const toml_array_t *arr, int idx) {
   return (0 <= idx && idx < arr->nitem) ? arr->item[idx].val : 0;
 }
 
+toml_rawview_t toml_raw_view_at(const toml_array_t *arr, int idx) {
+  toml_rawview_t ret = {0, 0};
+  if (0 <= idx && idx < arr->nitem) {
+    ret.ptr = arr->item[idx].raw;
+    ret.len = arr->item[idx].rawlen;
+  }
+  return ret;
+}
+
 char toml_array_kind(const toml_array_t *arr) { return arr->kind; }
 
 char toml_array_type(const toml_array_t *arr) {
@@ -2208,23 +3228,31 @@ int toml_rtod(toml_raw_t src, double *ret_) {
 }
 
 int toml_rtos(toml_raw_t src, char **ret) {
+  *ret = 0;
+  if (!src)
+    return -1;
+  return rtos_n(src, strlen(src), ret, 0);
+}
+
+/* toml_rtos over the srclen bytes at src. The length of the result goes
+ * to *retlen if retlen is not 0. */
+static int rtos_n(const char *src, int srclen, char **ret, int *retlen) {
   int multiline = 0;
   const char *sp;
   const char *sq;
 
   *ret = 0;
-  if (!src)
+  if (!src || srclen < 1)
     return -1;
 
   // for strings, first char must be a s-quote or d-quote
   int qchar = src[0];
-  int srclen = strlen(src);
   if (!(qchar == '\'' || qchar == '"')) {
     return -1;
   }
 
   // triple quotes?
-  if (qchar == src[1] && qchar == src[2]) {
+  if (srclen >= 3 && qchar == src[1] && qchar == src[2]) {
     multiline = 1;         // triple-quote implies multiline
     sp = src + 3;          // first char after quote
     sq = src + srclen - 3; // first char of ending quote
@@ -2254,47 +3282,54 @@ int toml_rtos(toml_raw_t src, char **ret) {
   //     sq points to one char beyond last valid char.
   //     string len is (sq - sp).
   if (qchar == '\'') {
-    *ret = norm_lit_str(sp, sq - sp, multiline, 0, 0);
+    *ret = norm_lit_str(sp, sq - sp, multiline, retlen, 0, 0);
   } else {
-    *ret = norm_basic_str(sp, sq - sp, multiline, 0, 0);
+    *ret = norm_basic_str(sp, sq - sp, multiline, retlen, 0, 0);
   }
 
   return *ret ? 0 : -1;
 }
 
-toml_datum_t toml_string_at(const toml_array_t *arr, int idx) {
+toml_datum_t toml_string_view(toml_rawview_t raw) {
   toml_datum_t ret;
   memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtos(toml_raw_at(arr, idx), &ret.u.s));
+  ret.ok = (0 == rtos_n(raw.ptr, raw.len, &ret.u.s, 0));
   return ret;
 }
 
-toml_datum_t toml_bool_at(const toml_array_t *arr, int idx) {
+toml_datum_t toml_bool_view(toml_rawview_t raw) {
   toml_datum_t ret;
+  char buf[128];
   memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtob(toml_raw_at(arr, idx), &ret.u.b));
+  ret.ok = (0 == toml_rtob(raw_cstr(raw.ptr, raw.len, buf, sizeof(buf)),
+                           &ret.u.b));
   return ret;
 }
 
-toml_datum_t toml_int_at(const toml_array_t *arr, int idx) {
+toml_datum_t toml_int_view(toml_rawview_t raw) {
   toml_datum_t ret;
+  char buf[128];
   memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtoi(toml_raw_at(arr, idx), &ret.u.i));
+  ret.ok = (0 == toml_rtoi(raw_cstr(raw.ptr, raw.len, buf, sizeof(buf)),
+                           &ret.u.i));
   return ret;
 }
 
-toml_datum_t toml_double_at(const toml_array_t *arr, int idx) {
+toml_datum_t toml_double_view(toml_rawview_t raw) {
   toml_datum_t ret;
+  char buf[128];
   memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtod(toml_raw_at(arr, idx), &ret.u.d));
+  ret.ok = (0 == toml_rtod(raw_cstr(raw.ptr, raw.len, buf, sizeof(buf)),
+                           &ret.u.d));
   return ret;
 }
 
-toml_datum_t toml_timestamp_at(const toml_array_t *arr, int idx) {
+toml_datum_t toml_timestamp_view(toml_rawview_t raw) {
   toml_timestamp_t ts;
   toml_datum_t ret;
+  char buf[128];
   memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtots(toml_raw_at(arr, idx), &ts));
+  ret.ok = (0 == toml_rtots(raw_cstr(raw.ptr, raw.len, buf, sizeof(buf)), &ts));
   if (ret.ok) {
     ret.ok = !!(ret.u.ts = MALLOC(sizeof(*ret.u.ts)));
     if (ret.ok) {
@@ -2320,65 +3355,85 @@ toml_datum_t toml_timestamp_at(const toml_array_t *arr, int idx) {
   return ret;
 }
 
-toml_datum_t toml_string_in(const toml_table_t *arr, const char *key) {
+int toml_string_ref_at(const toml_array_t *arr, int idx, const char **ret,
+                       int *len) {
+  *ret = 0;
+  if (!(0 <= idx && idx < arr->nitem && arr->item[idx].str))
+    return -1;
+  *ret = arr->item[idx].str;
+  if (len)
+    *len = arr->item[idx].slen;
+  return 0;
+}
+
+int toml_string_ref_in(const toml_table_t *tab, const char *key,
+                       const char **ret, int *len) {
+  int idx;
+  *ret = 0;
+  if (find_key(tab, key, &idx) != 1 || !tab->kval[idx]->str)
+    return -1;
+  *ret = tab->kval[idx]->str;
+  if (len)
+    *len = tab->kval[idx]->slen;
+  return 0;
+}
+
+/* A copy of a borrowed string, for toml_string_in() and _at(). rc is the
+ * result of toml_string_ref_in() or _at(). */
+static toml_datum_t string_copy(int rc, const char *s, int len) {
   toml_datum_t ret;
   memset(&ret, 0, sizeof(ret));
-  toml_raw_t raw = toml_raw_in(arr, key);
-  if (raw) {
-    ret.ok = (0 == toml_rtos(raw, &ret.u.s));
+  if (rc == 0 && (ret.u.s = MALLOC(len + 1))) {
+    memcpy(ret.u.s, s, len + 1);
+    ret.ok = 1;
   }
   return ret;
 }
 
+toml_datum_t toml_string_at(const toml_array_t *arr, int idx) {
+  const char *s;
+  int len = 0;
+  int rc = toml_string_ref_at(arr, idx, &s, &len);
+  return string_copy(rc, s, len);
+}
+
+toml_datum_t toml_bool_at(const toml_array_t *arr, int idx) {
+  return toml_bool_view(toml_raw_view_at(arr, idx));
+}
+
+toml_datum_t toml_int_at(const toml_array_t *arr, int idx) {
+  return toml_int_view(toml_raw_view_at(arr, idx));
+}
+
+toml_datum_t toml_double_at(const toml_array_t *arr, int idx) {
+  return toml_double_view(toml_raw_view_at(arr, idx));
+}
+
+toml_datum_t toml_timestamp_at(const toml_array_t *arr, int idx) {
+  return toml_timestamp_view(toml_raw_view_at(arr, idx));
+}
+
+toml_datum_t toml_string_in(const toml_table_t *arr, const char *key) {
+  const char *s;
+  int len = 0;
+  int rc = toml_string_ref_in(arr, key, &s, &len);
+  return string_copy(rc, s, len);
+}
+
 toml_datum_t toml_bool_in(const toml_table_t *arr, const char *key) {
-  toml_datum_t ret;
-  memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtob(toml_raw_in(arr, key), &ret.u.b));
-  return ret;
+  return toml_bool_view(toml_raw_view_in(arr, key));
 }
 
 toml_datum_t toml_int_in(const toml_table_t *arr, const char *key) {
-  toml_datum_t ret;
-  memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtoi(toml_raw_in(arr, key), &ret.u.i));
-  return ret;
+  return toml_int_view(toml_raw_view_in(arr, key));
 }
 
 toml_datum_t toml_double_in(const toml_table_t *arr, const char *key) {
-  toml_datum_t ret;
-  memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtod(toml_raw_in(arr, key), &ret.u.d));
-  return ret;
+  return toml_double_view(toml_raw_view_in(arr, key));
 }
 
 toml_datum_t toml_timestamp_in(const toml_table_t *arr, const char *key) {
-  toml_timestamp_t ts;
-  toml_datum_t ret;
-  memset(&ret, 0, sizeof(ret));
-  ret.ok = (0 == toml_rtots(toml_raw_in(arr, key), &ts));
-  if (ret.ok) {
-    ret.ok = !!(ret.u.ts = MALLOC(sizeof(*ret.u.ts)));
-    if (ret.ok) {
-      *ret.u.ts = ts;
-      if (ret.u.ts->year)
-        ret.u.ts->year = &ret.u.ts->__buffer.year;
-      if (ret.u.ts->month)
-        ret.u.ts->month = &ret.u.ts->__buffer.month;
-      if (ret.u.ts->day)
-        ret.u.ts->day = &ret.u.ts->__buffer.day;
-      if (ret.u.ts->hour)
-        ret.u.ts->hour = &ret.u.ts->__buffer.hour;
-      if (ret.u.ts->minute)
-        ret.u.ts->minute = &ret.u.ts->__buffer.minute;
-      if (ret.u.ts->second)
-        ret.u.ts->second = &ret.u.ts->__buffer.second;
-      if (ret.u.ts->millisec)
-        ret.u.ts->millisec = &ret.u.ts->__buffer.millisec;
-      if (ret.u.ts->z)
-        ret.u.ts->z = ret.u.ts->__buffer.z;
-    }
-  }
-  return ret;
+  return toml_timestamp_view(toml_raw_view_in(arr, key));
 }
 
 static int parse_millisec(const char *p, const char **endp) {
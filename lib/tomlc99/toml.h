@@ -55,9 +55,36 @@ TOML_EXTERN toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz);
 TOML_EXTERN toml_table_t *toml_parse(char *conf, /* NUL terminated, please. */
                                      char *errbuf, int errbufsz);
 
-/* Free the table returned by toml_parse() or toml_parse_file(). Once
- * this function is called, any handles accessed through this tab
- * directly or indirectly are no longer valid.
+/* Same as toml_parse() and toml_parse_file(), but the whole tree is
+ * allocated from one growable arena obtained in a few large blocks, and
+ * toml_free() releases it in one step. Suits configs that are parsed,
+ * read and discarded. Strings and timestamps returned by the accessors
+ * are still allocated separately and freed by the caller as usual.
+ */
+TOML_EXTERN toml_table_t *toml_parse_arena(char *conf, /* NUL terminated */
+                                           char *errbuf, int errbufsz);
+TOML_EXTERN toml_table_t *toml_parse_file_arena(FILE *fp, char *errbuf,
+                                                int errbufsz);
+
+/* Parse len bytes of text in place, e.g. from a read-only mapping. The
+ * text need not be NUL-terminated and is never written. Values are not
+ * copied out of it, so it must outlive the returned table; the tree is
+ * arena allocated as with toml_parse_arena(). toml_raw_in() and
+ * toml_raw_at() return 0 on such a table: use the typed accessors, or
+ * toml_raw_view_in() and toml_raw_view_at().
+ */
+TOML_EXTERN toml_table_t *toml_parse_n(const char *conf, size_t len,
+                                       char *errbuf, int errbufsz);
+
+/* toml_parse_n() over the file at path, mapped read-only. The mapping
+ * belongs to the returned table and is released by toml_free().
+ */
+TOML_EXTERN toml_table_t *toml_parse_mapped(const char *path, char *errbuf,
+                                            int errbufsz);
+
+/* Free the table returned by toml_parse(), toml_parse_file(), their
+ * arena variants, toml_parse_n() or toml_parse_mapped(). Once this function is called, any handles accessed
+ * through this tab directly or indirectly are no longer valid.
  */
 TOML_EXTERN void toml_free(toml_table_t *tab);
 
@@ -99,6 +126,9 @@ TOML_EXTERN toml_datum_t toml_bool_at(const toml_array_t *arr, int idx);
 TOML_EXTERN toml_datum_t toml_int_at(const toml_array_t *arr, int idx);
 TOML_EXTERN toml_datum_t toml_double_at(const toml_array_t *arr, int idx);
 TOML_EXTERN toml_datum_t toml_timestamp_at(const toml_array_t *arr, int idx);
+/* ... retrieve a string without copying it; see toml_string_ref_in() */
+TOML_EXTERN int toml_string_ref_at(const toml_array_t *arr, int idx,
+                                   const char **ret, int *len);
 /* ... retrieve array or table using index. */
 TOML_EXTERN toml_array_t *toml_array_at(const toml_array_t *arr, int idx);
 TOML_EXTERN toml_table_t *toml_table_at(const toml_array_t *arr, int idx);
@@ -117,6 +147,12 @@ TOML_EXTERN toml_datum_t toml_double_in(const toml_table_t *arr,
                                         const char *key);
 TOML_EXTERN toml_datum_t toml_timestamp_in(const toml_table_t *arr,
                                            const char *key);
+/* ... retrieve a string without copying it: *ret points to the unescaped
+ * string kept by the table, NUL-terminated and valid until toml_free().
+ * *len (if len is not 0) gets its length, which counts any \u0000.
+ * Return 0 on success, -1 if there is no such string. */
+TOML_EXTERN int toml_string_ref_in(const toml_table_t *tab, const char *key,
+                                   const char **ret, int *len);
 /* .. retrieve array or table using key. */
 TOML_EXTERN toml_array_t *toml_array_in(const toml_table_t *tab,
                                         const char *key);
@@ -150,6 +186,74 @@ TOML_EXTERN int toml_table_ntab(const toml_table_t *tab);
 /* Return the key of a table*/
 TOML_EXTERN const char *toml_table_key(const toml_table_t *tab);
 
+/* A raw value as it appears in the text, quotes included: len bytes at
+ * ptr, not NUL-terminated for a table from toml_parse_n(). ptr is 0 if
+ * there is no such value. Valid as long as the table.
+ */
+typedef struct toml_rawview_t toml_rawview_t;
+struct toml_rawview_t {
+  const char *ptr;
+  int len;
+};
+TOML_EXTERN toml_rawview_t toml_raw_view_in(const toml_table_t *tab,
+                                            const char *key);
+TOML_EXTERN toml_rawview_t toml_raw_view_at(const toml_array_t *arr, int idx);
+
+/* Convert a raw view, as the toml_*_in() and toml_*_at() accessors do */
+TOML_EXTERN toml_datum_t toml_string_view(toml_rawview_t raw);
+TOML_EXTERN toml_datum_t toml_bool_view(toml_rawview_t raw);
+TOML_EXTERN toml_datum_t toml_int_view(toml_rawview_t raw);
+TOML_EXTERN toml_datum_t toml_double_view(toml_rawview_t raw);
+TOML_EXTERN toml_datum_t toml_timestamp_view(toml_rawview_t raw);
+
+/*--------------------------------------------------------------
+ * streaming
+ */
+/* Events reported by toml_parse_events(), in document order. A value
+ * follows its TOML_KEY, or sits between TOML_ARRAY_BEGIN and
+ * TOML_ARRAY_END. Keys of a TOML_KEY are relative to the last table
+ * header, or to the enclosing inline table.
+ */
+typedef enum {
+  TOML_TABLE,              /* [a.b] */
+  TOML_ARRAY_TABLE,        /* [[a.b]] */
+  TOML_KEY,                /* a.b = */
+  TOML_VALUE,              /* a scalar */
+  TOML_ARRAY_BEGIN,        /* [ */
+  TOML_ARRAY_END,          /* ] */
+  TOML_INLINE_TABLE_BEGIN, /* { */
+  TOML_INLINE_TABLE_END    /* } */
+} toml_event_type_t;
+
+typedef struct toml_event_t toml_event_t;
+struct toml_event_t {
+  toml_event_type_t type;
+  int lineno;
+  const char *const *key; /* TOML_TABLE, TOML_ARRAY_TABLE, TOML_KEY: */
+  int nkey;               /* the parts of the key, e.g. "a", "b" */
+  toml_rawview_t raw;     /* TOML_VALUE: see the toml_*_view() functions */
+};
+
+/* Return 0 to go on, or nonzero to stop the parse. ev and all it points
+ * to are only valid during the call. */
+typedef int (*toml_event_cb)(const toml_event_t *ev, void *ud);
+
+/* Parse len bytes of text without building a table, calling cb for each
+ * event. Only the syntax is checked: duplicate keys and tables are not
+ * detected. Memory use depends on the nesting depth, not on the size of
+ * the text, and a consumer can stop once it has what it needs.
+ * Return 0 at the end of the text, 1 if cb stopped the parse, or -1 on
+ * error with the reason in errbuf.
+ */
+TOML_EXTERN int toml_parse_events(const char *conf, size_t len,
+                                  toml_event_cb cb, void *ud, char *errbuf,
+                                  int errbufsz);
+
+/* toml_parse_events() over the file at path, mapped read-only */
+TOML_EXTERN int toml_parse_events_mapped(const char *path, toml_event_cb cb,
+                                         void *ud, char *errbuf,
+                                         int errbufsz);
+
 /*--------------------------------------------------------------
  * misc
  */
@@ -0,0 +1,140 @@
+#include "../toml.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Count the allocations made through toml_set_memutil() to check that
+ * arena parses need only a few, and that everything is released. */
+static int nalloc, nfree;
+
+static void *count_malloc(size_t sz) {
+  nalloc++;
+  return malloc(sz);
+}
+
+static void count_free(void *p) {
+  if (p)
+    nfree++;
+  free(p);
+}
+
+static const char *config = "[build]\n"
+                            "entry_file = \"gamemodes/main.pwn\"\n"
+                            "output_file = \"gamemodes/main.amx\"\n"
+                            "compiler_version = \"v3.10.11\"\n"
+                            "\n"
+                            "[build.includes]\n"
+                            "paths = [\"qawno/include\", \"include\"]\n"
+                            "\n"
+                            "[build.args]\n"
+                            "args = [\"-d3\", \"-;+\", \"-(+\", \"-\\\\+\", "
+                            "\"-Z+\", \"-O1\"]\n"
+                            "\n"
+                            "[[build.targets]]\n"
+                            "name = \"gamemode\"\n"
+                            "entry_file = \"gamemodes/main.pwn\"\n"
+                            "\n"
+                            "[[build.targets]]\n"
+                            "entry_file = \"filterscripts/admin.pwn\"\n"
+                            "args = [\"-d0\"]\n";
+
+/* Parse conf and return the allocations the parse needed. The tree is
+ * checked and freed, and must give back every allocation. */
+static int parse_count(const char *conf, int arena) {
+  char errbuf[200];
+  char *copy = strdup(conf);
+  assert(copy);
+
+  nalloc = nfree = 0;
+  toml_table_t *tab = arena ? toml_parse_arena(copy, errbuf, sizeof(errbuf))
+                            : toml_parse(copy, errbuf, sizeof(errbuf));
+  int parse_allocs = nalloc;
+  assert(tab);
+
+  toml_table_t *build = toml_table_in(tab, "build");
+  assert(build);
+  toml_datum_t entry = toml_string_in(build, "entry_file");
+  assert(entry.ok && 0 == strcmp(entry.u.s, "gamemodes/main.pwn"));
+  count_free(entry.u.s);
+
+  toml_array_t *paths = toml_array_in(toml_table_in(build, "includes"), "paths");
+  assert(paths && toml_array_nelem(paths) == 2);
+  toml_array_t *targets = toml_array_in(build, "targets");
+  assert(targets && toml_array_nelem(targets) == 2);
+  toml_datum_t name = toml_string_in(toml_table_at(targets, 0), "name");
+  assert(name.ok && 0 == strcmp(name.u.s, "gamemode"));
+  count_free(name.u.s);
+
+  toml_free(tab);
+  free(copy);
+  assert(nalloc == nfree);
+  return parse_allocs;
+}
+
+int main(void) {
+  toml_set_memutil(count_malloc, count_free);
+
+  int plain = parse_count(config, 0);
+  int arena = parse_count(config, 1);
+  printf("allocations: %d plain, %d arena\n", plain, arena);
+  assert(arena == 1);
+  assert(plain > 20);
+
+  /* a large table outgrows the first chunk, but only a few times */
+  size_t bigsz = 64 * 1024;
+  char *big = malloc(bigsz);
+  assert(big);
+  int off = sprintf(big, "%s", config);
+  for (int i = 0; off < (int)bigsz - 64; i++)
+    off += sprintf(big + off, "[t%d]\nkey_%d = [\"value %d\"]\n", i, i, i);
+  plain = parse_count(big, 0);
+  arena = parse_count(big, 1);
+  printf("large: %d plain, %d arena\n", plain, arena);
+  assert(arena <= 4);
+
+  /* a failed parse releases the arena */
+  char errbuf[200];
+  char bad[] = "a = 1\na = 2\n";
+  nalloc = nfree = 0;
+  assert(!toml_parse_arena(bad, errbuf, sizeof(errbuf)));
+  assert(nalloc == nfree);
+
+  /* files parse the same way */
+  FILE *fp = tmpfile();
+  assert(fp);
+  fputs(config, fp);
+  rewind(fp);
+  nalloc = nfree = 0;
+  toml_table_t *tab = toml_parse_file_arena(fp, errbuf, sizeof(errbuf));
+  fclose(fp);
+  assert(tab && toml_table_in(tab, "build"));
+  printf("file: %d arena\n", nalloc);
+  assert(nalloc <= 3);
+  toml_free(tab);
+  assert(nalloc == nfree);
+
+  /* borrowed strings are read without allocating */
+  char *copy = strdup(config);
+  assert(copy);
+  tab = toml_parse(copy, errbuf, sizeof(errbuf));
+  assert(tab);
+  toml_table_t *build = toml_table_in(tab, "build");
+  toml_array_t *args = toml_array_in(toml_table_in(build, "args"), "args");
+  const char *s;
+  int len;
+  nalloc = 0;
+  assert(0 == toml_string_ref_in(build, "entry_file", &s, &len));
+  assert(0 == strcmp(s, "gamemodes/main.pwn") && len == 18);
+  assert(0 == toml_string_ref_at(args, 3, &s, &len));
+  assert(0 == strcmp(s, "-\\+") && len == 3);
+  assert(-1 == toml_string_ref_in(build, "includes", &s, &len) && !s);
+  assert(-1 == toml_string_ref_at(args, 6, &s, &len) && !s);
+  assert(nalloc == 0);
+  toml_free(tab);
+  free(copy);
+
+  free(big);
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../toml.h"
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check that toml_parse_n() and toml_parse_mapped() give the same tree as
+ * toml_parse(), reading nothing past the end of text that is not
+ * NUL-terminated. Extra TOML files to compare can be given as arguments.
+ * Every prefix of the files in ../stdex is parsed as well, which is
+ * mostly of use under a memory checker. */
+
+static const char *inputs[] = {
+    "[build]\n"
+    "entry_file = \"gamemodes/main.pwn\"\n"
+    "paths = [\"qawno/include\", 'include', \"\"\"multi\nline\"\"\"]\n"
+    "debug = true\n"
+    "level = 3\n"
+    "ratio = 0.5\n"
+    "when = 1979-05-27T07:32:00Z\n"
+    "[[build.targets]]\n"
+    "name = \"gamemode\"\n",
+    /* values that run up to the very end of the text */
+    "a = 1979-05-27",
+    "a = 07:32:00",
+    "a = 'lit'",
+    "a = \"basic\"",
+    "a = '''multi'''''",
+    "a = \"\"\"multi\"\"\"",
+    "a = true",
+    "a = 42",
+    "a = [1, 2]",
+    "",
+};
+
+/* not valid, and must fail at the end of the text rather than past it */
+static const char *errors[] = {
+    "a = 'lit", "a = \"basic", "a = '''multi''", "a = \"\"\"multi\"\"",
+    "a = \"\\",  "a = [1,",    "a =",
+};
+
+static void dump_tab(toml_table_t *tab, FILE *out);
+
+static void dump_value(toml_datum_t d, char kind, FILE *out) {
+  switch (kind) {
+  case 's':
+    fprintf(out, "s:%s\n", d.u.s);
+    free(d.u.s);
+    break;
+  case 'b':
+    fprintf(out, "b:%d\n", d.u.b);
+    break;
+  case 'i':
+    fprintf(out, "i:%lld\n", (long long)d.u.i);
+    break;
+  case 'd':
+    fprintf(out, "d:%g\n", d.u.d);
+    break;
+  case 't':
+    fprintf(out, "t:%d-%d-%d %d:%d:%d\n", d.u.ts->year ? *d.u.ts->year : -1,
+            d.u.ts->month ? *d.u.ts->month : -1,
+            d.u.ts->day ? *d.u.ts->day : -1,
+            d.u.ts->hour ? *d.u.ts->hour : -1,
+            d.u.ts->minute ? *d.u.ts->minute : -1,
+            d.u.ts->second ? *d.u.ts->second : -1);
+    free(d.u.ts);
+    break;
+  }
+}
+
+static void dump_raw(toml_rawview_t raw, FILE *out) {
+  assert(raw.ptr);
+  fprintf(out, "raw:%.*s\n", raw.len, raw.ptr);
+}
+
+static void dump_arr(toml_array_t *arr, FILE *out) {
+  for (int i = 0; i < toml_array_nelem(arr); i++) {
+    toml_datum_t d;
+    if (toml_array_at(arr, i))
+      dump_arr(toml_array_at(arr, i), out);
+    else if (toml_table_at(arr, i))
+      dump_tab(toml_table_at(arr, i), out);
+    else if ((d = toml_string_at(arr, i)).ok)
+      dump_value(d, 's', out);
+    else if ((d = toml_bool_at(arr, i)).ok)
+      dump_value(d, 'b', out);
+    else if ((d = toml_int_at(arr, i)).ok)
+      dump_value(d, 'i', out);
+    else if ((d = toml_double_at(arr, i)).ok)
+      dump_value(d, 'd', out);
+    else if ((d = toml_timestamp_at(arr, i)).ok)
+      dump_value(d, 't', out);
+    else
+      dump_raw(toml_raw_view_at(arr, i), out);
+  }
+}
+
+static void dump_tab(toml_table_t *tab, FILE *out) {
+  const char *key;
+  for (int i = 0; 0 != (key = toml_key_in(tab, i)); i++) {
+    toml_datum_t d;
+    fprintf(out, "%s\n", key);
+    if (toml_array_in(tab, key))
+      dump_arr(toml_array_in(tab, key), out);
+    else if (toml_table_in(tab, key))
+      dump_tab(toml_table_in(tab, key), out);
+    else if ((d = toml_string_in(tab, key)).ok)
+      dump_value(d, 's', out);
+    else if ((d = toml_bool_in(tab, key)).ok)
+      dump_value(d, 'b', out);
+    else if ((d = toml_int_in(tab, key)).ok)
+      dump_value(d, 'i', out);
+    else if ((d = toml_double_in(tab, key)).ok)
+      dump_value(d, 'd', out);
+    else if ((d = toml_timestamp_in(tab, key)).ok)
+      dump_value(d, 't', out);
+    else
+      dump_raw(toml_raw_view_in(tab, key), out);
+  }
+}
+
+/* Dump tab to a string, which the caller frees */
+static char *dump(toml_table_t *tab) {
+  char *buf;
+  size_t len;
+  FILE *out = open_memstream(&buf, &len);
+  assert(out);
+  dump_tab(tab, out);
+  fclose(out);
+  return buf;
+}
+
+/* An exact-size heap copy of text, without a NUL */
+static char *unterminated(const char *text, size_t len) {
+  char *copy = malloc(len ? len : 1);
+  assert(copy);
+  memcpy(copy, text, len);
+  return copy;
+}
+
+static void check(const char *text, size_t len, const char *name) {
+  char errbuf[200];
+  char *copy = malloc(len + 1);
+  assert(copy);
+  memcpy(copy, text, len);
+  copy[len] = 0;
+  toml_table_t *plain = toml_parse(copy, errbuf, sizeof(errbuf));
+  free(copy);
+  if (!plain) {
+    printf("%s: skipped, %s\n", name, errbuf);
+    return;
+  }
+  char *want = dump(plain);
+  toml_free(plain);
+
+  char *text_n = unterminated(text, len);
+  toml_table_t *tab = toml_parse_n(text_n, len, errbuf, sizeof(errbuf));
+  assert(tab);
+  const char *key = toml_key_in(tab, 0);
+  assert(!key || !toml_raw_in(tab, key));
+  char *got = dump(tab);
+  toml_free(tab);
+  free(text_n);
+  if (strcmp(want, got)) {
+    printf("%s: toml_parse_n differs\n--- want\n%s--- got\n%s", name, want,
+           got);
+    exit(1);
+  }
+  free(got);
+
+  char path[] = "/tmp/t3-XXXXXX";
+  FILE *fp = fdopen(mkstemp(path), "w");
+  assert(fp);
+  fwrite(text, 1, len, fp);
+  fclose(fp);
+  tab = toml_parse_mapped(path, errbuf, sizeof(errbuf));
+  remove(path);
+  assert(tab);
+  got = dump(tab);
+  toml_free(tab);
+  if (strcmp(want, got)) {
+    printf("%s: toml_parse_mapped differs\n", name);
+    exit(1);
+  }
+  free(got);
+  free(want);
+}
+
+/* Read a whole file into a heap buffer, which is not NUL-terminated */
+static char *read_file(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  assert(fp);
+  char *buf;
+  FILE *out = open_memstream(&buf, len);
+  int ch;
+  while ((ch = getc(fp)) != EOF)
+    putc(ch, out);
+  fclose(fp);
+  fclose(out);
+  return buf;
+}
+
+/* Parse text cut short at every length, from exact-size copies */
+static void check_prefixes(const char *text, size_t len) {
+  char errbuf[200];
+  for (size_t n = 0; n <= len; n++) {
+    char *copy = unterminated(text, n);
+    toml_table_t *tab = toml_parse_n(copy, n, errbuf, sizeof(errbuf));
+    if (tab)
+      toml_free(tab);
+    free(copy);
+  }
+}
+
+static void check_stdex(const char *dirname) {
+  DIR *dir = opendir(dirname);
+  if (!dir) {
+    printf("%s: skipped\n", dirname);
+    return;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    size_t namelen = strlen(ent->d_name);
+    if (namelen < 5 || strcmp(ent->d_name + namelen - 5, ".toml"))
+      continue;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dirname, ent->d_name);
+    size_t len;
+    char *buf = read_file(path, &len);
+    check_prefixes(buf, len);
+    free(buf);
+  }
+  closedir(dir);
+}
+
+int main(int argc, char **argv) {
+  char errbuf[200];
+
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    check(inputs[i], strlen(inputs[i]), inputs[i]);
+
+  for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+    size_t len = strlen(errors[i]);
+    char *text = unterminated(errors[i], len);
+    assert(!toml_parse_n(text, len, errbuf, sizeof(errbuf)));
+    free(text);
+  }
+
+  /* a NUL cannot hide the rest of the text */
+  assert(!toml_parse_n("a = 1\0b = 2", 11, errbuf, sizeof(errbuf)));
+  assert(!toml_parse_mapped("/nonexistent/t3.toml", errbuf, sizeof(errbuf)));
+
+  /* quoted keys cut short */
+  static const char *keys[] = {"[\"\"", "[[\"\"", "[''", "\"\"", "a.''"};
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    check_prefixes(keys[i], strlen(keys[i]));
+
+  check_stdex("../stdex");
+
+  for (int i = 1; i < argc; i++) {
+    size_t len;
+    char *buf = read_file(argv[i], &len);
+    check(buf, len, argv[i]);
+    free(buf);
+  }
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../toml.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check the events of toml_parse_events(), and stopping early. */
+
+static const char *manifest =
+    "# every release\n"
+    "[compilers.\"v3.10.10\"]\n"
+    "windows = { url = 'https://example.com/3.10.10-win.zip', size = 1 }\n"
+    "linux = { url = \"https://example.com/3.10.10-linux.tar.gz\" }\n"
+    "\n"
+    "[compilers.\"v3.10.11\"]\n"
+    "windows.url = 'https://example.com/3.10.11-win.zip'\n"
+    "linux.url = 'https://example.com/3.10.11-linux.tar.gz'\n"
+    "tags = [\"stable\", [1, 2.5], {lts = true}]\n"
+    "\n"
+    "[[mirrors]]\n"
+    "url = '''https://mirror.example.com'''\n";
+
+static const char *expected =
+    "table compilers.v3.10.10 @2\n"
+    "key windows @3\n"
+    "{\n"
+    "key url @3\n"
+    "value 'https://example.com/3.10.10-win.zip'\n"
+    "key size @3\n"
+    "value 1\n"
+    "}\n"
+    "key linux @4\n"
+    "{\n"
+    "key url @4\n"
+    "value \"https://example.com/3.10.10-linux.tar.gz\"\n"
+    "}\n"
+    "table compilers.v3.10.11 @6\n"
+    "key windows.url @7\n"
+    "value 'https://example.com/3.10.11-win.zip'\n"
+    "key linux.url @8\n"
+    "value 'https://example.com/3.10.11-linux.tar.gz'\n"
+    "key tags @9\n"
+    "[\n"
+    "value \"stable\"\n"
+    "[\n"
+    "value 1\n"
+    "value 2.5\n"
+    "]\n"
+    "{\n"
+    "key lts @9\n"
+    "value true\n"
+    "}\n"
+    "]\n"
+    "array-table mirrors @11\n"
+    "key url @12\n"
+    "value '''https://mirror.example.com'''\n";
+
+static void print_key(FILE *out, const toml_event_t *ev) {
+  for (int i = 0; i < ev->nkey; i++)
+    fprintf(out, "%s%s", i ? "." : "", ev->key[i]);
+  fprintf(out, " @%d\n", ev->lineno);
+}
+
+static int record(const toml_event_t *ev, void *ud) {
+  FILE *out = ud;
+  switch (ev->type) {
+  case TOML_TABLE:
+    fprintf(out, "table ");
+    print_key(out, ev);
+    break;
+  case TOML_ARRAY_TABLE:
+    fprintf(out, "array-table ");
+    print_key(out, ev);
+    break;
+  case TOML_KEY:
+    fprintf(out, "key ");
+    print_key(out, ev);
+    break;
+  case TOML_VALUE:
+    fprintf(out, "value %.*s\n", ev->raw.len, ev->raw.ptr);
+    break;
+  case TOML_ARRAY_BEGIN:
+    fprintf(out, "[\n");
+    break;
+  case TOML_ARRAY_END:
+    fprintf(out, "]\n");
+    break;
+  case TOML_INLINE_TABLE_BEGIN:
+    fprintf(out, "{\n");
+    break;
+  case TOML_INLINE_TABLE_END:
+    fprintf(out, "}\n");
+    break;
+  }
+  return 0;
+}
+
+/* Find the linux url of v3.10.11 and stop there */
+typedef struct {
+  int in_release;
+  int want_value;
+  int nevent;
+  char *url;
+} finder_t;
+
+static int find_linux(const toml_event_t *ev, void *ud) {
+  finder_t *f = ud;
+  f->nevent++;
+  if (ev->type == TOML_TABLE)
+    f->in_release = ev->nkey == 2 && 0 == strcmp(ev->key[1], "v3.10.11");
+  else if (ev->type == TOML_KEY)
+    f->want_value = f->in_release && ev->nkey == 2 &&
+                    0 == strcmp(ev->key[0], "linux") &&
+                    0 == strcmp(ev->key[1], "url");
+  else if (ev->type == TOML_VALUE && f->want_value) {
+    toml_datum_t url = toml_string_view(ev->raw);
+    assert(url.ok);
+    f->url = url.u.s;
+    return 1;
+  }
+  return 0;
+}
+
+static int count(const toml_event_t *ev, void *ud) {
+  (void)ev;
+  ++*(int *)ud;
+  return 0;
+}
+
+int main(void) {
+  char errbuf[200];
+  size_t len = strlen(manifest);
+
+  /* the text need not be NUL-terminated */
+  char *text = malloc(len);
+  assert(text);
+  memcpy(text, manifest, len);
+
+  char *got;
+  size_t gotlen;
+  FILE *out = open_memstream(&got, &gotlen);
+  assert(out);
+  int rc = toml_parse_events(text, len, record, out, errbuf, sizeof(errbuf));
+  fclose(out);
+  if (rc != 0 || strcmp(got, expected)) {
+    printf("rc %d: %s\n--- want\n%s--- got\n%s", rc, errbuf, expected, got);
+    return 1;
+  }
+  free(got);
+
+  finder_t f;
+  memset(&f, 0, sizeof(f));
+  assert(1 == toml_parse_events(text, len, find_linux, &f, errbuf,
+                                sizeof(errbuf)));
+  assert(0 == strcmp(f.url, "https://example.com/3.10.11-linux.tar.gz"));
+  assert(f.nevent == 18);
+  free(f.url);
+  free(text);
+
+  /* syntax errors are reported */
+  static const char *bad[] = {
+      "a = [1, 2",   "a = { b = 1",   "a = 'x' b = 2",  "[a\n",
+      "[[a]\n",      "a.b. = 1",      "a = { b = 1,\n}", "= 1",
+      "a = \"\\q\"", "a = 1\0b = 2\n"};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    int n = 0;
+    size_t badlen = i == 9 ? 12 : strlen(bad[i]);
+    assert(-1 == toml_parse_events(bad[i], badlen, count, &n, errbuf,
+                                   sizeof(errbuf)));
+    assert(errbuf[0]);
+  }
+
+  /* keys cut short, from exact-size copies, must fail within the text */
+  static const char *truncated[] = {"\"\"", "''", "a.\"\"", "[\"\"", "[[''"};
+  for (size_t i = 0; i < sizeof(truncated) / sizeof(truncated[0]); i++) {
+    int n = 0;
+    size_t keylen = strlen(truncated[i]);
+    char *key = malloc(keylen);
+    assert(key);
+    memcpy(key, truncated[i], keylen);
+    assert(-1 == toml_parse_events(key, keylen, count, &n, errbuf,
+                                   sizeof(errbuf)));
+    free(key);
+  }
+
+  /* and so must every prefix of the manifest, whether it parses or not */
+  for (size_t cut = 0; cut <= len; cut++) {
+    int n = 0;
+    char *prefix = malloc(cut ? cut : 1);
+    assert(prefix);
+    memcpy(prefix, manifest, cut);
+    toml_parse_events(prefix, cut, count, &n, errbuf, sizeof(errbuf));
+    free(prefix);
+  }
+
+  /* files, and empty text */
+  char path[] = "/tmp/t4-XXXXXX";
+  FILE *fp = fdopen(mkstemp(path), "w");
+  assert(fp);
+  fputs(manifest, fp);
+  fclose(fp);
+  int n = 0;
+  assert(0 == toml_parse_events_mapped(path, count, &n, errbuf,
+                                       sizeof(errbuf)));
+  int nline = 0;
+  for (const char *p = expected; *p; p++)
+    nline += *p == '\n';
+  assert(n == nline);
+  fp = fopen(path, "w");
+  fclose(fp);
+  n = 0;
+  assert(0 == toml_parse_events_mapped(path, count, &n, errbuf,
+                                       sizeof(errbuf)));
+  assert(n == 0);
+  for (size_t i = 0; i < sizeof(truncated) / sizeof(truncated[0]); i++) {
+    fp = fopen(path, "w");
+    fputs(truncated[i], fp);
+    fclose(fp);
+    assert(-1 == toml_parse_events_mapped(path, count, &n, errbuf,
+                                          sizeof(errbuf)));
+  }
+  remove(path);
+
+  printf("OK\n");
+  return 0;
+}
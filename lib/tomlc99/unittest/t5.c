@@ -0,0 +1,82 @@
+#include "../toml.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Check the vectorised string scanning: every kind of string, with the
+ * interesting byte at every offset of a block, and UTF-8 validation. */
+
+static char *parse_string(const char *conf, char *errbuf, int errbufsz) {
+  char *copy = malloc(strlen(conf) + 1);
+  assert(copy);
+  strcpy(copy, conf);
+  toml_table_t *tab = toml_parse(copy, errbuf, errbufsz);
+  free(copy);
+  if (!tab)
+    return 0;
+  toml_datum_t d = toml_string_in(tab, "a");
+  toml_free(tab);
+  assert(d.ok);
+  return d.u.s;
+}
+
+/* a = <open>xxx<special>xxx<close> with the special byte at offset i */
+static void check_at(int i, const char *open, const char *special,
+                     const char *close, const char *want_special) {
+  char conf[256], want[256], errbuf[200];
+  char pad[80];
+  memset(pad, 'x', sizeof(pad));
+
+  snprintf(conf, sizeof(conf), "a = %s%.*s%s%.*s%s\n", open, i, pad, special,
+           70 - i, pad, close);
+  snprintf(want, sizeof(want), "%.*s%s%.*s", i, pad, want_special, 70 - i,
+           pad);
+  char *got = parse_string(conf, errbuf, sizeof(errbuf));
+  if (!got || strcmp(got, want)) {
+    printf("%s: got %s, want %s\n", conf, got ? got : errbuf, want);
+    exit(1);
+  }
+  free(got);
+}
+
+int main(void) {
+  char errbuf[200];
+
+  for (int i = 0; i <= 70; i++) {
+    check_at(i, "\"", "\\\"", "\"", "\"");
+    check_at(i, "\"", "\\\\", "\"", "\\");
+    check_at(i, "\"", "\\u00E9", "\"", "\xc3\xa9");
+    check_at(i, "\"", "'", "\"", "'");
+    check_at(i, "\"", "\xe2\x82\xac", "\"", "\xe2\x82\xac");
+    check_at(i, "'", "\"", "'", "\"");
+    check_at(i, "'", "\xf0\x9f\x98\x80", "'", "\xf0\x9f\x98\x80");
+    check_at(i, "\"\"\"", "\\\"\"\"", "\"\"\"", "\"\"\"");
+    check_at(i, "\"\"\"", "-\n\xc3\xa9", "\"\"\"", "-\n\xc3\xa9");
+    check_at(i, "'''", "-\n\xc3\xa9\\", "'''", "-\n\xc3\xa9\\");
+  }
+
+  /* not UTF-8: a stray continuation byte, a truncated sequence, an
+   * overlong encoding, a surrogate and a code point past U+10FFFF */
+  static const char *bad[] = {"\x80", "\xc3", "\xc0\xaf", "\xed\xa0\x80",
+                              "\xf4\x90\x80\x80"};
+  static const char *quotes[] = {"\"", "'", "\"\"\"", "'''"};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    for (size_t j = 0; j < sizeof(quotes) / sizeof(quotes[0]); j++) {
+      char conf[200];
+      snprintf(conf, sizeof(conf), "a = %s%s%s%s\n", quotes[j],
+               "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", bad[i], quotes[j]);
+      assert(!parse_string(conf, errbuf, sizeof(errbuf)));
+      assert(strstr(errbuf, "UTF-8"));
+    }
+  }
+
+  /* comments are not checked */
+  char *got = parse_string("# caf\xe9\na = 'ok' # \xff\n", errbuf,
+                           sizeof(errbuf));
+  assert(got && 0 == strcmp(got, "ok"));
+  free(got);
+
+  printf("OK\n");
+  return 0;
+}
@@ -5,20 +5,29 @@
 #include "include_utils.h"
 #include "security_utils.h"
 #include "crypto_utils.h"
+#include "build_cache.h"
+#include "watch_utils.h"
+#include "pawnc_utils.h"
+#include "daemon_utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
 #endif
 
 #define DEFAULT_COMPILER_VERSION "v3.10.11"
 #define DEFAULT_INPUT_FILE "gamemodes/main.pwn"
 #define DEFAULT_OUTPUT_FILE "gamemodes/main.amx"
 #define DEFAULT_TOML_FILE "opencli.toml"
+#define WATCH_DEBOUNCE_MS 150
 
 // Error codes
 #define ERR_SUCCESS 0
@@ -72,45 +81,6 @@ static bool copy_file(const char *source, const char *destination) {
     return true;
 }
 
-static char* get_compiler_dll_path(const char *version) {
-    static char dll_path[512];
-    char version_without_v[32];
-    
-    if (version[0] == 'v') {
-        #ifdef _WIN32
-        strcpy_s(version_without_v, sizeof(version_without_v), version + 1);
-        #else
-        strcpy(version_without_v, version + 1);
-        #endif
-    } else {
-        #ifdef _WIN32
-        strcpy_s(version_without_v, sizeof(version_without_v), version);
-        #else
-        strcpy(version_without_v, version);
-        #endif
-    }
-    
-    const char *appdata_path = get_appdata_path();
-    
-#ifdef _WIN32
-    sprintf_s(dll_path, sizeof(dll_path), "%s\\opencli\\compiler\\%s\\pawnc-%s-windows\\bin\\pawnc.dll", 
-              appdata_path, version, version_without_v);
-#else
-    #ifdef __APPLE__
-    sprintf(dll_path, "%s/opencli/compiler/%s/pawnc-%s-macos/lib/libpawnc.dylib", 
-            appdata_path, version, version_without_v);
-    #elif defined(__ANDROID__)
-    sprintf(dll_path, "%s/opencli/compiler/%s/pawnc-%s-android/lib/libpawnc.so", 
-            appdata_path, version, version_without_v);
-    #else
-    sprintf(dll_path, "%s/opencli/compiler/%s/pawnc-%s-linux/lib/libpawnc.so", 
-            appdata_path, version, version_without_v);
-    #endif
-#endif
-
-    return dll_path;
-}
-
 static void print_build_usage(void) {
     printf("Usage: opencli build [options]\n");
     printf("\n");
@@ -119,6 +89,13 @@ static void print_build_usage(void) {
     printf("  --output <file>     Output file (default: from opencli.toml or %s)\n", DEFAULT_OUTPUT_FILE);
     printf("  --compiler <ver>    Compiler version to use (default: from opencli.toml or %s)\n", DEFAULT_COMPILER_VERSION);
     printf("  --includes <dir>    Additional include directory\n");
+    printf("  -j, --jobs <n>      Build [[build.targets]] with up to n parallel compilers (default: CPU count)\n");
+    printf("  --in-process        Compile through libpawnc inside opencli instead of running pawncc\n");
+    printf("  --depfile           Write a Make/Ninja depfile next to each .amx (<name>.amx gets <name>.d)\n");
+    printf("  --no-daemon         Build in this process even if the compile daemon is running\n");
+    printf("  --watch             Rebuild whenever a source file, include or opencli.toml changes\n");
+    printf("  --no-cache          Always invoke the compiler, bypassing the build cache\n");
+    printf("  --cache-stats       Show build cache hit/miss statistics\n");
     printf("  --help              Show this help message\n");
 }
 
@@ -127,71 +104,6 @@ static bool file_exists(const char *path) {
     return stat(path, &st) == 0;
 }
 
-/**
- * Process source file to detect missing includes (Enhanced with auto-append .inc)
- * 
- * @param source_file Source file path
- * @param include_dirs Array of include directories
- * @param include_dirs_count Number of include directories
- * @return true if all includes found, false if any missing
- */
-static bool process_source_file_includes(const char *source_file, const char **include_dirs, int include_dirs_count) {
-    FILE *file;
-    char line[1024];
-    bool all_includes_found = true;
-    
-    // Open source file
-#ifdef _WIN32
-    if (fopen_s(&file, source_file, "r") != 0) {
-        fprintf(stderr, "Failed to open source file: %s\n", source_file);
-        return false;
-    }
-#else
-    file = fopen(source_file, "r");
-    if (!file) {
-        fprintf(stderr, "Failed to open source file: %s\n", source_file);
-        return false;
-    }
-#endif
-    
-    // Get base directory from source file
-    char *base_dir = get_directory_path(source_file);
-    
-    IncludeResolver *resolver = include_resolver_create(include_dirs, include_dirs_count, base_dir, true);
-    if (!resolver) {
-        fprintf(stderr, "Failed to create include resolver\n");
-        fclose(file);
-        return false;
-    }
-    
-    // Read file line by line
-    int line_number = 0;
-    while (fgets(line, sizeof(line), file)) {
-        line_number++;
-        
-        // Check if line contains #include
-        if (strstr(line, "#include")) {
-            IncludeInfo info;
-            if (parse_include_statement(line, &info)) {
-                // Use enhanced resolver to find include file
-                char result_path[MAX_INCLUDE_PATH_LEN];
-                if (!resolve_include_file(resolver, &info, result_path, sizeof(result_path))) {
-                    fprintf(stderr, "Error: Cannot find include file '%s' at %s:%d\n", info.path, source_file, line_number);
-                    all_includes_found = false;
-                }
-            }
-        }
-    }
-    
-    // Cleanup
-    include_resolver_destroy(resolver);
-    fclose(file);
-    
-
-    
-    return all_includes_found;
-}
-
 static char* get_correct_input_path(const char *input_path) {
     static char correct_path[512];
     
@@ -233,531 +145,1128 @@ static char* get_correct_input_path(const char *input_path) {
     return correct_path;
 }
 
-int command_build(int argc, char *argv[]) {
-    char input_file[512] = "";
-    char output_file[512] = "";
-    char compiler_version[32] = "";
-    char includes[512] = "";
-    char *compiler_path;
-    bool have_includes = false;
+// args is sized for every argument a job can have, see prepare_build_job
+static void add_compiler_arg(char **args, int *arg_count, char *arg) {
+    if (arg) {
+        args[(*arg_count)++] = arg;
+    }
+}
+
+static char *make_prefixed_arg(const char *prefix, const char *value) {
+    char *arg = malloc(strlen(prefix) + strlen(value) + 1);
+    if (arg) {
+        sprintf(arg, "%s%s", prefix, value);
+    }
+    return arg;
+}
+
+#ifdef _WIN32
+static bool write_compile_batch_file(const char *batch_file, const char *working_dir,
+                                     char *const args[], const char *input_file) {
+    FILE* bat_file;
+    if (fopen_s(&bat_file, batch_file, "w") != 0) {
+        return false;
+    }
     
-    // Check if opencli.toml exists
-    struct stat toml_st;
-    bool has_toml = (stat(DEFAULT_TOML_FILE, &toml_st) == 0);
+    fprintf(bat_file, "@echo off\n");
+    fprintf(bat_file, "cd \"%s\"\n", working_dir);
+    fprintf(bat_file, "\"%s\" ", args[0]);
     
-    // Parse options
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--help") == 0) {
-            print_build_usage();
-            return EXIT_SUCCESS;
-        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
-            char safe_path[MAX_SAFE_PATH_LENGTH];
-            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
-                fprintf(stderr, "Security error: Invalid input path\n");
-                return ERR_SECURITY_VIOLATION;
-            }
-            const char *allowed_input_exts[] = {"pwn", "pawn"};
-            if (!validate_file_extension(safe_path, allowed_input_exts, 2)) {
-                fprintf(stderr, "Error: Input file must be .pwn or .pawn\n");
-                return ERR_INVALID_INPUT;
-            }
-            #ifdef _WIN32
-            strcpy_s(input_file, sizeof(input_file), safe_path);
-            #else
-            strcpy(input_file, safe_path);
-            #endif
-        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
-            char safe_path[MAX_SAFE_PATH_LENGTH];
-            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
-                fprintf(stderr, "Security error: Invalid output path\n");
-                return ERR_SECURITY_VIOLATION;
-            }
-            const char *allowed_output_exts[] = {"amx"};
-            if (!validate_file_extension(safe_path, allowed_output_exts, 1)) {
-                fprintf(stderr, "Error: Output file must be .amx\n");
-                return ERR_INVALID_INPUT;
-            }
-            #ifdef _WIN32
-            strcpy_s(output_file, sizeof(output_file), safe_path);
-            #else
-            strcpy(output_file, safe_path);
-            #endif
-        } else if (strcmp(argv[i], "--compiler") == 0 && i + 1 < argc) {
-            char sanitized_version[32];
-            if (!sanitize_argument(argv[++i], sanitized_version, sizeof(sanitized_version))) {
-                fprintf(stderr, "Error: Invalid compiler version\n");
-                return ERR_INVALID_INPUT;
-            }
-            #ifdef _WIN32
-            strcpy_s(compiler_version, sizeof(compiler_version), sanitized_version);
-            #else
-            strcpy(compiler_version, sanitized_version);
-            #endif
-        } else if (strcmp(argv[i], "--includes") == 0 && i + 1 < argc) {
-            char safe_path[MAX_SAFE_PATH_LENGTH];
-            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
-                fprintf(stderr, "Security error: Invalid includes path\n");
-                return ERR_SECURITY_VIOLATION;
-            }
-            #ifdef _WIN32
-            strcpy_s(includes, sizeof(includes), safe_path);
-            #else
-            strcpy(includes, safe_path);
-            #endif
-            have_includes = true;
-        } else if (argv[i][0] == '-') {
-            fprintf(stderr, "Unknown option: %s\n", argv[i]);
-            print_build_usage();
-            return EXIT_FAILURE;
+    for (int i = 1; args[i] != NULL; i++) {
+        if (strncmp(args[i], "-o", 2) == 0 || strncmp(args[i], "-i", 2) == 0) {
+            fprintf(bat_file, "%.2s\"%s\" ", args[i], args[i] + 2);
+        } else if (args[i] == input_file) {
+            fprintf(bat_file, "\"%s\" ", args[i]);
+        } else {
+            fprintf(bat_file, "%s ", args[i]);
         }
     }
     
-    // Read values from opencli.toml if available
-    if (has_toml) {
-        // Only use toml values if command line options were not provided
-        if (input_file[0] == '\0') {
-            char *toml_input = read_toml_entry_file(DEFAULT_TOML_FILE);
-            if (toml_input) {
-                #ifdef _WIN32
-                strcpy_s(input_file, sizeof(input_file), toml_input);
-                #else
-                strcpy(input_file, toml_input);
-                #endif
-            }
-        }
-        
-        if (output_file[0] == '\0') {
-            char *toml_output = read_toml_output_file(DEFAULT_TOML_FILE);
-            if (toml_output) {
-                #ifdef _WIN32
-                strcpy_s(output_file, sizeof(output_file), toml_output);
-                #else
-                strcpy(output_file, toml_output);
-                #endif
-            }
-        }
-        
-        if (compiler_version[0] == '\0') {
-            char *toml_compiler = read_toml_compiler_version(DEFAULT_TOML_FILE);
-            if (toml_compiler) {
-                #ifdef _WIN32
-                strcpy_s(compiler_version, sizeof(compiler_version), toml_compiler);
-                #else
-                strcpy(compiler_version, toml_compiler);
-                #endif
-            }
+    fclose(bat_file);
+    return true;
+}
+#endif
+
+static void print_cache_stats(void) {
+    BuildCacheStats stats;
+    if (!build_cache_get_stats(&stats)) {
+        fprintf(stderr, "Failed to read build cache statistics\n");
+        return;
+    }
+    
+    unsigned long lookups = stats.hits + stats.misses;
+    printf("Build cache: %s\n", build_cache_get_dir());
+    printf("  Hits:    %lu\n", stats.hits);
+    printf("  Misses:  %lu\n", stats.misses);
+    printf("  Stored:  %lu\n", stats.stores);
+    printf("  Hit rate: %.1f%%\n", lookups > 0 ? (100.0 * stats.hits) / lookups : 0.0);
+}
+
+typedef enum {
+    BUILD_PENDING,
+    BUILD_CACHED,
+    BUILD_SUCCEEDED,
+    BUILD_FAILED
+} BuildStatus;
+
+typedef struct {
+    const char *name;
+    char input_file[512];
+    char output_file[512];
+    char output_path_without_ext[512];
+    const char *compiler_version;
+    const char *compiler_path;
+    const char *cli_includes;       // --includes, NULL if not given
+    char **include_paths;           // [build.includes] or the target override
+    int include_count;
+    char **compiler_args;           // NULL selects the default flags
+    int compiler_args_count;
+    bool use_cache;
+    bool write_depfile;             // write <name>.d next to <name>.amx after a successful build
+    bool in_process;                // compile through the loaded libpawnc
+    bool buffered;                  // collect messages instead of printing them
+    int index;
+    
+    char **args;                    // NULL-terminated compiler command line
+    char **owned_args;              // the arguments in args allocated for it
+    int owned_count;
+    char cache_key[BUILD_CACHE_KEY_LENGTH];
+    bool cache_usable;
+    IncludeGraph includes;
+    IncludeFileList dependencies;
+    
+    BuildStatus status;
+    double seconds;
+    char *log;
+    size_t log_length;
+    size_t log_capacity;
+} BuildJob;
+
+static double get_time_seconds(void) {
+#ifdef _WIN32
+    return GetTickCount64() / 1000.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static void job_append(BuildJob *job, const char *data, size_t len) {
+    if (job->log_length + len + 1 > job->log_capacity) {
+        size_t new_capacity = job->log_capacity > 0 ? job->log_capacity : 1024;
+        while (new_capacity < job->log_length + len + 1) {
+            new_capacity *= 2;
         }
-        
-        if (!have_includes) {
-            int include_count = 0;
-            char **include_paths = read_toml_include_paths(DEFAULT_TOML_FILE, &include_count);
-            if (include_paths && include_count > 0) {
-                have_includes = true;
+        char *grown = realloc(job->log, new_capacity);
+        if (!grown) return;
+        job->log = grown;
+        job->log_capacity = new_capacity;
+    }
+    
+    memcpy(job->log + job->log_length, data, len);
+    job->log_length += len;
+    job->log[job->log_length] = '\0';
+}
+
+/**
+ * Print a message for a job, or keep it for later when jobs run in parallel
+ */
+static void job_log(BuildJob *job, FILE *stream, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    
+    if (!job->buffered) {
+        vfprintf(stream, format, ap);
+    } else {
+        char message[1024];
+        va_list copy;
+        va_copy(copy, ap);
+        int len = vsnprintf(message, sizeof(message), format, ap);
+        if (len > 0 && (size_t)len < sizeof(message)) {
+            job_append(job, message, (size_t)len);
+        } else if (len > 0) {
+            char *long_message = malloc((size_t)len + 1);
+            if (long_message) {
+                vsnprintf(long_message, (size_t)len + 1, format, copy);
+                job_append(job, long_message, (size_t)len);
+                free(long_message);
             }
         }
+        va_end(copy);
     }
     
-    // If still empty, use defaults
-    if (input_file[0] == '\0') {
-        #ifdef _WIN32
-        strcpy_s(input_file, sizeof(input_file), DEFAULT_INPUT_FILE);
-        #else
-        strcpy(input_file, DEFAULT_INPUT_FILE);
-        #endif
+    va_end(ap);
+}
+
+// Include problems go with the rest of the job's output
+static void report_include(const char *message, void *report_data) {
+    job_log(report_data, stderr, "%s", message);
+}
+
+static void free_build_job(BuildJob *job) {
+    for (int i = 0; i < job->owned_count; i++) {
+        free(job->owned_args[i]);
     }
+    job->owned_count = 0;
+    free(job->owned_args);
+    job->owned_args = NULL;
+    free(job->args);
+    job->args = NULL;
+    include_graph_free(&job->includes);
+    include_file_list_free(&job->dependencies);
+    free(job->log);
+    job->log = NULL;
+}
+
+/**
+ * Write the job's include graph as a Make/Ninja depfile next to the .amx
+ */
+static void write_job_depfile(BuildJob *job) {
+    if (!job->write_depfile) return;
     
-    if (output_file[0] == '\0') {
-        #ifdef _WIN32
-        strcpy_s(output_file, sizeof(output_file), DEFAULT_OUTPUT_FILE);
-        #else
-        strcpy(output_file, DEFAULT_OUTPUT_FILE);
-        #endif
-    }
+    char depfile_path[520];
+    snprintf(depfile_path, sizeof(depfile_path), "%s.d", job->output_path_without_ext);
     
-    if (compiler_version[0] == '\0') {
-        #ifdef _WIN32
-        strcpy_s(compiler_version, sizeof(compiler_version), DEFAULT_COMPILER_VERSION);
-        #else
-        strcpy(compiler_version, DEFAULT_COMPILER_VERSION);
-        #endif
+    if (include_graph_write_depfile(&job->includes, job->output_file, depfile_path)) {
+        job_log(job, stdout, "Depfile: %s\n", depfile_path);
+    } else {
+        job_log(job, stderr, "Warning: Failed to write depfile %s\n", depfile_path);
     }
-    
+}
+
+/**
+ * Resolve the job's paths, assemble the compiler arguments, check that all
+ * includes exist and look the compilation up in the build cache. Runs on the
+ * main thread since the include scanner is not thread-safe.
+ *
+ * @return false if the job failed; a cache hit leaves status at BUILD_CACHED
+ */
+static bool prepare_build_job(BuildJob *job) {
     // Check if input file exists and use the correct extension
-    char *correct_input_path = get_correct_input_path(input_file);
-    if (strcmp(correct_input_path, input_file) != 0) {
-        printf("Using input file: %s\n", correct_input_path);
+    char *correct_input_path = get_correct_input_path(job->input_file);
+    if (strcmp(correct_input_path, job->input_file) != 0) {
+        job_log(job, stdout, "Using input file: %s\n", correct_input_path);
         #ifdef _WIN32
-        strcpy_s(input_file, sizeof(input_file), correct_input_path);
+        strcpy_s(job->input_file, sizeof(job->input_file), correct_input_path);
         #else
-        strcpy(input_file, correct_input_path);
+        strcpy(job->input_file, correct_input_path);
         #endif
     }
     
     // Now check if file exists with final path
-    if (!file_exists(input_file)) {
-        fprintf(stderr, "Input file not found: %s\n", input_file);
-        fprintf(stderr, "Tried extensions: .pwn, .pawn\n");
-        return EXIT_FAILURE;
-    }
-    
-    // Check if compiler is installed, if not, install it
-    if (!is_compiler_installed(compiler_version)) {
-        printf("Compiler %s is not installed. Installing...\n", compiler_version);
-        if (!install_compiler(compiler_version)) {
-            fprintf(stderr, "Failed to install compiler %s\n", compiler_version);
-            return EXIT_FAILURE;
-        }
-    }
-    
-    // Get compiler path
-    compiler_path = get_compiler_path(compiler_version);
-    if (!compiler_path) {
-        fprintf(stderr, "Failed to get compiler path\n");
-        return EXIT_FAILURE;
+    if (!file_exists(job->input_file)) {
+        job_log(job, stderr, "Input file not found: %s\n", job->input_file);
+        job_log(job, stderr, "Tried extensions: .pwn, .pawn\n");
+        return false;
     }
     
-
-    char output_path_without_ext[512];
     #ifdef _WIN32
-    strcpy_s(output_path_without_ext, sizeof(output_path_without_ext), output_file);
+    strcpy_s(job->output_path_without_ext, sizeof(job->output_path_without_ext), job->output_file);
     #else
-    strcpy(output_path_without_ext, output_file);
+    strcpy(job->output_path_without_ext, job->output_file);
     #endif
 
     // Remove .amx extension if present
-    char *dot = strrchr(output_path_without_ext, '.');
+    char *dot = strrchr(job->output_path_without_ext, '.');
     if (dot && strcmp(dot, ".amx") == 0) {
         *dot = '\0'; 
     }
     
-#ifdef _WIN32
-    char* dll_source_path = get_compiler_dll_path(compiler_version);
-    char dll_dest_path[512] = "pawnc.dll"; 
-    
-    if (!copy_file(dll_source_path, dll_dest_path)) {
-        fprintf(stderr, "Warning: Failed to copy pawnc.dll to current directory.\n");
-        fprintf(stderr, "Compilation might fail if pawnc.dll is not in the PATH.\n");
-    }
-#endif
-    
-    
-#ifdef _WIN32
-    char batch_file[512];
-    char working_dir[512];
-
-    if (GetCurrentDirectory(sizeof(working_dir), working_dir) == 0) {
-        strcpy_s(working_dir, sizeof(working_dir), ".");
-    }
-    
-    
-    sprintf_s(batch_file, sizeof(batch_file), "%s\\pawn_compile_temp.bat", working_dir);
-    FILE* bat_file;
-    if (fopen_s(&bat_file, batch_file, "w") != 0) {
-        fprintf(stderr, "Failed to create temporary batch file for compilation\n");
-        return EXIT_FAILURE;
+    // Build the compiler argument vector. The same vector drives the build
+    // cache key and the actual compiler invocation. It holds the compiler,
+    // its flags (or the six defaults), the input file, -o, up to two
+    // include paths besides the configured ones, and the closing NULL
+    int flag_count = job->compiler_args && job->compiler_args_count > 0 ? job->compiler_args_count : 6;
+    size_t max_args = (size_t)flag_count + (size_t)job->include_count + 6;
+    job->args = malloc(sizeof(char *) * max_args);
+    job->owned_args = malloc(sizeof(char *) * max_args);
+    if (!job->args || !job->owned_args) {
+        job_log(job, stderr, "Error: Out of memory\n");
+        return false;
     }
+    char **args = job->args;
+    int arg_count = 0;
     
-   
-    fprintf(bat_file, "@echo off\n");
-    fprintf(bat_file, "cd \"%s\"\n", working_dir);
-    
-    
-    fprintf(bat_file, "\"%s\" ", compiler_path);
-    
+    add_compiler_arg(args, &arg_count, (char *)job->compiler_path);
     
-    if (has_toml) {
-        int args_count = 0;
-        char **compiler_args = read_toml_compiler_args(DEFAULT_TOML_FILE, &args_count);
-        if (compiler_args && args_count > 0) {
-            for (int i = 0; i < args_count; i++) {
-                fprintf(bat_file, "%s ", compiler_args[i]);
+    if (job->compiler_args && job->compiler_args_count > 0) {
+#ifdef __ANDROID__
+        // The joined form is only needed for the shell fallbacks of run_process
+        if (job->in_process) {
+            for (int i = 0; i < job->compiler_args_count; i++) {
+                add_compiler_arg(args, &arg_count, job->compiler_args[i]);
             }
         } else {
-            // Default compiler flags if no TOML args available
-            fprintf(bat_file, "-d3 ");
-            fprintf(bat_file, "-;+ ");
-            fprintf(bat_file, "-(+ ");
-            fprintf(bat_file, "-\\+ ");
-            fprintf(bat_file, "-Z+ ");
-            fprintf(bat_file, "-O1 "); 
+        int total_len = 1; 
+        for (int i = 0; i < job->compiler_args_count; i++) {
+            total_len += strlen(job->compiler_args[i]) + 1; 
         }
-    } else {
-        // Default compiler flags if no TOML file
-        fprintf(bat_file, "-d3 ");
-        fprintf(bat_file, "-;+ ");
-        fprintf(bat_file, "-(+ ");
-        fprintf(bat_file, "-\\+ ");
-        fprintf(bat_file, "-Z+ ");
-        fprintf(bat_file, "-O1 "); 
-    }
-    
-    // Add input and output
-    fprintf(bat_file, "\"%s\" ", input_file);
-    fprintf(bat_file, "-o\"%s\" ", output_path_without_ext);
-    
-    // Add the directory of the input file as an include path for relative includes
-    char *input_dir = get_directory_path(input_file);
-    fprintf(bat_file, "-i\"%s\" ", input_dir);
-    
-    // Add include paths from command line
-    if (have_includes && includes[0] != '\0') {
-        fprintf(bat_file, "-i\"%s\" ", includes);
-    }
-    
-    // Add includes from toml if available
-    if (has_toml) {
-        int include_count = 0;
-        char **include_paths = read_toml_include_paths(DEFAULT_TOML_FILE, &include_count);
-        if (include_paths && include_count > 0) {
-            for (int i = 0; i < include_count; i++) {
-                if (include_paths[i] && include_paths[i][0] != '\0') {
-                    // Check if directory exists
-                    struct stat dir_stat;
-                    if (stat(include_paths[i], &dir_stat) == 0) {
-                        fprintf(bat_file, "-i\"%s\" ", include_paths[i]);
-                    }
-                }
+        
+        char *combined_flags = malloc(total_len); 
+        if (combined_flags) {
+            strcpy(combined_flags, "");  // Remove quotes - start empty
+            for (int i = 0; i < job->compiler_args_count; i++) {
+                if (i > 0) strcat(combined_flags, " ");
+                strcat(combined_flags, job->compiler_args[i]);
             }
+            // NO quotes added - exactly like manual execution
+            job->owned_args[job->owned_count++] = combined_flags;
+            add_compiler_arg(args, &arg_count, combined_flags);
+        } else {
+            job_log(job, stderr, "Error: Out of memory\n");
+            return false;
         }
+        }
+#else
+        for (int i = 0; i < job->compiler_args_count; i++) {
+            add_compiler_arg(args, &arg_count, job->compiler_args[i]);
+        }
+#endif
+    } else {
+        // Default compiler flags if no TOML args available
+        add_compiler_arg(args, &arg_count, "-d3");
+        add_compiler_arg(args, &arg_count, "-;+");
+        add_compiler_arg(args, &arg_count, "-(+");
+        add_compiler_arg(args, &arg_count, "-\\+");
+        add_compiler_arg(args, &arg_count, "-Z+");
+        add_compiler_arg(args, &arg_count, "-O1"); 
     }
     
-    fclose(bat_file);
-    
+    add_compiler_arg(args, &arg_count, job->input_file);
     
-    const char *include_dirs[32]; 
+    char *output_arg = make_prefixed_arg("-o", job->output_path_without_ext);
+    if (!output_arg) {
+        job_log(job, stderr, "Error: Out of memory\n");
+        return false;
+    }
+    job->owned_args[job->owned_count++] = output_arg;
+    add_compiler_arg(args, &arg_count, output_arg);
+    
+    // Room for the input file's directory, the command line include path
+    // and every configured one
+    const char **include_dirs = malloc(sizeof(*include_dirs) * ((size_t)job->include_count + 2));
+    if (!include_dirs) {
+        job_log(job, stderr, "Error: Out of memory\n");
+        return false;
+    }
     int include_dir_count = 0;
     
-    
+#ifdef _WIN32
+    // Add the directory of the input file as an include path for relative includes
+    char *input_dir = dup_directory_path(job->input_file);
+    char *input_dir_arg = input_dir ? make_prefixed_arg("-i", input_dir) : NULL;
+    if (!input_dir_arg) {
+        free(input_dir);
+        free(include_dirs);
+        job_log(job, stderr, "Error: Out of memory\n");
+        return false;
+    }
+    job->owned_args[job->owned_count++] = input_dir_arg;
+    add_compiler_arg(args, &arg_count, input_dir_arg);
     include_dirs[include_dir_count++] = input_dir;
+#endif
     
-    
-    if (have_includes && includes[0] != '\0') {
-        include_dirs[include_dir_count++] = includes;
+    if (job->cli_includes && job->cli_includes[0] != '\0') {
+        char *include_arg = make_prefixed_arg("-i", job->cli_includes);
+        if (!include_arg) {
+#ifdef _WIN32
+            free(input_dir);
+#endif
+            free(include_dirs);
+            job_log(job, stderr, "Error: Out of memory\n");
+            return false;
+        }
+        job->owned_args[job->owned_count++] = include_arg;
+        add_compiler_arg(args, &arg_count, include_arg);
+        job_log(job, stdout, "Adding include path from command line: %s\n", job->cli_includes);
+        include_dirs[include_dir_count++] = job->cli_includes;
     }
     
-    
-    if (has_toml) {
-        int toml_include_count = 0;
-        char **toml_include_paths = read_toml_include_paths(DEFAULT_TOML_FILE, &toml_include_count);
-        if (toml_include_paths && toml_include_count > 0) {
-            for (int i = 0; i < toml_include_count && include_dir_count < 32; i++) {
-                if (toml_include_paths[i] && toml_include_paths[i][0] != '\0') {
-                    struct stat dir_stat;
-                    if (stat(toml_include_paths[i], &dir_stat) == 0) {
-                        include_dirs[include_dir_count++] = toml_include_paths[i];
-                    }
+    for (int i = 0; i < job->include_count; i++) {
+        const char *include_path = job->include_paths[i];
+        if (include_path && include_path[0] != '\0') {
+            struct stat dir_stat;
+            if (stat(include_path, &dir_stat) == 0) {
+                char *include_arg = make_prefixed_arg("-i", include_path);
+                if (!include_arg) {
+#ifdef _WIN32
+                    free(input_dir);
+#endif
+                    free(include_dirs);
+                    job_log(job, stderr, "Error: Out of memory\n");
+                    return false;
                 }
+                job->owned_args[job->owned_count++] = include_arg;
+                add_compiler_arg(args, &arg_count, include_arg);
+                job_log(job, stdout, "Adding include path from TOML: %s\n", include_path);
+                include_dirs[include_dir_count++] = include_path;
+            } else {
+                job_log(job, stdout, "Warning: Include directory not found: %s (skipping)\n", include_path);
             }
         }
     }
     
-    bool all_includes_found = process_source_file_includes(input_file, include_dirs, include_dir_count);
+    args[arg_count] = NULL;
     
-    if (!all_includes_found) {
-        fprintf(stderr, "Error: Some include files could not be found. Compilation aborted.\n");
-        fclose(bat_file);
-        remove(batch_file);
-        return EXIT_FAILURE;
-    }
-    
-    int result = system(batch_file);
+    // Walk every include once; the graph also feeds the cache key, --watch
+    // and the depfile. Dependencies are kept even when an include is
+    // missing, so that --watch sees the files of a broken target
+    bool have_graph = include_graph_build(&job->includes, job->input_file, include_dirs, include_dir_count,
+                                          report_include, job);
+    free(include_dirs);
+#ifdef _WIN32
+    free(input_dir);
+#endif
     
-    // Delete temporary batch file
-    remove(batch_file);
-#else
-    char *args[32]; 
-    int arg_count = 0;
+    bool have_dependencies = have_graph;
+    for (int i = 0; have_dependencies && i < job->includes.count; i++) {
+        have_dependencies = include_file_list_append(&job->dependencies, job->includes.nodes[i].path);
+    }
     
-    args[arg_count++] = compiler_path;
+    if (!have_graph) {
+        return false;
+    }
     
+    if (job->includes.root_missing_count > 0 || job->includes.depth_exceeded) {
+        job_log(job, stderr, "Error: Some include files could not be found. Compilation aborted.\n");
+        return false;
+    }
     
-    if (has_toml) {
-        int args_count = 0;
-        char **compiler_args = read_toml_compiler_args(DEFAULT_TOML_FILE, &args_count);
-        if (compiler_args && args_count > 0) {
-#ifdef __ANDROID__
-            
-            int total_len = 1; 
-            for (int i = 0; i < args_count; i++) {
-                total_len += strlen(compiler_args[i]) + 1; 
-            }
-            
-            char *combined_flags = malloc(total_len); 
-            if (combined_flags) {
-                strcpy(combined_flags, "");  // Remove quotes - start empty
-                for (int i = 0; i < args_count; i++) {
-                    if (i > 0) strcat(combined_flags, " ");
-                    strcat(combined_flags, compiler_args[i]);
+    // Look the compilation up in the build cache
+    if (job->use_cache) {
+        if (have_dependencies) {
+            job->cache_usable = build_cache_compute_key(job->compiler_version, job->compiler_path,
+                                                        job->args, &job->dependencies, job->cache_key);
+        }
+        
+        if (job->cache_usable) {
+            char *cached_diagnostics = NULL;
+            if (build_cache_restore(job->cache_key, job->output_file, &cached_diagnostics)) {
+                build_cache_record_lookup(true);
+                
+                if (cached_diagnostics) {
+                    job_log(job, stdout, "%s", cached_diagnostics);
+                    free(cached_diagnostics);
                 }
-                // NO quotes added - exactly like manual execution
-                args[arg_count++] = combined_flags;
-            }
-#else
-            
-            for (int i = 0; i < args_count && arg_count < 32; i++) {
-                args[arg_count++] = compiler_args[i];
+                
+                job_log(job, stdout, "Compilation successful! (restored from build cache)\n");
+                job_log(job, stdout, "Output file: %s\n", job->output_file);
+                write_job_depfile(job);
+                job->status = BUILD_CACHED;
+                return true;
             }
-#endif
-        } else {
-            
-            args[arg_count++] = "-d3";
-            args[arg_count++] = "-;+";
-            args[arg_count++] = "-(+";
-            args[arg_count++] = "-\\+";
-            args[arg_count++] = "-Z+";
-            args[arg_count++] = "-O1"; 
+            build_cache_record_lookup(false);
         }
-    } else {
-        
-        args[arg_count++] = "-d3";
-        args[arg_count++] = "-;+";
-        args[arg_count++] = "-(+";
-        args[arg_count++] = "-\\+";
-        args[arg_count++] = "-Z+";
-        args[arg_count++] = "-O1"; 
     }
     
+    return true;
+}
+
+typedef struct {
+    BuildJob *job;
+    char *text;
+    size_t length;
+    size_t capacity;
+} DiagnosticCapture;
+
+static void capture_diagnostic(const char *line, void *user_data) {
+    DiagnosticCapture *capture = user_data;
+    size_t len = strlen(line);
+    
+    if (capture->length + len + 2 > capture->capacity) {
+        size_t new_capacity = capture->capacity > 0 ? capture->capacity : 1024;
+        while (new_capacity < capture->length + len + 2) {
+            new_capacity *= 2;
+        }
+        char *grown = realloc(capture->text, new_capacity);
+        if (!grown) return;
+        capture->text = grown;
+        capture->capacity = new_capacity;
+    }
     
-    args[arg_count++] = input_file;
+    memcpy(capture->text + capture->length, line, len);
+    capture->length += len;
+    capture->text[capture->length++] = '\n';
+    capture->text[capture->length] = '\0';
     
+    job_log(capture->job, stdout, "%s\n", line);
+}
+
+/**
+ * Run pawncc as a child process, collecting its output in *diagnostics
+ */
+static int run_compiler_process(BuildJob *job, char **diagnostics) {
+#ifdef _WIN32
+    char batch_file[512];
+    char working_dir[512];
+
+    if (GetCurrentDirectory(sizeof(working_dir), working_dir) == 0) {
+        strcpy_s(working_dir, sizeof(working_dir), ".");
+    }
     
-    char *output_arg = malloc(strlen(output_path_without_ext) + 3);
-    if (output_arg) {
-        sprintf(output_arg, "-o%s", output_path_without_ext);
-        args[arg_count++] = output_arg;
+    sprintf_s(batch_file, sizeof(batch_file), "%s\\pawn_compile_temp_%d.bat", working_dir, job->index);
+    if (!write_compile_batch_file(batch_file, working_dir, job->args, job->input_file)) {
+        job_log(job, stderr, "Failed to create temporary batch file for compilation\n");
+        return -1;
     }
     
+    job_log(job, stdout, "Compiling %s to %s...\n", job->input_file, job->output_file);
+    
+    char *batch_args[] = {"cmd.exe", "/c", batch_file, NULL};
+    int result = run_process_capture("cmd.exe", batch_args, diagnostics, !job->buffered);
+    
+    // Delete temporary batch file
+    remove(batch_file);
+#else
+    job_log(job, stdout, "Compiling %s to %s...\n", job->input_file, job->output_file);
+    
+    int result = run_process_capture(job->compiler_path, job->args, diagnostics, !job->buffered);
+#endif
+    
+    if (job->buffered && *diagnostics) {
+        job_append(job, *diagnostics, strlen(*diagnostics));
+    }
+    return result;
+}
 
+/**
+ * Run the compiler for a prepared job and store the result in the build
+ * cache. Safe to call from several threads at once.
+ */
+static void run_build_job(BuildJob *job) {
+    char *diagnostics = NULL;
+    int result;
+    
+    if (job->in_process) {
+        job_log(job, stdout, "Compiling %s to %s (in-process)...\n", job->input_file, job->output_file);
+        
+        // stdout leads to the compiler while it runs, so its lines are kept
+        // and printed once it returns
+        bool buffered = job->buffered;
+        size_t log_start = job->log_length;
+        job->buffered = true;
+        
+        DiagnosticCapture capture = {job, NULL, 0, 0};
+        result = pawnc_compile(job->args, capture_diagnostic, &capture);
+        diagnostics = capture.text ? capture.text : calloc(1, 1);
+        
+        job->buffered = buffered;
+        if (!buffered && job->log_length > log_start) {
+            fputs(job->log + log_start, stdout);
+            job->log_length = log_start;
+            job->log[log_start] = '\0';
+        }
+    } else {
+        result = run_compiler_process(job, &diagnostics);
+    }
     
+    // Comprehensive validation: Check both exit code AND output file existence
+    bool exit_code_success = (result == 0);
+    bool output_file_exists = false;
     
-    if (have_includes && includes[0] != '\0') {
-        char *include_arg = malloc(strlen(includes) + 3); 
-        if (include_arg) {
-            sprintf(include_arg, "-i%s", includes);
-            args[arg_count++] = include_arg;
-            printf("Adding include path from command line: %s\n", includes);
+    // Check if output file was actually created
+    struct stat output_stat;
+    if (stat(job->output_file, &output_stat) == 0) {
+        output_file_exists = true;
+        
+        // Additional validation: Check if file is not empty (valid .amx should have content)
+        if (output_stat.st_size == 0) {
+            output_file_exists = false;
         }
     }
     
+    // Determine actual compilation success based on multiple factors
+    bool compilation_successful = exit_code_success && output_file_exists;
     
-    if (has_toml) {
-        int include_count = 0;
-        char **include_paths = read_toml_include_paths(DEFAULT_TOML_FILE, &include_count);
-        if (include_paths && include_count > 0) {
-            for (int i = 0; i < include_count; i++) {
-                if (include_paths[i] && include_paths[i][0] != '\0') {
-                    struct stat dir_stat;
-                    if (stat(include_paths[i], &dir_stat) == 0) {
-                        char *include_arg = malloc(strlen(include_paths[i]) + 3);
-                        if (include_arg) {
-                            sprintf(include_arg, "-i%s", include_paths[i]);
-                            args[arg_count++] = include_arg;
-                            printf("Adding include path from TOML: %s\n", include_paths[i]);
-                        }
-                    } else {
-                        printf("Warning: Include directory not found: %s (skipping)\n", include_paths[i]);
-                    }
-                }
+    if (compilation_successful) {
+        // Only store when the compiler output was captured, so a hit can
+        // replay the same diagnostics
+        if (job->cache_usable && diagnostics) {
+            // A file edited while the compiler ran may or may not have made
+            // it into the output, which then matches neither key
+            char key_after[BUILD_CACHE_KEY_LENGTH];
+            if (!build_cache_compute_key(job->compiler_version, job->compiler_path,
+                                         job->args, &job->dependencies, key_after) ||
+                strcmp(key_after, job->cache_key) != 0) {
+                job_log(job, stdout, "Sources changed during compilation, not caching the output\n");
+            } else if (!build_cache_store(job->cache_key, job->output_file, diagnostics)) {
+                job_log(job, stderr, "Warning: Failed to store build in cache\n");
+            }
+        }
+        free(diagnostics);
+        
+        job_log(job, stdout, "Compilation successful!\n");
+        job_log(job, stdout, "Output file: %s\n", job->output_file);
+        write_job_depfile(job);
+        job->status = BUILD_SUCCEEDED;
+    } else {
+        free(diagnostics);
+        job_log(job, stderr, "Compilation failed!\n");
+        
+        if (!exit_code_success) {
+            job_log(job, stderr, "  - Process exit code: %d\n", result);
+        }
+        
+        if (!output_file_exists) {
+            job_log(job, stderr, "  - Output file not created or empty: %s\n", job->output_file);
+        }
+        
+        // Additional debugging for Android/Termux FORTIFY issues
+        #ifdef __ANDROID__
+        job_log(job, stderr, "\nAndroid/Termux troubleshooting:\n");
+        job_log(job, stderr, "  - If you see 'FORTIFY: fputs: null FILE*', this indicates a runtime issue\n");
+        job_log(job, stderr, "  - Try: export FORTIFY_SOURCE=0 before running OpenCLI\n");
+        job_log(job, stderr, "  - Ensure pawncc binary has execute permissions: chmod +x\n");
+        #endif
+        
+        job->status = BUILD_FAILED;
+    }
+}
+
+typedef struct {
+    BuildJob *jobs;
+    int count;
+    int next;
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+} BuildPool;
+
+static void pool_lock(BuildPool *pool) {
+#ifdef _WIN32
+    EnterCriticalSection(&pool->lock);
+#else
+    pthread_mutex_lock(&pool->lock);
+#endif
+}
+
+static void pool_unlock(BuildPool *pool) {
+#ifdef _WIN32
+    LeaveCriticalSection(&pool->lock);
+#else
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+static void print_job_log(BuildJob *job) {
+    printf("==> %s\n", job->name);
+    if (job->log) {
+        fputs(job->log, stdout);
+    }
+    fflush(stdout);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI build_worker(LPVOID arg) {
+#else
+static void *build_worker(void *arg) {
+#endif
+    BuildPool *pool = arg;
+    
+    for (;;) {
+        pool_lock(pool);
+        BuildJob *job = NULL;
+        while (pool->next < pool->count) {
+            BuildJob *candidate = &pool->jobs[pool->next++];
+            if (candidate->status == BUILD_PENDING) {
+                job = candidate;
+                break;
             }
         }
+        pool_unlock(pool);
+        
+        if (!job) break;
+        
+        double start = get_time_seconds();
+        run_build_job(job);
+        job->seconds += get_time_seconds() - start;
+        
+        // Print each target's output in one piece as soon as it finishes
+        pool_lock(pool);
+        print_job_log(job);
+        pool_unlock(pool);
     }
     
-    args[arg_count] = NULL;
+    return 0;
+}
+
+/**
+ * Compile all pending jobs with at most max_jobs compilers running at once
+ *
+ * @return the number of workers that ran them
+ */
+static int run_build_jobs(BuildJob *jobs, int count, int max_jobs) {
+    BuildPool pool;
+    pool.jobs = jobs;
+    pool.count = count;
+    pool.next = 0;
+    
+    int pending = 0;
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].status == BUILD_PENDING) pending++;
+    }
+    if (max_jobs > pending) max_jobs = pending;
+    if (max_jobs < 1) return 0;
     
+#ifdef _WIN32
+    InitializeCriticalSection(&pool.lock);
+    HANDLE *threads = calloc((size_t)max_jobs, sizeof(HANDLE));
+    int started = 0;
+    for (int i = 0; threads && i < max_jobs; i++) {
+        threads[i] = CreateThread(NULL, 0, build_worker, &pool, 0, NULL);
+        if (!threads[i]) break;
+        started++;
+    }
+    if (started == 0) {
+        build_worker(&pool);
+    } else {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        for (int i = 0; i < started; i++) {
+            CloseHandle(threads[i]);
+        }
+    }
+    free(threads);
+    DeleteCriticalSection(&pool.lock);
+#else
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_t *threads = calloc((size_t)max_jobs, sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; threads && i < max_jobs; i++) {
+        if (pthread_create(&threads[i], NULL, build_worker, &pool) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        build_worker(&pool);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+#endif
+    return started > 0 ? started : 1;
+}
+
+static void print_build_summary(BuildJob *jobs, int count, int workers, double elapsed) {
+    int succeeded = 0, cached = 0, failed = 0;
+    
+    printf("\nBuild summary (%d targets, %d jobs):\n", count, workers);
+    for (int i = 0; i < count; i++) {
+        const char *label;
+        switch (jobs[i].status) {
+            case BUILD_CACHED:    label = "CACHED"; cached++; break;
+            case BUILD_SUCCEEDED: label = "OK";     succeeded++; break;
+            default:              label = "FAILED"; failed++; break;
+        }
+        printf("  %-7s %-32s %s (%.2fs)\n", label, jobs[i].name, jobs[i].output_file, jobs[i].seconds);
+    }
+    printf("%d succeeded, %d from cache, %d failed in %.2fs\n", succeeded, cached, failed, elapsed);
+}
+
+typedef struct {
+    char input_file[512];
+    char output_file[512];
+    char compiler_version[32];
+    char includes[512];
+    bool have_includes;
+    bool use_cache;
+    bool in_process;
+    bool write_depfile;
+    int max_jobs;
+    const ProjectConfig *config;    // opencli.toml loaded by the caller, or NULL
+} BuildOptions;
+
+/**
+ * Run one build with the given command line options.
+ *
+ * @param watch_files If not NULL, receives opencli.toml and every file the
+ *                    targets depend on
+ * @param watch_dirs If not NULL, receives the directories includes are
+ *                   looked up in
+ */
+static int run_build(const BuildOptions *options, IncludeFileList *watch_files, IncludeFileList *watch_dirs) {
+    const char *includes = options->includes;
+    char *compiler_path;
+    bool have_includes = options->have_includes;
+    bool use_cache = options->use_cache;
+    int max_jobs = options->max_jobs;
+    
+    ProjectConfig *loaded_config = options->config ? NULL : project_config_load(DEFAULT_TOML_FILE);
+    const ProjectConfig *config = options->config ? options->config : loaded_config;
+    if (!config) {
+        // Keep watching the project file so fixing it triggers a rebuild
+        if (watch_files) {
+            include_file_list_append(watch_files, DEFAULT_TOML_FILE);
+        }
+        return EXIT_FAILURE;
+    }
     
-    const char *include_dirs[32]; 
-    int include_dir_count = 0;
+    // Command line options win over opencli.toml. [[build.targets]]
+    // replaces entry_file/output_file unless a single file was requested
+    bool use_targets = options->input_file[0] == '\0' && options->output_file[0] == '\0';
+    BuildTarget *targets = use_targets ? config->targets : NULL;
+    int target_count = use_targets ? config->target_count : 0;
     
+    const char *input_file = options->input_file[0] != '\0' ? options->input_file : config->entry_file;
+    const char *output_file = options->output_file[0] != '\0' ? options->output_file : config->output_file;
+    const char *compiler_version = options->compiler_version[0] != '\0' ? options->compiler_version
+                                                                       : config->compiler_version;
     
-    if (have_includes && includes[0] != '\0') {
-        include_dirs[include_dir_count++] = includes;
+    // Check if compiler is installed, if not, install it
+    if (!is_compiler_installed(compiler_version)) {
+        printf("Compiler %s is not installed. Installing...\n", compiler_version);
+        if (!install_compiler(compiler_version)) {
+            fprintf(stderr, "Failed to install compiler %s\n", compiler_version);
+            project_config_free(loaded_config);
+            return EXIT_FAILURE;
+        }
     }
     
-    if (has_toml) {
-        int toml_include_count = 0;
-        char **toml_include_paths = read_toml_include_paths(DEFAULT_TOML_FILE, &toml_include_count);
-        if (toml_include_paths && toml_include_count > 0) {
-            for (int i = 0; i < toml_include_count && include_dir_count < 32; i++) {
-                if (toml_include_paths[i] && toml_include_paths[i][0] != '\0') {
-                    struct stat dir_stat;
-                    if (stat(toml_include_paths[i], &dir_stat) == 0) {
-                        include_dirs[include_dir_count++] = toml_include_paths[i];
-                    }
-                }
-            }
-        }
+    // Get compiler path
+    compiler_path = get_compiler_path(compiler_version);
+    if (!compiler_path) {
+        fprintf(stderr, "Failed to get compiler path\n");
+        project_config_free(loaded_config);
+        return EXIT_FAILURE;
     }
     
+    // Large projects can keep more include resolutions per build
+    set_default_include_cache_capacity(config->include_cache_size);
+    
+    // libpawnc stays loaded across --watch rebuilds
+    bool in_process = false;
+    if (options->in_process) {
+        char *library_path = get_compiler_library_path(compiler_version);
+        if (pawnc_in_process_supported() && library_path && pawnc_library_load(library_path)) {
+            in_process = true;
+        } else {
+            fprintf(stderr, "Warning: In-process compilation unavailable, running pawncc instead\n");
+        }
+    }
     
-    bool all_includes_found = process_source_file_includes(input_file, include_dirs, include_dir_count);
+    int job_count = target_count > 0 ? target_count : 1;
+    BuildJob *jobs = calloc((size_t)job_count, sizeof(BuildJob));
+    if (!jobs) {
+        fprintf(stderr, "Out of memory\n");
+        project_config_free(loaded_config);
+        return EXIT_FAILURE;
+    }
     
-    if (!all_includes_found) {
-        fprintf(stderr, "Error: Some include files could not be found. Compilation aborted.\n");
+    for (int i = 0; i < job_count; i++) {
+        BuildJob *job = &jobs[i];
+        const BuildTarget *target = target_count > 0 ? &targets[i] : NULL;
         
+        job->index = i;
+        job->compiler_version = compiler_version;
+        job->compiler_path = compiler_path;
+        job->cli_includes = have_includes ? includes : NULL;
+        job->use_cache = use_cache;
+        job->in_process = in_process;
+        job->write_depfile = options->write_depfile;
+        job->buffered = target_count > 0;
+        job->status = BUILD_PENDING;
         
-        for (int i = 11; i < arg_count; i++) {  
-            free(args[i]);
+        #ifdef _WIN32
+        strcpy_s(job->input_file, sizeof(job->input_file), target ? target->entry_file : input_file);
+        strcpy_s(job->output_file, sizeof(job->output_file), target ? target->output_file : output_file);
+        #else
+        snprintf(job->input_file, sizeof(job->input_file), "%s", target ? target->entry_file : input_file);
+        snprintf(job->output_file, sizeof(job->output_file), "%s", target ? target->output_file : output_file);
+        #endif
+        job->name = target ? target->name : job->input_file;
+        
+        if (target && target->include_paths) {
+            job->include_paths = target->include_paths;
+            job->include_count = target->include_count;
+        } else {
+            job->include_paths = config->include_paths;
+            job->include_count = config->include_count;
         }
         
-        return EXIT_FAILURE;
+        if (target && target->args) {
+            job->compiler_args = target->args;
+            job->compiler_args_count = target->args_count;
+        } else {
+            job->compiler_args = config->compiler_args;
+            job->compiler_args_count = config->args_count;
+        }
     }
     
-
-    printf("Compiling %s to %s...\n", input_file, output_file);
+    // The cache directory is worked out once, before any worker thread
+    // can ask for it
+    if (use_cache) {
+        build_cache_get_dir();
+    }
     
-    int result = run_process(compiler_path, args, true);
+    double build_start = get_time_seconds();
+    bool needs_compiler = false;
+    int workers = 0;
     
-    for (int i = 11; i < arg_count; i++) { 
-        free(args[i]);
+    for (int i = 0; i < job_count; i++) {
+        double start = get_time_seconds();
+        if (!prepare_build_job(&jobs[i])) {
+            jobs[i].status = BUILD_FAILED;
+        }
+        jobs[i].seconds = get_time_seconds() - start;
+        
+        if (jobs[i].status == BUILD_PENDING) {
+            needs_compiler = true;
+        } else if (jobs[i].buffered) {
+            print_job_log(&jobs[i]);
+        }
+    }
+    
+    if (max_jobs == 0) {
+        max_jobs = get_cpu_count();
     }
-#endif
     
+    // The compiler is not reentrant, so in-process builds run one at a time
+    if (in_process) {
+        max_jobs = 1;
+    }
     
+    if (needs_compiler) {
 #ifdef _WIN32
-    remove(dll_dest_path);
+        char* dll_source_path = get_compiler_library_path(compiler_version);
+        char dll_dest_path[512] = "pawnc.dll"; 
+        
+        if (!dll_source_path || !copy_file(dll_source_path, dll_dest_path)) {
+            fprintf(stderr, "Warning: Failed to copy pawnc.dll to current directory.\n");
+            fprintf(stderr, "Compilation might fail if pawnc.dll is not in the PATH.\n");
+        }
+#else
+        add_compiler_library_search_path(compiler_version);
 #endif
+        
+        if (job_count == 1) {
+            run_build_job(&jobs[0]);
+            workers = 1;
+        } else {
+            workers = run_build_jobs(jobs, job_count, max_jobs);
+        }
+        
+#ifdef _WIN32
+        remove(dll_dest_path);
+#endif
+    }
     
-    // Comprehensive validation: Check both exit code AND output file existence
-    bool exit_code_success = (result == 0);
-    bool output_file_exists = false;
+    int failed = 0;
+    for (int i = 0; i < job_count; i++) {
+        if (jobs[i].status == BUILD_FAILED) failed++;
+    }
     
-    // Check if output file was actually created
-    struct stat output_stat;
-    if (stat(output_file, &output_stat) == 0) {
-        output_file_exists = true;
-        
-        // Additional validation: Check if file is not empty (valid .amx should have content)
-        if (output_stat.st_size == 0) {
-            output_file_exists = false;
+    if (watch_files) {
+        include_file_list_append(watch_files, DEFAULT_TOML_FILE);
+        for (int i = 0; i < job_count; i++) {
+            // The entry file may not exist yet; watch it regardless
+            include_file_list_append(watch_files, jobs[i].input_file);
+            for (int j = 0; j < jobs[i].dependencies.count; j++) {
+                include_file_list_append(watch_files, jobs[i].dependencies.files[j]);
+            }
         }
     }
     
-    // Determine actual compilation success based on multiple factors
-    bool compilation_successful = exit_code_success && output_file_exists;
+    if (watch_dirs) {
+        for (int i = 0; i < job_count; i++) {
+            char *input_dir = dup_directory_path(jobs[i].input_file);
+            if (input_dir) {
+                include_file_list_append(watch_dirs, input_dir);
+                free(input_dir);
+            }
+            if (jobs[i].cli_includes && jobs[i].cli_includes[0] != '\0') {
+                include_file_list_append(watch_dirs, jobs[i].cli_includes);
+            }
+            for (int j = 0; j < jobs[i].include_count; j++) {
+                struct stat dir_stat;
+                if (jobs[i].include_paths[j] && stat(jobs[i].include_paths[j], &dir_stat) == 0) {
+                    include_file_list_append(watch_dirs, jobs[i].include_paths[j]);
+                }
+            }
+        }
+    }
     
-    if (compilation_successful) {
-        printf("Compilation successful!\n");
-        printf("Output file: %s\n", output_file);
-        return EXIT_SUCCESS;
-    } else {
-        fprintf(stderr, "Compilation failed!\n");
+    if (target_count > 0) {
+        print_build_summary(jobs, job_count, workers, get_time_seconds() - build_start);
+    }
+    
+    for (int i = 0; i < job_count; i++) {
+        free_build_job(&jobs[i]);
+    }
+    free(jobs);
+    project_config_free(loaded_config);
+    
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Rebuild whenever the entry files, their includes or opencli.toml change.
+ * The watch set is refreshed after every build so new includes are picked up
+ */
+static int watch_build(const BuildOptions *options) {
+    FileWatcher *watcher = file_watcher_create();
+    if (!watcher) {
+        fprintf(stderr, "Failed to create file watcher\n");
+        return EXIT_FAILURE;
+    }
+    
+    for (;;) {
+        IncludeFileList watch_files;
+        IncludeFileList watch_dirs;
+        memset(&watch_files, 0, sizeof(watch_files));
+        memset(&watch_dirs, 0, sizeof(watch_dirs));
         
-        if (!exit_code_success) {
-            fprintf(stderr, "  - Process exit code: %d\n", result);
+        // Edits from here on may not have made it into this build
+        time_t build_started = time(NULL);
+        int result = run_build(options, &watch_files, &watch_dirs);
+        
+        bool watching = file_watcher_set(watcher, &watch_files, &watch_dirs, build_started);
+        int watched_count = watch_files.count;
+        include_file_list_free(&watch_files);
+        include_file_list_free(&watch_dirs);
+        
+        if (!watching) {
+            fprintf(stderr, "Failed to watch project files\n");
+            file_watcher_destroy(watcher);
+            return EXIT_FAILURE;
         }
         
-        if (!output_file_exists) {
-            fprintf(stderr, "  - Output file not created or empty: %s\n", output_file);
+        printf("\nWatching %d files for changes (Ctrl+C to stop)...\n", watched_count);
+        fflush(stdout);
+        
+        // After a failed build also react to files appearing in the include
+        // directories, which may be the include that was missing
+        char changed_file[512] = "";
+        if (!file_watcher_wait(watcher, WATCH_DEBOUNCE_MS, result != EXIT_SUCCESS,
+                               changed_file, sizeof(changed_file))) {
+            fprintf(stderr, "Failed to wait for file changes\n");
+            file_watcher_destroy(watcher);
+            return EXIT_FAILURE;
         }
         
-        // Additional debugging for Android/Termux FORTIFY issues
-        #ifdef __ANDROID__
-        fprintf(stderr, "\nAndroid/Termux troubleshooting:\n");
-        fprintf(stderr, "  - If you see 'FORTIFY: fputs: null FILE*', this indicates a runtime issue\n");
-        fprintf(stderr, "  - Try: export FORTIFY_SOURCE=0 before running OpenCLI\n");
-        fprintf(stderr, "  - Ensure pawncc binary has execute permissions: chmod +x\n");
-        #endif
+        printf("\nChange detected: %s\n", changed_file);
+        fflush(stdout);
+    }
+}
+
+int command_build(int argc, char *argv[]) {
+    return command_build_with_config(argc, argv, NULL);
+}
+
+int command_build_with_config(int argc, char *argv[], const ProjectConfig *config) {
+    BuildOptions options;
+    memset(&options, 0, sizeof(options));
+    options.use_cache = true;
+    options.config = config;
+    bool watch = false;
+    bool use_daemon = true;
+    
+    // Parse options
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            print_build_usage();
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "--no-daemon") == 0) {
+            use_daemon = false;
+        } else if (strcmp(argv[i], "--in-process") == 0) {
+            options.in_process = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[i], "--depfile") == 0) {
+            options.write_depfile = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.use_cache = false;
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            print_cache_stats();
+            return EXIT_SUCCESS;
+        } else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+            options.max_jobs = atoi(argv[++i]);
+            if (options.max_jobs < 1) {
+                fprintf(stderr, "Error: Invalid job count: %s\n", argv[i]);
+                return ERR_INVALID_INPUT;
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+            options.max_jobs = atoi(argv[i] + 2);
+            if (options.max_jobs < 1) {
+                fprintf(stderr, "Error: Invalid job count: %s\n", argv[i] + 2);
+                return ERR_INVALID_INPUT;
+            }
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            char safe_path[MAX_SAFE_PATH_LENGTH];
+            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
+                fprintf(stderr, "Security error: Invalid input path\n");
+                return ERR_SECURITY_VIOLATION;
+            }
+            const char *allowed_input_exts[] = {"pwn", "pawn"};
+            if (!validate_file_extension(safe_path, allowed_input_exts, 2)) {
+                fprintf(stderr, "Error: Input file must be .pwn or .pawn\n");
+                return ERR_INVALID_INPUT;
+            }
+            #ifdef _WIN32
+            strcpy_s(options.input_file, sizeof(options.input_file), safe_path);
+            #else
+            strcpy(options.input_file, safe_path);
+            #endif
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            char safe_path[MAX_SAFE_PATH_LENGTH];
+            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
+                fprintf(stderr, "Security error: Invalid output path\n");
+                return ERR_SECURITY_VIOLATION;
+            }
+            const char *allowed_output_exts[] = {"amx"};
+            if (!validate_file_extension(safe_path, allowed_output_exts, 1)) {
+                fprintf(stderr, "Error: Output file must be .amx\n");
+                return ERR_INVALID_INPUT;
+            }
+            #ifdef _WIN32
+            strcpy_s(options.output_file, sizeof(options.output_file), safe_path);
+            #else
+            strcpy(options.output_file, safe_path);
+            #endif
+        } else if (strcmp(argv[i], "--compiler") == 0 && i + 1 < argc) {
+            char sanitized_version[32];
+            if (!sanitize_argument(argv[++i], sanitized_version, sizeof(sanitized_version))) {
+                fprintf(stderr, "Error: Invalid compiler version\n");
+                return ERR_INVALID_INPUT;
+            }
+            #ifdef _WIN32
+            strcpy_s(options.compiler_version, sizeof(options.compiler_version), sanitized_version);
+            #else
+            strcpy(options.compiler_version, sanitized_version);
+            #endif
+        } else if (strcmp(argv[i], "--includes") == 0 && i + 1 < argc) {
+            char safe_path[MAX_SAFE_PATH_LENGTH];
+            if (!validate_safe_path(argv[++i], safe_path, sizeof(safe_path))) {
+                fprintf(stderr, "Security error: Invalid includes path\n");
+                return ERR_SECURITY_VIOLATION;
+            }
+            #ifdef _WIN32
+            strcpy_s(options.includes, sizeof(options.includes), safe_path);
+            #else
+            strcpy(options.includes, safe_path);
+            #endif
+            options.have_includes = true;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_build_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (!watch) {
+        // Hand the build to the compile daemon when one is running
+        if (use_daemon && daemon_supported()) {
+            bool handled = false;
+            int result = daemon_client_build(argc, argv, &handled);
+            if (handled) {
+                return result;
+            }
+        }
         
-        return EXIT_FAILURE;
+        return run_build(&options, NULL, NULL);
     }
-}
\ No newline at end of file
+    
+    return watch_build(&options);
+}
@@ -0,0 +1,984 @@
+#include "commands.h"
+#include "compiler_utils.h"
+#include "daemon_utils.h"
+#include "include_index.h"
+#include "pawnc_utils.h"
+#include "process_utils.h"
+#include "toml_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#define DEFAULT_COMPILER_VERSION "v3.10.11"
+#define DAEMON_REQUEST_TIMEOUT_SEC 5
+
+static void print_daemon_usage(void) {
+    printf("Usage: opencli daemon <start|stop|status> [options]\n");
+    printf("\n");
+    printf("Runs a background compile server that keeps compilers loaded and\n");
+    printf("project configuration parsed between builds. While it is running,\n");
+    printf("'opencli build' sends its builds to it.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  --foreground        Do not detach from the terminal (start)\n");
+    printf("  -j, --jobs <n>      Builds to run at once (default: CPU count)\n");
+    printf("  --help              Show this help message\n");
+}
+
+#ifndef _WIN32
+
+extern char **environ;
+
+typedef struct DaemonRequest {
+    int fd;
+    char **argv;
+    int argc;
+    char **envp;                // the client's environment, NULL-terminated
+    struct DaemonRequest *next;
+} DaemonRequest;
+
+// A client whose request frame has not fully arrived yet. Clients are read
+// without blocking so a slow one cannot hold up the others
+typedef struct {
+    int fd;
+    unsigned char header[5];
+    uint32_t header_received;
+    char *payload;
+    uint32_t length;
+    uint32_t received;
+    time_t deadline;
+} DaemonConnection;
+
+// Per-project state, kept for the lifetime of the daemon. Requests are
+// queued per project and projects are served round-robin
+typedef struct {
+    char *cwd;
+    time_t toml_mtime;
+    long toml_mtime_nsec;
+    long long toml_size;
+    time_t toml_loaded;         // when the config was read, see refresh_project_config
+    bool have_config;
+    ProjectConfig *config;      // handed to the workers, NULL without one
+    char compiler_version[32];
+    char **index_dirs;          // absolute include directories to keep indexed
+    int index_dir_count;
+    DaemonRequest *head;
+    DaemonRequest *tail;
+    unsigned long served;
+} DaemonProject;
+
+typedef struct {
+    DaemonProject *projects;
+    int project_count;
+    int project_capacity;
+    int next_project;
+    int running;
+    int max_running;
+    unsigned long served;
+    time_t started;
+    bool stopping;
+    char loaded_versions[8][32];
+    int loaded_version_count;
+    DaemonConnection *connections;
+    int connection_count;
+    int connection_capacity;
+} DaemonState;
+
+static int signal_pipe[2] = {-1, -1};
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int sig) {
+    int saved_errno = errno;
+    if (sig == SIGTERM || sig == SIGINT) {
+        stop_requested = 1;
+    }
+    char c = (char)sig;
+    if (write(signal_pipe[1], &c, 1) < 0) {
+        // Nothing to do; the pipe is only a wake-up
+    }
+    errno = saved_errno;
+}
+
+static void free_request(DaemonRequest *request) {
+    if (!request) return;
+    if (request->fd >= 0) {
+        close(request->fd);
+    }
+    free(request->argv);
+    free(request);
+}
+
+static DaemonProject *find_project(DaemonState *state, const char *cwd) {
+    for (int i = 0; i < state->project_count; i++) {
+        if (strcmp(state->projects[i].cwd, cwd) == 0) {
+            return &state->projects[i];
+        }
+    }
+
+    if (state->project_count >= state->project_capacity) {
+        int new_capacity = state->project_capacity > 0 ? state->project_capacity * 2 : 8;
+        DaemonProject *projects = realloc(state->projects, sizeof(DaemonProject) * new_capacity);
+        if (!projects) return NULL;
+        state->projects = projects;
+        state->project_capacity = new_capacity;
+    }
+
+    DaemonProject *project = &state->projects[state->project_count];
+    memset(project, 0, sizeof(*project));
+    project->cwd = malloc(strlen(cwd) + 1);
+    if (!project->cwd) return NULL;
+    strcpy(project->cwd, cwd);
+    state->project_count++;
+    return project;
+}
+
+static void free_index_dirs(DaemonProject *project) {
+    for (int i = 0; i < project->index_dir_count; i++) {
+        free(project->index_dirs[i]);
+    }
+    free(project->index_dirs);
+    project->index_dirs = NULL;
+    project->index_dir_count = 0;
+}
+
+static void add_index_dir(DaemonProject *project, const char *dir) {
+    char path[1400];
+    while (dir[0] == '.' && dir[1] == '/') {
+        dir += 2;
+    }
+    if (dir[0] == '\0' || strcmp(dir, ".") == 0) {
+        snprintf(path, sizeof(path), "%s", project->cwd);
+    } else if (dir[0] == '/') {
+        snprintf(path, sizeof(path), "%s", dir);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s", project->cwd, dir);
+    }
+
+    char **dirs = realloc(project->index_dirs, sizeof(char *) * (project->index_dir_count + 1));
+    if (!dirs) return;
+    project->index_dirs = dirs;
+
+    dirs[project->index_dir_count] = malloc(strlen(path) + 1);
+    if (dirs[project->index_dir_count]) {
+        strcpy(dirs[project->index_dir_count++], path);
+    }
+}
+
+/**
+ * Re-read the parts of opencli.toml the daemon keeps warm, but only when
+ * the file changed since the last request for this project
+ */
+static void refresh_project_config(DaemonProject *project) {
+    char toml_path[1100];
+    snprintf(toml_path, sizeof(toml_path), "%s/opencli.toml", project->cwd);
+
+    struct stat st;
+    if (stat(toml_path, &st) != 0) {
+        project->have_config = false;
+        project_config_free(project->config);
+        project->config = NULL;
+        return;
+    }
+
+    long mtime_nsec = 0;
+#if defined(__APPLE__)
+    mtime_nsec = st.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__ANDROID__)
+    mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+
+    // Where mtimes have no sub-second part, a file written in the second it
+    // was read can change again without its mtime moving, so it is read
+    // again until it is older than the last read
+    if (project->have_config && st.st_mtime == project->toml_mtime &&
+        mtime_nsec == project->toml_mtime_nsec && (long long)st.st_size == project->toml_size &&
+        project->toml_mtime < project->toml_loaded) {
+        return;
+    }
+    time_t loaded = time(NULL);
+
+    // The worker loads and reports a file that does not parse itself
+    project_config_free(project->config);
+    project->config = NULL;
+    ProjectConfig *config = project_config_load(toml_path);
+    if (!config) {
+        project->have_config = false;
+        return;
+    }
+
+    snprintf(project->compiler_version, sizeof(project->compiler_version), "%s",
+             config->compiler_version);
+
+    free_index_dirs(project);
+    for (int i = 0; i < config->include_count; i++) {
+        add_index_dir(project, config->include_paths[i]);
+    }
+
+    // Quoted includes resolve against the entry file's directory
+    char *entry_dir = dup_directory_path(config->entry_file);
+    if (entry_dir) {
+        add_index_dir(project, entry_dir);
+        free(entry_dir);
+    }
+
+    project->config = config;
+    project->toml_mtime = st.st_mtime;
+    project->toml_mtime_nsec = mtime_nsec;
+    project->toml_size = (long long)st.st_size;
+    project->toml_loaded = loaded;
+    project->have_config = true;
+}
+
+static bool has_argument(char **argv, int argc, const char *argument) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], argument) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Work out which compiler a build will use
+ */
+static const char *project_compiler_version(DaemonProject *project, char **argv, int argc) {
+    for (int i = 0; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--compiler") == 0) {
+            return argv[i + 1];
+        }
+    }
+
+    return project->have_config ? project->compiler_version : DEFAULT_COMPILER_VERSION;
+}
+
+/**
+ * Bring the project's include directory listings up to date in the daemon,
+ * so the forked worker starts with them indexed
+ */
+static void warm_includes(DaemonProject *project) {
+    include_index_begin_pass();
+    for (int i = 0; i < project->index_dir_count; i++) {
+        include_index_warm(project->index_dirs[i]);
+    }
+}
+
+/**
+ * Load the compiler a request needs into the daemon itself, so the forked
+ * worker inherits it already loaded
+ */
+static bool warm_compiler(DaemonState *state, const char *version) {
+    if (!is_compiler_installed(version)) {
+        return false;
+    }
+
+    char *library_path = get_compiler_library_path(version);
+    if (!library_path || !pawnc_library_load(library_path)) {
+        return false;
+    }
+
+    for (int i = 0; i < state->loaded_version_count; i++) {
+        if (strcmp(state->loaded_versions[i], version) == 0) {
+            return true;
+        }
+    }
+    if (state->loaded_version_count < 8) {
+        snprintf(state->loaded_versions[state->loaded_version_count++], 32, "%s", version);
+    }
+    return true;
+}
+
+typedef struct {
+    int source;
+    int client;
+    char type;
+    pthread_mutex_t *lock;
+} FrameForwarder;
+
+static void *forward_output(void *arg) {
+    FrameForwarder *forwarder = arg;
+    char chunk[4096];
+
+    for (;;) {
+        ssize_t n = read(forwarder->source, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        pthread_mutex_lock(forwarder->lock);
+        daemon_send_frame(forwarder->client, forwarder->type, chunk, (uint32_t)n);
+        pthread_mutex_unlock(forwarder->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Body of a forked worker: run the build in the project directory and the
+ * client's environment, with stdout and stderr relayed to the client as
+ * frames
+ */
+static void run_worker(DaemonRequest *request, DaemonProject *project) {
+    int client = request->fd;
+    int code = EXIT_FAILURE;
+
+    environ = request->envp;
+    if (chdir(project->cwd) != 0) {
+        const char *message = "Compile daemon: project directory no longer exists\n";
+        daemon_send_frame(client, DAEMON_FRAME_STDERR, message, (uint32_t)strlen(message));
+    } else {
+        int out_pipe[2], err_pipe[2];
+        if (pipe(out_pipe) == 0 && pipe(err_pipe) == 0) {
+            pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+            FrameForwarder out_forwarder = {out_pipe[0], client, DAEMON_FRAME_STDOUT, &lock};
+            FrameForwarder err_forwarder = {err_pipe[0], client, DAEMON_FRAME_STDERR, &lock};
+            pthread_t out_thread, err_thread;
+
+            dup2(out_pipe[1], STDOUT_FILENO);
+            dup2(err_pipe[1], STDERR_FILENO);
+            close(out_pipe[1]);
+            close(err_pipe[1]);
+
+            pthread_create(&out_thread, NULL, forward_output, &out_forwarder);
+            pthread_create(&err_thread, NULL, forward_output, &err_forwarder);
+
+            // The worker must not hand the build back to the daemon
+            char **argv = calloc((size_t)request->argc + 2, sizeof(char *));
+            int argc = 0;
+            if (argv) {
+                for (int i = 0; i < request->argc; i++) {
+                    argv[argc++] = request->argv[i];
+                }
+                argv[argc++] = "--no-daemon";
+                code = command_build_with_config(argc, argv, project->config);
+                free(argv);
+            }
+
+            fflush(stdout);
+            fflush(stderr);
+            int devnull = open("/dev/null", O_WRONLY);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            close(devnull);
+
+            pthread_join(out_thread, NULL);
+            pthread_join(err_thread, NULL);
+            close(out_pipe[0]);
+            close(err_pipe[0]);
+        }
+    }
+
+    unsigned char exit_code[4] = {
+        (unsigned char)((unsigned)code >> 24), (unsigned char)((unsigned)code >> 16),
+        (unsigned char)((unsigned)code >> 8), (unsigned char)code
+    };
+    daemon_send_frame(client, DAEMON_FRAME_EXIT, exit_code, sizeof(exit_code));
+    close(client);
+    _exit(0);
+}
+
+static void start_request(DaemonState *state, DaemonProject *project, DaemonRequest *request, int listen_fd) {
+    refresh_project_config(project);
+    // Only in-process builds use the library; the others run pawncc
+    if (has_argument(request->argv, request->argc, "--in-process")) {
+        warm_compiler(state, project_compiler_version(project, request->argv, request->argc));
+    }
+    warm_includes(project);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        const char *message = "Compile daemon: failed to start worker\n";
+        daemon_send_frame(request->fd, DAEMON_FRAME_STDERR, message, (uint32_t)strlen(message));
+        free_request(request);
+        return;
+    }
+
+    if (pid == 0) {
+        close(listen_fd);
+        close(signal_pipe[0]);
+        close(signal_pipe[1]);
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        for (int i = 0; i < state->connection_count; i++) {
+            close(state->connections[i].fd);
+        }
+        run_worker(request, project);
+    }
+
+    state->running++;
+    state->served++;
+    project->served++;
+    free_request(request);
+}
+
+/**
+ * Start queued builds while worker slots are free, taking one request per
+ * project in turn so one busy project cannot starve the others
+ */
+static void schedule(DaemonState *state, int listen_fd) {
+    while (state->running < state->max_running) {
+        DaemonProject *project = NULL;
+        for (int i = 0; i < state->project_count; i++) {
+            int index = (state->next_project + i) % state->project_count;
+            if (state->projects[index].head) {
+                project = &state->projects[index];
+                state->next_project = (index + 1) % state->project_count;
+                break;
+            }
+        }
+        if (!project) {
+            return;
+        }
+
+        DaemonRequest *request = project->head;
+        project->head = request->next;
+        if (!project->head) {
+            project->tail = NULL;
+        }
+        request->next = NULL;
+
+        start_request(state, project, request, listen_fd);
+    }
+}
+
+static void send_status(DaemonState *state, int fd) {
+    char report[4096];
+    int queued = 0;
+    for (int i = 0; i < state->project_count; i++) {
+        for (DaemonRequest *r = state->projects[i].head; r; r = r->next) {
+            queued++;
+        }
+    }
+
+    int len = snprintf(report, sizeof(report),
+                       "Compile daemon running (pid %ld)\n"
+                       "  Uptime:    %lds\n"
+                       "  Builds:    %lu served, %d running, %d queued\n"
+                       "  Workers:   %d\n"
+                       "  Projects:  %d\n"
+                       "  Compilers:",
+                       (long)getpid(), (long)(time(NULL) - state->started),
+                       state->served, state->running, queued, state->max_running,
+                       state->project_count);
+    for (int i = 0; i < state->loaded_version_count && len < (int)sizeof(report); i++) {
+        len += snprintf(report + len, sizeof(report) - len, " %s", state->loaded_versions[i]);
+    }
+    if (len < (int)sizeof(report)) {
+        len += snprintf(report + len, sizeof(report) - len, "%s\n",
+                        state->loaded_version_count == 0 ? " none" : "");
+    }
+    if (len > (int)sizeof(report) - 1) {
+        len = (int)sizeof(report) - 1;
+    }
+
+    daemon_send_frame(fd, DAEMON_FRAME_STDOUT, report, (uint32_t)len);
+    unsigned char ok[4] = {0, 0, 0, 0};
+    daemon_send_frame(fd, DAEMON_FRAME_EXIT, ok, sizeof(ok));
+}
+
+/**
+ * Act on the request frame of a client. Takes ownership of fd and payload
+ */
+static void handle_frame(DaemonState *state, int fd, char type, char *payload, uint32_t length) {
+    if (type == DAEMON_FRAME_STATUS) {
+        send_status(state, fd);
+        close(fd);
+        free(payload);
+        return;
+    }
+
+    if (type == DAEMON_FRAME_STOP) {
+        unsigned char ok[4] = {0, 0, 0, 0};
+        daemon_send_frame(fd, DAEMON_FRAME_EXIT, ok, sizeof(ok));
+        close(fd);
+        free(payload);
+        state->stopping = true;
+        return;
+    }
+
+    if (type != DAEMON_FRAME_BUILD || length == 0 || payload[length - 1] != '\0') {
+        close(fd);
+        free(payload);
+        return;
+    }
+
+    // payload: cwd\0argc\0arg\0...arg\0env\0env\0...
+    int count = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        if (payload[i] == '\0') count++;
+    }
+    const char *argc_text = count >= 2 ? payload + strlen(payload) + 1 : "";
+    char *end;
+    long argc = strtol(argc_text, &end, 10);
+    if (count < 2 || *end != '\0' || end == argc_text || argc < 0 || argc > count - 2) {
+        close(fd);
+        free(payload);
+        return;
+    }
+
+    DaemonRequest *request = calloc(1, sizeof(DaemonRequest));
+    if (!request) {
+        close(fd);
+        free(payload);
+        return;
+    }
+    request->fd = fd;
+
+    // One allocation holds the argv and envp arrays followed by the strings
+    request->argv = malloc(sizeof(char *) * (size_t)count + length);
+    if (!request->argv) {
+        free_request(request);
+        free(payload);
+        return;
+    }
+    char *strings = (char *)(request->argv + count);
+    memcpy(strings, payload, length);
+    free(payload);
+
+    const char *cwd = strings;
+    char *p = strings + strlen(strings) + 1;
+    p += strlen(p) + 1;
+    for (long i = 0; i < argc; i++) {
+        request->argv[request->argc++] = p;
+        p += strlen(p) + 1;
+    }
+    // argv[argc] and envp share the NULL between them
+    request->argv[request->argc] = NULL;
+    request->envp = request->argv + request->argc + 1;
+    int env_count = 0;
+    while (p < strings + length) {
+        request->envp[env_count++] = p;
+        p += strlen(p) + 1;
+    }
+    request->envp[env_count] = NULL;
+
+    DaemonProject *project = find_project(state, cwd);
+    if (!project) {
+        free_request(request);
+        return;
+    }
+
+    if (project->tail) {
+        project->tail->next = request;
+    } else {
+        project->head = request;
+    }
+    project->tail = request;
+}
+
+static void add_connection(DaemonState *state, int fd) {
+    if (state->connection_count >= state->connection_capacity) {
+        int new_capacity = state->connection_capacity > 0 ? state->connection_capacity * 2 : 8;
+        DaemonConnection *connections = realloc(state->connections, sizeof(DaemonConnection) * new_capacity);
+        if (!connections) {
+            close(fd);
+            return;
+        }
+        state->connections = connections;
+        state->connection_capacity = new_capacity;
+    }
+
+    DaemonConnection *connection = &state->connections[state->connection_count++];
+    memset(connection, 0, sizeof(*connection));
+    connection->fd = fd;
+    connection->deadline = time(NULL) + DAEMON_REQUEST_TIMEOUT_SEC;
+}
+
+static void remove_connection(DaemonState *state, int index, bool close_fd) {
+    DaemonConnection *connection = &state->connections[index];
+    if (close_fd) {
+        close(connection->fd);
+        free(connection->payload);
+    }
+    state->connections[index] = state->connections[--state->connection_count];
+}
+
+/**
+ * Read whatever a client has sent so far
+ *
+ * @return 1 once the whole frame is in, 0 if more is to come, -1 if the
+ *         client went away or sent something invalid
+ */
+static int read_connection(DaemonConnection *connection) {
+    for (;;) {
+        void *target;
+        size_t wanted;
+        if (connection->header_received < sizeof(connection->header)) {
+            target = connection->header + connection->header_received;
+            wanted = sizeof(connection->header) - connection->header_received;
+        } else {
+            if (!connection->payload) {
+                const unsigned char *header = connection->header;
+                connection->length = ((uint32_t)header[1] << 24) | ((uint32_t)header[2] << 16) |
+                                     ((uint32_t)header[3] << 8) | (uint32_t)header[4];
+                if (connection->length > DAEMON_MAX_FRAME ||
+                    !(connection->payload = malloc(connection->length + 1))) {
+                    return -1;
+                }
+            }
+            if (connection->received == connection->length) {
+                connection->payload[connection->length] = '\0';
+                return 1;
+            }
+            target = connection->payload + connection->received;
+            wanted = connection->length - connection->received;
+        }
+
+        ssize_t n = recv(connection->fd, target, wanted, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+
+        if (connection->header_received < sizeof(connection->header)) {
+            connection->header_received += (uint32_t)n;
+        } else {
+            connection->received += (uint32_t)n;
+        }
+    }
+}
+
+static void reap_workers(DaemonState *state) {
+    int status;
+    while (waitpid(-1, &status, WNOHANG) > 0) {
+        if (state->running > 0) {
+            state->running--;
+        }
+    }
+}
+
+static int open_listen_socket(void) {
+    const char *socket_path = daemon_get_socket_path();
+    struct sockaddr_un addr;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    // Nobody answered on the socket, so whatever is there is stale
+    unlink(socket_path);
+
+    mode_t old_umask = umask(077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+
+    if (bound != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int serve(int listen_fd, int max_running) {
+    DaemonState state;
+    memset(&state, 0, sizeof(state));
+    state.max_running = max_running;
+    state.started = time(NULL);
+
+    if (pipe(signal_pipe) != 0) {
+        fprintf(stderr, "Failed to create signal pipe\n");
+        return EXIT_FAILURE;
+    }
+    fcntl(signal_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Pay the one-off start-up costs here rather than in every build
+    init_compiler_dir();
+
+    struct pollfd *fds = NULL;
+    int fd_capacity = 0;
+
+    while (!state.stopping && !stop_requested) {
+        int fd_count = 2 + state.connection_count;
+        if (fd_count > fd_capacity) {
+            struct pollfd *grown = realloc(fds, sizeof(struct pollfd) * fd_count);
+            if (!grown) break;
+            fds = grown;
+            fd_capacity = fd_count;
+        }
+
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = signal_pipe[0];
+        fds[1].events = POLLIN;
+
+        // Wake up in time to drop the first client that stops sending
+        time_t now = time(NULL);
+        int timeout_ms = -1;
+        for (int i = 0; i < state.connection_count; i++) {
+            fds[2 + i].fd = state.connections[i].fd;
+            fds[2 + i].events = POLLIN;
+            fds[2 + i].revents = 0;
+            int remaining = state.connections[i].deadline > now ?
+                (int)(state.connections[i].deadline - now) * 1000 : 0;
+            if (timeout_ms < 0 || remaining < timeout_ms) {
+                timeout_ms = remaining;
+            }
+        }
+
+        if (poll(fds, (nfds_t)fd_count, timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(signal_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+            reap_workers(&state);
+        }
+
+        // Walk backwards: removing a connection moves the last one into its
+        // slot, and that one has been handled already
+        now = time(NULL);
+        for (int i = fd_count - 3; i >= 0; i--) {
+            DaemonConnection *connection = &state.connections[i];
+            int status = 0;
+            if (fds[2 + i].revents) {
+                status = read_connection(connection);
+            }
+            if (status == 0 && now >= connection->deadline) {
+                status = -1;
+            }
+
+            if (status < 0) {
+                remove_connection(&state, i, true);
+            } else if (status > 0) {
+                int fd = connection->fd;
+                char type = (char)connection->header[0];
+                char *payload = connection->payload;
+                uint32_t length = connection->length;
+                remove_connection(&state, i, false);
+
+                // Replies are written in one go
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+                handle_frame(&state, fd, type, payload, length);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client >= 0) {
+                fcntl(client, F_SETFD, FD_CLOEXEC);
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                add_connection(&state, client);
+            }
+        }
+
+        schedule(&state, listen_fd);
+    }
+
+    free(fds);
+    close(listen_fd);
+    unlink(daemon_get_socket_path());
+
+    while (state.connection_count > 0) {
+        remove_connection(&state, state.connection_count - 1, true);
+    }
+    free(state.connections);
+
+    // Let running builds finish; drop the queued ones
+    for (int i = 0; i < state.project_count; i++) {
+        DaemonRequest *request = state.projects[i].head;
+        while (request) {
+            DaemonRequest *next = request->next;
+            free_request(request);
+            request = next;
+        }
+        free(state.projects[i].cwd);
+        free_index_dirs(&state.projects[i]);
+        project_config_free(state.projects[i].config);
+    }
+    free(state.projects);
+
+    while (state.running > 0 && waitpid(-1, NULL, 0) > 0) {
+        state.running--;
+    }
+
+    pawnc_library_unload();
+    return EXIT_SUCCESS;
+}
+
+static int send_simple_request(char type) {
+    int fd = daemon_connect();
+    if (fd < 0) {
+        printf("Compile daemon is not running\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!daemon_send_frame(fd, type, NULL, 0)) {
+        close(fd);
+        fprintf(stderr, "Failed to contact the compile daemon\n");
+        return EXIT_FAILURE;
+    }
+
+    int code = EXIT_FAILURE;
+    char frame_type;
+    char *payload;
+    uint32_t length;
+    while (daemon_recv_frame(fd, &frame_type, &payload, &length)) {
+        if (frame_type == DAEMON_FRAME_STDOUT) {
+            fwrite(payload, 1, length, stdout);
+        } else if (frame_type == DAEMON_FRAME_EXIT) {
+            code = EXIT_SUCCESS;
+            free(payload);
+            break;
+        }
+        free(payload);
+    }
+
+    close(fd);
+    return code;
+}
+
+static int start_daemon(bool foreground, int max_running) {
+    char opencli_dir[512];
+    snprintf(opencli_dir, sizeof(opencli_dir), "%s/opencli", get_appdata_path());
+    if (!ensure_directory_exists(opencli_dir)) {
+        fprintf(stderr, "Failed to create %s\n", opencli_dir);
+        return EXIT_FAILURE;
+    }
+
+    int existing = daemon_connect();
+    if (existing >= 0) {
+        close(existing);
+        printf("Compile daemon is already running\n");
+        return EXIT_SUCCESS;
+    }
+
+    int listen_fd = open_listen_socket();
+    if (listen_fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (!foreground) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Failed to start the compile daemon\n");
+            close(listen_fd);
+            return EXIT_FAILURE;
+        }
+        if (pid > 0) {
+            printf("Compile daemon started (pid %ld, %d workers)\n", (long)pid, max_running);
+            printf("Listening on %s\n", daemon_get_socket_path());
+            close(listen_fd);
+            return EXIT_SUCCESS;
+        }
+
+        setsid();
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+            if (devnull > STDERR_FILENO) close(devnull);
+        }
+    } else {
+        printf("Compile daemon listening on %s (%d workers)\n", daemon_get_socket_path(), max_running);
+        fflush(stdout);
+    }
+
+    int code = serve(listen_fd, max_running);
+    if (!foreground) {
+        _exit(code);
+    }
+    return code;
+}
+
+#endif
+
+int command_daemon(int argc, char *argv[]) {
+    const char *action = NULL;
+    bool foreground = false;
+    int max_running = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            print_daemon_usage();
+            return EXIT_SUCCESS;
+        } else if (strcmp(argv[i], "--foreground") == 0) {
+            foreground = true;
+        } else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) {
+            max_running = atoi(argv[++i]);
+            if (max_running < 1) {
+                fprintf(stderr, "Error: Invalid job count: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_daemon_usage();
+            return EXIT_FAILURE;
+        } else if (!action) {
+            action = argv[i];
+        }
+    }
+
+    if (!action) {
+        print_daemon_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!daemon_supported()) {
+        fprintf(stderr, "The compile daemon is not supported on this platform\n");
+        return EXIT_FAILURE;
+    }
+
+#ifdef _WIN32
+    (void)foreground;
+    (void)max_running;
+    return EXIT_FAILURE;
+#else
+    if (strcmp(action, "start") == 0) {
+        return start_daemon(foreground, max_running > 0 ? max_running : get_cpu_count());
+    } else if (strcmp(action, "stop") == 0) {
+        int code = send_simple_request(DAEMON_FRAME_STOP);
+        if (code == EXIT_SUCCESS) {
+            printf("Compile daemon stopped\n");
+        }
+        return code;
+    } else if (strcmp(action, "status") == 0) {
+        return send_simple_request(DAEMON_FRAME_STATUS);
+    }
+
+    fprintf(stderr, "Unknown daemon action: %s\n", action);
+    print_daemon_usage();
+    return EXIT_FAILURE;
+#endif
+}
@@ -10,90 +10,118 @@ static void print_install_usage(void) {
     printf("Usage: opencli install <resource> [options]\n");
     printf("\n");
     printf("Resources:\n");
-    printf("  compiler       Download and install Pawn compiler\n");
+    printf("  compiler [ver...]  Download and install Pawn compilers\n");
     printf("\n");
     printf("Options:\n");
-    printf("  --version <ver>    Specify version to install (default: %s)\n", DEFAULT_COMPILER_VERSION);
+    printf("  --version <ver>    Specify version to install (default: %s); may be repeated\n", DEFAULT_COMPILER_VERSION);
     printf("  --help             Show this help message\n");
 }
 
+// Add a version, with a 'v' prefix, unless it is already listed
+static bool add_version(char (*versions)[32], int *count, const char *version) {
+    char normalized[32];
+    int length = snprintf(normalized, sizeof(normalized), "%s%s", version[0] == 'v' ? "" : "v", version);
+    if (length < 2 || length >= (int)sizeof(normalized)) {
+        fprintf(stderr, "Invalid compiler version: %s\n", version);
+        return false;
+    }
+    
+    for (int i = 0; i < *count; i++) {
+        if (strcmp(versions[i], normalized) == 0) {
+            return true;
+        }
+    }
+    memcpy(versions[(*count)++], normalized, (size_t)length + 1);
+    return true;
+}
+
 static int handle_install_compiler(int argc, char *argv[]) {
-    char compiler_version[32] = DEFAULT_COMPILER_VERSION;
-    bool version_specified = false;
+    // Every argument is at most one version
+    char (*versions)[32] = calloc((size_t)argc + 1, sizeof(*versions));
+    if (!versions) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    int version_count = 0;
     
-    // Parse options
+    // Parse options; positional arguments are versions
     for (int i = 0; i < argc; i++) {
+        bool ok = true;
         if (strcmp(argv[i], "--help") == 0) {
             print_install_usage();
+            free(versions);
             return EXIT_SUCCESS;
         } else if (strcmp(argv[i], "--version") == 0 && i + 1 < argc) {
-            #ifdef _WIN32
-            strcpy_s(compiler_version, sizeof(compiler_version), argv[++i]);
-            #else
-            strcpy(compiler_version, argv[++i]);
-            #endif
-            version_specified = true;
-            
-            // Ensure version starts with 'v'
-            if (compiler_version[0] != 'v') {
-                char temp[32];
-                #ifdef _WIN32
-                strcpy_s(temp, sizeof(temp), compiler_version);
-                sprintf_s(compiler_version, sizeof(compiler_version), "v%s", temp);
-                #else
-                strcpy(temp, compiler_version);
-                sprintf(compiler_version, "v%s", temp);
-                #endif
-            }
+            ok = add_version(versions, &version_count, argv[++i]);
         } else if (argv[i][0] == '-') {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             print_install_usage();
+            ok = false;
+        } else {
+            ok = add_version(versions, &version_count, argv[i]);
+        }
+        if (!ok) {
+            free(versions);
             return EXIT_FAILURE;
-        } else if (!version_specified) {
-            // First positional argument is treated as version
-            #ifdef _WIN32
-            strcpy_s(compiler_version, sizeof(compiler_version), argv[i]);
-            #else
-            strcpy(compiler_version, argv[i]);
-            #endif
-            version_specified = true;
-            
-            // Ensure version starts with 'v'
-            if (compiler_version[0] != 'v') {
-                char temp[32];
-                #ifdef _WIN32
-                strcpy_s(temp, sizeof(temp), compiler_version);
-                sprintf_s(compiler_version, sizeof(compiler_version), "v%s", temp);
-                #else
-                strcpy(temp, compiler_version);
-                sprintf(compiler_version, "v%s", temp);
-                #endif
-            }
         }
     }
     
-    printf("Installing Pawn compiler version %s\n", compiler_version);
+    if (version_count == 0) {
+        add_version(versions, &version_count, DEFAULT_COMPILER_VERSION);
+    }
     
     // Initialize compiler directory
     if (!init_compiler_dir()) {
         fprintf(stderr, "Failed to initialize compiler directory\n");
+        free(versions);
         return EXIT_FAILURE;
     }
     
-    // Check if compiler is already installed
-    if (is_compiler_installed(compiler_version)) {
-        printf("Compiler version %s is already installed\n", compiler_version);
-        return EXIT_SUCCESS;
+    // Only versions that are missing are downloaded
+    const char **pending = calloc((size_t)version_count, sizeof(char *));
+    bool *installed = calloc((size_t)version_count, sizeof(bool));
+    if (!pending || !installed) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(pending);
+        free(installed);
+        free(versions);
+        return EXIT_FAILURE;
     }
     
-    // Install compiler
-    if (!install_compiler(compiler_version)) {
-        fprintf(stderr, "Failed to install compiler version %s\n", compiler_version);
-        return EXIT_FAILURE;
+    int pending_count = 0;
+    for (int i = 0; i < version_count; i++) {
+        if (is_compiler_installed(versions[i])) {
+            printf("Compiler version %s is already installed\n", versions[i]);
+        } else {
+            pending[pending_count++] = versions[i];
+        }
+    }
+    
+    int failed = 0;
+    if (pending_count > 0) {
+        if (pending_count == 1) {
+            printf("Installing Pawn compiler version %s\n", pending[0]);
+        } else {
+            printf("Installing %d Pawn compiler versions\n", pending_count);
+        }
+        fflush(stdout);
+        
+        install_compilers(pending, pending_count, installed);
+        
+        for (int i = 0; i < pending_count; i++) {
+            if (installed[i]) {
+                printf("Compiler version %s installed successfully\n", pending[i]);
+            } else {
+                fprintf(stderr, "Failed to install compiler version %s\n", pending[i]);
+                failed++;
+            }
+        }
     }
     
-    printf("Compiler version %s installed successfully\n", compiler_version);
-    return EXIT_SUCCESS;
+    free(pending);
+    free(installed);
+    free(versions);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int command_install(int argc, char *argv[]) {
@@ -20,6 +20,8 @@ void print_usage(void) {
     printf("Compile Pawn scripts\n");
     print_colored(COLOR_GREEN, "  install     ");
     printf("Install resources (compiler, etc.)\n");
+    print_colored(COLOR_GREEN, "  daemon      ");
+    printf("Start or stop the background compile server\n");
     printf("\n");
     print_info("For more information: ");
     print_colored(COLOR_CYAN, "opencli <command> --help\n");
@@ -44,6 +46,8 @@ int main(int argc, char *argv[]) {
         return command_build(argc - 2, &argv[2]);
     } else if (strcmp(command, "install") == 0) {
         return command_install(argc - 2, &argv[2]);
+    } else if (strcmp(command, "daemon") == 0) {
+        return command_daemon(argc - 2, &argv[2]);
     } else if (strcmp(command, "--help") == 0 || strcmp(command, "-h") == 0) {
         print_usage();
         return EXIT_SUCCESS;
@@ -0,0 +1,1332 @@
+#include "archive_stream.h"
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "process_utils.h"
+
+#define TAR_BLOCK_SIZE 512
+#define INFLATE_CHUNK (64 * 1024)
+// Longest GNU long name or pax header accepted
+#define MAX_TAR_META (64 * 1024)
+// Longest name an ArchiveEntryMap may produce
+#define ARCHIVE_MAX_NAME 1024
+
+#define ZIP_LOCAL_SIGNATURE 0x04034b50u
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50u
+#define ZIP_END_SIGNATURE 0x06054b50u
+#define ZIP64_END_SIGNATURE 0x06064b50u
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50u
+#define ZIP_DESCRIPTOR_SIGNATURE 0x08074b50u
+
+typedef enum {
+    // .tar.gz, after the gzip layer
+    TAR_HEADER,
+    TAR_DATA,
+    TAR_PADDING,
+    TAR_END,
+    // .zip
+    ZIP_SIGNATURE,
+    ZIP_LOCAL_HEADER,
+    ZIP_LOCAL_NAME,
+    ZIP_STORED,
+    ZIP_DEFLATED,
+    ZIP_DESCRIPTOR,
+    ZIP_CENTRAL_HEADER,
+    ZIP_CENTRAL_NAME,
+    ZIP64_END_SIZE,
+    ZIP_SKIP,
+    ZIP_END
+} StreamState;
+
+// What the data of the current tar entry is for
+typedef enum {
+    TAR_ENTRY_FILE,
+    TAR_ENTRY_LONG_NAME,    // GNU 'L'
+    TAR_ENTRY_PAX,          // pax 'x'
+    TAR_ENTRY_SKIP
+} TarEntryKind;
+
+struct ArchiveStream {
+    ArchiveFormat format;
+    char *dest_dir;
+    ArchiveEntryMap map;
+    void *map_data;
+    StreamState state;
+    bool failed;
+    uint64_t file_count;
+
+    // Fixed-size headers are gathered here across writes
+    unsigned char *buffer;
+    size_t buffered;
+    size_t needed;
+    size_t capacity;
+
+    // The gzip layer of a .tar.gz, or the deflate data of a zip entry
+    z_stream inflater;
+    bool inflater_ready;
+    bool gzip_ended;
+    unsigned char *chunk;
+
+    // The entry being extracted
+    FILE *out;
+    char *out_path;
+    unsigned int mode;
+    uint64_t remaining;
+    uint64_t entry_size;
+
+    // tar
+    TarEntryKind tar_kind;
+    char *meta;             // long name or pax records being read
+    size_t meta_length;
+    char *long_name;        // name for the next entry
+    int zero_blocks;
+
+    // zip
+    uint16_t zip_flags;
+    uint16_t zip_method;
+    uint32_t zip_crc;       // from the local header
+    uint32_t crc;           // of the data written
+    bool zip64;
+    uint16_t name_length;
+    uint32_t skip_after_name;
+    uint16_t made_by;
+    uint32_t external_attributes;
+};
+
+static bool archive_error(const char *message, const char *name) {
+    if (name) {
+        fprintf(stderr, "Archive error: %s: %s\n", message, name);
+    } else {
+        fprintf(stderr, "Archive error: %s\n", message);
+    }
+    return false;
+}
+
+static bool stream_error(ArchiveStream *stream, const char *message, const char *name) {
+    stream->failed = true;
+    return archive_error(message, name);
+}
+
+static uint16_t read_le16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const unsigned char *p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+// Gather the next `needed` bytes of a header into stream->buffer
+static bool expect(ArchiveStream *stream, size_t needed) {
+    if (needed > stream->capacity) {
+        unsigned char *buffer = realloc(stream->buffer, needed);
+        if (!buffer) {
+            return stream_error(stream, "out of memory", NULL);
+        }
+        stream->buffer = buffer;
+        stream->capacity = needed;
+    }
+    stream->buffered = 0;
+    stream->needed = needed;
+    return true;
+}
+
+/**
+ * Move input into the header buffer
+ *
+ * @return true once the whole header is there
+ */
+static bool gather(ArchiveStream *stream, const unsigned char **data, size_t *length) {
+    size_t take = stream->needed - stream->buffered;
+    if (take > *length) {
+        take = *length;
+    }
+    memcpy(stream->buffer + stream->buffered, *data, take);
+    stream->buffered += take;
+    *data += take;
+    *length -= take;
+    return stream->buffered == stream->needed;
+}
+
+// name without leading "./"
+static const char *strip_dot_slash(const char *name) {
+    while (name[0] == '.' && name[1] == '/') {
+        name += 2;
+    }
+    return name;
+}
+
+/**
+ * The name an entry is extracted under: itself, or what map makes of it
+ * (in mapped). NULL if map leaves it out
+ */
+static const char *mapped_name(ArchiveEntryMap map, void *map_data, const char *name, char *mapped, size_t mapped_size) {
+    if (!map) {
+        return name;
+    }
+    return map(strip_dot_slash(name), mapped, mapped_size, map_data) ? mapped : NULL;
+}
+
+/**
+ * dest_dir/name, or NULL if name is absolute or climbs out with "..".
+ * "." and "./" stand for dest_dir itself
+ */
+static char *entry_path(const char *dest_dir, const char *name) {
+    name = strip_dot_slash(name);
+    if (strcmp(name, ".") == 0) {
+        name = "";
+    }
+    if (name[0] == '/' || name[0] == '\\' || strchr(name, ':')) {
+        return NULL;
+    }
+
+    const char *component = name;
+    for (;;) {
+        size_t length = strcspn(component, "/\\");
+        if (length == 2 && component[0] == '.' && component[1] == '.') {
+            return NULL;
+        }
+        if (component[length] == '\0') break;
+        component += length + 1;
+    }
+
+    size_t dir_len = strlen(dest_dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (path) {
+        memcpy(path, dest_dir, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+    }
+    return path;
+}
+
+// Create every directory leading up to path
+static bool make_parent_directories(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *p = '/';
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Start writing an entry. Directories are created on the spot; a name
+ * ending in '/' is one. With a map, only the files it names are written
+ * and directories come from their paths
+ */
+static bool open_entry(ArchiveStream *stream, const char *name, unsigned int mode, bool directory) {
+    size_t name_length = strlen(name);
+    directory = directory || (name_length > 0 && name[name_length - 1] == '/');
+    if (stream->map && directory) {
+        return true;
+    }
+
+    char mapped[ARCHIVE_MAX_NAME];
+    const char *target = mapped_name(stream->map, stream->map_data, name, mapped, sizeof(mapped));
+    if (!target) {
+        // Read through without writing
+        return true;
+    }
+
+    char *path = entry_path(stream->dest_dir, target);
+    if (!path) {
+        return stream_error(stream, "entry outside the destination", name);
+    }
+
+    if (!make_parent_directories(path)) {
+        free(path);
+        return stream_error(stream, "cannot create the directory of", name);
+    }
+
+    if (directory) {
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        free(path);
+        return ok || stream_error(stream, "cannot create directory", name);
+    }
+
+    // Replace rather than write through whatever is there, such as a symlink
+    unlink(path);
+    stream->out = fopen(path, "wb");
+    if (!stream->out) {
+        free(path);
+        return stream_error(stream, "cannot create", name);
+    }
+    stream->out_path = path;
+    stream->mode = mode;
+    stream->file_count++;
+    return true;
+}
+
+static bool write_entry(ArchiveStream *stream, const void *data, size_t length) {
+    if (stream->out && fwrite(data, 1, length, stream->out) != length) {
+        return stream_error(stream, "cannot write", stream->out_path);
+    }
+    return true;
+}
+
+static bool close_entry(ArchiveStream *stream) {
+    bool ok = true;
+    if (stream->out) {
+        ok = fclose(stream->out) == 0;
+        stream->out = NULL;
+        if (ok && stream->mode) {
+            chmod(stream->out_path, stream->mode & 0777);
+        }
+    }
+    if (!ok) {
+        stream_error(stream, "cannot write", stream->out_path);
+    }
+    free(stream->out_path);
+    stream->out_path = NULL;
+    return ok;
+}
+
+// Whether a symlink target stays inside the destination
+static bool safe_link_target(const char *target) {
+    return target[0] != '\0' && target[0] != '/' && !strstr(target, "..");
+}
+
+/*
+ * tar
+ */
+
+// Parse an octal tar field, or the base-256 form GNU tar uses for large values
+static uint64_t tar_number(const unsigned char *field, size_t size) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7f;
+        for (size_t i = 1; i < size; i++) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    for (size_t i = 0; i < size && field[i]; i++) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            value = value * 8 + (uint64_t)(field[i] - '0');
+        } else if (field[i] != ' ') {
+            break;
+        }
+    }
+    return value;
+}
+
+static bool tar_checksum_ok(const unsigned char *header) {
+    uint64_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    }
+    return sum == tar_number(header + 148, 8);
+}
+
+// Find the path record of pax extended header records ("<len> path=<value>\n")
+static char *pax_path(const char *records, size_t length) {
+    size_t offset = 0;
+    while (offset < length) {
+        char *end;
+        unsigned long record_len = strtoul(records + offset, &end, 10);
+        if (record_len == 0 || offset + record_len > length || *end != ' ') {
+            break;
+        }
+        const char *key = end + 1;
+        const char *record_end = records + offset + record_len - 1;    // the '\n'
+        if ((size_t)(record_end - key) > 5 && strncmp(key, "path=", 5) == 0) {
+            size_t value_len = (size_t)(record_end - key - 5);
+            char *path = malloc(value_len + 1);
+            if (path) {
+                memcpy(path, key + 5, value_len);
+                path[value_len] = '\0';
+            }
+            return path;
+        }
+        offset += record_len;
+    }
+    return NULL;
+}
+
+static bool tar_begin_entry(ArchiveStream *stream) {
+    const unsigned char *header = stream->buffer;
+
+    bool zero = true;
+    for (int i = 0; i < TAR_BLOCK_SIZE && zero; i++) {
+        zero = header[i] == 0;
+    }
+    if (zero) {
+        // Two zero blocks end the archive
+        stream->state = ++stream->zero_blocks == 2 ? TAR_END : TAR_HEADER;
+        return stream->state == TAR_END || expect(stream, TAR_BLOCK_SIZE);
+    }
+    stream->zero_blocks = 0;
+
+    if (!tar_checksum_ok(header)) {
+        return stream_error(stream, "bad tar header checksum", NULL);
+    }
+
+    char name[256 + 1 + 100 + 1];
+    if (stream->long_name) {
+        snprintf(name, sizeof(name), "%s", stream->long_name);
+    } else if (memcmp(header + 257, "ustar", 5) == 0 && header[345]) {
+        snprintf(name, sizeof(name), "%.155s/%.100s", (const char *)header + 345, (const char *)header);
+    } else {
+        snprintf(name, sizeof(name), "%.100s", (const char *)header);
+    }
+    bool long_name = stream->long_name != NULL;
+    free(stream->long_name);
+    stream->long_name = NULL;
+    if (long_name && strlen(name) == sizeof(name) - 1) {
+        return stream_error(stream, "name too long", name);
+    }
+
+    unsigned int mode = (unsigned int)tar_number(header + 100, 8);
+    uint64_t size = tar_number(header + 124, 12);
+    char type = (char)header[156];
+
+    stream->remaining = size;
+    stream->entry_size = size;
+    stream->tar_kind = TAR_ENTRY_SKIP;
+    switch (type) {
+    case '0':
+    case '\0':
+    case '7':
+        stream->tar_kind = TAR_ENTRY_FILE;
+        if (!open_entry(stream, name, mode, false)) return false;
+        break;
+    case '5':
+        stream->remaining = 0;
+        stream->entry_size = 0;
+        if (!open_entry(stream, name, mode, true)) return false;
+        break;
+    case '2': {
+        // Only links that stay inside the destination. A map moves files
+        // away from where a link would point, so links are left out
+        stream->remaining = 0;
+        stream->entry_size = 0;
+        if (stream->map) {
+            break;
+        }
+        char target[101];
+        snprintf(target, sizeof(target), "%.100s", (const char *)header + 157);
+        char *path = entry_path(stream->dest_dir, name);
+        if (!path || !safe_link_target(target)) {
+            free(path);
+            return stream_error(stream, "symlink outside the destination", name);
+        }
+        make_parent_directories(path);
+        unlink(path);
+        bool ok = symlink(target, path) == 0;
+        free(path);
+        if (!ok) {
+            return stream_error(stream, "cannot create symlink", name);
+        }
+        break;
+    }
+    case 'L':
+    case 'x':
+        if (size > MAX_TAR_META) {
+            return stream_error(stream, "tar extended header too long", NULL);
+        }
+        stream->tar_kind = type == 'L' ? TAR_ENTRY_LONG_NAME : TAR_ENTRY_PAX;
+        free(stream->meta);
+        stream->meta = malloc((size_t)size + 1);
+        stream->meta_length = 0;
+        if (!stream->meta) {
+            return stream_error(stream, "out of memory", NULL);
+        }
+        break;
+    default:
+        // Hard links, devices, global pax headers and the like carry
+        // nothing a toolchain needs
+        break;
+    }
+
+    stream->state = TAR_DATA;
+    return true;
+}
+
+static bool tar_end_entry(ArchiveStream *stream) {
+    if (stream->tar_kind == TAR_ENTRY_FILE && !close_entry(stream)) {
+        return false;
+    }
+    if (stream->tar_kind == TAR_ENTRY_LONG_NAME) {
+        stream->meta[stream->meta_length] = '\0';
+        stream->long_name = stream->meta;
+        stream->meta = NULL;
+    } else if (stream->tar_kind == TAR_ENTRY_PAX) {
+        stream->long_name = pax_path(stream->meta, stream->meta_length);
+        free(stream->meta);
+        stream->meta = NULL;
+    }
+
+    stream->remaining = (TAR_BLOCK_SIZE - stream->entry_size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    stream->state = TAR_PADDING;
+    return true;
+}
+
+// Consume decompressed tar bytes
+static bool tar_consume(ArchiveStream *stream, const unsigned char *data, size_t length) {
+    while (length > 0 || (stream->state == TAR_DATA && stream->remaining == 0) ||
+           (stream->state == TAR_PADDING && stream->remaining == 0)) {
+        switch (stream->state) {
+        case TAR_HEADER:
+            if (gather(stream, &data, &length) && !tar_begin_entry(stream)) {
+                return false;
+            }
+            break;
+        case TAR_DATA: {
+            size_t take = stream->remaining < length ? (size_t)stream->remaining : length;
+            if (stream->tar_kind == TAR_ENTRY_FILE) {
+                if (!write_entry(stream, data, take)) return false;
+            } else if (stream->tar_kind != TAR_ENTRY_SKIP) {
+                memcpy(stream->meta + stream->meta_length, data, take);
+                stream->meta_length += take;
+            }
+            data += take;
+            length -= take;
+            stream->remaining -= take;
+            if (stream->remaining == 0 && !tar_end_entry(stream)) {
+                return false;
+            }
+            break;
+        }
+        case TAR_PADDING: {
+            size_t take = stream->remaining < length ? (size_t)stream->remaining : length;
+            data += take;
+            length -= take;
+            stream->remaining -= take;
+            if (stream->remaining == 0) {
+                stream->state = TAR_HEADER;
+                if (!expect(stream, TAR_BLOCK_SIZE)) return false;
+            }
+            break;
+        }
+        case TAR_END:
+            // Anything after the end blocks is padding
+            return true;
+        default:
+            return stream_error(stream, "bad state", NULL);
+        }
+    }
+    return true;
+}
+
+// Consume .tar.gz bytes: gunzip them, possibly several gzip members, into the tar parser
+static bool gzip_consume(ArchiveStream *stream, const unsigned char *data, size_t length) {
+    z_stream *z = &stream->inflater;
+    z->next_in = (Bytef *)data;
+    z->avail_in = (uInt)length;
+
+    // Until the input is used up and zlib has no more output for us
+    do {
+        if (stream->gzip_ended) {
+            if (z->avail_in == 0 || stream->state == TAR_END) {
+                // Whatever follows the tar end blocks is padding
+                break;
+            }
+            // Another gzip member follows
+            if (inflateReset(z) != Z_OK) {
+                return stream_error(stream, "cannot restart gzip stream", NULL);
+            }
+            stream->gzip_ended = false;
+        }
+
+        z->next_out = stream->chunk;
+        z->avail_out = INFLATE_CHUNK;
+        int ret = inflate(z, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return stream_error(stream, z->msg ? z->msg : "bad gzip data", NULL);
+        }
+
+        size_t produced = INFLATE_CHUNK - z->avail_out;
+        if (produced > 0 && !tar_consume(stream, stream->chunk, produced)) {
+            return false;
+        }
+        if (ret == Z_STREAM_END) {
+            stream->gzip_ended = true;
+        } else if (ret == Z_BUF_ERROR) {
+            break;
+        }
+    } while (z->avail_in > 0 || z->avail_out == 0);
+    return true;
+}
+
+/*
+ * zip
+ */
+
+static bool zip_begin_entry(ArchiveStream *stream) {
+    const unsigned char *header = stream->buffer;
+    const unsigned char *extra = header + stream->name_length;
+    uint16_t extra_length = (uint16_t)(stream->needed - stream->name_length);
+
+    char *name = malloc((size_t)stream->name_length + 1);
+    if (!name) {
+        return stream_error(stream, "out of memory", NULL);
+    }
+    memcpy(name, header, stream->name_length);
+    name[stream->name_length] = '\0';
+
+    // Zip64 sizes live in an extra field
+    uint64_t compressed = stream->remaining;
+    for (uint16_t offset = 0; offset + 4 <= extra_length;) {
+        uint16_t id = read_le16(extra + offset);
+        uint16_t size = read_le16(extra + offset + 2);
+        if (id == 0x0001 && size >= 16 && offset + 4 + size <= extra_length) {
+            compressed = read_le64(extra + offset + 12);
+            stream->zip64 = true;
+        }
+        offset += 4 + size;
+    }
+
+    bool directory = stream->name_length > 0 && name[stream->name_length - 1] == '/';
+    bool ok = open_entry(stream, name, 0, directory);
+    free(name);
+    if (!ok) {
+        return false;
+    }
+
+    stream->crc = crc32(0L, Z_NULL, 0);
+    if (!stream->out && !directory && !(stream->zip_flags & 0x08)) {
+        // A skipped entry of known size is passed over without inflating
+        stream->remaining = compressed;
+        stream->state = ZIP_STORED;
+    } else if (stream->zip_method == 0) {
+        if (stream->zip_flags & 0x08) {
+            // Only an empty directory can go without its size up front
+            if (!directory) {
+                return stream_error(stream, "stored entry without a size cannot be streamed", NULL);
+            }
+            compressed = 0;
+        }
+        stream->remaining = compressed;
+        stream->state = ZIP_STORED;
+    } else if (stream->zip_method == 8) {
+        if (inflateReset2(&stream->inflater, -MAX_WBITS) != Z_OK) {
+            return stream_error(stream, "cannot start inflating", NULL);
+        }
+        stream->state = ZIP_DEFLATED;
+    } else {
+        return stream_error(stream, "unsupported compression method", NULL);
+    }
+    return true;
+}
+
+static bool zip_end_entry(ArchiveStream *stream) {
+    if (stream->zip_flags & 0x08) {
+        // The CRC and sizes follow the data, with or without a signature
+        stream->state = ZIP_DESCRIPTOR;
+        return expect(stream, 4);
+    }
+    if (stream->out && stream->crc != stream->zip_crc) {
+        return stream_error(stream, "CRC mismatch", stream->out_path);
+    }
+    stream->state = ZIP_SIGNATURE;
+    return close_entry(stream) && expect(stream, 4);
+}
+
+/**
+ * Give a written file its Unix mode. A symlink was written as a file
+ * holding its target and is turned into a link, or removed under a map
+ */
+static bool apply_unix_mode(const char *path, const char *name, unsigned int mode, bool mapped) {
+    bool ok = true;
+    if (S_ISREG(mode)) {
+        chmod(path, mode & 0777);
+    } else if (mapped) {
+        unlink(path);
+    } else {
+        char target[1024];
+        FILE *fp = fopen(path, "rb");
+        size_t length = fp ? fread(target, 1, sizeof(target) - 1, fp) : 0;
+        if (fp) {
+            fclose(fp);
+        }
+        target[length] = '\0';
+        if (!safe_link_target(target)) {
+            ok = archive_error("symlink outside the destination", name);
+        } else if (unlink(path) != 0 || symlink(target, path) != 0) {
+            ok = archive_error("cannot create symlink", name);
+        }
+    }
+    return ok;
+}
+
+// Apply the mode of the central directory entry named in stream->buffer
+static bool zip_apply_mode(ArchiveStream *stream, unsigned int mode) {
+    char *name = malloc((size_t)stream->name_length + 1);
+    if (!name) {
+        return stream_error(stream, "out of memory", NULL);
+    }
+    memcpy(name, stream->buffer, stream->name_length);
+    name[stream->name_length] = '\0';
+
+    char mapped[ARCHIVE_MAX_NAME];
+    const char *target = mapped_name(stream->map, stream->map_data, name, mapped, sizeof(mapped));
+    char *path = target ? entry_path(stream->dest_dir, target) : NULL;
+    bool ok = !path || apply_unix_mode(path, name, mode, stream->map != NULL);
+    if (!ok) {
+        stream->failed = true;
+    }
+
+    free(path);
+    free(name);
+    return ok;
+}
+
+// Consume zip bytes
+static bool zip_consume(ArchiveStream *stream, const unsigned char *data, size_t length) {
+    while (length > 0 || ((stream->state == ZIP_STORED || stream->state == ZIP_SKIP) && stream->remaining == 0)) {
+        switch (stream->state) {
+        case ZIP_SIGNATURE: {
+            if (!gather(stream, &data, &length)) break;
+            uint32_t signature = read_le32(stream->buffer);
+            if (signature == ZIP_LOCAL_SIGNATURE) {
+                stream->state = ZIP_LOCAL_HEADER;
+                if (!expect(stream, 26)) return false;
+            } else if (signature == ZIP_CENTRAL_SIGNATURE) {
+                stream->state = ZIP_CENTRAL_HEADER;
+                if (!expect(stream, 42)) return false;
+            } else if (signature == ZIP_END_SIGNATURE) {
+                // The comment and anything after it are of no interest
+                stream->state = ZIP_END;
+            } else if (signature == ZIP64_END_SIGNATURE) {
+                stream->state = ZIP64_END_SIZE;
+                if (!expect(stream, 8)) return false;
+            } else if (signature == ZIP64_LOCATOR_SIGNATURE) {
+                stream->remaining = 16;
+                stream->state = ZIP_SKIP;
+            } else {
+                return stream_error(stream, "not a zip archive or an unsupported layout", NULL);
+            }
+            break;
+        }
+        case ZIP_LOCAL_HEADER: {
+            if (!gather(stream, &data, &length)) break;
+            const unsigned char *header = stream->buffer;
+            stream->zip_flags = read_le16(header + 2);
+            stream->zip_method = read_le16(header + 4);
+            stream->zip_crc = read_le32(header + 10);
+            stream->remaining = read_le32(header + 14);
+            stream->zip64 = false;
+            stream->name_length = read_le16(header + 22);
+            uint16_t extra_length = read_le16(header + 24);
+            if (stream->zip_flags & 0x01) {
+                return stream_error(stream, "encrypted entries are not supported", NULL);
+            }
+            stream->state = ZIP_LOCAL_NAME;
+            if (!expect(stream, (size_t)stream->name_length + extra_length)) return false;
+            if (stream->needed == 0 || stream->name_length == 0) {
+                return stream_error(stream, "entry without a name", NULL);
+            }
+            break;
+        }
+        case ZIP_LOCAL_NAME:
+            if (gather(stream, &data, &length) && !zip_begin_entry(stream)) {
+                return false;
+            }
+            break;
+        case ZIP_STORED: {
+            size_t take = stream->remaining < length ? (size_t)stream->remaining : length;
+            if (!write_entry(stream, data, take)) return false;
+            stream->crc = crc32(stream->crc, data, (uInt)take);
+            data += take;
+            length -= take;
+            stream->remaining -= take;
+            if (stream->remaining == 0 && !zip_end_entry(stream)) {
+                return false;
+            }
+            break;
+        }
+        case ZIP_DEFLATED: {
+            z_stream *z = &stream->inflater;
+            z->next_in = (Bytef *)data;
+            z->avail_in = (uInt)length;
+            int ret;
+            do {
+                z->next_out = stream->chunk;
+                z->avail_out = INFLATE_CHUNK;
+                ret = inflate(z, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    return stream_error(stream, z->msg ? z->msg : "bad deflate data", NULL);
+                }
+                size_t produced = INFLATE_CHUNK - z->avail_out;
+                if (!write_entry(stream, stream->chunk, produced)) return false;
+                stream->crc = crc32(stream->crc, stream->chunk, (uInt)produced);
+            } while (ret == Z_OK && z->avail_out == 0);
+            // The entry's data ends where the deflate stream does
+            data += length - z->avail_in;
+            length = z->avail_in;
+            if (ret == Z_STREAM_END && !zip_end_entry(stream)) {
+                return false;
+            }
+            break;
+        }
+        case ZIP_DESCRIPTOR: {
+            if (!gather(stream, &data, &length)) break;
+            size_t sizes = stream->zip64 ? 16 : 8;
+            if (stream->needed == 4) {
+                bool signed_descriptor = read_le32(stream->buffer) == ZIP_DESCRIPTOR_SIGNATURE;
+                size_t total = (signed_descriptor ? 8 : 4) + sizes;
+                // Keep the 4 bytes already read
+                unsigned char first[4];
+                memcpy(first, stream->buffer, 4);
+                if (!expect(stream, total)) return false;
+                memcpy(stream->buffer, first, 4);
+                stream->buffered = 4;
+                break;
+            }
+            size_t crc_offset = stream->needed - sizes - 4;
+            if (stream->out && read_le32(stream->buffer + crc_offset) != stream->crc) {
+                return stream_error(stream, "CRC mismatch", stream->out_path);
+            }
+            stream->state = ZIP_SIGNATURE;
+            if (!close_entry(stream) || !expect(stream, 4)) return false;
+            break;
+        }
+        case ZIP_CENTRAL_HEADER: {
+            if (!gather(stream, &data, &length)) break;
+            const unsigned char *header = stream->buffer;
+            stream->made_by = read_le16(header);
+            stream->name_length = read_le16(header + 24);
+            stream->skip_after_name = (uint32_t)read_le16(header + 26) + read_le16(header + 28);
+            stream->external_attributes = read_le32(header + 34);
+            stream->state = ZIP_CENTRAL_NAME;
+            if (!expect(stream, stream->name_length)) return false;
+            if (stream->name_length == 0) {
+                stream->remaining = stream->skip_after_name;
+                stream->state = ZIP_SKIP;
+            }
+            break;
+        }
+        case ZIP_CENTRAL_NAME: {
+            if (!gather(stream, &data, &length)) break;
+            // Permissions are only in the central directory; apply those
+            // of files made on Unix, such as the executable bit
+            unsigned int mode = stream->external_attributes >> 16;
+            if ((stream->made_by >> 8) == 3 && (S_ISREG(mode) || S_ISLNK(mode)) &&
+                !zip_apply_mode(stream, mode)) {
+                return false;
+            }
+            stream->remaining = stream->skip_after_name;
+            stream->state = ZIP_SKIP;
+            break;
+        }
+        case ZIP64_END_SIZE:
+            if (gather(stream, &data, &length)) {
+                stream->remaining = read_le64(stream->buffer);
+                stream->state = ZIP_SKIP;
+            }
+            break;
+        case ZIP_SKIP: {
+            size_t take = stream->remaining < length ? (size_t)stream->remaining : length;
+            data += take;
+            length -= take;
+            stream->remaining -= take;
+            if (stream->remaining == 0) {
+                stream->state = ZIP_SIGNATURE;
+                if (!expect(stream, 4)) return false;
+            }
+            break;
+        }
+        case ZIP_END:
+            return true;
+        default:
+            return stream_error(stream, "bad state", NULL);
+        }
+    }
+    return true;
+}
+
+ArchiveStream *archive_stream_create(ArchiveFormat format, const char *dest_dir) {
+    ArchiveStream *stream = calloc(1, sizeof(ArchiveStream));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->format = format;
+    size_t dir_len = strlen(dest_dir);
+    while (dir_len > 1 && dest_dir[dir_len - 1] == '/') {
+        dir_len--;
+    }
+    stream->dest_dir = malloc(dir_len + 1);
+    stream->chunk = malloc(INFLATE_CHUNK);
+    if (!stream->dest_dir || !stream->chunk) {
+        archive_stream_free(stream);
+        return NULL;
+    }
+    memcpy(stream->dest_dir, dest_dir, dir_len);
+    stream->dest_dir[dir_len] = '\0';
+
+    // gzip for .tar.gz; raw deflate, reset per entry, for zip
+    int window_bits = format == ARCHIVE_TGZ ? MAX_WBITS + 16 : -MAX_WBITS;
+    if (inflateInit2(&stream->inflater, window_bits) != Z_OK) {
+        archive_stream_free(stream);
+        return NULL;
+    }
+    stream->inflater_ready = true;
+
+    stream->state = format == ARCHIVE_TGZ ? TAR_HEADER : ZIP_SIGNATURE;
+    if (!expect(stream, format == ARCHIVE_TGZ ? TAR_BLOCK_SIZE : 4)) {
+        archive_stream_free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+bool archive_stream_write(ArchiveStream *stream, const void *data, size_t length) {
+    if (stream->failed) {
+        return false;
+    }
+    if (stream->format == ARCHIVE_TGZ) {
+        return gzip_consume(stream, data, length);
+    }
+    return zip_consume(stream, data, length);
+}
+
+bool archive_stream_finish(ArchiveStream *stream) {
+    if (stream->failed) {
+        return false;
+    }
+    if (stream->format == ARCHIVE_TGZ) {
+        // Some writers leave out the end blocks; a whole last entry will do
+        bool at_entry = stream->state == TAR_END ||
+                        (stream->state == TAR_HEADER && stream->buffered == 0);
+        if (!stream->gzip_ended || !at_entry) {
+            return stream_error(stream, "archive is truncated", NULL);
+        }
+    } else if (stream->state != ZIP_END) {
+        return stream_error(stream, "archive is truncated", NULL);
+    }
+    return true;
+}
+
+void archive_stream_set_map(ArchiveStream *stream, ArchiveEntryMap map, void *map_data) {
+    stream->map = map;
+    stream->map_data = map_data;
+}
+
+uint64_t archive_stream_file_count(const ArchiveStream *stream) {
+    return stream->file_count;
+}
+
+void archive_stream_free(ArchiveStream *stream) {
+    if (!stream) return;
+
+    if (stream->out) {
+        fclose(stream->out);
+    }
+    if (stream->inflater_ready) {
+        inflateEnd(&stream->inflater);
+    }
+    free(stream->out_path);
+    free(stream->meta);
+    free(stream->long_name);
+    free(stream->buffer);
+    free(stream->chunk);
+    free(stream->dest_dir);
+    free(stream);
+}
+
+/*
+ * zip files on disk
+ */
+
+// A file entry of a zip central directory, and where it goes
+typedef struct {
+    char *name;
+    char *path;
+    uint16_t method;
+    uint32_t crc;
+    uint64_t compressed;
+    uint64_t local_offset;
+    unsigned int mode;      // Unix mode, 0 when the zip was not made on Unix
+} ZipFileEntry;
+
+// Entries shared out between the inflating threads
+typedef struct {
+    int fd;
+    bool mapped;
+    ZipFileEntry *entries;
+    size_t count;
+    size_t next;
+    bool failed;
+    pthread_mutex_t lock;
+} ZipJobs;
+
+static bool read_at(int fd, void *buffer, size_t length, uint64_t offset) {
+    unsigned char *p = buffer;
+    while (length > 0) {
+        ssize_t n = pread(fd, p, length, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+/**
+ * Locate the central directory through the end record, or the zip64 one
+ * it points to
+ */
+static bool zip_find_central(int fd, uint64_t *offset, uint64_t *size, uint64_t *count) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 22) {
+        return false;
+    }
+
+    // The end record is the last 22 bytes but for a comment of up to 64 KiB
+    uint64_t file_size = (uint64_t)st.st_size;
+    size_t tail = file_size < 22 + 0xffff ? (size_t)file_size : 22 + 0xffff;
+    unsigned char *buffer = malloc(tail);
+    if (!buffer || !read_at(fd, buffer, tail, file_size - tail)) {
+        free(buffer);
+        return false;
+    }
+
+    bool found = false;
+    for (size_t i = tail - 22 + 1; i-- > 0;) {
+        if (read_le32(buffer + i) != ZIP_END_SIGNATURE) continue;
+        const unsigned char *end = buffer + i;
+        *count = read_le16(end + 10);
+        *size = read_le32(end + 12);
+        *offset = read_le32(end + 16);
+        found = true;
+
+        unsigned char locator[20];
+        uint64_t end_offset = file_size - tail + i;
+        if ((*count == 0xffff || *size == 0xffffffffu || *offset == 0xffffffffu) && end_offset >= 20 &&
+            read_at(fd, locator, sizeof(locator), end_offset - 20) &&
+            read_le32(locator) == ZIP64_LOCATOR_SIGNATURE) {
+            unsigned char record[56];
+            found = read_at(fd, record, sizeof(record), read_le64(locator + 8)) &&
+                    read_le32(record) == ZIP64_END_SIGNATURE;
+            if (found) {
+                *count = read_le64(record + 32);
+                *size = read_le64(record + 40);
+                *offset = read_le64(record + 48);
+            }
+        }
+        break;
+    }
+    free(buffer);
+    return found && *offset + *size <= file_size;
+}
+
+/**
+ * Read the central directory into the list of files to extract. Only
+ * directories are created here
+ */
+static bool zip_read_central(int fd, const char *dest_dir, ArchiveEntryMap map, void *map_data,
+                             ZipFileEntry **entries_out, size_t *count_out) {
+    uint64_t offset, size, count;
+    if (!zip_find_central(fd, &offset, &size, &count)) {
+        return archive_error("not a zip archive or an unsupported layout", NULL);
+    }
+
+    unsigned char *central = malloc(size ? (size_t)size : 1);
+    ZipFileEntry *entries = calloc(count ? (size_t)count : 1, sizeof(ZipFileEntry));
+    if (!central || !entries || !read_at(fd, central, (size_t)size, offset)) {
+        free(central);
+        free(entries);
+        return archive_error(central && entries ? "cannot read the central directory" : "out of memory", NULL);
+    }
+
+    bool ok = true;
+    size_t used = 0;
+    uint64_t position = 0;
+    for (uint64_t i = 0; i < count && ok; i++) {
+        const unsigned char *header = central + position;
+        if (position + 46 > size || read_le32(header) != ZIP_CENTRAL_SIGNATURE) {
+            ok = archive_error("bad central directory", NULL);
+            break;
+        }
+        uint16_t made_by = read_le16(header + 4);
+        uint16_t flags = read_le16(header + 8);
+        uint16_t name_length = read_le16(header + 28);
+        uint16_t extra_length = read_le16(header + 30);
+        uint16_t comment_length = read_le16(header + 32);
+        if (position + 46 + name_length + extra_length + comment_length > size) {
+            ok = archive_error("bad central directory", NULL);
+            break;
+        }
+
+        ZipFileEntry entry = {0};
+        entry.method = read_le16(header + 10);
+        entry.crc = read_le32(header + 16);
+        entry.compressed = read_le32(header + 20);
+        uint64_t uncompressed = read_le32(header + 24);
+        entry.local_offset = read_le32(header + 42);
+        if ((made_by >> 8) == 3) {
+            entry.mode = read_le32(header + 38) >> 16;
+        }
+
+        // Zip64 extra field: the saturated values, in this order
+        const unsigned char *extra = header + 46 + name_length;
+        for (uint16_t at = 0; at + 4 <= extra_length;) {
+            uint16_t id = read_le16(extra + at);
+            uint16_t field_size = read_le16(extra + at + 2);
+            if (id == 0x0001 && at + 4 + field_size <= extra_length) {
+                const unsigned char *value = extra + at + 4;
+                const unsigned char *value_end = value + field_size;
+                if (uncompressed == 0xffffffffu && value + 8 <= value_end) {
+                    value += 8;
+                }
+                if (entry.compressed == 0xffffffffu && value + 8 <= value_end) {
+                    entry.compressed = read_le64(value);
+                    value += 8;
+                }
+                if (entry.local_offset == 0xffffffffu && value + 8 <= value_end) {
+                    entry.local_offset = read_le64(value);
+                }
+            }
+            at += 4 + field_size;
+        }
+
+        char *name = malloc((size_t)name_length + 1);
+        if (!name) {
+            ok = archive_error("out of memory", NULL);
+            break;
+        }
+        memcpy(name, header + 46, name_length);
+        name[name_length] = '\0';
+        position += 46 + (uint64_t)name_length + extra_length + comment_length;
+
+        bool directory = name_length > 0 && name[name_length - 1] == '/';
+        char mapped[ARCHIVE_MAX_NAME];
+        const char *target = NULL;
+        if (!directory && !(map && S_ISLNK(entry.mode))) {
+            target = mapped_name(map, map_data, name, mapped, sizeof(mapped));
+        } else if (directory && !map) {
+            target = name;
+        }
+        if (!target) {
+            free(name);
+            continue;
+        }
+
+        char *path = entry_path(dest_dir, target);
+        if (!path) {
+            ok = archive_error("entry outside the destination", name);
+        } else if (flags & 0x01) {
+            ok = archive_error("encrypted entries are not supported", name);
+        } else if (entry.method != 0 && entry.method != 8) {
+            ok = archive_error("unsupported compression method", name);
+        } else if (!make_parent_directories(path)) {
+            ok = archive_error("cannot create the directory of", name);
+        } else if (directory) {
+            ok = mkdir(path, 0755) == 0 || errno == EEXIST || archive_error("cannot create directory", name);
+        } else {
+            entry.name = name;
+            entry.path = path;
+            entries[used++] = entry;
+            continue;
+        }
+        free(path);
+        free(name);
+    }
+
+    free(central);
+    *entries_out = entries;
+    *count_out = used;
+    return ok;
+}
+
+// Copy or inflate one entry into its file, checking the CRC
+static bool zip_extract_entry(int fd, const ZipFileEntry *entry, bool mapped, unsigned char *in, unsigned char *out) {
+    unsigned char local[30];
+    if (!read_at(fd, local, sizeof(local), entry->local_offset) || read_le32(local) != ZIP_LOCAL_SIGNATURE) {
+        return archive_error("bad local header", entry->name);
+    }
+    uint64_t position = entry->local_offset + 30 + read_le16(local + 26) + read_le16(local + 28);
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (entry->method == 8 && inflateInit2(&z, -MAX_WBITS) != Z_OK) {
+        return archive_error("cannot start inflating", entry->name);
+    }
+
+    // Replace rather than write through whatever is there, such as a symlink
+    unlink(entry->path);
+    FILE *fp = fopen(entry->path, "wb");
+    bool ok = fp != NULL || archive_error("cannot create", entry->name);
+    uint32_t crc = crc32(0L, Z_NULL, 0);
+    uint64_t remaining = entry->compressed;
+    int ret = Z_OK;
+
+    while (ok && remaining > 0 && ret != Z_STREAM_END) {
+        size_t take = remaining < INFLATE_CHUNK ? (size_t)remaining : INFLATE_CHUNK;
+        if (!read_at(fd, in, take, position)) {
+            ok = archive_error("archive is truncated", entry->name);
+            break;
+        }
+        position += take;
+        remaining -= take;
+
+        if (entry->method == 0) {
+            crc = crc32(crc, in, (uInt)take);
+            ok = fwrite(in, 1, take, fp) == take || archive_error("cannot write", entry->path);
+            continue;
+        }
+        z.next_in = in;
+        z.avail_in = (uInt)take;
+        do {
+            z.next_out = out;
+            z.avail_out = INFLATE_CHUNK;
+            ret = inflate(&z, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                ok = archive_error(z.msg ? z.msg : "bad deflate data", entry->name);
+                break;
+            }
+            size_t produced = INFLATE_CHUNK - z.avail_out;
+            crc = crc32(crc, out, (uInt)produced);
+            if (fwrite(out, 1, produced, fp) != produced) {
+                ok = archive_error("cannot write", entry->path);
+            }
+        } while (ok && ret == Z_OK && (z.avail_in > 0 || z.avail_out == 0));
+    }
+
+    if (ok && entry->method == 8 && ret != Z_STREAM_END) {
+        ok = archive_error("archive is truncated", entry->name);
+    }
+    if (ok && crc != entry->crc) {
+        ok = archive_error("CRC mismatch", entry->path);
+    }
+    if (fp && fclose(fp) != 0 && ok) {
+        ok = archive_error("cannot write", entry->path);
+    }
+    if (entry->method == 8) {
+        inflateEnd(&z);
+    }
+    if (ok && entry->mode && (S_ISREG(entry->mode) || S_ISLNK(entry->mode))) {
+        ok = apply_unix_mode(entry->path, entry->name, entry->mode, mapped);
+    }
+    return ok;
+}
+
+static void *zip_worker(void *arg) {
+    ZipJobs *jobs = arg;
+    unsigned char *in = malloc(INFLATE_CHUNK);
+    unsigned char *out = malloc(INFLATE_CHUNK);
+
+    for (;;) {
+        pthread_mutex_lock(&jobs->lock);
+        size_t index = jobs->next++;
+        bool stop = index >= jobs->count || jobs->failed;
+        pthread_mutex_unlock(&jobs->lock);
+        if (stop) break;
+
+        bool ok = in && out && zip_extract_entry(jobs->fd, &jobs->entries[index], jobs->mapped, in, out);
+        if (!ok) {
+            pthread_mutex_lock(&jobs->lock);
+            jobs->failed = true;
+            pthread_mutex_unlock(&jobs->lock);
+        }
+    }
+
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/**
+ * Extract a zip through its central directory. Entries are independent,
+ * so each thread inflates whole entries with its own reads
+ */
+static bool zip_extract_file(const char *archive_path, const char *dest_dir, ArchiveEntryMap map, void *map_data) {
+    int fd = open(archive_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s\n", archive_path);
+        return false;
+    }
+
+    ZipJobs jobs = {0};
+    jobs.fd = fd;
+    jobs.mapped = map != NULL;
+    bool ok = zip_read_central(fd, dest_dir, map, map_data, &jobs.entries, &jobs.count);
+
+    if (ok && jobs.count > 0) {
+        pthread_mutex_init(&jobs.lock, NULL);
+        size_t thread_count = (size_t)get_cpu_count();
+        if (thread_count > jobs.count) thread_count = jobs.count;
+        if (thread_count > 16) thread_count = 16;
+        if (thread_count < 1) thread_count = 1;
+
+        pthread_t threads[16];
+        size_t started = 0;
+        while (started + 1 < thread_count &&
+               pthread_create(&threads[started], NULL, zip_worker, &jobs) == 0) {
+            started++;
+        }
+        // This thread takes a share too
+        zip_worker(&jobs);
+        for (size_t i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_mutex_destroy(&jobs.lock);
+        ok = !jobs.failed;
+    }
+
+    if (jobs.entries) {
+        for (size_t i = 0; i < jobs.count; i++) {
+            free(jobs.entries[i].name);
+            free(jobs.entries[i].path);
+        }
+        free(jobs.entries);
+    }
+    close(fd);
+    return ok;
+}
+
+bool archive_extract_file(ArchiveFormat format, const char *archive_path, const char *dest_dir,
+                          ArchiveEntryMap map, void *map_data) {
+    if (format == ARCHIVE_ZIP) {
+        return zip_extract_file(archive_path, dest_dir, map, map_data);
+    }
+
+    FILE *fp = fopen(archive_path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s\n", archive_path);
+        return false;
+    }
+
+    ArchiveStream *stream = archive_stream_create(format, dest_dir);
+    if (!stream) {
+        fprintf(stderr, "Error: Out of memory\n");
+        fclose(fp);
+        return false;
+    }
+    archive_stream_set_map(stream, map, map_data);
+
+    unsigned char buffer[64 * 1024];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        ok = archive_stream_write(stream, buffer, n);
+    }
+    ok = ok && !ferror(fp) && archive_stream_finish(stream);
+
+    archive_stream_free(stream);
+    fclose(fp);
+    return ok;
+}
+
+#endif /* ARCHIVE_STREAM_SUPPORTED */
@@ -0,0 +1,395 @@
+#include "build_cache.h"
+#include "compiler_utils.h"
+#include "crypto_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#define rmdir _rmdir
+#define PATH_SEPARATOR '\\'
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#define BUILD_CACHE_FORMAT "opencli-build-cache-v1"
+#define CACHE_OUTPUT_NAME "output.amx"
+#define CACHE_DIAGNOSTICS_NAME "diagnostics.log"
+#define CACHE_STATS_NAME "stats"
+#define CACHE_LOCK_NAME "stats.lock"
+
+#ifdef _WIN32
+typedef HANDLE CacheLock;
+#define INVALID_CACHE_LOCK INVALID_HANDLE_VALUE
+#else
+typedef int CacheLock;
+#define INVALID_CACHE_LOCK (-1)
+#endif
+
+const char *build_cache_get_dir(void) {
+    static char cache_dir[512] = {0};
+
+    if (cache_dir[0] != '\0') {
+        return cache_dir;
+    }
+
+    snprintf(cache_dir, sizeof(cache_dir), "%s%copencli%ccache%cbuild",
+             get_appdata_path(), PATH_SEPARATOR, PATH_SEPARATOR, PATH_SEPARATOR);
+
+    if (!ensure_directory_exists(cache_dir)) {
+        fprintf(stderr, "Warning: Failed to create build cache directory: %s\n", cache_dir);
+    }
+
+    return cache_dir;
+}
+
+static void get_entry_dir(const char *key, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s%c%.2s%c%s",
+             build_cache_get_dir(), PATH_SEPARATOR, key, PATH_SEPARATOR, key);
+}
+
+static bool copy_file_contents(const char *source, const char *destination) {
+    FILE *src_file = fopen(source, "rb");
+    if (!src_file) {
+        return false;
+    }
+
+    FILE *dst_file = fopen(destination, "wb");
+    if (!dst_file) {
+        fclose(src_file);
+        return false;
+    }
+
+    char buffer[8192];
+    size_t bytes_read;
+    bool ok = true;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), src_file)) > 0) {
+        if (fwrite(buffer, 1, bytes_read, dst_file) != bytes_read) {
+            ok = false;
+            break;
+        }
+    }
+
+    fclose(src_file);
+    if (fclose(dst_file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+static bool replace_file(const char *source, const char *destination) {
+#ifdef _WIN32
+    return MoveFileEx(source, destination, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(source, destination) == 0;
+#endif
+}
+
+static char *read_text_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    char *text = malloc((size_t)size + 1);
+    if (!text) {
+        fclose(file);
+        return NULL;
+    }
+
+    size_t bytes_read = fread(text, 1, (size_t)size, file);
+    text[bytes_read] = '\0';
+    fclose(file);
+    return text;
+}
+
+static bool write_text_file(const char *path, const char *text) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    size_t len = text ? strlen(text) : 0;
+    bool ok = fwrite(text ? text : "", 1, len, file) == len;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool build_cache_compute_key(const char *compiler_version, const char *compiler_path,
+                             char *const args[], const IncludeFileList *dependencies,
+                             char key[BUILD_CACHE_KEY_LENGTH]) {
+    if (!compiler_version || !compiler_path || !args || !dependencies || !key) {
+        return false;
+    }
+
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *)BUILD_CACHE_FORMAT, strlen(BUILD_CACHE_FORMAT) + 1);
+    sha256_update(&ctx, (const uint8_t *)compiler_version, strlen(compiler_version) + 1);
+
+    // A reinstalled compiler under the same version name must not reuse
+    // outputs of the old binary
+    struct stat compiler_stat;
+    if (stat(compiler_path, &compiler_stat) != 0) {
+        return false;
+    }
+    char compiler_id[64];
+    snprintf(compiler_id, sizeof(compiler_id), "%lld:%lld",
+             (long long)compiler_stat.st_size, (long long)compiler_stat.st_mtime);
+    sha256_update(&ctx, (const uint8_t *)compiler_id, strlen(compiler_id) + 1);
+
+    for (int i = 0; args[i] != NULL; i++) {
+        sha256_update(&ctx, (const uint8_t *)args[i], strlen(args[i]) + 1);
+    }
+    sha256_update(&ctx, (const uint8_t *)"\n", 1);
+
+    for (int i = 0; i < dependencies->count; i++) {
+        uint8_t file_hash[SHA256_DIGEST_LENGTH];
+        if (!calculate_file_sha256(dependencies->files[i], file_hash)) {
+            return false;
+        }
+        sha256_update(&ctx, (const uint8_t *)dependencies->files[i], strlen(dependencies->files[i]) + 1);
+        sha256_update(&ctx, file_hash, sizeof(file_hash));
+    }
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    sha256_final(&ctx, digest);
+    hash_to_hex_string(digest, key);
+    return true;
+}
+
+bool build_cache_restore(const char *key, const char *output_file, char **diagnostics) {
+    char entry_dir[768];
+    char cached_output[1024];
+    char cached_diagnostics[1024];
+    char temp_output[1024];
+    struct stat st;
+
+    *diagnostics = NULL;
+
+    get_entry_dir(key, entry_dir, sizeof(entry_dir));
+    snprintf(cached_output, sizeof(cached_output), "%s%c%s", entry_dir, PATH_SEPARATOR, CACHE_OUTPUT_NAME);
+    snprintf(cached_diagnostics, sizeof(cached_diagnostics), "%s%c%s", entry_dir, PATH_SEPARATOR, CACHE_DIAGNOSTICS_NAME);
+
+    if (stat(cached_output, &st) != 0 || st.st_size == 0) {
+        return false;
+    }
+
+    // Copy next to the destination first so readers never observe a
+    // partially written .amx
+    snprintf(temp_output, sizeof(temp_output), "%s.%d.tmp", output_file, (int)getpid());
+    if (!copy_file_contents(cached_output, temp_output)) {
+        remove(temp_output);
+        return false;
+    }
+
+    if (!replace_file(temp_output, output_file)) {
+        remove(temp_output);
+        return false;
+    }
+
+    *diagnostics = read_text_file(cached_diagnostics);
+    return true;
+}
+
+static void update_stats(unsigned long hits, unsigned long misses, unsigned long stores);
+
+static void remove_entry_dir(const char *dir) {
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s%c%s", dir, PATH_SEPARATOR, CACHE_OUTPUT_NAME);
+    remove(path);
+    snprintf(path, sizeof(path), "%s%c%s", dir, PATH_SEPARATOR, CACHE_DIAGNOSTICS_NAME);
+    remove(path);
+    rmdir(dir);
+}
+
+bool build_cache_store(const char *key, const char *output_file, const char *diagnostics) {
+    char entry_dir[768];
+    char shard_dir[768];
+    char temp_dir[768];
+    char path[1024];
+    struct stat st;
+
+    get_entry_dir(key, entry_dir, sizeof(entry_dir));
+    if (stat(entry_dir, &st) == 0) {
+        return true;
+    }
+
+    snprintf(shard_dir, sizeof(shard_dir), "%s%c%.2s", build_cache_get_dir(), PATH_SEPARATOR, key);
+    if (!ensure_directory_exists(shard_dir)) {
+        return false;
+    }
+
+    // Entries are assembled in a private directory and renamed into place,
+    // so concurrent builds only ever see complete entries
+    snprintf(temp_dir, sizeof(temp_dir), "%s%ctmp-%s-%d-%ld",
+             build_cache_get_dir(), PATH_SEPARATOR, key, (int)getpid(), (long)time(NULL));
+    if (!ensure_directory_exists(temp_dir)) {
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s%c%s", temp_dir, PATH_SEPARATOR, CACHE_OUTPUT_NAME);
+    if (!copy_file_contents(output_file, path)) {
+        remove_entry_dir(temp_dir);
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s%c%s", temp_dir, PATH_SEPARATOR, CACHE_DIAGNOSTICS_NAME);
+    if (!write_text_file(path, diagnostics)) {
+        remove_entry_dir(temp_dir);
+        return false;
+    }
+
+    if (rename(temp_dir, entry_dir) != 0) {
+        // Another process stored the same key first
+        remove_entry_dir(temp_dir);
+        return stat(entry_dir, &st) == 0;
+    }
+
+    update_stats(0, 0, 1);
+    return true;
+}
+
+static CacheLock acquire_stats_lock(void) {
+    char lock_path[768];
+    snprintf(lock_path, sizeof(lock_path), "%s%c%s", build_cache_get_dir(), PATH_SEPARATOR, CACHE_LOCK_NAME);
+
+#ifdef _WIN32
+    HANDLE handle = CreateFile(lock_path, GENERIC_READ | GENERIC_WRITE,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return INVALID_CACHE_LOCK;
+    }
+
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+        CloseHandle(handle);
+        return INVALID_CACHE_LOCK;
+    }
+    return handle;
+#else
+    int fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return INVALID_CACHE_LOCK;
+    }
+
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return INVALID_CACHE_LOCK;
+    }
+    return fd;
+#endif
+}
+
+static void release_stats_lock(CacheLock lock) {
+    if (lock == INVALID_CACHE_LOCK) {
+        return;
+    }
+
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    UnlockFileEx(lock, 0, 1, 0, &overlapped);
+    CloseHandle(lock);
+#else
+    flock(lock, LOCK_UN);
+    close(lock);
+#endif
+}
+
+static void read_stats_file(const char *path, BuildCacheStats *stats) {
+    memset(stats, 0, sizeof(BuildCacheStats));
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+
+    char name[32];
+    unsigned long value;
+    while (fscanf(file, "%31s %lu", name, &value) == 2) {
+        if (strcmp(name, "hits") == 0) {
+            stats->hits = value;
+        } else if (strcmp(name, "misses") == 0) {
+            stats->misses = value;
+        } else if (strcmp(name, "stores") == 0) {
+            stats->stores = value;
+        }
+    }
+
+    fclose(file);
+}
+
+static void update_stats(unsigned long hits, unsigned long misses, unsigned long stores) {
+    char stats_path[768];
+    char temp_path[800];
+    BuildCacheStats stats;
+
+    snprintf(stats_path, sizeof(stats_path), "%s%c%s", build_cache_get_dir(), PATH_SEPARATOR, CACHE_STATS_NAME);
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", stats_path, (int)getpid());
+
+    CacheLock lock = acquire_stats_lock();
+    if (lock == INVALID_CACHE_LOCK) {
+        return;
+    }
+
+    read_stats_file(stats_path, &stats);
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.stores += stores;
+
+    FILE *file = fopen(temp_path, "w");
+    if (file) {
+        fprintf(file, "hits %lu\nmisses %lu\nstores %lu\n", stats.hits, stats.misses, stats.stores);
+        if (fclose(file) == 0) {
+            replace_file(temp_path, stats_path);
+        } else {
+            remove(temp_path);
+        }
+    }
+
+    release_stats_lock(lock);
+}
+
+void build_cache_record_lookup(bool hit) {
+    update_stats(hit ? 1 : 0, hit ? 0 : 1, 0);
+}
+
+bool build_cache_get_stats(BuildCacheStats *stats) {
+    char stats_path[768];
+
+    if (!stats) {
+        return false;
+    }
+
+    snprintf(stats_path, sizeof(stats_path), "%s%c%s", build_cache_get_dir(), PATH_SEPARATOR, CACHE_STATS_NAME);
+
+    CacheLock lock = acquire_stats_lock();
+    read_stats_file(stats_path, stats);
+    release_stats_lock(lock);
+
+    return true;
+}
@@ -0,0 +1,275 @@
+#include "compiler_manifest.h"
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+
+#include "config_snapshot.h"
+
+typedef struct {
+    const char *pattern;
+    const char *name;
+} DefaultPath;
+
+typedef struct {
+    const char *platform;
+    ArchiveFormat format;
+    const char *binary;
+    DefaultPath paths[3];
+} DefaultSection;
+
+// Used when compilers.toml cannot be read or has no usable section
+static const DefaultSection DEFAULT_MANIFEST[] = {
+    {"darwin", ARCHIVE_ZIP, "pawncc", {
+        {"(pawnc-(.+)/)?bin/pawncc", "pawncc"},
+        {"(pawnc-(.+)/)?bin/pawndisasm", "pawndisasm"},
+        {"(pawnc-(.+)/)?lib/libpawnc.dylib", "libpawnc.dylib"},
+    }},
+    {"linux", ARCHIVE_TGZ, "pawncc", {
+        {"(pawnc-(.+)/)?bin/pawncc", "pawncc"},
+        {"(pawnc-(.+)/)?bin/pawndisasm", "pawndisasm"},
+        {"(pawnc-(.+)/)?lib/libpawnc.so", "libpawnc.so"},
+    }},
+};
+
+typedef struct {
+    regex_t pattern;
+    char *name;
+} ManifestPath;
+
+struct CompilerManifest {
+    ArchiveFormat format;
+    ManifestPath *paths;
+    int path_count;
+    const char *binary;         // installed names; point into paths
+    const char *library;
+};
+
+const char *compiler_manifest_platform(void) {
+#ifdef __APPLE__
+    return "darwin";
+#else
+    return "linux";
+#endif
+}
+
+static void free_paths(CompilerManifest *manifest) {
+    for (int i = 0; i < manifest->path_count; i++) {
+        regfree(&manifest->paths[i].pattern);
+        free(manifest->paths[i].name);
+    }
+    free(manifest->paths);
+    manifest->paths = NULL;
+    manifest->path_count = 0;
+    manifest->binary = NULL;
+    manifest->library = NULL;
+}
+
+/**
+ * Compile pattern into the next slot of manifest->paths, which has room
+ *
+ * @return false, with the reason printed, if the pattern is invalid
+ */
+static bool add_path(CompilerManifest *manifest, const char *pattern, const char *name,
+                     const char *platform, const char *source) {
+    ManifestPath *path = &manifest->paths[manifest->path_count];
+
+    // The pattern has to match the whole archive path
+    size_t pattern_len = strlen(pattern);
+    char *anchored = malloc(pattern_len + 5);
+    path->name = malloc(strlen(name) + 1);
+    if (!anchored || !path->name) {
+        free(anchored);
+        free(path->name);
+        return false;
+    }
+    strcpy(path->name, name);
+    snprintf(anchored, pattern_len + 5, "^(%s)$", pattern);
+    int err = regcomp(&path->pattern, anchored, REG_EXTENDED | REG_NOSUB);
+    free(anchored);
+    if (err != 0) {
+        fprintf(stderr, "Warning: %s: bad pattern in %s.paths: %s\n", source, platform, pattern);
+        free(path->name);
+        return false;
+    }
+    manifest->path_count++;
+    return true;
+}
+
+/**
+ * Find the installed names of the compiler binary and library among the
+ * mapped names: the binary is the one named by binary, the library the
+ * first that is a shared library of platform
+ *
+ * @return false, with the reason printed, if either is not mapped
+ */
+static bool find_compiler_files(CompilerManifest *manifest, const char *binary,
+                                const char *platform, const char *source) {
+    const char *suffix = strcmp(platform, "darwin") == 0 ? ".dylib" :
+                         strcmp(platform, "windows") == 0 ? ".dll" : ".so";
+    size_t suffix_len = strlen(suffix);
+
+    for (int i = 0; i < manifest->path_count; i++) {
+        const char *name = manifest->paths[i].name;
+        size_t name_len = strlen(name);
+        if (!manifest->binary && binary && strcmp(name, binary) == 0) {
+            manifest->binary = name;
+        }
+        if (!manifest->library && name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0) {
+            manifest->library = name;
+        }
+    }
+
+    if (!manifest->binary) {
+        fprintf(stderr, "Warning: %s: %s.binary is not one of the names in [%s.paths]\n", source, platform, platform);
+        return false;
+    }
+    if (!manifest->library) {
+        fprintf(stderr, "Warning: %s: [%s.paths] installs no %s library\n", source, platform, suffix);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the section of platform out of a compiled compilers.toml
+ *
+ * @return false, with the reason printed, if it is missing or unusable
+ */
+static bool read_section(CompilerManifest *manifest, const ConfigSnapshot *snapshot, const char *platform,
+                         const char *source) {
+    const ConfigNode *section = config_node_get(snapshot, config_snapshot_root(snapshot), platform);
+    const ConfigNode *paths = section ? config_node_get(snapshot, section, "paths") : NULL;
+    if (!paths || paths->type != CONFIG_NODE_TABLE || paths->count == 0) {
+        fprintf(stderr, "Warning: %s has no [%s.paths]\n", source, platform);
+        return false;
+    }
+
+    const char *method;
+    if (!config_node_string(snapshot, config_node_get(snapshot, section, "method"), &method, NULL)) {
+        fprintf(stderr, "Warning: %s has no %s.method\n", source, platform);
+        return false;
+    }
+    bool zip = strcmp(method, "zip") == 0;
+    bool tgz = strcmp(method, "tgz") == 0;
+    if (!zip && !tgz) {
+        fprintf(stderr, "Warning: %s: unknown %s.method \"%s\"\n", source, platform, method);
+        return false;
+    }
+    manifest->format = zip ? ARCHIVE_ZIP : ARCHIVE_TGZ;
+
+    const char *binary;
+    if (!config_node_string(snapshot, config_node_get(snapshot, section, "binary"), &binary, NULL)) {
+        fprintf(stderr, "Warning: %s has no %s.binary\n", source, platform);
+        return false;
+    }
+
+    // Keys come back sorted, so patterns had better not overlap
+    manifest->paths = calloc(paths->count, sizeof(ManifestPath));
+    if (!manifest->paths) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < paths->count; i++) {
+        const ConfigNode *node = config_node_at(snapshot, paths, i);
+        const char *name;
+        if (!config_node_string(snapshot, node, &name, NULL)) {
+            fprintf(stderr, "Warning: %s: %s.paths values must be strings\n", source, platform);
+            free_paths(manifest);
+            return false;
+        }
+        if (!add_path(manifest, config_node_key(snapshot, node), name, platform, source)) {
+            free_paths(manifest);
+            return false;
+        }
+    }
+
+    if (!find_compiler_files(manifest, binary, platform, source)) {
+        free_paths(manifest);
+        return false;
+    }
+    return true;
+}
+
+static bool read_default_section(CompilerManifest *manifest, const char *platform) {
+    const char *source = "the built-in manifest";
+    for (size_t i = 0; i < sizeof(DEFAULT_MANIFEST) / sizeof(DEFAULT_MANIFEST[0]); i++) {
+        const DefaultSection *section = &DEFAULT_MANIFEST[i];
+        if (strcmp(section->platform, platform) != 0) {
+            continue;
+        }
+
+        size_t count = sizeof(section->paths) / sizeof(section->paths[0]);
+        manifest->format = section->format;
+        manifest->paths = calloc(count, sizeof(ManifestPath));
+        if (!manifest->paths) {
+            return false;
+        }
+        for (size_t j = 0; j < count; j++) {
+            if (!add_path(manifest, section->paths[j].pattern, section->paths[j].name, platform, source)) {
+                free_paths(manifest);
+                return false;
+            }
+        }
+        return find_compiler_files(manifest, section->binary, platform, source);
+    }
+
+    fprintf(stderr, "Warning: %s has no [%s.paths]\n", source, platform);
+    return false;
+}
+
+CompilerManifest *compiler_manifest_load(const char *toml_path, const char *platform) {
+    CompilerManifest *manifest = calloc(1, sizeof(CompilerManifest));
+    if (!manifest) {
+        return NULL;
+    }
+
+    ConfigSnapshot snapshot;
+    if (toml_path && config_snapshot_open(&snapshot, toml_path) == CONFIG_SNAPSHOT_OK) {
+        bool ok = read_section(manifest, &snapshot, platform, toml_path);
+        config_snapshot_close(&snapshot);
+        if (ok) {
+            return manifest;
+        }
+    }
+
+    if (!read_default_section(manifest, platform)) {
+        compiler_manifest_free(manifest);
+        return NULL;
+    }
+    return manifest;
+}
+
+ArchiveFormat compiler_manifest_format(const CompilerManifest *manifest) {
+    return manifest->format;
+}
+
+const char *compiler_manifest_binary(const CompilerManifest *manifest) {
+    return manifest->binary;
+}
+
+const char *compiler_manifest_library(const CompilerManifest *manifest) {
+    return manifest->library;
+}
+
+bool compiler_manifest_map(const char *name, char *mapped, size_t mapped_size, void *manifest) {
+    const CompilerManifest *m = manifest;
+    for (int i = 0; i < m->path_count; i++) {
+        if (regexec(&m->paths[i].pattern, name, 0, NULL, 0) == 0) {
+            snprintf(mapped, mapped_size, "%s", m->paths[i].name);
+            return true;
+        }
+    }
+    return false;
+}
+
+void compiler_manifest_free(CompilerManifest *manifest) {
+    if (!manifest) return;
+    free_paths(manifest);
+    free(manifest);
+}
+
+#endif /* ARCHIVE_STREAM_SUPPORTED */
@@ -1,6 +1,9 @@
 #include "compiler_utils.h"
 #include "download_utils.h"
 #include "crypto_utils.h"
+#include "archive_stream.h"
+#include "compiler_manifest.h"
+#include "toolchain_store.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +11,7 @@
 #include <errno.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdarg.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -16,7 +20,9 @@
 #define mkdir(dir, mode) _mkdir(dir)
 #else
 #include <unistd.h>
+#include <dirent.h>
 #include <pwd.h>
+#include <pthread.h>
 #endif
 
 #ifdef __ANDROID__
@@ -84,7 +90,6 @@ static FILE* log_file = NULL;
 static int verbose_logging = 0;
 
 static bool create_directory(const char *path);
-static bool ensure_directory_exists(const char *path);
 
 void set_compiler_verbose_logging(bool verbose) {
     verbose_logging = verbose ? 1 : 0;
@@ -147,7 +152,8 @@ static void log_message(const char* format, ...) {
     localtime_s(&timeinfo_obj, &now);
     timeinfo = &timeinfo_obj;
     #else
-    timeinfo = localtime(&now);
+    // Install workers log from several threads
+    timeinfo = localtime_r(&now, &timeinfo_obj);
     #endif
     
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
@@ -226,7 +232,7 @@ static bool create_directory(const char *path) {
 #endif
 }
 
-static bool ensure_directory_exists(const char *path) {
+bool ensure_directory_exists(const char *path) {
     char tmp[512];
     char *p;
     
@@ -284,7 +290,7 @@ static bool try_alternative_download(const char *url, const char *dest_path) {
 #else
     // Use curl or wget
     if (system("which curl > /dev/null 2>&1") == 0) {
-        sprintf(cmd, "curl -L '%s' -o '%s'", url, dest_path);
+        sprintf(cmd, "curl -fL '%s' -o '%s'", url, dest_path);
     } else if (system("which wget > /dev/null 2>&1") == 0) {
         sprintf(cmd, "wget '%s' -O '%s'", url, dest_path);
     } else {
@@ -305,6 +311,14 @@ static bool try_alternative_download(const char *url, const char *dest_path) {
 }
 
 bool init_compiler_dir(void) {
+    static bool initialized = false;
+    
+    // Long-running processes (the compile daemon, --watch) only pay for
+    // this once
+    if (initialized) {
+        return true;
+    }
+    
     const char *appdata_path = get_appdata_path();
     
     init_log_file();
@@ -352,9 +366,56 @@ bool init_compiler_dir(void) {
     }
     
     log_message("Compiler directory initialized successfully");
+    initialized = true;
     return true;
 }
 
+#ifdef ARCHIVE_STREAM_SUPPORTED
+#ifdef __APPLE__
+#define COMPILER_LIBRARY_NAME "libpawnc.dylib"
+#else
+#define COMPILER_LIBRARY_NAME "libpawnc.so"
+#endif
+
+// compilers.toml as the lookups below read it, loaded on first use
+static const CompilerManifest *installed_manifest(void) {
+    static CompilerManifest *manifest = NULL;
+    static bool loaded = false;
+
+    if (!loaded) {
+        char manifest_path[512];
+        snprintf(manifest_path, sizeof(manifest_path), "%s/compilers.toml", opencli_dir);
+        manifest = compiler_manifest_load(manifest_path, compiler_manifest_platform());
+        loaded = true;
+    }
+    return manifest;
+}
+
+static const char *installed_binary_name(void) {
+    const CompilerManifest *manifest = installed_manifest();
+    return manifest ? compiler_manifest_binary(manifest) : "pawncc";
+}
+
+static const char *installed_library_name(void) {
+    const CompilerManifest *manifest = installed_manifest();
+    return manifest ? compiler_manifest_library(manifest) : COMPILER_LIBRARY_NAME;
+}
+
+/**
+ * Installs extracted through compilers.toml keep their files directly in
+ * the version directory, older ones in the archive's own layout. Point
+ * path at the file of the first kind when there is one
+ */
+static void prefer_mapped_path(char *path, size_t size, const char *version, const char *name) {
+    char mapped[512];
+    struct stat st;
+    snprintf(mapped, sizeof(mapped), "%s/%s/%s", compiler_base_dir, version, name);
+    if (stat(mapped, &st) == 0) {
+        snprintf(path, size, "%s", mapped);
+    }
+}
+#endif
+
 bool is_compiler_installed(const char *version) {
     char path_exe[512];
     char path_dll[512];
@@ -397,6 +458,10 @@ bool is_compiler_installed(const char *version) {
     sprintf(path_dll, "%s/%s/pawnc-%s-linux/lib/libpawnc.so", compiler_base_dir, version, version_without_v);
     #endif
 #endif
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    prefer_mapped_path(path_exe, sizeof(path_exe), version, installed_binary_name());
+    prefer_mapped_path(path_dll, sizeof(path_dll), version, installed_library_name());
+#endif
     
     log_message("Checking if compiler executable exists: %s", path_exe);
     log_message("Checking if compiler library exists: %s", path_dll);
@@ -452,26 +517,180 @@ char *get_compiler_path(const char *version) {
     sprintf(path, "%s/%s/pawnc-%s-linux/bin/pawncc", compiler_base_dir, version, version_without_v);
     #endif
 #endif
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    prefer_mapped_path(path, sizeof(path), version, installed_binary_name());
+#endif
     
     log_message("Compiler path: %s", path);
     return path;
 }
 
-bool install_compiler(const char *version) {
+char *get_compiler_library_path(const char *version) {
+    static char path[512];
+    char version_without_v[32];
+    
+    if (!init_compiler_dir()) {
+        log_message("Failed to initialize compiler directory when getting library path");
+        return NULL;
+    }
+    
+    if (version[0] == 'v') {
+        #ifdef _WIN32
+        strcpy_s(version_without_v, sizeof(version_without_v), version + 1);
+        #else
+        strcpy(version_without_v, version + 1);
+        #endif
+    } else {
+        #ifdef _WIN32
+        strcpy_s(version_without_v, sizeof(version_without_v), version);
+        #else
+        strcpy(version_without_v, version);
+        #endif
+    }
+    
+#ifdef _WIN32
+    sprintf_s(path, sizeof(path), "%s\\%s\\pawnc-%s-windows\\bin\\pawnc.dll", compiler_base_dir, version, version_without_v);
+#else
+    #ifdef __APPLE__
+    sprintf(path, "%s/%s/pawnc-%s-macos/lib/libpawnc.dylib", compiler_base_dir, version, version_without_v);
+    #elif defined(__ANDROID__)
+    const char* android_arch = detect_android_architecture();
+    sprintf(path, "%s/%s-%s/lib/libpawnc.so", compiler_base_dir, version, android_arch);
+    #else
+    sprintf(path, "%s/%s/pawnc-%s-linux/lib/libpawnc.so", compiler_base_dir, version, version_without_v);
+    #endif
+#endif
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    prefer_mapped_path(path, sizeof(path), version, installed_library_name());
+#endif
+    
+    log_message("Compiler library path: %s", path);
+    return path;
+}
+
+void add_compiler_library_search_path(const char *version) {
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    char *library_path = get_compiler_library_path(version);
+    if (!library_path) {
+        return;
+    }
+    char library_dir[512];
+    snprintf(library_dir, sizeof(library_dir), "%s", library_path);
+    char *slash = strrchr(library_dir, '/');
+    if (!slash) {
+        return;
+    }
+    *slash = '\0';
+
+    // Only a mapped install has the library next to pawncc, out of reach
+    // of the ../lib the release binaries look in
+    char *compiler_path = get_compiler_path(version);
+    size_t dir_len = strlen(library_dir);
+    if (!compiler_path || strncmp(compiler_path, library_dir, dir_len) != 0 ||
+        compiler_path[dir_len] != '/' || strchr(compiler_path + dir_len + 1, '/')) {
+        return;
+    }
+
+#ifdef __APPLE__
+    const char *variable = "DYLD_LIBRARY_PATH";
+#else
+    const char *variable = "LD_LIBRARY_PATH";
+#endif
+    const char *current = getenv(variable);
+    if (current && strncmp(current, library_dir, dir_len) == 0 &&
+        (current[dir_len] == ':' || current[dir_len] == '\0')) {
+        return;
+    }
+    char value[2048];
+    if (current && current[0] != '\0') {
+        snprintf(value, sizeof(value), "%s:%s", library_dir, current);
+    } else {
+        snprintf(value, sizeof(value), "%s", library_dir);
+    }
+    setenv(variable, value, 1);
+    log_message("%s=%s", variable, value);
+#else
+    (void)version;
+#endif
+}
+
+// Everything needed to install one compiler version
+typedef struct {
+    const char *version;
     char url[512];
     char zip_path[512];
     char extract_dir[512];
+    // The compiler files, relative to extract_dir
+    char pawncc_name[256];
+    char pawnc_name[256];
+    bool installed;
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    // Extraction goes here and is renamed to extract_dir once verified, so
+    // a broken install never sits under the version's own name
+    char staging_dir[520];
+    // Which archive entries are installed, and under what names
+    CompilerManifest *manifest;
+    // Hashes and extracts the archive as it downloads; NULL once dropped
+    // for the on-disk fallback
+    ArchiveStream *archive;
+    SHA256_CTX sha;
+    uint64_t received;
+#endif
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    bool thread_started;
+} CompilerInstall;
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+// Remove path and everything under it; a path that is not there is fine
+static bool remove_directory_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return errno == ENOENT || (errno == ENOTDIR && unlink(path) == 0);
+    }
+
+    bool ok = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char child_path[1024];
+        snprintf(child_path, sizeof(child_path), "%s/%s", path, name);
+        struct stat st;
+        if (lstat(child_path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            ok = remove_directory_tree(child_path) && ok;
+        } else if (unlink(child_path) != 0) {
+            ok = false;
+        }
+    }
+    closedir(dir);
+    return rmdir(path) == 0 && ok;
+}
+
+// Start with an empty staging directory, whatever an earlier attempt left
+static bool reset_staging_dir(const CompilerInstall *install) {
+    if (!remove_directory_tree(install->staging_dir) || mkdir(install->staging_dir, 0755) != 0) {
+        log_message("Failed to create staging directory %s: %s", install->staging_dir, strerror(errno));
+        return false;
+    }
+    return true;
+}
+#endif
+
+// Work out the download URL and the paths of a version, and create its directory
+static bool prepare_install(CompilerInstall *install, const char *version) {
     char version_without_v[32];
 #ifdef __ANDROID__
     const char* android_arch = NULL;
 #endif
     
-    log_message("Installing compiler version: %s", version);
-    
-    if (!init_compiler_dir()) {
-        log_message("Failed to initialize compiler directory when installing");
-        return false;
-    }
+    memset(install, 0, sizeof(*install));
+    install->version = version;
     
     if (version[0] == 'v') {
         #ifdef _WIN32
@@ -510,43 +729,150 @@ bool install_compiler(const char *version) {
 #endif
     
 #ifdef _WIN32
-    sprintf_s(url, sizeof(url), "%s/releases/download/%s/pawnc-%s-windows.zip", repo_url, version, version_without_v);
-    sprintf_s(zip_path, sizeof(zip_path), "%s\\%s.zip", compiler_base_dir, version);
-    sprintf_s(extract_dir, sizeof(extract_dir), "%s\\%s", compiler_base_dir, version);
+    sprintf_s(install->url, sizeof(install->url), "%s/releases/download/%s/pawnc-%s-windows.zip", repo_url, version, version_without_v);
+    sprintf_s(install->zip_path, sizeof(install->zip_path), "%s\\%s.zip", compiler_base_dir, version);
+    sprintf_s(install->extract_dir, sizeof(install->extract_dir), "%s\\%s", compiler_base_dir, version);
 #else
     #ifdef __APPLE__
-    sprintf(url, "%s/releases/download/%s/pawnc-%s-macos.zip", repo_url, version, version_without_v);
-    sprintf(zip_path, "%s/%s.zip", compiler_base_dir, version);
-    sprintf(extract_dir, "%s/%s", compiler_base_dir, version);
+    sprintf(install->url, "%s/releases/download/%s/pawnc-%s-macos.zip", repo_url, version, version_without_v);
+    sprintf(install->zip_path, "%s/%s.zip", compiler_base_dir, version);
+    sprintf(install->extract_dir, "%s/%s", compiler_base_dir, version);
     #elif defined(__ANDROID__)
     android_arch = detect_android_architecture();
-    sprintf(url, "%s/releases/download/%s/pawnc-%s-android-%s.zip", repo_url, version_without_v, version_without_v, android_arch);
-    sprintf(zip_path, "%s/%s-%s.zip", compiler_base_dir, version, android_arch);
-    sprintf(extract_dir, "%s/%s-%s", compiler_base_dir, version, android_arch);
+    sprintf(install->url, "%s/releases/download/%s/pawnc-%s-android-%s.zip", repo_url, version_without_v, version_without_v, android_arch);
+    sprintf(install->zip_path, "%s/%s-%s.zip", compiler_base_dir, version, android_arch);
+    sprintf(install->extract_dir, "%s/%s-%s", compiler_base_dir, version, android_arch);
     #else
-    sprintf(url, "%s/releases/download/%s/pawnc-%s-linux.tar.gz", repo_url, version, version_without_v);
-    sprintf(zip_path, "%s/%s.tar.gz", compiler_base_dir, version);
-    sprintf(extract_dir, "%s/%s", compiler_base_dir, version);
+    sprintf(install->url, "%s/releases/download/%s/pawnc-%s-linux.tar.gz", repo_url, version, version_without_v);
+    sprintf(install->zip_path, "%s/%s.tar.gz", compiler_base_dir, version);
+    sprintf(install->extract_dir, "%s/%s", compiler_base_dir, version);
     #endif
 #endif
 
-    log_message("Download URL: %s", url);
-    log_message("Zip path: %s", zip_path);
-    log_message("Extract dir: %s", extract_dir);
+#ifdef _WIN32
+    sprintf_s(install->pawncc_name, sizeof(install->pawncc_name), "pawnc-%s-windows\\bin\\pawncc.exe", version_without_v);
+    sprintf_s(install->pawnc_name, sizeof(install->pawnc_name), "pawnc-%s-windows\\bin\\pawnc.dll", version_without_v);
+#elif defined(ARCHIVE_STREAM_SUPPORTED)
+    // Named by compilers.toml, straight in the version directory; filled
+    // in from the manifest by install_compilers
+#else
+    sprintf(install->pawncc_name, "bin/pawncc");
+    sprintf(install->pawnc_name, "lib/libpawnc.so");
+#endif
+
+    log_message("Download URL: %s", install->url);
+    log_message("Zip path: %s", install->zip_path);
+    log_message("Extract dir: %s", install->extract_dir);
 
-    if (!ensure_directory_exists(extract_dir)) {
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    snprintf(install->staging_dir, sizeof(install->staging_dir), "%s.tmp", install->extract_dir);
+    return reset_staging_dir(install);
+#else
+    if (!ensure_directory_exists(install->extract_dir)) {
         log_message("Failed to create extraction directory");
         return false;
     }
+    return true;
+#endif
+}
 
-    log_message("Downloading compiler %s...", version);
-    if (!download_file(url, zip_path)) {
-        log_message("Failed to download compiler, trying alternative method");
-        if (!try_alternative_download(url, zip_path)) {
-            log_message("Failed to download compiler with alternative method");
-            return false;
-        }
+// Where the archive is extracted to
+static const char *install_target_dir(const CompilerInstall *install) {
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    return install->staging_dir;
+#else
+    return install->extract_dir;
+#endif
+}
+
+static void compiler_file_path(char *path, size_t size, const char *dir, const char *name) {
+#ifdef _WIN32
+    snprintf(path, size, "%s\\%s", dir, name);
+#else
+    snprintf(path, size, "%s/%s", dir, name);
+#endif
+}
+
+// Check that the compiler files are in place after extraction into dir
+static bool verify_install(const CompilerInstall *install, const char *dir) {
+    char pawncc_path[1024];
+    char pawnc_path[1024];
+    compiler_file_path(pawncc_path, sizeof(pawncc_path), dir, install->pawncc_name);
+    compiler_file_path(pawnc_path, sizeof(pawnc_path), dir, install->pawnc_name);
+
+    struct stat st_exe = {0};
+    struct stat st_dll = {0};
+    bool exe_exists = (stat(pawncc_path, &st_exe) == 0);
+    bool dll_exists = (stat(pawnc_path, &st_dll) == 0);
+
+    if (!exe_exists || !dll_exists) {
+        log_message("Required compiler files not found after extraction:");
+        log_message("  Executable (%s): %s", pawncc_path, exe_exists ? "Found" : "Missing");
+        log_message("  Library (%s): %s", pawnc_path, dll_exists ? "Found" : "Missing");
+        
+        return false;
+    }
+    
+#ifdef __ANDROID__
+    if (chmod(pawncc_path, 0755) != 0) {
+        log_message("Warning: Failed to make pawncc executable: %s", strerror(errno));
+    } else {
+        log_message("Made pawncc executable with chmod +x");
+    }
+#endif
+    return true;
+}
+
+/**
+ * Put a verified install in place: on the native extractor's platforms the
+ * staging directory replaces whatever an earlier install left
+ */
+static bool commit_install(const CompilerInstall *install) {
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    if (!remove_directory_tree(install->extract_dir)) {
+        log_message("Failed to remove the previous install at %s", install->extract_dir);
+        return false;
+    }
+    if (rename(install->staging_dir, install->extract_dir) != 0) {
+        log_message("Failed to move %s into place: %s", install->staging_dir, strerror(errno));
+        return false;
+    }
+#endif
+
+#ifdef TOOLCHAIN_STORE_SUPPORTED
+    // Files other versions already have become links to one stored copy.
+    // Not being able to share them costs disk space, not the install
+    char store_dir[512];
+    ToolchainStoreStats stats = {0};
+    snprintf(store_dir, sizeof(store_dir), "%s/store", opencli_dir);
+    if (!toolchain_store_adopt_tree(store_dir, install->extract_dir, &stats)) {
+        log_message("Warning: Some files of %s could not be added to the toolchain store", install->version);
     }
+    log_message("Toolchain store: %llu files, %llu shared with other versions (%llu bytes)",
+                (unsigned long long)stats.files, (unsigned long long)stats.shared,
+                (unsigned long long)stats.shared_bytes);
+
+    // The install this one replaced may have held the last link to some
+    uint64_t swept = toolchain_store_sweep(store_dir);
+    if (swept > 0) {
+        log_message("Toolchain store: removed %llu files no version uses", (unsigned long long)swept);
+    }
+#endif
+    
+    char pawncc_path[1024];
+    char pawnc_path[1024];
+    compiler_file_path(pawncc_path, sizeof(pawncc_path), install->extract_dir, install->pawncc_name);
+    compiler_file_path(pawnc_path, sizeof(pawnc_path), install->extract_dir, install->pawnc_name);
+    log_message("Compiler %s installed successfully", install->version);
+    log_message("Executable path: %s", pawncc_path);
+    log_message("Library path: %s", pawnc_path);
+    return true;
+}
+
+// Hash, extract and check a downloaded archive
+static bool finish_install(const CompilerInstall *install) {
+    const char *zip_path = install->zip_path;
+    const char *extract_dir = install_target_dir(install);
     
     struct stat st = {0};
     if (stat(zip_path, &st) != 0) {
@@ -579,67 +905,227 @@ bool install_compiler(const char *version) {
             return false;
         }
     }
-#else
-    #ifdef __APPLE__
-    if (!extract_zip(zip_path, extract_dir)) {
+#elif defined(ARCHIVE_STREAM_SUPPORTED)
+    if (!archive_extract_file(compiler_manifest_format(install->manifest), zip_path, extract_dir,
+                              compiler_manifest_map, install->manifest)) {
         log_message("Failed to extract compiler");
         return false;
     }
-    #elif defined(__ANDROID__)
+#else
     if (!extract_zip(zip_path, extract_dir)) {
         log_message("Failed to extract compiler");
         return false;
     }
-    #else
-    if (!extract_tgz(zip_path, extract_dir)) {
+#endif
+    
+    return verify_install(install, extract_dir) && commit_install(install);
+}
+
+bool install_compiler(const char *version) {
+    bool installed;
+    return install_compilers(&version, 1, &installed);
+}
+
+#ifdef ARCHIVE_STREAM_SUPPORTED
+// The download sink: every chunk goes through the hash and the extractor
+static bool install_sink(const void *data, size_t length, void *sink_data) {
+    CompilerInstall *install = sink_data;
+    sha256_update(&install->sha, data, length);
+    install->received += length;
+    return archive_stream_write(install->archive, data, length);
+}
+
+// Close the stream once the whole archive has arrived, and check the result
+static bool finish_streamed_install(CompilerInstall *install) {
+    log_message("Download successful. Size: %llu bytes", (unsigned long long)install->received);
+
+    uint8_t file_hash[SHA256_DIGEST_LENGTH];
+    char hash_string[65];
+    sha256_final(&install->sha, file_hash);
+    hash_to_hex_string(file_hash, hash_string);
+    log_message("File SHA256: %s", hash_string);
+
+    if (!archive_stream_finish(install->archive)) {
         log_message("Failed to extract compiler");
         return false;
     }
-    #endif
+    log_message("Extracted %llu files to %s", (unsigned long long)archive_stream_file_count(install->archive), install->staging_dir);
+    return verify_install(install, install->staging_dir) && commit_install(install);
+}
 #endif
-    
-    char pawncc_path[512];
-    char pawnc_path[512];
 
+/**
+ * Fetch the archive into zip_path after the first attempt failed: the
+ * resumable download where there is one, then the shell tools. Those
+ * write to a temporary name so a cut-off archive is never taken as whole
+ */
+static bool fetch_archive(const CompilerInstall *install) {
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    log_message("Downloading compiler %s to %s", install->version, install->zip_path);
+    if (download_file(install->url, install->zip_path)) {
+        return true;
+    }
+#endif
+    log_message("Failed to download compiler %s, trying alternative method", install->version);
+    char temp_path[520];
+    snprintf(temp_path, sizeof(temp_path), "%s.download", install->zip_path);
+    if (!try_alternative_download(install->url, temp_path)) {
+        log_message("Failed to download compiler %s with alternative method", install->version);
+        remove(temp_path);
+        return false;
+    }
 #ifdef _WIN32
-    sprintf_s(pawncc_path, sizeof(pawncc_path), "%s\\pawnc-%s-windows\\bin\\pawncc.exe", extract_dir, version_without_v);
-    sprintf_s(pawnc_path, sizeof(pawnc_path), "%s\\pawnc-%s-windows\\bin\\pawnc.dll", extract_dir, version_without_v);
+    remove(install->zip_path);
+#endif
+    if (rename(temp_path, install->zip_path) != 0) {
+        log_message("Failed to move %s into place", temp_path);
+        remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Runs on a thread of its own once a download has finished, so extracting
+ * one version overlaps with downloading the others
+ */
+#ifdef _WIN32
+static DWORD WINAPI install_worker(LPVOID arg) {
 #else
-    #ifdef __APPLE__
-    sprintf(pawncc_path, "%s/pawnc-%s-macos/bin/pawncc", extract_dir, version_without_v);
-    sprintf(pawnc_path, "%s/pawnc-%s-macos/lib/libpawnc.dylib", extract_dir, version_without_v);
-    #elif defined(__ANDROID__)
-    sprintf(pawncc_path, "%s/bin/pawncc", extract_dir);
-    sprintf(pawnc_path, "%s/lib/libpawnc.so", extract_dir);
-    #else
-    sprintf(pawncc_path, "%s/pawnc-%s-linux/bin/pawncc", extract_dir, version_without_v);
-    sprintf(pawnc_path, "%s/pawnc-%s-linux/lib/libpawnc.so", extract_dir, version_without_v);
-    #endif
+static void *install_worker(void *arg) {
+#endif
+    DownloadRequest *request = arg;
+    CompilerInstall *install = request->user_data;
+    
+    bool fetched = request->ok;
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    if (install->archive) {
+        if (request->ok && finish_streamed_install(install)) {
+            install->installed = true;
+            return NULL;
+        }
+        // Start over from a file, dropping whatever was extracted
+        log_message("Streamed install of %s failed, downloading the archive instead", install->version);
+        archive_stream_free(install->archive);
+        install->archive = NULL;
+        fetched = false;
+        if (!reset_staging_dir(install)) {
+            return NULL;
+        }
+    }
 #endif
+    install->installed = (fetched || fetch_archive(install)) && finish_install(install);
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    if (!install->installed) {
+        remove_directory_tree(install->staging_dir);
+    }
+#endif
+    
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
 
-    struct stat st_exe = {0};
-    struct stat st_dll = {0};
-    bool exe_exists = (stat(pawncc_path, &st_exe) == 0);
-    bool dll_exists = (stat(pawnc_path, &st_dll) == 0);
+static void start_install_worker(DownloadRequest *request) {
+    CompilerInstall *install = request->user_data;
+    
+#ifdef _WIN32
+    install->thread = CreateThread(NULL, 0, install_worker, request, 0, NULL);
+    install->thread_started = install->thread != NULL;
+#else
+    install->thread_started = pthread_create(&install->thread, NULL, install_worker, request) == 0;
+#endif
+    if (!install->thread_started) {
+        install_worker(request);
+    }
+}
 
-    if (!exe_exists || !dll_exists) {
-        log_message("Required compiler files not found after extraction:");
-        log_message("  Executable (%s): %s", pawncc_path, exe_exists ? "Found" : "Missing");
-        log_message("  Library (%s): %s", pawnc_path, dll_exists ? "Found" : "Missing");
-        
+bool install_compilers(const char *const *versions, int count, bool *installed) {
+    for (int i = 0; i < count; i++) {
+        installed[i] = false;
+    }
+    
+    if (!init_compiler_dir()) {
+        log_message("Failed to initialize compiler directory when installing");
         return false;
     }
     
-#ifdef __ANDROID__
-    if (chmod(pawncc_path, 0755) != 0) {
-        log_message("Warning: Failed to make pawncc executable: %s", strerror(errno));
-    } else {
-        log_message("Made pawncc executable with chmod +x");
+    CompilerInstall *installs = calloc((size_t)count, sizeof(CompilerInstall));
+    DownloadRequest *requests = calloc((size_t)count, sizeof(DownloadRequest));
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    // compilers.toml says which files of an archive make up the compiler
+    char manifest_path[512];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/compilers.toml", opencli_dir);
+    CompilerManifest *manifest = compiler_manifest_load(manifest_path, compiler_manifest_platform());
+    if (!manifest) {
+        free(installs);
+        free(requests);
+        return false;
     }
 #endif
+    if (!installs || !requests) {
+        free(installs);
+        free(requests);
+#ifdef ARCHIVE_STREAM_SUPPORTED
+        compiler_manifest_free(manifest);
+#endif
+        return false;
+    }
     
-    log_message("Compiler %s installed successfully", version);
-    log_message("Executable path: %s", pawncc_path);
-    log_message("Library path: %s", pawnc_path);
-    return true;
-} 
\ No newline at end of file
+    // Versions that cannot even be prepared are left out of the downloads
+    int request_count = 0;
+    for (int i = 0; i < count; i++) {
+        log_message("Installing compiler version: %s", versions[i]);
+        if (!prepare_install(&installs[i], versions[i])) {
+            continue;
+        }
+#ifdef ARCHIVE_STREAM_SUPPORTED
+        installs[i].manifest = manifest;
+        snprintf(installs[i].pawncc_name, sizeof(installs[i].pawncc_name), "%s", compiler_manifest_binary(manifest));
+        snprintf(installs[i].pawnc_name, sizeof(installs[i].pawnc_name), "%s", compiler_manifest_library(manifest));
+#endif
+        DownloadRequest *request = &requests[request_count++];
+        request->url = installs[i].url;
+        request->dest_path = installs[i].zip_path;
+        request->user_data = &installs[i];
+#ifdef ARCHIVE_STREAM_SUPPORTED
+        installs[i].archive = archive_stream_create(compiler_manifest_format(manifest), installs[i].staging_dir);
+        if (installs[i].archive) {
+            archive_stream_set_map(installs[i].archive, compiler_manifest_map, manifest);
+            sha256_init(&installs[i].sha);
+            request->sink = install_sink;
+            request->sink_data = &installs[i];
+            log_message("Extracting compiler to %s as it downloads", installs[i].staging_dir);
+        }
+#endif
+    }
+    
+    log_message("Downloading %d compilers...", request_count);
+    download_files(requests, request_count, start_install_worker);
+    
+    bool all_installed = true;
+    for (int i = 0; i < count; i++) {
+        if (installs[i].thread_started) {
+#ifdef _WIN32
+            WaitForSingleObject(installs[i].thread, INFINITE);
+            CloseHandle(installs[i].thread);
+#else
+            pthread_join(installs[i].thread, NULL);
+#endif
+        }
+#ifdef ARCHIVE_STREAM_SUPPORTED
+        archive_stream_free(installs[i].archive);
+#endif
+        installed[i] = installs[i].installed;
+        all_installed = all_installed && installed[i];
+    }
+    
+    free(installs);
+    free(requests);
+#ifdef ARCHIVE_STREAM_SUPPORTED
+    compiler_manifest_free(manifest);
+#endif
+    return all_installed;
+}
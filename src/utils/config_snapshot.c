@@ -0,0 +1,620 @@
+#include "config_snapshot.h"
+#include "compiler_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#define PATH_SEPARATOR '\\'
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#include "toml.h"
+
+#define SNAPSHOT_MAGIC "OCCS"
+#define SNAPSHOT_VERSION 1
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t content_hash;
+    int32_t source_mtime_nsec;
+    uint32_t path;              // pool offset of the absolute source path
+    uint32_t node_count;
+    uint32_t nodes_offset;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    uint32_t total_size;
+    uint32_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+    uint64_t size;
+    int64_t mtime;
+    int32_t mtime_nsec;
+    uint64_t hash;
+} SourceInfo;
+
+typedef struct {
+    ConfigNode *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    char *strings;
+    uint32_t strings_size;
+    uint32_t strings_capacity;
+} Builder;
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool get_absolute_path(const char *path, char *out, size_t out_size) {
+#ifdef _WIN32
+    return _fullpath(out, path, out_size) != NULL;
+#else
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved)) return false;
+    return snprintf(out, out_size, "%s", resolved) < (int)out_size;
+#endif
+}
+
+static void get_snapshot_dir(char *out, size_t out_size) {
+    snprintf(out, out_size, "%s%copencli%ccache%cconfig", get_appdata_path(),
+             PATH_SEPARATOR, PATH_SEPARATOR, PATH_SEPARATOR);
+}
+
+static void get_snapshot_path(const char *absolute_path, char *out, size_t out_size) {
+    char dir[512];
+    get_snapshot_dir(dir, sizeof(dir));
+
+    uint64_t hash = fnv1a(14695981039346656037ULL, (const unsigned char *)absolute_path, strlen(absolute_path));
+    snprintf(out, out_size, "%s%c%016llx.snap", dir, PATH_SEPARATOR, (unsigned long long)hash);
+}
+
+/**
+ * Size, mtime and content hash of the source. Reading the file is far
+ * cheaper than tokenising it, and catches edits that keep size and mtime
+ */
+static bool read_source_info(const char *path, SourceInfo *info) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+
+    info->size = (uint64_t)st.st_size;
+    info->mtime = (int64_t)st.st_mtime;
+    info->mtime_nsec = 0;
+#if defined(__APPLE__)
+    info->mtime_nsec = (int32_t)st.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__ANDROID__)
+    info->mtime_nsec = (int32_t)st.st_mtim.tv_nsec;
+#endif
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    unsigned char chunk[4096];
+    uint64_t hash = 14695981039346656037ULL;
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        hash = fnv1a(hash, chunk, n);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+
+    info->hash = hash;
+    return ok;
+}
+
+static bool snapshot_attach(ConfigSnapshot *snapshot, const unsigned char *data, size_t size) {
+    if (size < sizeof(SnapshotHeader)) return false;
+
+    const SnapshotHeader *header = (const SnapshotHeader *)data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->total_size != size || header->nodes_offset != sizeof(SnapshotHeader) ||
+        header->node_count == 0 ||
+        header->node_count > (size - sizeof(SnapshotHeader)) / sizeof(ConfigNode) ||
+        header->strings_offset != header->nodes_offset + header->node_count * sizeof(ConfigNode) ||
+        header->strings_size == 0 || (size_t)header->strings_offset + header->strings_size != size) {
+        return false;
+    }
+
+    snapshot->data = data;
+    snapshot->size = size;
+    snapshot->nodes = (const ConfigNode *)(data + header->nodes_offset);
+    snapshot->node_count = header->node_count;
+    snapshot->strings = (const char *)(data + header->strings_offset);
+    snapshot->strings_size = header->strings_size;
+
+    // Every offset is checked once here, so the accessors can trust them
+    if (snapshot->strings[0] != '\0' || snapshot->strings[snapshot->strings_size - 1] != '\0' ||
+        header->path >= snapshot->strings_size || snapshot->nodes[0].type != CONFIG_NODE_TABLE) {
+        return false;
+    }
+    for (uint32_t i = 0; i < snapshot->node_count; i++) {
+        const ConfigNode *node = &snapshot->nodes[i];
+        if (node->key >= snapshot->strings_size) return false;
+
+        switch (node->type) {
+            case CONFIG_NODE_TABLE:
+            case CONFIG_NODE_ARRAY:
+                if (node->first > snapshot->node_count || node->count > snapshot->node_count - node->first) {
+                    return false;
+                }
+                break;
+            case CONFIG_NODE_STRING:
+                if (node->first >= snapshot->strings_size ||
+                    node->count >= snapshot->strings_size - node->first ||
+                    snapshot->strings[node->first + node->count] != '\0') {
+                    return false;
+                }
+                break;
+            case CONFIG_NODE_INT:
+            case CONFIG_NODE_DOUBLE:
+            case CONFIG_NODE_BOOL:
+                break;
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool snapshot_matches(const ConfigSnapshot *snapshot, const char *absolute_path, const SourceInfo *info) {
+    const SnapshotHeader *header = (const SnapshotHeader *)snapshot->data;
+    return header->source_size == info->size && header->source_mtime == info->mtime &&
+           header->source_mtime_nsec == info->mtime_nsec && header->content_hash == info->hash &&
+           strcmp(snapshot->strings + header->path, absolute_path) == 0;
+}
+
+void config_snapshot_close(ConfigSnapshot *snapshot) {
+    if (!snapshot) return;
+
+    if (snapshot->buffer) {
+        free(snapshot->buffer);
+    } else if (snapshot->data) {
+#ifdef _WIN32
+        UnmapViewOfFile(snapshot->data);
+#else
+        munmap((void *)snapshot->data, snapshot->size);
+#endif
+    }
+    memset(snapshot, 0, sizeof(ConfigSnapshot));
+}
+
+/**
+ * Map a stored snapshot, which is used only if it describes the source as
+ * it is now
+ */
+static bool map_snapshot(ConfigSnapshot *snapshot, const char *snapshot_path,
+                         const char *absolute_path, const SourceInfo *info) {
+    const unsigned char *data = NULL;
+    size_t size = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(snapshot_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(SnapshotHeader) &&
+        file_size.QuadPart <= UINT32_MAX) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = (size_t)file_size.QuadPart;
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(snapshot_path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SnapshotHeader) && st.st_size <= UINT32_MAX) {
+        void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data = mapped;
+            size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!data) return false;
+
+    if (!snapshot_attach(snapshot, data, size) || !snapshot_matches(snapshot, absolute_path, info)) {
+        snapshot->data = data;
+        snapshot->size = size;
+        config_snapshot_close(snapshot);
+        return false;
+    }
+    return true;
+}
+
+static uint32_t builder_string(Builder *builder, const char *text, size_t length) {
+    if (length >= UINT32_MAX - builder->strings_size - 1) return UINT32_MAX;
+
+    uint32_t needed = builder->strings_size + (uint32_t)length + 1;
+    if (needed > builder->strings_capacity) {
+        uint32_t capacity = builder->strings_capacity > 0 ? builder->strings_capacity : 1024;
+        while (capacity < needed) capacity *= 2;
+        char *strings = realloc(builder->strings, capacity);
+        if (!strings) return UINT32_MAX;
+        builder->strings = strings;
+        builder->strings_capacity = capacity;
+    }
+
+    uint32_t offset = builder->strings_size;
+    memcpy(builder->strings + offset, text, length);
+    builder->strings[offset + length] = '\0';
+    builder->strings_size = needed;
+    return offset;
+}
+
+// Append count empty nodes, returning the index of the first
+static uint32_t builder_reserve(Builder *builder, uint32_t count) {
+    if (count > UINT32_MAX / 2 - builder->node_count) return UINT32_MAX;
+
+    uint32_t needed = builder->node_count + count;
+    if (needed > builder->node_capacity) {
+        uint32_t capacity = builder->node_capacity > 0 ? builder->node_capacity : 64;
+        while (capacity < needed) capacity *= 2;
+        ConfigNode *nodes = realloc(builder->nodes, sizeof(ConfigNode) * capacity);
+        if (!nodes) return UINT32_MAX;
+        builder->nodes = nodes;
+        builder->node_capacity = capacity;
+    }
+
+    uint32_t first = builder->node_count;
+    memset(&builder->nodes[first], 0, sizeof(ConfigNode) * count);
+    builder->node_count = needed;
+    return first;
+}
+
+// A scalar, as written in the mapped source. string is its value, borrowed
+// from the table, if it is a quoted string
+static bool build_value(Builder *builder, toml_rawview_t raw, const char *string, int string_length,
+                        uint32_t index) {
+    int boolean;
+    int64_t integer;
+    double number;
+
+    if (raw.ptr[0] == '"' || raw.ptr[0] == '\'') {
+        if (!string) return false;
+        size_t length = (size_t)string_length;
+        uint32_t offset = builder_string(builder, string, length);
+        if (offset == UINT32_MAX) return false;
+
+        builder->nodes[index].type = CONFIG_NODE_STRING;
+        builder->nodes[index].first = offset;
+        builder->nodes[index].count = (uint32_t)length;
+        return true;
+    }
+
+    // The converters want a C string; anything longer than this is no
+    // number or boolean
+    char text[128];
+    size_t text_length = raw.len < (int)sizeof(text) ? (size_t)raw.len : 0;
+    memcpy(text, raw.ptr, text_length);
+    text[text_length] = '\0';
+
+    if (toml_rtob(text, &boolean) == 0) {
+        builder->nodes[index].type = CONFIG_NODE_BOOL;
+        builder->nodes[index].value = boolean ? 1 : 0;
+    } else if (toml_rtoi(text, &integer) == 0) {
+        builder->nodes[index].type = CONFIG_NODE_INT;
+        builder->nodes[index].value = integer;
+    } else if (toml_rtod(text, &number) == 0) {
+        builder->nodes[index].type = CONFIG_NODE_DOUBLE;
+        memcpy(&builder->nodes[index].value, &number, sizeof(number));
+    } else {
+        // Dates and times keep their text
+        size_t length = (size_t)raw.len;
+        uint32_t offset = builder_string(builder, raw.ptr, length);
+        if (offset == UINT32_MAX) return false;
+
+        builder->nodes[index].type = CONFIG_NODE_STRING;
+        builder->nodes[index].first = offset;
+        builder->nodes[index].count = (uint32_t)length;
+    }
+    return true;
+}
+
+static bool build_table(Builder *builder, const toml_table_t *table, uint32_t index);
+
+static bool build_array(Builder *builder, const toml_array_t *array, uint32_t index) {
+    int count = toml_array_nelem(array);
+    if (count < 0) return false;
+
+    uint32_t first = builder_reserve(builder, (uint32_t)count);
+    if (first == UINT32_MAX) return false;
+
+    builder->nodes[index].type = CONFIG_NODE_ARRAY;
+    builder->nodes[index].first = first;
+    builder->nodes[index].count = (uint32_t)count;
+
+    for (int i = 0; i < count; i++) {
+        uint32_t child = first + (uint32_t)i;
+        toml_rawview_t raw = toml_raw_view_at(array, i);
+        const toml_array_t *sub_array;
+        const toml_table_t *sub_table;
+
+        if (raw.ptr) {
+            const char *string;
+            int length = 0;
+            toml_string_ref_at(array, i, &string, &length);
+            if (!build_value(builder, raw, string, length, child)) return false;
+        } else if ((sub_array = toml_array_at(array, i)) != NULL) {
+            if (!build_array(builder, sub_array, child)) return false;
+        } else if ((sub_table = toml_table_at(array, i)) != NULL) {
+            if (!build_table(builder, sub_table, child)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static bool build_table(Builder *builder, const toml_table_t *table, uint32_t index) {
+    int count = 0;
+    while (toml_key_in(table, count)) count++;
+
+    const char **keys = malloc(sizeof(char *) * (count > 0 ? count : 1));
+    if (!keys) return false;
+    for (int i = 0; i < count; i++) {
+        keys[i] = toml_key_in(table, i);
+    }
+    qsort(keys, (size_t)count, sizeof(char *), compare_keys);
+
+    uint32_t first = builder_reserve(builder, (uint32_t)count);
+    bool ok = first != UINT32_MAX;
+    if (ok) {
+        builder->nodes[index].type = CONFIG_NODE_TABLE;
+        builder->nodes[index].first = first;
+        builder->nodes[index].count = (uint32_t)count;
+    }
+
+    for (int i = 0; ok && i < count; i++) {
+        uint32_t child = first + (uint32_t)i;
+        uint32_t key = builder_string(builder, keys[i], strlen(keys[i]));
+        if (key == UINT32_MAX) {
+            ok = false;
+            break;
+        }
+        builder->nodes[child].key = key;
+
+        toml_rawview_t raw = toml_raw_view_in(table, keys[i]);
+        const toml_array_t *sub_array;
+        const toml_table_t *sub_table;
+        if (raw.ptr) {
+            const char *string;
+            int length = 0;
+            toml_string_ref_in(table, keys[i], &string, &length);
+            ok = build_value(builder, raw, string, length, child);
+        } else if ((sub_array = toml_array_in(table, keys[i])) != NULL) {
+            ok = build_array(builder, sub_array, child);
+        } else if ((sub_table = toml_table_in(table, keys[i])) != NULL) {
+            ok = build_table(builder, sub_table, child);
+        } else {
+            ok = false;
+        }
+    }
+
+    free(keys);
+    return ok;
+}
+
+/**
+ * Parse the source and lay it out as a snapshot blob
+ */
+static unsigned char *compile_snapshot(const char *toml_path, const char *absolute_path,
+                                       const SourceInfo *info, size_t *size) {
+    // Parsed in place: values are only copied once, into the blob
+    char errbuf[200];
+    toml_table_t *conf = toml_parse_mapped(toml_path, errbuf, sizeof(errbuf));
+
+    if (!conf) {
+        fprintf(stderr, "Error parsing %s: %s\n", toml_path, errbuf);
+        return NULL;
+    }
+
+    Builder builder;
+    memset(&builder, 0, sizeof(builder));
+
+    // Offset 0 is the empty string used as the key of array elements
+    uint32_t empty = builder_string(&builder, "", 0);
+    uint32_t path = builder_string(&builder, absolute_path, strlen(absolute_path));
+    uint32_t root = builder_reserve(&builder, 1);
+    bool ok = empty != UINT32_MAX && path != UINT32_MAX && root != UINT32_MAX &&
+              build_table(&builder, conf, root);
+    toml_free(conf);
+
+    size_t nodes_size = sizeof(ConfigNode) * (size_t)builder.node_count;
+    size_t total = sizeof(SnapshotHeader) + nodes_size + builder.strings_size;
+    unsigned char *blob = ok && total <= UINT32_MAX ? malloc(total) : NULL;
+    if (blob) {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+        header.version = SNAPSHOT_VERSION;
+        header.source_size = info->size;
+        header.source_mtime = info->mtime;
+        header.source_mtime_nsec = info->mtime_nsec;
+        header.content_hash = info->hash;
+        header.path = path;
+        header.node_count = builder.node_count;
+        header.nodes_offset = sizeof(SnapshotHeader);
+        header.strings_offset = (uint32_t)(sizeof(SnapshotHeader) + nodes_size);
+        header.strings_size = builder.strings_size;
+        header.total_size = (uint32_t)total;
+
+        memcpy(blob, &header, sizeof(header));
+        memcpy(blob + header.nodes_offset, builder.nodes, nodes_size);
+        memcpy(blob + header.strings_offset, builder.strings, builder.strings_size);
+        *size = total;
+    } else {
+        fprintf(stderr, "Error: Out of memory reading %s\n", toml_path);
+    }
+
+    free(builder.nodes);
+    free(builder.strings);
+    return blob;
+}
+
+/**
+ * Store a snapshot next to the others, replacing any old one atomically so
+ * a concurrent reader maps either the old or the new blob
+ */
+static bool store_snapshot(const char *snapshot_path, const unsigned char *blob, size_t size) {
+    char cache_dir[512];
+    snprintf(cache_dir, sizeof(cache_dir), "%s%copencli%ccache", get_appdata_path(), PATH_SEPARATOR, PATH_SEPARATOR);
+    ensure_directory_exists(cache_dir);
+
+    char snapshot_dir[512];
+    get_snapshot_dir(snapshot_dir, sizeof(snapshot_dir));
+    ensure_directory_exists(snapshot_dir);
+
+    char temp_path[600];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", snapshot_path, (int)getpid()) >= (int)sizeof(temp_path)) {
+        return false;
+    }
+
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) return false;
+
+    bool ok = fwrite(blob, 1, size, file) == size;
+    if (fclose(file) != 0) ok = false;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp_path, snapshot_path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path, snapshot_path) == 0;
+#endif
+    if (!ok) {
+        remove(temp_path);
+    }
+    return ok;
+}
+
+ConfigSnapshotStatus config_snapshot_open(ConfigSnapshot *snapshot, const char *toml_path) {
+    memset(snapshot, 0, sizeof(ConfigSnapshot));
+
+    SourceInfo info;
+    char absolute_path[PATH_MAX];
+    if (!read_source_info(toml_path, &info) || !get_absolute_path(toml_path, absolute_path, sizeof(absolute_path))) {
+        if (errno == ENOENT) {
+            return CONFIG_SNAPSHOT_MISSING;
+        }
+        fprintf(stderr, "Error: Cannot read %s: %s\n", toml_path, strerror(errno));
+        return CONFIG_SNAPSHOT_ERROR;
+    }
+
+    char snapshot_path[600];
+    get_snapshot_path(absolute_path, snapshot_path, sizeof(snapshot_path));
+
+    if (map_snapshot(snapshot, snapshot_path, absolute_path, &info)) {
+        return CONFIG_SNAPSHOT_OK;
+    }
+
+    size_t size = 0;
+    unsigned char *blob = compile_snapshot(toml_path, absolute_path, &info, &size);
+    if (!blob) {
+        return CONFIG_SNAPSHOT_ERROR;
+    }
+
+    // A snapshot that cannot be stored is still good for this process
+    store_snapshot(snapshot_path, blob, size);
+
+    if (!snapshot_attach(snapshot, blob, size)) {
+        free(blob);
+        memset(snapshot, 0, sizeof(ConfigSnapshot));
+        fprintf(stderr, "Error: Cannot read %s: too large\n", toml_path);
+        return CONFIG_SNAPSHOT_ERROR;
+    }
+    snapshot->buffer = blob;
+    return CONFIG_SNAPSHOT_OK;
+}
+
+const ConfigNode *config_snapshot_root(const ConfigSnapshot *snapshot) {
+    return snapshot->node_count > 0 ? &snapshot->nodes[0] : NULL;
+}
+
+const ConfigNode *config_node_get(const ConfigSnapshot *snapshot, const ConfigNode *table, const char *key) {
+    if (!table || table->type != CONFIG_NODE_TABLE) return NULL;
+
+    // Keys are sorted, so a binary search finds them without a hash table
+    uint32_t low = table->first;
+    uint32_t high = table->first + table->count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int cmp = strcmp(snapshot->strings + snapshot->nodes[mid].key, key);
+        if (cmp == 0) return &snapshot->nodes[mid];
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+const ConfigNode *config_node_at(const ConfigSnapshot *snapshot, const ConfigNode *node, uint32_t index) {
+    if (!node || (node->type != CONFIG_NODE_ARRAY && node->type != CONFIG_NODE_TABLE) || index >= node->count) {
+        return NULL;
+    }
+    return &snapshot->nodes[node->first + index];
+}
+
+const char *config_node_key(const ConfigSnapshot *snapshot, const ConfigNode *node) {
+    return node ? snapshot->strings + node->key : NULL;
+}
+
+bool config_node_string(const ConfigSnapshot *snapshot, const ConfigNode *node, const char **value, size_t *length) {
+    if (!node || node->type != CONFIG_NODE_STRING) return false;
+    *value = snapshot->strings + node->first;
+    if (length) *length = node->count;
+    return true;
+}
+
+bool config_node_int(const ConfigNode *node, int64_t *value) {
+    if (!node || node->type != CONFIG_NODE_INT) return false;
+    *value = node->value;
+    return true;
+}
+
+bool config_node_double(const ConfigNode *node, double *value) {
+    if (!node || node->type != CONFIG_NODE_DOUBLE) return false;
+    memcpy(value, &node->value, sizeof(*value));
+    return true;
+}
+
+bool config_node_bool(const ConfigNode *node, bool *value) {
+    if (!node || node->type != CONFIG_NODE_BOOL) return false;
+    *value = node->value != 0;
+    return true;
+}
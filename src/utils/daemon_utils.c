@@ -0,0 +1,243 @@
+#include "daemon_utils.h"
+#include "compiler_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+extern char **environ;
+#endif
+
+const char *daemon_get_socket_path(void) {
+    static char socket_path[512] = {0};
+
+    if (socket_path[0] == '\0') {
+        #ifdef _WIN32
+        sprintf_s(socket_path, sizeof(socket_path), "%s\\opencli\\compiled.sock", get_appdata_path());
+        #else
+        snprintf(socket_path, sizeof(socket_path), "%s/opencli/compiled.sock", get_appdata_path());
+        #endif
+    }
+
+    return socket_path;
+}
+
+bool daemon_supported(void) {
+#ifdef _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+#ifndef _WIN32
+static bool write_all(int fd, const void *data, size_t length) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t length) {
+    char *p = data;
+    while (length > 0) {
+        ssize_t n = recv(fd, p, length, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+#endif
+
+int daemon_connect(void) {
+#ifdef _WIN32
+    return -1;
+#else
+    const char *socket_path = daemon_get_socket_path();
+    struct sockaddr_un addr;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#endif
+}
+
+bool daemon_send_frame(int fd, char type, const void *payload, uint32_t length) {
+#ifdef _WIN32
+    (void)fd; (void)type; (void)payload; (void)length;
+    return false;
+#else
+    unsigned char header[5];
+    header[0] = (unsigned char)type;
+    header[1] = (unsigned char)(length >> 24);
+    header[2] = (unsigned char)(length >> 16);
+    header[3] = (unsigned char)(length >> 8);
+    header[4] = (unsigned char)length;
+
+    if (!write_all(fd, header, sizeof(header))) {
+        return false;
+    }
+    return length == 0 || write_all(fd, payload, length);
+#endif
+}
+
+bool daemon_recv_frame(int fd, char *type, char **payload, uint32_t *length) {
+    *payload = NULL;
+#ifdef _WIN32
+    (void)fd; (void)type; (void)length;
+    return false;
+#else
+    unsigned char header[5];
+    if (!read_all(fd, header, sizeof(header))) {
+        return false;
+    }
+
+    *type = (char)header[0];
+    *length = ((uint32_t)header[1] << 24) | ((uint32_t)header[2] << 16) |
+              ((uint32_t)header[3] << 8) | (uint32_t)header[4];
+    if (*length > DAEMON_MAX_FRAME) {
+        return false;
+    }
+
+    char *data = malloc(*length + 1);
+    if (!data) {
+        return false;
+    }
+    if (*length > 0 && !read_all(fd, data, *length)) {
+        free(data);
+        return false;
+    }
+    data[*length] = '\0';
+
+    *payload = data;
+    return true;
+#endif
+}
+
+int daemon_client_build(int argc, char *argv[], bool *handled) {
+    *handled = false;
+#ifdef _WIN32
+    (void)argc;
+    (void)argv;
+    return EXIT_FAILURE;
+#else
+    char cwd[1024];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return EXIT_FAILURE;
+    }
+
+    int fd = daemon_connect();
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    char argc_text[16];
+    snprintf(argc_text, sizeof(argc_text), "%d", argc);
+
+    size_t length = strlen(cwd) + 1 + strlen(argc_text) + 1;
+    for (int i = 0; i < argc; i++) {
+        length += strlen(argv[i]) + 1;
+    }
+    for (char **env = environ; *env; env++) {
+        length += strlen(*env) + 1;
+    }
+    if (length > DAEMON_MAX_FRAME) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    char *request = malloc(length);
+    if (!request) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    size_t offset = 0;
+    memcpy(request, cwd, strlen(cwd) + 1);
+    offset += strlen(cwd) + 1;
+    memcpy(request + offset, argc_text, strlen(argc_text) + 1);
+    offset += strlen(argc_text) + 1;
+    for (int i = 0; i < argc; i++) {
+        memcpy(request + offset, argv[i], strlen(argv[i]) + 1);
+        offset += strlen(argv[i]) + 1;
+    }
+    // The build runs with the caller's environment, not the daemon's
+    for (char **env = environ; *env; env++) {
+        memcpy(request + offset, *env, strlen(*env) + 1);
+        offset += strlen(*env) + 1;
+    }
+
+    bool sent = daemon_send_frame(fd, DAEMON_FRAME_BUILD, request, (uint32_t)length);
+    free(request);
+    if (!sent) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    // From here on the daemon owns the build; a dropped connection is an
+    // error rather than a reason to build a second time locally
+    *handled = true;
+
+    for (;;) {
+        char type;
+        char *payload;
+        uint32_t payload_length;
+
+        if (!daemon_recv_frame(fd, &type, &payload, &payload_length)) {
+            fprintf(stderr, "Lost connection to the compile daemon\n");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+
+        if (type == DAEMON_FRAME_STDOUT) {
+            fwrite(payload, 1, payload_length, stdout);
+            fflush(stdout);
+        } else if (type == DAEMON_FRAME_STDERR) {
+            fwrite(payload, 1, payload_length, stderr);
+            fflush(stderr);
+        } else if (type == DAEMON_FRAME_EXIT) {
+            int code = payload_length >= 4 ?
+                (int)(((uint32_t)(unsigned char)payload[0] << 24) | ((uint32_t)(unsigned char)payload[1] << 16) |
+                      ((uint32_t)(unsigned char)payload[2] << 8) | (uint32_t)(unsigned char)payload[3]) :
+                EXIT_FAILURE;
+            free(payload);
+            close(fd);
+            return code;
+        }
+
+        free(payload);
+    }
+#endif
+}
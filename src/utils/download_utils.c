@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -14,10 +15,359 @@
 #include <netdb.h>
 #else
 #include <curl/curl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
-bool download_file(const char *url, const char *dest_path) {
-    
+#include "archive_stream.h"
+
+// path with suffix appended; the caller frees it
+static char *path_with_suffix(const char *path, const char *suffix) {
+    size_t path_len = strlen(path);
+    size_t suffix_len = strlen(suffix);
+    char *result = malloc(path_len + suffix_len + 1);
+    if (result) {
+        memcpy(result, path, path_len);
+        memcpy(result + path_len, suffix, suffix_len + 1);
+    }
+    return result;
+}
+
+// Move a finished download into place in one step
+static bool commit_download(const char *part_path, const char *dest_path) {
+#ifdef _WIN32
+    if (!MoveFileExA(part_path, dest_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        fprintf(stderr, "Failed to move %s into place (error code: %lu)\n", part_path, GetLastError());
+        return false;
+    }
+#else
+    if (rename(part_path, dest_path) != 0) {
+        fprintf(stderr, "Failed to move %s into place: %s\n", part_path, strerror(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+/**
+ * A download into <dest>.part. <dest>.part.info keeps the URL and the
+ * validator (a strong ETag, else Last-Modified) of the response the part
+ * came from. A later attempt resumes with Range and If-Range only when
+ * both are known, so a file that changed on the server is fetched again
+ * instead of being spliced onto the old part
+ */
+typedef struct {
+    const char *url;
+    const char *dest_path;
+    char *part_path;
+    char *info_path;
+    CURL *curl;
+    FILE *fp;
+    struct curl_slist *headers;
+    curl_off_t resume_from;         // bytes kept from an earlier attempt
+    char resume_validator[256];
+    // Of the response being received
+    char validator[256];
+    bool strong_etag;
+    curl_off_t range_start;         // from Content-Range, -1 without one
+    bool range_mismatch;
+    int attempts;
+    // Set for a download that goes to a sink rather than <dest>.part
+    DownloadSink sink;
+    void *sink_data;
+} PartialDownload;
+
+/**
+ * If the header line is "name: value", copy the trimmed value
+ */
+static bool header_value(const char *line, size_t length, const char *name, char *value, size_t value_size) {
+    size_t name_len = strlen(name);
+    if (length <= name_len || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':') {
+        return false;
+    }
+
+    const char *start = line + name_len + 1;
+    const char *end = line + length;
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+
+    size_t value_len = (size_t)(end - start);
+    if (value_len >= value_size) {
+        value_len = 0;  // too long to be of use
+    }
+    memcpy(value, start, value_len);
+    value[value_len] = '\0';
+    return true;
+}
+
+static size_t partial_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    PartialDownload *download = userdata;
+    size_t length = size * nitems;
+    char value[256];
+
+    if (length >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        // A new response, after a redirect or an interim one
+        download->validator[0] = '\0';
+        download->strong_etag = false;
+        download->range_start = -1;
+    } else if (header_value(buffer, length, "etag", value, sizeof(value))) {
+        // Weak ETags cannot be used with If-Range
+        if (value[0] != '\0' && strncmp(value, "W/", 2) != 0) {
+            memcpy(download->validator, value, sizeof(value));
+            download->strong_etag = true;
+        }
+    } else if (header_value(buffer, length, "last-modified", value, sizeof(value))) {
+        if (!download->strong_etag) {
+            memcpy(download->validator, value, sizeof(value));
+        }
+    } else if (header_value(buffer, length, "content-range", value, sizeof(value))) {
+        long long start;
+        if (sscanf(value, "bytes %lld-", &start) == 1) {
+            download->range_start = (curl_off_t)start;
+        }
+    }
+    return length;
+}
+
+// Remember where the .part file came from, or forget it if it cannot be resumed
+static void save_partial_info(const PartialDownload *download) {
+    FILE *fp = download->validator[0] ? fopen(download->info_path, "w") : NULL;
+    if (!fp) {
+        remove(download->info_path);
+        return;
+    }
+    fprintf(fp, "%s\n%s\n", download->url, download->validator);
+    fclose(fp);
+}
+
+// Open the .part file for the first bytes of the body
+static bool open_partial(PartialDownload *download) {
+    long status = 0;
+    curl_easy_getinfo(download->curl, CURLINFO_RESPONSE_CODE, &status);
+
+    if (status == 206 && download->resume_from > 0) {
+        // A server that ignores If-Range can send the rest of a newer file
+        if (download->range_start != download->resume_from ||
+            strcmp(download->validator, download->resume_validator) != 0) {
+            download->range_mismatch = true;
+            return false;
+        }
+        download->fp = fopen(download->part_path, "ab");
+    } else {
+        // A full response, so whatever the .part file held is dropped
+        download->resume_from = 0;
+        download->fp = fopen(download->part_path, "wb");
+    }
+
+    if (!download->fp) {
+        fprintf(stderr, "Failed to create file: %s\n", download->part_path);
+        return false;
+    }
+    save_partial_info(download);
+    return true;
+}
+
+static size_t partial_write(char *data, size_t size, size_t nmemb, void *userdata) {
+    PartialDownload *download = userdata;
+    size_t length = size * nmemb;
+
+    if (!download->fp) {
+        // The body of an error response is not the file
+        long status = 0;
+        curl_easy_getinfo(download->curl, CURLINFO_RESPONSE_CODE, &status);
+        if (status != 200 && status != 206) {
+            return length;
+        }
+        if (download->sink) {
+            return download->sink(data, length, download->sink_data) ? length : 0;
+        }
+        if (!open_partial(download)) {
+            return 0;
+        }
+    }
+    return fwrite(data, 1, length, download->fp);
+}
+
+/**
+ * Pick up what an earlier attempt left in <dest>.part, if it can be
+ * resumed safely; anything else is removed
+ */
+static bool partial_begin(PartialDownload *download, const char *url, const char *dest_path) {
+    memset(download, 0, sizeof(*download));
+    download->url = url;
+    download->dest_path = dest_path;
+    if (!dest_path) {
+        // Streamed to a sink
+        return true;
+    }
+    download->part_path = path_with_suffix(dest_path, ".part");
+    download->info_path = path_with_suffix(dest_path, ".part.info");
+    if (!download->part_path || !download->info_path) {
+        free(download->part_path);
+        free(download->info_path);
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+
+    struct stat st;
+    FILE *info = fopen(download->info_path, "r");
+    if (info && stat(download->part_path, &st) == 0 && st.st_size > 0) {
+        char saved_url[2048];
+        if (fgets(saved_url, sizeof(saved_url), info) &&
+            fgets(download->resume_validator, sizeof(download->resume_validator), info)) {
+            saved_url[strcspn(saved_url, "\r\n")] = '\0';
+            download->resume_validator[strcspn(download->resume_validator, "\r\n")] = '\0';
+            if (strcmp(saved_url, url) == 0 && download->resume_validator[0] != '\0') {
+                download->resume_from = (curl_off_t)st.st_size;
+            }
+        }
+    }
+    if (info) {
+        fclose(info);
+    }
+
+    if (download->resume_from == 0) {
+        remove(download->part_path);
+        remove(download->info_path);
+    }
+    return true;
+}
+
+static void partial_end(PartialDownload *download) {
+    if (download->fp) {
+        fclose(download->fp);
+    }
+    if (download->curl) {
+        curl_easy_cleanup(download->curl);
+    }
+    curl_slist_free_all(download->headers);
+    free(download->part_path);
+    free(download->info_path);
+}
+
+// An easy handle for the next attempt at download
+static CURL *create_transfer(PartialDownload *download) {
+    download->attempts++;
+    download->range_start = -1;
+    download->range_mismatch = false;
+    curl_slist_free_all(download->headers);
+    download->headers = NULL;
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        return NULL;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, download->url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, partial_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, download);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, partial_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, download);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "opencli/1.0");
+
+    if (download->resume_from > 0) {
+        // The server sends the whole file instead if it has changed. A plain
+        // Range rather than CURLOPT_RESUME_FROM, which fails on that answer
+        char if_range[300];
+        char range[32];
+        snprintf(if_range, sizeof(if_range), "If-Range: %s", download->resume_validator);
+        snprintf(range, sizeof(range), "%lld-", (long long)download->resume_from);
+        download->headers = curl_slist_append(NULL, if_range);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, download->headers);
+        curl_easy_setopt(curl, CURLOPT_RANGE, range);
+        printf("Resuming download of %s at %lld bytes\n", download->url, (long long)download->resume_from);
+    }
+
+    download->curl = curl;
+    return curl;
+}
+
+/**
+ * Check the outcome of a finished transfer, printing why it failed. label
+ * names the download when several run at once
+ */
+static bool transfer_succeeded(CURL *curl, CURLcode res, const char *label) {
+    const char *prefix = label ? label : "";
+    const char *separator = label ? ": " : "";
+
+    if (res != CURLE_OK) {
+        fprintf(stderr, "%s%sFailed to download file: %s\n", prefix, separator, curl_easy_strerror(res));
+        return false;
+    }
+
+    // Check HTTP status code; 206 answers a resumed download
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 200 && http_code != 206) {
+        fprintf(stderr, "%s%sHTTP error: %ld\n", prefix, separator, http_code);
+        if (http_code == 404) {
+            fprintf(stderr, "File not found on server (HTTP 404)\n");
+        } else if (http_code == 403) {
+            fprintf(stderr, "Access forbidden (HTTP 403)\n");
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Finish an attempt: close the .part file and move it into place if the
+ * transfer succeeded. *retry is set when the kept part turned out to be
+ * unusable and the download should start over
+ */
+static bool partial_finish(PartialDownload *download, CURLcode res, const char *label, bool *retry) {
+    CURL *curl = download->curl;
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    *retry = false;
+
+    if (download->sink) {
+        bool ok = transfer_succeeded(curl, res, label);
+        curl_easy_cleanup(curl);
+        download->curl = NULL;
+        return ok;
+    }
+
+    bool ok = true;
+    if (download->fp) {
+        ok = fflush(download->fp) == 0 && fsync(fileno(download->fp)) == 0;
+        ok = fclose(download->fp) == 0 && ok;
+        download->fp = NULL;
+    } else if (res == CURLE_OK && status == 200) {
+        // An empty file has no body to open the .part file for
+        ok = open_partial(download) && fclose(download->fp) == 0;
+        download->fp = NULL;
+    }
+
+    if ((download->range_mismatch || status == 416) && download->resume_from > 0) {
+        // The part does not fit what the server has now
+        remove(download->part_path);
+        remove(download->info_path);
+        download->resume_from = 0;
+        *retry = download->attempts < 2;
+        ok = false;
+    } else if (!transfer_succeeded(curl, res, label)) {
+        ok = false;
+    } else if (!ok) {
+        fprintf(stderr, "%s%sFailed to write %s\n", label ? label : "", label ? ": " : "", download->part_path);
+    } else if (commit_download(download->part_path, download->dest_path)) {
+        remove(download->info_path);
+    } else {
+        ok = false;
+    }
+
+    curl_easy_cleanup(curl);
+    download->curl = NULL;
+    return ok;
+}
+#endif
+
+#if defined(_WIN32) || defined(__ANDROID__)
+// Download url into dest_path, from the first byte
+static bool fetch_file(const char *url, const char *dest_path) {
 #ifdef _WIN32
     // Windows implementation using WinInet
     HINTERNET hInternet, hUrl;
@@ -183,58 +533,155 @@ bool download_file(const char *url, const char *dest_path) {
     fprintf(stderr, "  pkg install wget     (recommended)\n");
     fprintf(stderr, "  pkg install curl     (alternative)\n");
     return false;
+#endif
+}
+#endif
+
+bool download_file(const char *url, const char *dest_path) {
+#if defined(_WIN32) || defined(__ANDROID__)
+    // These downloaders cannot resume, so a failed part is not kept
+    char *part_path = path_with_suffix(dest_path, ".part");
+    if (!part_path) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    bool result = fetch_file(url, part_path) && commit_download(part_path, dest_path);
+    if (!result) {
+        remove(part_path);
+    }
+    free(part_path);
+    return result;
 #else
     // Linux/macOS implementation using libcurl
-    CURL *curl;
-    FILE *fp;
-    CURLcode res;
+    PartialDownload download;
+    if (!partial_begin(&download, url, dest_path)) {
+        return false;
+    }
+
     bool result = false;
+    bool retry = true;
+    while (!result && retry) {
+        if (!create_transfer(&download)) {
+            fprintf(stderr, "Failed to initialize curl\n");
+            break;
+        }
+        result = partial_finish(&download, curl_easy_perform(download.curl), NULL, &retry);
+    }
 
-    curl = curl_easy_init();
-    if (!curl) {
+    partial_end(&download);
+    return result;
+#endif
+}
+
+bool download_files(DownloadRequest *requests, int count, DownloadDoneCallback on_done) {
+    bool all_ok = true;
+
+#if defined(_WIN32) || defined(__ANDROID__)
+    for (int i = 0; i < count; i++) {
+        requests[i].ok = download_file(requests[i].url, requests[i].dest_path);
+        all_ok = all_ok && requests[i].ok;
+        if (on_done) {
+            on_done(&requests[i]);
+        }
+    }
+    return all_ok;
+#else
+    CURLM *multi = curl_multi_init();
+    PartialDownload *downloads = calloc((size_t)count, sizeof(PartialDownload));
+    bool *started = calloc((size_t)count, sizeof(bool));
+    if (!multi || !downloads || !started) {
         fprintf(stderr, "Failed to initialize curl\n");
+        if (multi) curl_multi_cleanup(multi);
+        free(downloads);
+        free(started);
         return false;
     }
 
-    fp = fopen(dest_path, "wb");
-    if (!fp) {
-        fprintf(stderr, "Failed to create file: %s\n", dest_path);
-        curl_easy_cleanup(curl);
-        return false;
+    for (int i = 0; i < count; i++) {
+        DownloadRequest *request = &requests[i];
+        PartialDownload *download = &downloads[i];
+        request->ok = false;
+
+        started[i] = partial_begin(download, request->url, request->sink ? NULL : request->dest_path);
+        download->sink = request->sink;
+        download->sink_data = request->sink_data;
+        CURL *curl = started[i] ? create_transfer(download) : NULL;
+        if (curl) {
+            curl_easy_setopt(curl, CURLOPT_PRIVATE, (char *)request);
+            if (curl_multi_add_handle(multi, curl) == CURLM_OK) {
+                continue;
+            }
+            curl_easy_cleanup(curl);
+            download->curl = NULL;
+        }
+
+        fprintf(stderr, "Failed to start download of %s\n", request->url);
+        all_ok = false;
+        if (on_done) {
+            on_done(request);
+        }
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "opencli/1.0");
+    int running = 1;
+    while (running) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            break;
+        }
 
-    res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        fprintf(stderr, "Failed to download file: %s\n", curl_easy_strerror(res));
-        fclose(fp);
-        curl_easy_cleanup(curl);
-        return false;
+        CURLMsg *msg;
+        int queued;
+        while ((msg = curl_multi_info_read(multi, &queued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            CURL *curl = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            char *private_data = NULL;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, &private_data);
+            DownloadRequest *request = (DownloadRequest *)private_data;
+            PartialDownload *download = &downloads[request - requests];
+
+            // The file is in place before on_done so the caller can read it
+            curl_multi_remove_handle(multi, curl);
+            bool retry;
+            request->ok = partial_finish(download, res, request->url, &retry);
+            if (retry && create_transfer(download)) {
+                curl_easy_setopt(download->curl, CURLOPT_PRIVATE, (char *)request);
+                if (curl_multi_add_handle(multi, download->curl) == CURLM_OK) {
+                    running++;
+                    continue;
+                }
+            }
+
+            all_ok = all_ok && request->ok;
+            if (on_done) {
+                on_done(request);
+            }
+        }
+
+        if (running) {
+            curl_multi_wait(multi, NULL, 0, 1000, NULL);
+        }
     }
 
-    // Check HTTP status code
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    if (http_code != 200) {
-        fprintf(stderr, "HTTP error: %ld\n", http_code);
-        if (http_code == 404) {
-            fprintf(stderr, "File not found on server (HTTP 404)\n");
-        } else if (http_code == 403) {
-            fprintf(stderr, "Access forbidden (HTTP 403)\n");
+    // Anything still running was cut short by a multi handle error
+    for (int i = 0; i < count; i++) {
+        if (downloads[i].curl) {
+            fprintf(stderr, "Download of %s was interrupted\n", requests[i].url);
+            curl_multi_remove_handle(multi, downloads[i].curl);
+            all_ok = false;
+            if (on_done) {
+                on_done(&requests[i]);
+            }
+        }
+        if (started[i]) {
+            partial_end(&downloads[i]);
         }
-        fclose(fp);
-        curl_easy_cleanup(curl);
-        return false;
     }
 
-    fclose(fp);
-    curl_easy_cleanup(curl);
-    return true;
+    curl_multi_cleanup(multi);
+    free(downloads);
+    free(started);
+    return all_ok;
 #endif
 }
 
@@ -294,8 +741,9 @@ bool extract_zip(const char *zip_path, const char *dest_dir) {
     
     fprintf(stderr, "Failed to extract %s\n", zip_path);
     return false;
+#elif defined(ARCHIVE_STREAM_SUPPORTED)
+    return archive_extract_file(ARCHIVE_ZIP, zip_path, dest_dir, NULL, NULL);
 #else
-    // Linux/macOS implementation
     char cmd[1024];
     sprintf(cmd, "unzip -o '%s' -d '%s'", zip_path, dest_dir);
     int result = system(cmd);
@@ -318,8 +766,9 @@ bool extract_tgz(const char *tgz_path, const char *dest_dir) {
         return false;
     }
     return true;
+#elif defined(ARCHIVE_STREAM_SUPPORTED)
+    return archive_extract_file(ARCHIVE_TGZ, tgz_path, dest_dir, NULL, NULL);
 #else
-    // Linux/macOS implementation
     char cmd[1024];
     sprintf(cmd, "tar -xzf '%s' -C '%s'", tgz_path, dest_dir);
     int result = system(cmd);
@@ -0,0 +1,994 @@
+#include "include_cache.h"
+#include "compiler_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#define PATH_SEPARATOR '\\'
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#define INCLUDE_CACHE_MAGIC "OCIC"
+#define INCLUDE_CACHE_VERSION 1
+#define INCLUDE_CACHE_NAME "includes.cache"
+#define INCLUDE_CACHE_LOCK_NAME "includes.cache.lock"
+
+#ifdef _WIN32
+typedef HANDLE SaveLock;
+#define INVALID_SAVE_LOCK INVALID_HANDLE_VALUE
+#else
+typedef int SaveLock;
+#define INVALID_SAVE_LOCK (-1)
+#endif
+
+typedef struct {
+    char *path;
+    int64_t mtime;
+    int32_t mtime_nsec;
+    bool exists;
+    unsigned checked_pass;  // pass valid was last worked out in
+    bool valid;
+} CachedDir;
+
+typedef struct {
+    uint32_t context;
+    char *include;
+    char *resolved;         // NULL for an include that was not found
+    uint32_t *dirs;
+    uint32_t dir_count;
+    uint64_t last_used;     // use_clock at the last lookup or store
+    int64_t recorded;       // when it was stored, 0 if it came from the file
+} CachedEntry;
+
+static char **contexts = NULL;
+static uint32_t context_count = 0;
+static uint32_t context_capacity = 0;
+
+// A directory appears once per recorded state; entries made before the
+// directory changed keep pointing at the old record and fail validation
+static CachedDir *dirs = NULL;
+static uint32_t dir_count = 0;
+static uint32_t dir_capacity = 0;
+
+// Open-addressing table of dir index + 1 over path and state
+static uint32_t *dir_table = NULL;
+static size_t dir_table_slots = 0;
+
+static CachedEntry *entries = NULL;
+static uint32_t entry_count = 0;
+static uint32_t entry_capacity = 0;
+
+// Open-addressing table of entry index + 1, 0 marks an empty slot
+static uint32_t *table = NULL;
+static size_t table_slots = 0;
+
+// Ticks on every use; the file keeps entries in order of use, so this
+// carries over between runs
+static uint64_t use_clock = 0;
+
+static bool loaded = false;
+static bool dirty = false;
+static unsigned current_pass = 1;
+static time_t loaded_mtime = 0;
+static long long loaded_size = -1;
+
+const char *include_cache_get_path(void) {
+    static char cache_path[512] = {0};
+
+    if (cache_path[0] == '\0') {
+        snprintf(cache_path, sizeof(cache_path), "%s%copencli%ccache%c%s",
+                 get_appdata_path(), PATH_SEPARATOR, PATH_SEPARATOR, PATH_SEPARATOR, INCLUDE_CACHE_NAME);
+    }
+
+    return cache_path;
+}
+
+static char *dup_bytes(const char *data, size_t length) {
+    char *copy = malloc(length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static uint64_t hash_entry(uint32_t context, const char *include) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 4; i++) {
+        hash ^= (context >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    for (const unsigned char *p = (const unsigned char *)include; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t hash_dir(const char *path, size_t length, int64_t mtime, int32_t mtime_nsec, bool exists) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= 1099511628211ULL;
+    }
+    uint64_t state[2] = {(uint64_t)mtime, ((uint64_t)(uint32_t)mtime_nsec << 1) | (exists ? 1 : 0)};
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 8; j++) {
+            hash ^= (state[i] >> (j * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static bool stat_dir(const char *path, int64_t *mtime, int32_t *mtime_nsec, bool *exists) {
+    struct stat st;
+    *mtime = 0;
+    *mtime_nsec = 0;
+    *exists = stat(path, &st) == 0;
+    if (*exists) {
+        *mtime = (int64_t)st.st_mtime;
+#if defined(__APPLE__)
+        *mtime_nsec = (int32_t)st.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__ANDROID__)
+        *mtime_nsec = (int32_t)st.st_mtim.tv_nsec;
+#endif
+    }
+    return true;
+}
+
+static bool dir_is_valid(CachedDir *dir) {
+    if (dir->checked_pass != current_pass) {
+        int64_t mtime;
+        int32_t mtime_nsec;
+        bool exists;
+        stat_dir(dir->path, &mtime, &mtime_nsec, &exists);
+
+        dir->valid = exists == dir->exists &&
+                     (!exists || (mtime == dir->mtime && mtime_nsec == dir->mtime_nsec));
+        dir->checked_pass = current_pass;
+    }
+    return dir->valid;
+}
+
+static void free_entry(CachedEntry *entry) {
+    free(entry->include);
+    free(entry->resolved);
+    free(entry->dirs);
+}
+
+void include_cache_clear(void) {
+    for (uint32_t i = 0; i < context_count; i++) {
+        free(contexts[i]);
+    }
+    free(contexts);
+    contexts = NULL;
+    context_count = context_capacity = 0;
+
+    for (uint32_t i = 0; i < dir_count; i++) {
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    dir_count = dir_capacity = 0;
+
+    free(dir_table);
+    dir_table = NULL;
+    dir_table_slots = 0;
+
+    for (uint32_t i = 0; i < entry_count; i++) {
+        free_entry(&entries[i]);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = entry_capacity = 0;
+    use_clock = 0;
+
+    free(table);
+    table = NULL;
+    table_slots = 0;
+
+    loaded = false;
+    dirty = false;
+}
+
+static bool table_rebuild(size_t slots) {
+    uint32_t *new_table = calloc(slots, sizeof(uint32_t));
+    if (!new_table) return false;
+
+    for (uint32_t i = 0; i < entry_count; i++) {
+        size_t slot = (size_t)hash_entry(entries[i].context, entries[i].include) & (slots - 1);
+        while (new_table[slot]) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        new_table[slot] = i + 1;
+    }
+
+    free(table);
+    table = new_table;
+    table_slots = slots;
+    return true;
+}
+
+static CachedEntry *find_entry(uint32_t context, const char *include) {
+    if (table_slots == 0) return NULL;
+
+    size_t slot = (size_t)hash_entry(context, include) & (table_slots - 1);
+    while (table[slot]) {
+        CachedEntry *entry = &entries[table[slot] - 1];
+        if (entry->context == context && strcmp(entry->include, include) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & (table_slots - 1);
+    }
+    return NULL;
+}
+
+static CachedEntry *append_entry(void) {
+    if (entry_count >= entry_capacity) {
+        uint32_t new_capacity = entry_capacity > 0 ? entry_capacity * 2 : 256;
+        CachedEntry *grown = realloc(entries, sizeof(CachedEntry) * new_capacity);
+        if (!grown) return NULL;
+        entries = grown;
+        entry_capacity = new_capacity;
+    }
+
+    // Keep the table at most half full
+    if ((size_t)(entry_count + 1) * 2 > table_slots &&
+        !table_rebuild(table_slots > 0 ? table_slots * 2 : 512)) {
+        return NULL;
+    }
+
+    CachedEntry *entry = &entries[entry_count];
+    memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+static void insert_entry(uint32_t index) {
+    size_t slot = (size_t)hash_entry(entries[index].context, entries[index].include) & (table_slots - 1);
+    while (table[slot]) {
+        slot = (slot + 1) & (table_slots - 1);
+    }
+    table[slot] = index + 1;
+}
+
+static int64_t find_context(const char *context, size_t length) {
+    for (uint32_t i = 0; i < context_count; i++) {
+        if (strlen(contexts[i]) == length && memcmp(contexts[i], context, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool add_context(const char *context, size_t length) {
+    if (context_count >= context_capacity) {
+        uint32_t new_capacity = context_capacity > 0 ? context_capacity * 2 : 16;
+        char **grown = realloc(contexts, sizeof(char *) * new_capacity);
+        if (!grown) return false;
+        contexts = grown;
+        context_capacity = new_capacity;
+    }
+
+    contexts[context_count] = dup_bytes(context, length);
+    if (!contexts[context_count]) return false;
+    context_count++;
+    return true;
+}
+
+static bool dir_table_rebuild(size_t slots) {
+    uint32_t *new_table = calloc(slots, sizeof(uint32_t));
+    if (!new_table) return false;
+
+    for (uint32_t i = 0; i < dir_count; i++) {
+        const CachedDir *dir = &dirs[i];
+        size_t slot = (size_t)hash_dir(dir->path, strlen(dir->path), dir->mtime, dir->mtime_nsec, dir->exists) &
+                      (slots - 1);
+        while (new_table[slot]) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        new_table[slot] = i + 1;
+    }
+
+    free(dir_table);
+    dir_table = new_table;
+    dir_table_slots = slots;
+    return true;
+}
+
+/**
+ * Index of the record of a directory in the given state, added if there
+ * is none yet; -1 if out of memory
+ */
+static int64_t find_or_add_dir(const char *path, size_t length, int64_t mtime, int32_t mtime_nsec, bool exists) {
+    uint64_t hash = hash_dir(path, length, mtime, mtime_nsec, exists);
+    if (dir_table_slots > 0) {
+        size_t slot = (size_t)hash & (dir_table_slots - 1);
+        while (dir_table[slot]) {
+            const CachedDir *dir = &dirs[dir_table[slot] - 1];
+            if (dir->exists == exists && dir->mtime == mtime && dir->mtime_nsec == mtime_nsec &&
+                strlen(dir->path) == length && memcmp(dir->path, path, length) == 0) {
+                return dir_table[slot] - 1;
+            }
+            slot = (slot + 1) & (dir_table_slots - 1);
+        }
+    }
+
+    if (dir_count >= dir_capacity) {
+        uint32_t new_capacity = dir_capacity > 0 ? dir_capacity * 2 : 64;
+        CachedDir *grown = realloc(dirs, sizeof(CachedDir) * new_capacity);
+        if (!grown) return -1;
+        dirs = grown;
+        dir_capacity = new_capacity;
+    }
+
+    // Keep the table at most half full
+    if ((size_t)(dir_count + 1) * 2 > dir_table_slots &&
+        !dir_table_rebuild(dir_table_slots > 0 ? dir_table_slots * 2 : 128)) {
+        return -1;
+    }
+
+    CachedDir *dir = &dirs[dir_count];
+    memset(dir, 0, sizeof(*dir));
+    dir->path = dup_bytes(path, length);
+    if (!dir->path) return -1;
+    dir->mtime = mtime;
+    dir->mtime_nsec = mtime_nsec;
+    dir->exists = exists;
+
+    size_t slot = (size_t)hash & (dir_table_slots - 1);
+    while (dir_table[slot]) {
+        slot = (slot + 1) & (dir_table_slots - 1);
+    }
+    dir_table[slot] = dir_count + 1;
+    return dir_count++;
+}
+
+/**
+ * Record of path in its current state, added if the directory is new or
+ * changed since it was last recorded
+ */
+static int64_t current_dir_record(const char *path) {
+    int64_t mtime;
+    int32_t mtime_nsec;
+    bool exists;
+    stat_dir(path, &mtime, &mtime_nsec, &exists);
+
+    uint32_t previous_count = dir_count;
+    int64_t record = find_or_add_dir(path, strlen(path), mtime, mtime_nsec, exists);
+    if (record >= 0 && dir_count != previous_count) {
+        // Just taken, so it is current for this pass
+        dirs[record].checked_pass = current_pass;
+        dirs[record].valid = true;
+    }
+    return record;
+}
+
+/**
+ * An entry is kept unless one of its directories is known to have changed
+ */
+static bool entry_is_kept(const CachedEntry *entry) {
+    for (uint32_t i = 0; i < entry->dir_count; i++) {
+        const CachedDir *dir = &dirs[entry->dirs[i]];
+        if (dir->checked_pass == current_pass && !dir->valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} Reader;
+
+static bool read_u32(Reader *reader, uint32_t *value) {
+    if (reader->end - reader->p < 4) return false;
+    *value = (uint32_t)reader->p[0] | ((uint32_t)reader->p[1] << 8) |
+             ((uint32_t)reader->p[2] << 16) | ((uint32_t)reader->p[3] << 24);
+    reader->p += 4;
+    return true;
+}
+
+static bool read_u64(Reader *reader, uint64_t *value) {
+    uint32_t low, high;
+    if (!read_u32(reader, &low) || !read_u32(reader, &high)) return false;
+    *value = (uint64_t)low | ((uint64_t)high << 32);
+    return true;
+}
+
+static bool read_bytes(Reader *reader, const char **data, uint32_t *length) {
+    if (!read_u32(reader, length)) return false;
+    if ((uint64_t)(reader->end - reader->p) < *length) return false;
+    *data = (const char *)reader->p;
+    reader->p += *length;
+    return true;
+}
+
+static bool read_contexts(Reader *reader, uint32_t **map, uint32_t *count) {
+    const char *bytes;
+    uint32_t length;
+
+    if (!read_u32(reader, count) || (uint64_t)(reader->end - reader->p) < (uint64_t)*count * 4) return false;
+    *map = malloc(sizeof(uint32_t) * (*count > 0 ? *count : 1));
+    if (!*map) return false;
+
+    for (uint32_t i = 0; i < *count; i++) {
+        if (!read_bytes(reader, &bytes, &length)) return false;
+        int64_t context = find_context(bytes, length);
+        if (context < 0) {
+            if (!add_context(bytes, length)) return false;
+            context = context_count - 1;
+        }
+        (*map)[i] = (uint32_t)context;
+    }
+    return true;
+}
+
+static bool read_dirs(Reader *reader, uint32_t **map, uint32_t *count) {
+    const char *bytes;
+    uint32_t length;
+
+    if (!read_u32(reader, count) || (uint64_t)(reader->end - reader->p) < (uint64_t)*count * 20) return false;
+    *map = malloc(sizeof(uint32_t) * (*count > 0 ? *count : 1));
+    if (!*map) return false;
+
+    for (uint32_t i = 0; i < *count; i++) {
+        uint64_t mtime;
+        uint32_t mtime_nsec, exists;
+        if (!read_bytes(reader, &bytes, &length) || !read_u64(reader, &mtime) ||
+            !read_u32(reader, &mtime_nsec) || !read_u32(reader, &exists)) {
+            return false;
+        }
+        int64_t dir = find_or_add_dir(bytes, length, (int64_t)mtime, (int32_t)mtime_nsec, exists != 0);
+        if (dir < 0) return false;
+        (*map)[i] = (uint32_t)dir;
+    }
+    return true;
+}
+
+static bool read_entries(Reader *reader, const uint32_t *context_map, uint32_t file_contexts,
+                         const uint32_t *dir_map, uint32_t file_dirs) {
+    uint32_t count;
+    if (!read_u32(reader, &count)) return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t context, found, deps;
+        const char *include, *resolved;
+        uint32_t include_length, resolved_length;
+
+        if (!read_u32(reader, &context) || context >= file_contexts ||
+            !read_bytes(reader, &include, &include_length) ||
+            !read_u32(reader, &found) ||
+            !read_bytes(reader, &resolved, &resolved_length) ||
+            !read_u32(reader, &deps) || (uint64_t)(reader->end - reader->p) < (uint64_t)deps * 4) {
+            return false;
+        }
+
+        CachedEntry loaded_entry;
+        memset(&loaded_entry, 0, sizeof(loaded_entry));
+        loaded_entry.context = context_map[context];
+        loaded_entry.include = dup_bytes(include, include_length);
+        loaded_entry.resolved = found ? dup_bytes(resolved, resolved_length) : NULL;
+        loaded_entry.dirs = malloc(sizeof(uint32_t) * (deps > 0 ? deps : 1));
+        if (!loaded_entry.include || (found && !loaded_entry.resolved) || !loaded_entry.dirs) {
+            free_entry(&loaded_entry);
+            return false;
+        }
+        for (uint32_t j = 0; j < deps; j++) {
+            uint32_t dir;
+            read_u32(reader, &dir);
+            if (dir >= file_dirs) {
+                free_entry(&loaded_entry);
+                return false;
+            }
+            loaded_entry.dirs[j] = dir_map[dir];
+        }
+        loaded_entry.dir_count = deps;
+        loaded_entry.last_used = ++use_clock;
+
+        // An entry we already hold wins unless it is known to be stale, as
+        // it is at least as recent; a later duplicate within the file
+        // would shadow nothing
+        CachedEntry *existing = find_entry(loaded_entry.context, loaded_entry.include);
+        if (existing) {
+            if (entry_is_kept(existing)) {
+                free_entry(&loaded_entry);
+            } else {
+                free_entry(existing);
+                *existing = loaded_entry;
+            }
+            continue;
+        }
+
+        CachedEntry *entry = append_entry();
+        if (!entry) {
+            free_entry(&loaded_entry);
+            return false;
+        }
+        *entry = loaded_entry;
+        entry_count++;
+        insert_entry(entry_count - 1);
+    }
+
+    return true;
+}
+
+/**
+ * Read a cache file into memory. What is already held is kept, so this
+ * both loads the cache and merges in what another process saved
+ */
+static bool parse_cache(const unsigned char *data, size_t size) {
+    Reader reader = {data, data + size};
+    uint32_t version;
+
+    if (size < 4 || memcmp(data, INCLUDE_CACHE_MAGIC, 4) != 0) return false;
+    reader.p += 4;
+    if (!read_u32(&reader, &version) || version != INCLUDE_CACHE_VERSION) return false;
+
+    // Records are numbered from 0 in the file; these map them to ours
+    uint32_t *context_map = NULL, *dir_map = NULL;
+    uint32_t file_contexts = 0, file_dirs = 0;
+    bool ok = read_contexts(&reader, &context_map, &file_contexts) &&
+              read_dirs(&reader, &dir_map, &file_dirs) &&
+              read_entries(&reader, context_map, file_contexts, dir_map, file_dirs);
+    free(context_map);
+    free(dir_map);
+    return ok;
+}
+
+/**
+ * Read the cache file and pass it to parse_cache
+ *
+ * @param st set to the file's stat on success
+ */
+static bool read_cache_file(struct stat *st) {
+    const char *path = include_cache_get_path();
+    if (stat(path, st) != 0) {
+        return false;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+
+    unsigned char *data = malloc((size_t)st->st_size + 1);
+    size_t size = data ? fread(data, 1, (size_t)st->st_size, file) : 0;
+    fclose(file);
+
+    bool ok = data && parse_cache(data, size);
+    free(data);
+    return ok;
+}
+
+static void load_cache(void) {
+    loaded = true;
+
+    struct stat st;
+    if (stat(include_cache_get_path(), &st) != 0) {
+        loaded_size = -1;
+        return;
+    }
+
+    if (!read_cache_file(&st)) {
+        // A damaged or outdated cache is simply rebuilt
+        include_cache_clear();
+        loaded = true;
+    }
+
+    loaded_mtime = st.st_mtime;
+    loaded_size = (long long)st.st_size;
+}
+
+static void ensure_loaded(void) {
+    if (!loaded) {
+        load_cache();
+    }
+}
+
+void include_cache_begin_pass(void) {
+    current_pass++;
+
+    // Pick up what other opencli processes stored since we loaded
+    if (loaded && !dirty) {
+        struct stat st;
+        bool exists = stat(include_cache_get_path(), &st) == 0;
+        if (exists ? (st.st_mtime != loaded_mtime || (long long)st.st_size != loaded_size) : loaded_size >= 0) {
+            include_cache_clear();
+        }
+    }
+}
+
+int include_cache_context(const char *context) {
+    if (!context) return -1;
+
+    ensure_loaded();
+
+    int64_t existing = find_context(context, strlen(context));
+    if (existing >= 0) {
+        return (int)existing;
+    }
+
+    if (!add_context(context, strlen(context))) {
+        return -1;
+    }
+    return (int)(context_count - 1);
+}
+
+bool include_cache_lookup(int context, const char *include, bool *found,
+                          char *resolved_path, size_t resolved_path_size) {
+    if (context < 0 || !include || !loaded) return false;
+
+    CachedEntry *entry = find_entry((uint32_t)context, include);
+    if (!entry) return false;
+
+    for (uint32_t i = 0; i < entry->dir_count; i++) {
+        if (!dir_is_valid(&dirs[entry->dirs[i]])) {
+            return false;
+        }
+    }
+
+    *found = entry->resolved != NULL;
+    if (*found) {
+        if (strlen(entry->resolved) >= resolved_path_size) return false;
+        strcpy(resolved_path, entry->resolved);
+    }
+    // Not worth rewriting the file for; the order is saved with the next change
+    entry->last_used = ++use_clock;
+    return true;
+}
+
+void include_cache_store(int context, const char *include, const char *resolved_path,
+                         const char *const *dir_paths, int dir_path_count) {
+    if (context < 0 || !include || !loaded) return;
+
+    uint32_t *entry_dirs = malloc(sizeof(uint32_t) * (dir_path_count > 0 ? dir_path_count : 1));
+    if (!entry_dirs) return;
+    for (int i = 0; i < dir_path_count; i++) {
+        int64_t record = current_dir_record(dir_paths[i]);
+        if (record < 0) {
+            free(entry_dirs);
+            return;
+        }
+        entry_dirs[i] = (uint32_t)record;
+    }
+
+    char *include_copy = dup_bytes(include, strlen(include));
+    char *resolved_copy = resolved_path ? dup_bytes(resolved_path, strlen(resolved_path)) : NULL;
+    if (!include_copy || (resolved_path && !resolved_copy)) {
+        free(include_copy);
+        free(resolved_copy);
+        free(entry_dirs);
+        return;
+    }
+
+    CachedEntry *entry = find_entry((uint32_t)context, include);
+    bool is_new = entry == NULL;
+    if (is_new) {
+        entry = append_entry();
+        if (!entry) {
+            free(include_copy);
+            free(resolved_copy);
+            free(entry_dirs);
+            return;
+        }
+    } else {
+        free_entry(entry);
+    }
+
+    entry->context = (uint32_t)context;
+    entry->include = include_copy;
+    entry->resolved = resolved_copy;
+    entry->dirs = entry_dirs;
+    entry->dir_count = (uint32_t)dir_path_count;
+    entry->last_used = ++use_clock;
+    entry->recorded = (int64_t)time(NULL);
+
+    if (is_new) {
+        entry_count++;
+        insert_entry(entry_count - 1);
+    }
+    dirty = true;
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+    unsigned char bytes[4] = {
+        (unsigned char)value, (unsigned char)(value >> 8),
+        (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+    };
+    fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+static void write_bytes(FILE *file, const char *data) {
+    uint32_t length = data ? (uint32_t)strlen(data) : 0;
+    write_u32(file, length);
+    if (length > 0) {
+        fwrite(data, 1, length, file);
+    }
+}
+
+/**
+ * Whether a directory of the entry was modified within a second of the
+ * entry being stored. A change in that same second can leave the mtime as
+ * it was, so such an entry is not trusted beyond this process
+ */
+static bool entry_is_racy(const CachedEntry *entry) {
+    if (entry->recorded == 0) return false;
+
+    for (uint32_t i = 0; i < entry->dir_count; i++) {
+        const CachedDir *dir = &dirs[entry->dirs[i]];
+        if (dir->exists && entry->recorded <= dir->mtime + 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_last_used(const void *a, const void *b) {
+    uint64_t used_a = entries[*(const uint32_t *)a].last_used;
+    uint64_t used_b = entries[*(const uint32_t *)b].last_used;
+    return used_a < used_b ? -1 : used_a > used_b;
+}
+
+/**
+ * Drop the entries known to be stale and the directory records no entry
+ * uses any more, so a long-running process does not keep every state a
+ * directory was ever seen in
+ */
+static void drop_stale_records(void) {
+    uint32_t kept_entries = 0;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (entry_is_kept(&entries[i])) {
+            entries[kept_entries++] = entries[i];
+        } else {
+            free_entry(&entries[i]);
+        }
+    }
+    if (kept_entries != entry_count) {
+        entry_count = kept_entries;
+        memset(table, 0, sizeof(uint32_t) * table_slots);
+        for (uint32_t i = 0; i < entry_count; i++) {
+            insert_entry(i);
+        }
+    }
+
+    uint32_t *dir_map = malloc(sizeof(uint32_t) * (dir_count > 0 ? dir_count : 1));
+    if (!dir_map) return;
+    memset(dir_map, 0xff, sizeof(uint32_t) * dir_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        for (uint32_t j = 0; j < entries[i].dir_count; j++) {
+            dir_map[entries[i].dirs[j]] = 0;
+        }
+    }
+
+    uint32_t kept_dirs = 0;
+    for (uint32_t i = 0; i < dir_count; i++) {
+        if (dir_map[i] == UINT32_MAX) {
+            free(dirs[i].path);
+            continue;
+        }
+        dir_map[i] = kept_dirs;
+        dirs[kept_dirs++] = dirs[i];
+    }
+    if (kept_dirs != dir_count) {
+        dir_count = kept_dirs;
+        for (uint32_t i = 0; i < entry_count; i++) {
+            for (uint32_t j = 0; j < entries[i].dir_count; j++) {
+                entries[i].dirs[j] = dir_map[entries[i].dirs[j]];
+            }
+        }
+
+        memset(dir_table, 0, sizeof(uint32_t) * dir_table_slots);
+        for (uint32_t i = 0; i < dir_count; i++) {
+            const CachedDir *dir = &dirs[i];
+            size_t slot = (size_t)hash_dir(dir->path, strlen(dir->path), dir->mtime, dir->mtime_nsec,
+                                           dir->exists) & (dir_table_slots - 1);
+            while (dir_table[slot]) {
+                slot = (slot + 1) & (dir_table_slots - 1);
+            }
+            dir_table[slot] = i + 1;
+        }
+    }
+    free(dir_map);
+}
+
+static SaveLock acquire_save_lock(const char *cache_dir) {
+    char lock_path[600];
+    snprintf(lock_path, sizeof(lock_path), "%s%c%s", cache_dir, PATH_SEPARATOR, INCLUDE_CACHE_LOCK_NAME);
+
+#ifdef _WIN32
+    HANDLE handle = CreateFile(lock_path, GENERIC_READ | GENERIC_WRITE,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return INVALID_SAVE_LOCK;
+    }
+
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+        CloseHandle(handle);
+        return INVALID_SAVE_LOCK;
+    }
+    return handle;
+#else
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return INVALID_SAVE_LOCK;
+    }
+
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return INVALID_SAVE_LOCK;
+    }
+    return fd;
+#endif
+}
+
+static void release_save_lock(SaveLock lock) {
+    if (lock == INVALID_SAVE_LOCK) {
+        return;
+    }
+
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    UnlockFileEx(lock, 0, 1, 0, &overlapped);
+    CloseHandle(lock);
+#else
+    flock(lock, LOCK_UN);
+    close(lock);
+#endif
+}
+
+static bool write_cache_file(void) {
+    // Keep the most recently used entries only, and only the contexts and
+    // directory records they still use
+    uint32_t *order = malloc(sizeof(uint32_t) * (entry_count > 0 ? entry_count : 1));
+    uint32_t *context_map = malloc(sizeof(uint32_t) * (context_count > 0 ? context_count : 1));
+    uint32_t *dir_map = malloc(sizeof(uint32_t) * (dir_count > 0 ? dir_count : 1));
+    uint32_t *dir_order = malloc(sizeof(uint32_t) * (dir_count > 0 ? dir_count : 1));
+    if (!order || !context_map || !dir_map || !dir_order) {
+        free(order);
+        free(context_map);
+        free(dir_map);
+        free(dir_order);
+        return false;
+    }
+    memset(context_map, 0xff, sizeof(uint32_t) * context_count);
+    memset(dir_map, 0xff, sizeof(uint32_t) * dir_count);
+
+    uint32_t kept_entries = 0, kept_contexts = 0, kept_dirs = 0;
+    bool racy = false;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (entry_is_racy(&entries[i])) {
+            // Written by a later save, once it is old enough
+            racy = true;
+            continue;
+        }
+        order[kept_entries++] = i;
+    }
+    qsort(order, kept_entries, sizeof(uint32_t), compare_last_used);
+    uint32_t first = kept_entries > INCLUDE_CACHE_MAX_ENTRIES ? kept_entries - INCLUDE_CACHE_MAX_ENTRIES : 0;
+
+    for (uint32_t n = first; n < kept_entries; n++) {
+        const CachedEntry *entry = &entries[order[n]];
+        if (context_map[entry->context] == UINT32_MAX) {
+            context_map[entry->context] = kept_contexts++;
+        }
+        for (uint32_t j = 0; j < entry->dir_count; j++) {
+            if (dir_map[entry->dirs[j]] == UINT32_MAX) {
+                dir_map[entry->dirs[j]] = kept_dirs++;
+            }
+        }
+    }
+
+    const char *path = include_cache_get_path();
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        free(order);
+        free(context_map);
+        free(dir_map);
+        free(dir_order);
+        return false;
+    }
+
+    fwrite(INCLUDE_CACHE_MAGIC, 1, 4, file);
+    write_u32(file, INCLUDE_CACHE_VERSION);
+
+    // Records are written in their new order, which is the order the map
+    // assigned them in
+    write_u32(file, kept_contexts);
+    for (uint32_t n = 0; n < kept_contexts; n++) {
+        for (uint32_t i = 0; i < context_count; i++) {
+            if (context_map[i] == n) {
+                write_bytes(file, contexts[i]);
+                break;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < dir_count; i++) {
+        if (dir_map[i] != UINT32_MAX) dir_order[dir_map[i]] = i;
+    }
+    write_u32(file, kept_dirs);
+    for (uint32_t n = 0; n < kept_dirs; n++) {
+        const CachedDir *dir = &dirs[dir_order[n]];
+        write_bytes(file, dir->path);
+        write_u32(file, (uint32_t)((uint64_t)dir->mtime & 0xffffffffu));
+        write_u32(file, (uint32_t)((uint64_t)dir->mtime >> 32));
+        write_u32(file, (uint32_t)dir->mtime_nsec);
+        write_u32(file, dir->exists ? 1 : 0);
+    }
+    free(dir_order);
+
+    // Least recently used first, the order a later load replays them in
+    write_u32(file, kept_entries - first);
+    for (uint32_t n = first; n < kept_entries; n++) {
+        const CachedEntry *entry = &entries[order[n]];
+        write_u32(file, context_map[entry->context]);
+        write_bytes(file, entry->include);
+        write_u32(file, entry->resolved ? 1 : 0);
+        write_bytes(file, entry->resolved);
+        write_u32(file, entry->dir_count);
+        for (uint32_t j = 0; j < entry->dir_count; j++) {
+            write_u32(file, dir_map[entry->dirs[j]]);
+        }
+    }
+
+    free(order);
+    free(context_map);
+    free(dir_map);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path, path) == 0;
+#endif
+    if (!ok) {
+        remove(temp_path);
+        return false;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        loaded_mtime = st.st_mtime;
+        loaded_size = (long long)st.st_size;
+    }
+    dirty = racy;
+    return true;
+}
+
+bool include_cache_save(void) {
+    if (!dirty) return true;
+
+    char cache_dir[512];
+    snprintf(cache_dir, sizeof(cache_dir), "%s%copencli%ccache", get_appdata_path(), PATH_SEPARATOR, PATH_SEPARATOR);
+    ensure_directory_exists(cache_dir);
+
+    // Other processes save the cache too. Under the lock, merge in what
+    // they wrote since it was loaded so that neither overwrites the
+    // other's resolutions; a damaged file is simply replaced
+    SaveLock lock = acquire_save_lock(cache_dir);
+    struct stat st;
+    read_cache_file(&st);
+    drop_stale_records();
+    bool ok = write_cache_file();
+    release_save_lock(lock);
+    return ok;
+}
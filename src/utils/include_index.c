@@ -0,0 +1,413 @@
+#include "include_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+// Windows and macOS file systems match names case-insensitively, so the
+// index must too or it would reject includes the compiler finds
+#if defined(_WIN32) || defined(__APPLE__)
+#define INDEX_FOLD_CASE 1
+#endif
+
+/**
+ * The listing of one directory. A nested include such as <YSI/y_hooks> is
+ * looked up in the index of YSI, read when it is first asked for, so no
+ * directory is read unless an include can be in it and symlinked
+ * directories cannot send a walk round in circles
+ */
+typedef struct {
+    char *root;             // absolute path of the directory
+    uint64_t root_hash;
+    char **names;           // open-addressing table of the files in it
+    size_t slots;           // always a power of two
+    size_t count;
+    time_t mtime;
+    long mtime_nsec;
+    bool exists;
+    bool complete;          // false if it could not be read or is too large
+    unsigned generation;    // pass the index was last checked in
+} DirIndex;
+
+// Open-addressing table of every index by root
+static DirIndex **indexes = NULL;
+static size_t index_slots = 0;
+static size_t index_count = 0;
+static unsigned current_generation = 1;
+static char current_dir[1024] = "";
+
+static uint64_t hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void fold_name(char *name) {
+    for (char *p = name; *p; p++) {
+        if (*p == '\\') *p = '/';
+#ifdef INDEX_FOLD_CASE
+        *p = (char)tolower((unsigned char)*p);
+#endif
+    }
+}
+
+static bool get_mtime(const char *path, time_t *mtime, long *mtime_nsec) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+
+    *mtime = st.st_mtime;
+#if defined(__APPLE__)
+    *mtime_nsec = st.st_mtimespec.tv_nsec;
+#elif defined(__linux__) || defined(__ANDROID__)
+    *mtime_nsec = st.st_mtim.tv_nsec;
+#else
+    *mtime_nsec = 0;
+#endif
+    return true;
+}
+
+static bool index_grow(DirIndex *index) {
+    size_t new_slots = index->slots > 0 ? index->slots * 2 : 256;
+    char **names = calloc(new_slots, sizeof(char *));
+    if (!names) return false;
+
+    for (size_t i = 0; i < index->slots; i++) {
+        if (!index->names[i]) continue;
+        size_t slot = (size_t)hash_name(index->names[i]) & (new_slots - 1);
+        while (names[slot]) {
+            slot = (slot + 1) & (new_slots - 1);
+        }
+        names[slot] = index->names[i];
+    }
+
+    free(index->names);
+    index->names = names;
+    index->slots = new_slots;
+    return true;
+}
+
+static bool index_add_name(DirIndex *index, const char *name) {
+    // Keep the table at most half full so probe chains stay short
+    if ((index->count + 1) * 2 > index->slots && !index_grow(index)) {
+        return false;
+    }
+
+    char *copy = malloc(strlen(name) + 1);
+    if (!copy) return false;
+    strcpy(copy, name);
+    fold_name(copy);
+
+    size_t slot = (size_t)hash_name(copy) & (index->slots - 1);
+    while (index->names[slot]) {
+        if (strcmp(index->names[slot], copy) == 0) {
+            free(copy);
+            return true;
+        }
+        slot = (slot + 1) & (index->slots - 1);
+    }
+
+    index->names[slot] = copy;
+    index->count++;
+    return true;
+}
+
+static void index_reset(DirIndex *index) {
+    for (size_t i = 0; i < index->slots; i++) {
+        free(index->names[i]);
+    }
+    free(index->names);
+    index->names = NULL;
+    index->slots = 0;
+    index->count = 0;
+}
+
+#ifndef _WIN32
+// Whether a directory entry is a file an include can name
+static bool is_file_entry(const char *path, const char *name) {
+    char child_path[2048];
+    if (snprintf(child_path, sizeof(child_path), "%s/%s", path, name) >= (int)sizeof(child_path)) {
+        return false;
+    }
+    // A symlink counts as what it points to, as it does for the compiler
+    struct stat st;
+    return stat(child_path, &st) == 0 && !S_ISDIR(st.st_mode);
+}
+#endif
+
+// Read the files directly in the directory into the index
+static bool index_read_dir(DirIndex *index) {
+#ifdef _WIN32
+    char pattern[2048];
+    snprintf(pattern, sizeof(pattern), "%s\\*", index->root);
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) return false;
+
+    bool ok = true;
+    do {
+        const char *name = data.cFileName;
+        if (name[0] == '.' || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+#else
+    DIR *dir = opendir(index->root);
+    if (!dir) return false;
+
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        // Also skips hidden files, which never hold includes
+        if (name[0] == '.') continue;
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR) continue;
+        if ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && !is_file_entry(index->root, name)) continue;
+#else
+        if (!is_file_entry(index->root, name)) continue;
+#endif
+#endif
+
+        if (index->count >= INCLUDE_INDEX_MAX_FILES) {
+            ok = false;
+        } else {
+            ok = index_add_name(index, name);
+        }
+#ifdef _WIN32
+    } while (ok && FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    }
+    closedir(dir);
+#endif
+
+    return ok;
+}
+
+static void index_build(DirIndex *index) {
+    index_reset(index);
+    index->exists = get_mtime(index->root, &index->mtime, &index->mtime_nsec);
+    index->complete = index->exists && index_read_dir(index);
+    if (!index->complete) {
+        // Keep only the mtime, so a later pass still notices when the
+        // directory changes and tries again
+        index_reset(index);
+    }
+    index->generation = current_generation;
+}
+
+static bool index_is_current(const DirIndex *index) {
+    if (!index->exists) return false;
+
+    time_t mtime;
+    long mtime_nsec;
+    return get_mtime(index->root, &mtime, &mtime_nsec) &&
+           mtime == index->mtime && mtime_nsec == index->mtime_nsec;
+}
+
+static bool is_absolute_path(const char *path) {
+#ifdef _WIN32
+    return (path[0] != '\0' && path[1] == ':') || path[0] == '\\' || path[0] == '/';
+#else
+    return path[0] == '/';
+#endif
+}
+
+/**
+ * Registry key of a directory: its absolute path without trailing
+ * separators. Relative paths are taken against the working directory at the
+ * start of the pass
+ */
+static bool make_index_root(const char *dir, char *root, size_t root_size) {
+    while (dir[0] == '.' && (dir[1] == '/' || dir[1] == '\\')) {
+        dir += 2;
+    }
+
+    int written;
+    if (is_absolute_path(dir)) {
+        written = snprintf(root, root_size, "%s", dir);
+    } else {
+        if (current_dir[0] == '\0' && !getcwd(current_dir, sizeof(current_dir))) {
+            return false;
+        }
+        if (dir[0] == '\0' || strcmp(dir, ".") == 0) {
+            written = snprintf(root, root_size, "%s", current_dir);
+        } else {
+#ifdef _WIN32
+            written = snprintf(root, root_size, "%s\\%s", current_dir, dir);
+#else
+            written = snprintf(root, root_size, "%s/%s", current_dir, dir);
+#endif
+        }
+    }
+    if (written < 0 || (size_t)written >= root_size) return false;
+
+    size_t len = strlen(root);
+    while (len > 1 && (root[len - 1] == '/' || root[len - 1] == '\\')) {
+        root[--len] = '\0';
+    }
+    return true;
+}
+
+static size_t registry_slot(const char *root, uint64_t hash) {
+    size_t slot = (size_t)hash & (index_slots - 1);
+    while (indexes[slot] && (indexes[slot]->root_hash != hash || strcmp(indexes[slot]->root, root) != 0)) {
+        slot = (slot + 1) & (index_slots - 1);
+    }
+    return slot;
+}
+
+static bool registry_grow(void) {
+    size_t new_slots = index_slots > 0 ? index_slots * 2 : 64;
+    DirIndex **grown = calloc(new_slots, sizeof(DirIndex *));
+    if (!grown) return false;
+
+    for (size_t i = 0; i < index_slots; i++) {
+        if (!indexes[i]) continue;
+        size_t slot = (size_t)indexes[i]->root_hash & (new_slots - 1);
+        while (grown[slot]) {
+            slot = (slot + 1) & (new_slots - 1);
+        }
+        grown[slot] = indexes[i];
+    }
+
+    free(indexes);
+    indexes = grown;
+    index_slots = new_slots;
+    return true;
+}
+
+static DirIndex *get_index(const char *dir) {
+    char root[1024];
+    if (!make_index_root(dir, root, sizeof(root))) return NULL;
+
+    uint64_t hash = hash_name(root);
+    if (index_slots > 0) {
+        DirIndex *index = indexes[registry_slot(root, hash)];
+        if (index) {
+            if (index->generation != current_generation) {
+                if (index_is_current(index)) {
+                    index->generation = current_generation;
+                } else {
+                    index_build(index);
+                }
+            }
+            return index;
+        }
+    }
+
+    if ((index_count + 1) * 2 > index_slots && !registry_grow()) return NULL;
+
+    DirIndex *index = calloc(1, sizeof(DirIndex));
+    if (!index) return NULL;
+    index->root = malloc(strlen(root) + 1);
+    if (!index->root) {
+        free(index);
+        return NULL;
+    }
+    strcpy(index->root, root);
+    index->root_hash = hash;
+
+    index_build(index);
+    indexes[registry_slot(root, hash)] = index;
+    index_count++;
+    return index;
+}
+
+void include_index_begin_pass(void) {
+    current_generation++;
+    if (!getcwd(current_dir, sizeof(current_dir))) {
+        current_dir[0] = '\0';
+    }
+}
+
+IncludeIndexResult include_index_lookup(const char *dir, const char *relative_path) {
+    if (!dir || !relative_path || relative_path[0] == '\0' || is_absolute_path(relative_path)) {
+        return INCLUDE_INDEX_UNAVAILABLE;
+    }
+
+    char name[1024];
+    if (strlen(relative_path) >= sizeof(name)) return INCLUDE_INDEX_UNAVAILABLE;
+    strcpy(name, relative_path);
+    for (char *p = name; *p; p++) {
+        if (*p == '\\') *p = '/';
+    }
+
+    // "." and ".." components are left to the file system
+    char *file_name = name;
+    for (char *p = name; *p; ) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 0 || (p[0] == '.' && (len == 1 || (len == 2 && p[1] == '.')))) {
+            return INCLUDE_INDEX_UNAVAILABLE;
+        }
+        p += len;
+        if (*p == '/') {
+            file_name = ++p;
+        }
+    }
+
+    // A nested path is looked up in the index of its own directory. The
+    // directory part keeps its case, which matters on case-sensitive
+    // volumes even where names are folded
+    DirIndex *index;
+    if (file_name != name) {
+        char sub_dir[2048];
+        int written = snprintf(sub_dir, sizeof(sub_dir), "%s/%.*s", dir, (int)(file_name - name - 1), name);
+        if (written < 0 || (size_t)written >= sizeof(sub_dir)) return INCLUDE_INDEX_UNAVAILABLE;
+        index = get_index(sub_dir);
+    } else {
+        index = get_index(dir);
+    }
+    if (!index) return INCLUDE_INDEX_UNAVAILABLE;
+    if (!index->complete) {
+        // A directory that does not exist holds nothing
+        return index->exists ? INCLUDE_INDEX_UNAVAILABLE : INCLUDE_INDEX_MISSING;
+    }
+    if (index->count == 0) {
+        return INCLUDE_INDEX_MISSING;
+    }
+
+    fold_name(file_name);
+    size_t slot = (size_t)hash_name(file_name) & (index->slots - 1);
+    while (index->names[slot]) {
+        if (strcmp(index->names[slot], file_name) == 0) {
+            return INCLUDE_INDEX_FOUND;
+        }
+        slot = (slot + 1) & (index->slots - 1);
+    }
+    return INCLUDE_INDEX_MISSING;
+}
+
+bool include_index_warm(const char *dir) {
+    if (!dir) return false;
+
+    DirIndex *index = get_index(dir);
+    return index && index->complete;
+}
+
+void include_index_clear(void) {
+    for (size_t i = 0; i < index_slots; i++) {
+        if (!indexes[i]) continue;
+        index_reset(indexes[i]);
+        free(indexes[i]->root);
+        free(indexes[i]);
+    }
+    free(indexes);
+    indexes = NULL;
+    index_slots = 0;
+    index_count = 0;
+}
@@ -0,0 +1,437 @@
+#include "include_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define SCAN_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The bytes that can start something the scanner cares about outside of
+// comments and literals: a directive, a comment or a string/char literal
+typedef const char *(*FindSpecialFn)(const char *p, const char *end);
+
+static inline bool is_special(unsigned char c) {
+    return c == '#' || c == '/' || c == '"' || c == '\'';
+}
+
+static inline int lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static const char *find_special_scalar(const char *p, const char *end) {
+    while (p < end && !is_special((unsigned char)*p)) {
+        p++;
+    }
+    return p;
+}
+
+#ifdef SCAN_HAVE_SSE2
+static const char *find_special_sse2(const char *p, const char *end) {
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i dquote = _mm_set1_epi8('"');
+    const __m128i squote = _mm_set1_epi8('\'');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, hash), _mm_cmpeq_epi8(v, slash)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, dquote), _mm_cmpeq_epi8(v, squote)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+        if (mask) {
+            return p + lowest_bit(mask);
+        }
+        p += 16;
+    }
+    return find_special_scalar(p, end);
+}
+#endif
+
+#ifdef SCAN_HAVE_AVX2
+__attribute__((target("avx2")))
+static const char *find_special_avx2(const char *p, const char *end) {
+    const __m256i hash = _mm256_set1_epi8('#');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i dquote = _mm256_set1_epi8('"');
+    const __m256i squote = _mm256_set1_epi8('\'');
+
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, hash), _mm256_cmpeq_epi8(v, slash)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, dquote), _mm256_cmpeq_epi8(v, squote)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+        if (mask) {
+            return p + lowest_bit(mask);
+        }
+        p += 32;
+    }
+    return find_special_scalar(p, end);
+}
+#endif
+
+#ifdef SCAN_HAVE_NEON
+static const char *find_special_neon(const char *p, const char *end) {
+    const uint8x16_t hash = vdupq_n_u8('#');
+    const uint8x16_t slash = vdupq_n_u8('/');
+    const uint8x16_t dquote = vdupq_n_u8('"');
+    const uint8x16_t squote = vdupq_n_u8('\'');
+
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)p);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, hash), vceqq_u8(v, slash)),
+                                vorrq_u8(vceqq_u8(v, dquote), vceqq_u8(v, squote)));
+        if (vmaxvq_u8(m)) {
+            return find_special_scalar(p, p + 16);
+        }
+        p += 16;
+    }
+    return find_special_scalar(p, end);
+}
+#endif
+
+static FindSpecialFn find_special = NULL;
+static const char *implementation_name = "scalar";
+
+static void select_implementation(void) {
+    FindSpecialFn fn = find_special_scalar;
+    const char *name = "scalar";
+
+#if defined(SCAN_HAVE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = find_special_avx2;
+        name = "avx2";
+    }
+#endif
+#if defined(SCAN_HAVE_SSE2)
+    if (fn == find_special_scalar) {
+        fn = find_special_sse2;
+        name = "sse2";
+    }
+#endif
+#if defined(SCAN_HAVE_NEON)
+    fn = find_special_neon;
+    name = "neon";
+#endif
+
+    implementation_name = name;
+    find_special = fn;
+}
+
+const char *include_scan_implementation(void) {
+    if (!find_special) {
+        select_implementation();
+    }
+    return implementation_name;
+}
+
+static const char *skip_block_comment(const char *p, const char *end) {
+    while (p < end) {
+        const char *star = memchr(p, '*', (size_t)(end - p));
+        if (!star || star + 1 >= end) return end;
+        if (star[1] == '/') return star + 2;
+        p = star + 1;
+    }
+    return end;
+}
+
+/**
+ * Skip a string or character literal starting at the quote. Literals end
+ * at the line end if unterminated; raw strings (\"...\") have no escapes
+ */
+static const char *skip_literal(const char *p, const char *end, bool raw) {
+    char quote = *p++;
+    while (p < end) {
+        char c = *p;
+        if (c == quote) return p + 1;
+        if (c == '\n') return p;
+        if (c == '\\' && !raw) {
+            p += 2;
+            continue;
+        }
+        p++;
+    }
+    return end;
+}
+
+/**
+ * Whether only blanks precede p on its line. The compiler strips comments
+ * before it looks for directives, so a block comment that itself begins
+ * the line, or ends one that started earlier, counts as blank too
+ */
+static bool at_line_start(const char *data, const char *p, const char *comment_end, bool comment_blank) {
+    while (p > data && (p[-1] == ' ' || p[-1] == '\t')) {
+        p--;
+    }
+    if (p == comment_end && comment_blank) return true;
+    return p == data || p[-1] == '\n' || p[-1] == '\r';
+}
+
+static bool append_include(ScannedIncludeList *list, const char *path, size_t length,
+                           IncludeType type, bool optional, int line) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity > 0 ? list->capacity * 2 : 16;
+        ScannedInclude *items = realloc(list->items, sizeof(ScannedInclude) * new_capacity);
+        if (!items) return false;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+
+    char *copy = malloc(length + 1);
+    if (!copy) return false;
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+
+    ScannedInclude *item = &list->items[list->count++];
+    item->path = copy;
+    item->type = type;
+    item->optional = optional;
+    item->line = line;
+    return true;
+}
+
+/**
+ * Parse the directive after a '#'. Returns where scanning continues, or
+ * NULL if this is not an include directive
+ */
+static const char *parse_directive(const char *p, const char *end, const char **path, size_t *length,
+                                   IncludeType *type, bool *optional) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+    if (end - p >= 7 && memcmp(p, "include", 7) == 0) {
+        *optional = false;
+        p += 7;
+    } else if (end - p >= 10 && memcmp(p, "tryinclude", 10) == 0) {
+        *optional = true;
+        p += 10;
+    } else {
+        return NULL;
+    }
+
+    // #include_foo is not an include
+    if (p < end && *p != ' ' && *p != '\t' && *p != '<' && *p != '"') return NULL;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p >= end) return NULL;
+
+    char close;
+    if (*p == '<') {
+        *type = INCLUDE_TYPE_ANGLE;
+        close = '>';
+        p++;
+    } else if (*p == '"') {
+        *type = INCLUDE_TYPE_QUOTE;
+        close = '"';
+        p++;
+    } else {
+        *type = INCLUDE_TYPE_ANGLE;
+        close = '\0';
+    }
+
+    const char *start = p;
+    if (close) {
+        while (p < end && *p != close && *p != '\n') p++;
+        if (p >= end || *p != close) return NULL;
+        *path = start;
+        *length = (size_t)(p - start);
+        return p + 1;
+    }
+
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' &&
+           !(*p == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*'))) {
+        p++;
+    }
+    *path = start;
+    *length = (size_t)(p - start);
+    return p;
+}
+
+static int count_lines(const char *p, const char *end) {
+    int lines = 0;
+    while (p < end && (p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+bool include_scan_buffer(const char *data, size_t size, ScannedIncludeList *list) {
+    if (!list) return false;
+    if (!find_special) {
+        select_implementation();
+    }
+
+    const char *p = data;
+    const char *end = data + size;
+    const char *counted = data;
+    int line = 1;
+    const char *comment_end = NULL;     // end of the last block comment
+    bool comment_blank = false;         // whether that comment leaves its line blank so far
+
+    while (p < end) {
+        p = find_special(p, end);
+        if (p >= end) break;
+
+        char c = *p;
+        if (c == '/') {
+            if (p + 1 < end && p[1] == '/') {
+                const char *newline = memchr(p, '\n', (size_t)(end - p));
+                p = newline ? newline : end;
+            } else if (p + 1 < end && p[1] == '*') {
+                const char *start = p;
+                p = skip_block_comment(p + 2, end);
+                comment_end = p;
+                comment_blank = at_line_start(data, start, NULL, false) ||
+                                memchr(start, '\n', (size_t)(p - start)) != NULL;
+            } else {
+                p++;
+            }
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            p = skip_literal(p, end, c == '"' && p > data && p[-1] == '\\');
+            continue;
+        }
+
+        // '#': only a directive when it starts the line
+        const char *hash = p++;
+        if (!at_line_start(data, hash, comment_end, comment_blank)) continue;
+
+        const char *path;
+        size_t length;
+        IncludeType type;
+        bool optional;
+        const char *next = parse_directive(p, end, &path, &length, &type, &optional);
+        if (!next) continue;
+        p = next;
+
+        if (length == 0 || length >= MAX_INCLUDE_PATH_LEN) continue;
+
+        line += count_lines(counted, hash);
+        counted = hash;
+
+        if (type == INCLUDE_TYPE_QUOTE) {
+            char checked[MAX_INCLUDE_PATH_LEN];
+            memcpy(checked, path, length);
+            checked[length] = '\0';
+            if (!validate_include_path(checked)) continue;
+        }
+
+        if (!append_include(list, path, length, type, optional, line)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool include_scan_file(const char *path, ScannedIncludeList *list) {
+    if (!path || !list) return false;
+
+    memset(list, 0, sizeof(ScannedIncludeList));
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const char *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    bool ok = data && include_scan_buffer(data, (size_t)size.QuadPart, list);
+
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        // Some file systems cannot be mapped; read the file instead
+        char *buffer = malloc(size);
+        size_t length = 0;
+        if (buffer) {
+            ssize_t n;
+            while (length < size && (n = read(fd, buffer + length, size - length)) > 0) {
+                length += (size_t)n;
+            }
+        }
+        close(fd);
+        bool ok = buffer && include_scan_buffer(buffer, length, list);
+        free(buffer);
+        return ok;
+    }
+    close(fd);
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, size, MADV_SEQUENTIAL);
+#endif
+    bool ok = include_scan_buffer(data, size, list);
+    munmap(data, size);
+    return ok;
+#endif
+}
+
+void scanned_include_list_free(ScannedIncludeList *list) {
+    if (!list) return;
+
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].path);
+    }
+    free(list->items);
+    memset(list, 0, sizeof(ScannedIncludeList));
+}
@@ -1,11 +1,16 @@
 #include "include_utils.h"
 #include "toml_utils.h"
+#include "include_index.h"
+#include "include_cache.h"
+#include "include_scan.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -32,6 +37,342 @@
 static const char* default_auto_extensions[] = {".inc"};
 static const int default_auto_extensions_count = 1;
 
+static int default_cache_capacity = DEFAULT_INCLUDE_CACHE_SIZE;
+
+#define ARENA_CHUNK_SIZE 16384
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaChunk;
+
+// Append-only string storage; equal strings are stored once
+typedef struct {
+    ArenaChunk *chunks;
+    const char **set;       // open-addressing set of the interned strings
+    size_t set_slots;
+    size_t set_count;
+} StringArena;
+
+typedef struct {
+    const char *key;            // interned; type marker followed by the include
+    const char *resolved_path;  // interned, NULL if the include does not exist
+    bool exists;
+    time_t cached_time;
+    uint32_t hash;
+    int prev;                   // towards the most recently used entry
+    int next;
+} IncludeCacheEntry;
+
+struct IncludeResolverCache {
+    IncludeCacheEntry *entries;
+    int count;
+    int allocated;
+    uint32_t *slots;            // entry index + 1, 0 marks an empty slot
+    size_t slot_count;
+    int head;                   // most recently used, -1 when empty
+    int tail;                   // least recently used
+    int evictions;              // since the arena was last compacted
+    StringArena strings;
+};
+
+static uint32_t hash_string(const char *str) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void arena_free(StringArena *arena) {
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena->set);
+    memset(arena, 0, sizeof(*arena));
+}
+
+static bool arena_grow_set(StringArena *arena) {
+    size_t new_slots = arena->set_slots > 0 ? arena->set_slots * 2 : 64;
+    const char **set = calloc(new_slots, sizeof(char *));
+    if (!set) return false;
+    
+    for (size_t i = 0; i < arena->set_slots; i++) {
+        if (!arena->set[i]) continue;
+        size_t slot = hash_string(arena->set[i]) & (new_slots - 1);
+        while (set[slot]) {
+            slot = (slot + 1) & (new_slots - 1);
+        }
+        set[slot] = arena->set[i];
+    }
+    
+    free(arena->set);
+    arena->set = set;
+    arena->set_slots = new_slots;
+    return true;
+}
+
+static const char *arena_intern(StringArena *arena, const char *str) {
+    if ((arena->set_count + 1) * 2 > arena->set_slots && !arena_grow_set(arena)) {
+        return NULL;
+    }
+    
+    size_t slot = hash_string(str) & (arena->set_slots - 1);
+    while (arena->set[slot]) {
+        if (strcmp(arena->set[slot], str) == 0) {
+            return arena->set[slot];
+        }
+        slot = (slot + 1) & (arena->set_slots - 1);
+    }
+    
+    size_t length = strlen(str) + 1;
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < length) {
+        size_t size = length > ARENA_CHUNK_SIZE ? length : ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(ArenaChunk) + size);
+        if (!chunk) return NULL;
+        chunk->next = arena->chunks;
+        chunk->used = 0;
+        chunk->size = size;
+        arena->chunks = chunk;
+    }
+    
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, str, length);
+    chunk->used += length;
+    
+    arena->set[slot] = copy;
+    arena->set_count++;
+    return copy;
+}
+
+static void cache_link_front(IncludeResolverCache *cache, int index) {
+    IncludeCacheEntry *entry = &cache->entries[index];
+    entry->prev = -1;
+    entry->next = cache->head;
+    if (cache->head >= 0) {
+        cache->entries[cache->head].prev = index;
+    }
+    cache->head = index;
+    if (cache->tail < 0) {
+        cache->tail = index;
+    }
+}
+
+static void cache_unlink(IncludeResolverCache *cache, int index) {
+    IncludeCacheEntry *entry = &cache->entries[index];
+    if (entry->prev >= 0) {
+        cache->entries[entry->prev].next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next >= 0) {
+        cache->entries[entry->next].prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+static bool cache_rebuild_slots(IncludeResolverCache *cache, size_t slot_count) {
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+    
+    for (int i = 0; i < cache->count; i++) {
+        size_t slot = cache->entries[i].hash & (slot_count - 1);
+        while (slots[slot]) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = (uint32_t)i + 1;
+    }
+    
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_count = slot_count;
+    return true;
+}
+
+static size_t cache_find_slot(const IncludeResolverCache *cache, const char *key, uint32_t hash) {
+    size_t slot = hash & (cache->slot_count - 1);
+    while (cache->slots[slot]) {
+        const IncludeCacheEntry *entry = &cache->entries[cache->slots[slot] - 1];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (cache->slot_count - 1);
+    }
+    return slot;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+static void cache_remove_slot(IncludeResolverCache *cache, size_t slot) {
+    size_t mask = cache->slot_count - 1;
+    cache->slots[slot] = 0;
+    
+    size_t next = (slot + 1) & mask;
+    while (cache->slots[next]) {
+        size_t home = cache->entries[cache->slots[next] - 1].hash & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            cache->slots[slot] = cache->slots[next];
+            cache->slots[next] = 0;
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+static void cache_free(IncludeResolverCache *cache) {
+    if (!cache) return;
+    free(cache->entries);
+    free(cache->slots);
+    arena_free(&cache->strings);
+    free(cache);
+}
+
+/**
+ * Re-intern the live entries into a fresh arena, dropping the strings of
+ * evicted ones
+ */
+static void cache_compact_strings(IncludeResolverCache *cache) {
+    StringArena fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    
+    for (int i = 0; i < cache->count; i++) {
+        IncludeCacheEntry *entry = &cache->entries[i];
+        const char *key = arena_intern(&fresh, entry->key);
+        const char *resolved = entry->resolved_path ? arena_intern(&fresh, entry->resolved_path) : NULL;
+        if (!key || (entry->resolved_path && !resolved)) {
+            arena_free(&fresh);
+            return;
+        }
+        entry->key = key;
+        entry->resolved_path = resolved;
+    }
+    
+    arena_free(&cache->strings);
+    cache->strings = fresh;
+    cache->evictions = 0;
+}
+
+static IncludeCacheEntry* find_cache_entry(IncludeResolver *resolver, const char *key) {
+    if (!resolver || !resolver->enable_cache || !resolver->cache || !key) return NULL;
+    
+    IncludeResolverCache *cache = resolver->cache;
+    if (cache->count == 0) return NULL;
+    
+    uint32_t hash = hash_string(key);
+    size_t slot = cache_find_slot(cache, key, hash);
+    if (!cache->slots[slot]) return NULL;
+    
+    int index = (int)cache->slots[slot] - 1;
+    if (cache->head != index) {
+        cache_unlink(cache, index);
+        cache_link_front(cache, index);
+    }
+    return &cache->entries[index];
+}
+
+static void add_cache_entry(IncludeResolver *resolver, const char *key,
+                           const char *resolved_path, bool exists) {
+    if (!resolver || !resolver->enable_cache || !key || resolver->cache_capacity <= 0) return;
+    
+    if (!resolver->cache) {
+        resolver->cache = calloc(1, sizeof(IncludeResolverCache));
+        if (!resolver->cache) return;
+        resolver->cache->head = -1;
+        resolver->cache->tail = -1;
+    }
+    IncludeResolverCache *cache = resolver->cache;
+    
+    const char *interned_key = arena_intern(&cache->strings, key);
+    const char *interned_resolved = resolved_path ? arena_intern(&cache->strings, resolved_path) : NULL;
+    if (!interned_key || (resolved_path && !interned_resolved)) return;
+    
+    uint32_t hash = hash_string(key);
+    int index = -1;
+    
+    if (cache->slot_count > 0) {
+        size_t slot = cache_find_slot(cache, key, hash);
+        if (cache->slots[slot]) {
+            index = (int)cache->slots[slot] - 1;
+            cache_unlink(cache, index);
+        }
+    }
+    
+    if (index < 0 && cache->count >= resolver->cache_capacity) {
+        // Reuse the least recently used entry
+        index = cache->tail;
+        cache_unlink(cache, index);
+        cache_remove_slot(cache, cache_find_slot(cache, cache->entries[index].key, cache->entries[index].hash));
+        cache->entries[index].hash = hash;
+        cache->entries[index].key = interned_key;
+        
+        size_t slot = hash & (cache->slot_count - 1);
+        while (cache->slots[slot]) {
+            slot = (slot + 1) & (cache->slot_count - 1);
+        }
+        cache->slots[slot] = (uint32_t)index + 1;
+        cache->evictions++;
+    } else if (index < 0) {
+        if (cache->count >= cache->allocated) {
+            int new_allocated = cache->allocated > 0 ? cache->allocated * 2 : 16;
+            if (new_allocated > resolver->cache_capacity) new_allocated = resolver->cache_capacity;
+            IncludeCacheEntry *entries = realloc(cache->entries, sizeof(IncludeCacheEntry) * new_allocated);
+            if (!entries) return;
+            cache->entries = entries;
+            cache->allocated = new_allocated;
+        }
+        
+        index = cache->count++;
+        cache->entries[index].hash = hash;
+        cache->entries[index].key = interned_key;
+        
+        // Keep the table at most half full
+        if ((size_t)cache->count * 2 > cache->slot_count) {
+            size_t slot_count = cache->slot_count > 0 ? cache->slot_count : 32;
+            while ((size_t)cache->count * 2 > slot_count) slot_count *= 2;
+            if (!cache_rebuild_slots(cache, slot_count)) {
+                cache->count--;
+                return;
+            }
+        } else {
+            size_t slot = hash & (cache->slot_count - 1);
+            while (cache->slots[slot]) {
+                slot = (slot + 1) & (cache->slot_count - 1);
+            }
+            cache->slots[slot] = (uint32_t)index + 1;
+        }
+    }
+    
+    IncludeCacheEntry *entry = &cache->entries[index];
+    entry->resolved_path = interned_resolved;
+    entry->exists = exists;
+    entry->cached_time = time(NULL);
+    cache_link_front(cache, index);
+    
+    if (cache->evictions > resolver->cache_capacity) {
+        cache_compact_strings(cache);
+    }
+}
+
+void set_default_include_cache_capacity(int capacity) {
+    default_cache_capacity = capacity > 0 ? capacity : DEFAULT_INCLUDE_CACHE_SIZE;
+}
+
+void set_include_cache_capacity(IncludeResolver *resolver, int capacity) {
+    if (!resolver || capacity <= 0) return;
+    
+    if (resolver->cache && resolver->cache->count > capacity) {
+        clear_include_cache(resolver);
+    }
+    resolver->cache_capacity = capacity;
+}
+
 IncludeResolver* include_resolver_create(const char **include_dirs, int include_dirs_count, 
                                         const char *base_dir, bool enable_cache) {
     return include_resolver_create_advanced(include_dirs, include_dirs_count, base_dir, 
@@ -50,24 +391,27 @@ IncludeResolver* include_resolver_create_advanced(const char **include_dirs, int
     resolver->include_dirs_count = include_dirs_count;
     resolver->base_dir = base_dir;
     resolver->enable_cache = enable_cache;
-    resolver->cache_count = 0;
+    resolver->cache_capacity = default_cache_capacity;
     resolver->auto_append_inc = auto_append_inc;
     resolver->auto_extensions = auto_extensions;
     resolver->auto_extensions_count = auto_extensions_count;
+    resolver->cache_contexts[0] = -2;
+    resolver->cache_contexts[1] = -2;
     
     return resolver;
 }
 
 void include_resolver_destroy(IncludeResolver *resolver) {
     if (resolver) {
+        cache_free(resolver->cache);
         free(resolver);
     }
 }
 
 void clear_include_cache(IncludeResolver *resolver) {
     if (resolver) {
-        resolver->cache_count = 0;
-        memset(resolver->cache, 0, sizeof(resolver->cache));
+        cache_free(resolver->cache);
+        resolver->cache = NULL;
     }
 }
 
@@ -84,6 +428,25 @@ void set_auto_extensions(IncludeResolver *resolver, const char **extensions, int
     }
 }
 
+void set_base_dir(IncludeResolver *resolver, const char *base_dir) {
+    if (resolver && resolver->base_dir != base_dir) {
+        resolver->base_dir = base_dir;
+        resolver->cache_contexts[1] = -2;
+    }
+}
+
+void set_dir_index(IncludeResolver *resolver, bool enabled) {
+    if (resolver) {
+        resolver->use_dir_index = enabled;
+    }
+}
+
+void set_persistent_cache(IncludeResolver *resolver, bool enabled) {
+    if (resolver) {
+        resolver->use_persistent_cache = enabled;
+    }
+}
+
 void normalize_path(char *path) {
     if (!path) return;
     
@@ -159,8 +522,14 @@ bool parse_include_statement(const char *include_str, IncludeInfo *info) {
     p++;
     
     while (isspace(*p)) p++;
-    if (strncmp(p, "include", 7) != 0) return false;
-    p += 7;
+    if (strncmp(p, "include", 7) == 0) {
+        p += 7;
+    } else if (strncmp(p, "tryinclude", 10) == 0) {
+        info->optional = true;
+        p += 10;
+    } else {
+        return false;
+    }
     
     while (isspace(*p)) p++;
     
@@ -201,42 +570,6 @@ bool parse_include_statement(const char *include_str, IncludeInfo *info) {
 
 
 
-static IncludeCacheEntry* find_cache_entry(IncludeResolver *resolver, const char *include_path) {
-    if (!resolver || !resolver->enable_cache || !include_path) return NULL;
-    
-    for (int i = 0; i < resolver->cache_count; i++) {
-        if (strcmp(resolver->cache[i].include_path, include_path) == 0) {
-            return &resolver->cache[i];
-        }
-    }
-    return NULL;
-}
-
-static void add_cache_entry(IncludeResolver *resolver, const char *include_path, 
-                           const char *resolved_path, bool exists) {
-    if (!resolver || !resolver->enable_cache || !include_path) return;
-    
-    if (resolver->cache_count >= MAX_INCLUDE_CACHE_SIZE) {
-        memmove(&resolver->cache[0], &resolver->cache[1], 
-                sizeof(IncludeCacheEntry) * (MAX_INCLUDE_CACHE_SIZE - 1));
-        resolver->cache_count = MAX_INCLUDE_CACHE_SIZE - 1;
-    }
-    
-    IncludeCacheEntry *entry = &resolver->cache[resolver->cache_count++];
-    strncpy(entry->include_path, include_path, MAX_INCLUDE_PATH_LEN - 1);
-    entry->include_path[MAX_INCLUDE_PATH_LEN - 1] = '\0';
-    
-    if (resolved_path) {
-        strncpy(entry->resolved_path, resolved_path, MAX_INCLUDE_PATH_LEN - 1);
-        entry->resolved_path[MAX_INCLUDE_PATH_LEN - 1] = '\0';
-    } else {
-        entry->resolved_path[0] = '\0';
-    }
-    
-    entry->exists = exists;
-    entry->cached_time = time(NULL);
-}
-
 bool check_include_file_exists(const char *include_path) {
     if (!include_path || include_path[0] == '\0') return false;
     
@@ -247,9 +580,9 @@ bool check_include_file_exists(const char *include_path) {
 #endif
 }
 
-static bool try_resolve_path_with_extension(const char *base_path, const char *include_path, 
-                                           const char *extension, char *result_path, 
-                                           size_t result_size) {
+static bool try_resolve_path_with_extension(IncludeResolver *resolver, const char *base_path,
+                                           const char *include_path, const char *extension,
+                                           char *result_path, size_t result_size) {
     char test_path[MAX_INCLUDE_PATH_LEN];
     
     if (extension && strlen(extension) > 0) {
@@ -266,7 +599,20 @@ static bool try_resolve_path_with_extension(const char *base_path, const char *i
     
     normalize_path(test_path);
     
-    if (check_include_file_exists(test_path)) {
+    // Answer from the directory listing when there is one, saving a failing
+    // access() per candidate
+    IncludeIndexResult indexed = INCLUDE_INDEX_UNAVAILABLE;
+    if (resolver->use_dir_index) {
+        char relative_path[MAX_INCLUDE_PATH_LEN];
+        snprintf(relative_path, sizeof(relative_path), "%s%s", include_path, extension ? extension : "");
+        indexed = include_index_lookup(base_path, relative_path);
+    }
+    
+    if (indexed == INCLUDE_INDEX_MISSING) {
+        return false;
+    }
+    
+    if (indexed == INCLUDE_INDEX_FOUND || check_include_file_exists(test_path)) {
         if (result_size > strlen(test_path)) {
             strcpy(result_path, test_path);
             return true;
@@ -318,7 +664,7 @@ static bool try_resolve_path(IncludeResolver *resolver, const char *base_path,
                             const char *include_path, char *result_path, size_t result_size) {
     if (!resolver || !base_path || !include_path || !result_path) return false;
     
-    if (try_resolve_path_with_extension(base_path, include_path, NULL, 
+    if (try_resolve_path_with_extension(resolver, base_path, include_path, NULL,
                                        result_path, result_size)) {
         return true;
     }
@@ -327,7 +673,7 @@ static bool try_resolve_path(IncludeResolver *resolver, const char *base_path,
         if (!has_valid_include_extension(include_path)) {
             for (int i = 0; i < resolver->auto_extensions_count; i++) {
                 if (resolver->auto_extensions[i]) {
-                    if (try_resolve_path_with_extension(base_path, include_path, 
+                    if (try_resolve_path_with_extension(resolver, base_path, include_path,
                                                        resolver->auto_extensions[i],
                                                        result_path, result_size)) {
                         return true;
@@ -340,14 +686,142 @@ static bool try_resolve_path(IncludeResolver *resolver, const char *base_path,
     return false;
 }
 
+/**
+ * Id of the persistent cache context for an include of this type. Angle
+ * includes ignore the base directory, so they share one context across the
+ * files of a project
+ */
+static int get_persistent_context(IncludeResolver *resolver, IncludeType type) {
+    int slot = type == INCLUDE_TYPE_QUOTE ? 1 : 0;
+    if (resolver->cache_contexts[slot] != -2) {
+        return resolver->cache_contexts[slot];
+    }
+    resolver->cache_contexts[slot] = -1;
+    
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+    
+    size_t length = strlen(cwd) + 16;
+    if (slot == 1 && resolver->base_dir) length += strlen(resolver->base_dir);
+    for (int i = 0; i < resolver->auto_extensions_count; i++) {
+        if (resolver->auto_extensions[i]) length += strlen(resolver->auto_extensions[i]) + 1;
+    }
+    for (int i = 0; i < resolver->include_dirs_count; i++) {
+        if (resolver->include_dirs[i]) length += strlen(resolver->include_dirs[i]) + 1;
+    }
+    
+    char *context = malloc(length);
+    if (!context) return -1;
+    
+    size_t offset = (size_t)sprintf(context, "%s\n%s\n%c", cwd,
+                                    slot == 1 && resolver->base_dir ? resolver->base_dir : "",
+                                    resolver->auto_append_inc ? '+' : '-');
+    for (int i = 0; i < resolver->auto_extensions_count; i++) {
+        if (resolver->auto_extensions[i]) {
+            offset += (size_t)sprintf(context + offset, "%s ", resolver->auto_extensions[i]);
+        }
+    }
+    for (int i = 0; i < resolver->include_dirs_count; i++) {
+        if (resolver->include_dirs[i]) {
+            offset += (size_t)sprintf(context + offset, "\n%s", resolver->include_dirs[i]);
+        }
+    }
+    
+    resolver->cache_contexts[slot] = include_cache_context(context);
+    free(context);
+    return resolver->cache_contexts[slot];
+}
+
+/**
+ * Add the directory that holds include_path below base_path, i.e. the one
+ * whose listing decides whether the include is there
+ */
+static void add_decisive_dir(char dirs[][MAX_INCLUDE_PATH_LEN], int *count, int max_count,
+                             const char *base_path, const char *include_path) {
+    if (*count >= max_count) return;
+    
+    char *dir = dirs[*count];
+    if (base_path) {
+        snprintf(dir, MAX_INCLUDE_PATH_LEN, "%s%c%s", base_path, PATH_SEPARATOR, include_path);
+    } else {
+        snprintf(dir, MAX_INCLUDE_PATH_LEN, "%s", include_path);
+    }
+    normalize_path(dir);
+    
+    char *last_sep = strrchr(dir, PATH_SEPARATOR);
+    if (last_sep == dir) {
+        last_sep[1] = '\0';
+    } else if (last_sep) {
+        *last_sep = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    (*count)++;
+}
+
+#define MAX_DECISIVE_DIRS 64
+
+static void store_persistent_result(IncludeResolver *resolver, int context, const char *key,
+                                    const IncludeInfo *info, const char *resolved_path) {
+    char (*dirs)[MAX_INCLUDE_PATH_LEN] = malloc(sizeof(*dirs) * MAX_DECISIVE_DIRS);
+    const char *dir_ptrs[MAX_DECISIVE_DIRS];
+    int count = 0;
+    
+    if (!dirs) return;
+    
+    if (info->is_absolute) {
+        add_decisive_dir(dirs, &count, MAX_DECISIVE_DIRS, NULL, info->path);
+    } else {
+        char found_dir[MAX_INCLUDE_PATH_LEN] = "";
+        if (resolved_path) {
+            strncpy(found_dir, resolved_path, sizeof(found_dir) - 1);
+            found_dir[sizeof(found_dir) - 1] = '\0';
+            char *last_sep = strrchr(found_dir, PATH_SEPARATOR);
+            if (last_sep) *last_sep = '\0';
+        }
+        
+        // Every directory searched up to the one that had the file
+        int search_count = resolver->include_dirs_count + (info->type == INCLUDE_TYPE_QUOTE ? 1 : 0);
+        for (int i = 0; i < search_count; i++) {
+            const char *search_dir = info->type == INCLUDE_TYPE_QUOTE ?
+                (i == 0 ? resolver->base_dir : resolver->include_dirs[i - 1]) : resolver->include_dirs[i];
+            if (!search_dir) continue;
+            
+            add_decisive_dir(dirs, &count, MAX_DECISIVE_DIRS, search_dir, info->path);
+            if (resolved_path && count > 0 && strcmp(dirs[count - 1], found_dir) == 0) {
+                break;
+            }
+        }
+        
+    }
+    
+    // Too many directories to track; leave this one uncached
+    if (count < MAX_DECISIVE_DIRS) {
+        for (int i = 0; i < count; i++) {
+            dir_ptrs[i] = dirs[i];
+        }
+        include_cache_store(context, key, resolved_path, dir_ptrs, count);
+    }
+    free(dirs);
+}
+
 bool resolve_include_file(IncludeResolver *resolver, const IncludeInfo *info,
                          char *result_path, size_t result_path_size) {
     if (!resolver || !info || !result_path || result_path_size == 0) return false;
     
     result_path[0] = '\0';
     
+    // Quoted includes depend on the including file's directory, so it is
+    // part of their key; angle includes are shared by every file
+    char cache_key[MAX_INCLUDE_PATH_LEN * 2 + 2];
+    if (info->type == INCLUDE_TYPE_QUOTE) {
+        snprintf(cache_key, sizeof(cache_key), "\"%s\n%s", resolver->base_dir ? resolver->base_dir : "", info->path);
+    } else {
+        snprintf(cache_key, sizeof(cache_key), "<%s", info->path);
+    }
+    
     if (resolver->enable_cache) {
-        IncludeCacheEntry *cached = find_cache_entry(resolver, info->path);
+        IncludeCacheEntry *cached = find_cache_entry(resolver, cache_key);
         if (cached) {
             if (cached->exists && strlen(cached->resolved_path) < result_path_size) {
                 strcpy(result_path, cached->resolved_path);
@@ -361,6 +835,28 @@ bool resolve_include_file(IncludeResolver *resolver, const IncludeInfo *info,
     bool found = false;
     char resolved_path[MAX_INCLUDE_PATH_LEN];
     
+    // Then the persistent cache, which answers without touching the
+    // include directories while they are unchanged
+    int context = -1;
+    char key[MAX_INCLUDE_PATH_LEN + 1];
+    if (resolver->use_persistent_cache) {
+        context = get_persistent_context(resolver, info->type);
+        snprintf(key, sizeof(key), "%c%s", info->type == INCLUDE_TYPE_ANGLE ? '<' : '"', info->path);
+        
+        if (context >= 0 && include_cache_lookup(context, key, &found, resolved_path, sizeof(resolved_path))) {
+            if (found && strlen(resolved_path) >= result_path_size) {
+                found = false;
+            } else if (found) {
+                strcpy(result_path, resolved_path);
+            }
+            if (resolver->enable_cache) {
+                add_cache_entry(resolver, cache_key, found ? resolved_path : NULL, found);
+            }
+            return found;
+        }
+        found = false;
+    }
+    
     if (info->is_absolute) {
         if (check_include_file_exists(info->path)) {
             if (strlen(info->path) < result_path_size) {
@@ -410,7 +906,11 @@ bool resolve_include_file(IncludeResolver *resolver, const IncludeInfo *info,
     }
     
     if (resolver->enable_cache) {
-        add_cache_entry(resolver, info->path, found ? resolved_path : NULL, found);
+        add_cache_entry(resolver, cache_key, found ? resolved_path : NULL, found);
+    }
+    
+    if (context >= 0) {
+        store_persistent_result(resolver, context, key, info, found ? resolved_path : NULL);
     }
     
     return found;
@@ -427,4 +927,334 @@ bool find_include_file(const IncludeInfo *info, const char *base_dir,
     include_resolver_destroy(resolver);
     
     return result;
-}
\ No newline at end of file
+}
+
+// A file list holds char * paths and a graph IncludeGraphNodes with the path
+// first, so either is a char * every stride bytes
+static const char *indexed_path(const void *items, size_t stride, int i) {
+    return *(char *const *)((const char *)items + (size_t)i * stride);
+}
+
+static size_t path_index_slot(const IncludePathIndex *index, const void *items, size_t stride,
+                              const char *path) {
+    size_t mask = index->slot_count - 1;
+    size_t slot = hash_string(path) & mask;
+    while (index->slots[slot] &&
+           strcmp(indexed_path(items, stride, (int)index->slots[slot] - 1), path) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Position of path among items, -1 if it is not there
+static int path_index_find(const IncludePathIndex *index, const void *items, size_t stride,
+                           const char *path) {
+    if (index->slot_count == 0) return -1;
+    return (int)index->slots[path_index_slot(index, items, stride, path)] - 1;
+}
+
+// Index the last of count items, growing to keep the table at most half full
+static bool path_index_add(IncludePathIndex *index, const void *items, size_t stride, int count) {
+    if ((size_t)count * 2 > index->slot_count) {
+        size_t slot_count = index->slot_count > 0 ? index->slot_count * 2 : 64;
+        uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+        if (!slots) return false;
+        free(index->slots);
+        index->slots = slots;
+        index->slot_count = slot_count;
+        for (int i = 0; i < count - 1; i++) {
+            index->slots[path_index_slot(index, items, stride, indexed_path(items, stride, i))] = (uint32_t)i + 1;
+        }
+    }
+    
+    const char *path = indexed_path(items, stride, count - 1);
+    index->slots[path_index_slot(index, items, stride, path)] = (uint32_t)count;
+    return true;
+}
+
+static void path_index_free(IncludePathIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->slot_count = 0;
+}
+
+bool include_file_list_append(IncludeFileList *list, const char *path) {
+    if (path_index_find(&list->index, list->files, sizeof(char *), path) >= 0) {
+        return true;
+    }
+    
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity > 0 ? list->capacity * 2 : 32;
+        char **files = realloc(list->files, sizeof(char *) * new_capacity);
+        if (!files) return false;
+        list->files = files;
+        list->capacity = new_capacity;
+    }
+    
+    char *copy = malloc(strlen(path) + 1);
+    if (!copy) return false;
+    strcpy(copy, path);
+    
+    list->files[list->count++] = copy;
+    return path_index_add(&list->index, list->files, sizeof(char *), list->count);
+}
+
+static int include_graph_find(const IncludeGraph *graph, const char *path) {
+    return path_index_find(&graph->index, graph->nodes, sizeof(IncludeGraphNode), path);
+}
+
+static int include_graph_add_node(IncludeGraph *graph, const char *path) {
+    if (graph->count >= graph->capacity) {
+        int new_capacity = graph->capacity > 0 ? graph->capacity * 2 : 32;
+        IncludeGraphNode *nodes = realloc(graph->nodes, sizeof(IncludeGraphNode) * new_capacity);
+        if (!nodes) return -1;
+        graph->nodes = nodes;
+        graph->capacity = new_capacity;
+    }
+    
+    IncludeGraphNode *node = &graph->nodes[graph->count];
+    memset(node, 0, sizeof(*node));
+    node->path = malloc(strlen(path) + 1);
+    if (!node->path) return -1;
+    strcpy(node->path, path);
+    
+    graph->count++;
+    if (!path_index_add(&graph->index, graph->nodes, sizeof(IncludeGraphNode), graph->count)) {
+        return -1;
+    }
+    return graph->count - 1;
+}
+
+static bool include_graph_add_edge(IncludeGraph *graph, int from, int to) {
+    IncludeGraphNode *node = &graph->nodes[from];
+    
+    for (int i = 0; i < node->edge_count; i++) {
+        if (node->edges[i] == to) return true;
+    }
+    
+    if (node->edge_count >= node->edge_capacity) {
+        int new_capacity = node->edge_capacity > 0 ? node->edge_capacity * 2 : 8;
+        int *edges = realloc(node->edges, sizeof(int) * new_capacity);
+        if (!edges) return false;
+        node->edges = edges;
+        node->edge_capacity = new_capacity;
+    }
+    
+    node->edges[node->edge_count++] = to;
+    return true;
+}
+
+// Format a problem for the caller's report function, if there is one
+static void graph_report(IncludeReport report, void *report_data, const char *format, ...) {
+    if (!report) return;
+    
+    char message[MAX_INCLUDE_PATH_LEN * 2 + 128];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+    report(message, report_data);
+}
+
+/**
+ * Depth-first walk from node. Nodes are referred to by index since the node
+ * array moves as it grows.
+ */
+static bool include_graph_walk(IncludeGraph *graph, int index, IncludeResolver *resolver,
+                               int depth, IncludeReport report, void *report_data) {
+    ScannedIncludeList includes;
+    if (!include_scan_file(graph->nodes[index].path, &includes)) {
+        graph_report(report, report_data, "Failed to open source file: %s\n", graph->nodes[index].path);
+        return depth > 1;
+    }
+    
+    // Quoted includes are relative to the including file. dup_directory_path
+    // keeps the trailing separator; drop it so resolved paths come out the
+    // same at every depth
+    char *base_dir = dup_directory_path(graph->nodes[index].path);
+    if (!base_dir) {
+        scanned_include_list_free(&includes);
+        return false;
+    }
+    size_t base_len = strlen(base_dir);
+    while (base_len > 1 && (base_dir[base_len - 1] == '/' || base_dir[base_len - 1] == '\\')) {
+        base_dir[--base_len] = '\0';
+    }
+    graph->nodes[index].dir = base_dir;
+    
+    graph->nodes[index].visiting = true;
+    
+    bool ok = true;
+    for (int i = 0; ok && i < includes.count; i++) {
+        const ScannedInclude *scanned = &includes.items[i];
+        int line_number = scanned->line;
+        
+        IncludeInfo info;
+        memset(&info, 0, sizeof(info));
+        strcpy(info.path, scanned->path);
+        info.type = scanned->type;
+        info.optional = scanned->optional;
+#ifdef _WIN32
+        info.is_absolute = (strlen(info.path) >= 3 && info.path[1] == ':');
+#else
+        info.is_absolute = (info.path[0] == '/');
+#endif
+        
+        char resolved[MAX_INCLUDE_PATH_LEN];
+        set_base_dir(resolver, graph->nodes[index].dir);
+        if (!resolve_include_file(resolver, &info, resolved, sizeof(resolved))) {
+            // #tryinclude may miss by design
+            if (info.optional) continue;
+            
+            // Nested includes may sit in inactive #if blocks, which are not
+            // evaluated here, so only the entry file's are errors
+            graph->missing_count++;
+            if (depth == 1) {
+                graph->root_missing_count++;
+            }
+            graph_report(report, report_data, "%s: Cannot find include file '%s' at %s:%d\n",
+                         depth == 1 ? "Error" : "Warning", info.path, graph->nodes[index].path, line_number);
+            continue;
+        }
+        
+        int target = include_graph_find(graph, resolved);
+        if (target >= 0) {
+            // Pawn includes each file once, so a cycle is legal; just don't
+            // walk into it again
+            if (graph->nodes[target].visiting) {
+                graph->cycle_count++;
+            }
+            ok = include_graph_add_edge(graph, index, target);
+            continue;
+        }
+        
+        if (depth >= MAX_INCLUDE_DEPTH) {
+            graph->depth_exceeded = true;
+            graph_report(report, report_data, "Error: Includes nested deeper than %d levels at %s:%d\n",
+                         MAX_INCLUDE_DEPTH, graph->nodes[index].path, line_number);
+            continue;
+        }
+        
+        target = include_graph_add_node(graph, resolved);
+        if (target < 0 || !include_graph_add_edge(graph, index, target)) {
+            ok = false;
+            break;
+        }
+        
+        ok = include_graph_walk(graph, target, resolver, depth + 1, report, report_data);
+    }
+    
+    graph->nodes[index].visiting = false;
+    
+    scanned_include_list_free(&includes);
+    return ok;
+}
+
+bool include_graph_build(IncludeGraph *graph, const char *source_file, const char **include_dirs,
+                         int include_dirs_count, IncludeReport report, void *report_data) {
+    if (!graph || !source_file) return false;
+    
+    memset(graph, 0, sizeof(IncludeGraph));
+    
+    // Pick up include directories that changed since the previous build
+    include_index_begin_pass();
+    include_cache_begin_pass();
+    
+    if (include_graph_add_node(graph, source_file) < 0) {
+        return false;
+    }
+    
+    // One resolver for the whole graph, so files share its cache
+    IncludeResolver *resolver = include_resolver_create(include_dirs, include_dirs_count, NULL, true);
+    if (!resolver) {
+        return false;
+    }
+    set_dir_index(resolver, true);
+    set_persistent_cache(resolver, true);
+    
+    bool ok = include_graph_walk(graph, 0, resolver, 1, report, report_data);
+    
+    include_resolver_destroy(resolver);
+    include_cache_save();
+    return ok;
+}
+
+void include_graph_free(IncludeGraph *graph) {
+    if (!graph) return;
+    
+    for (int i = 0; i < graph->count; i++) {
+        free(graph->nodes[i].path);
+        free(graph->nodes[i].dir);
+        free(graph->nodes[i].edges);
+    }
+    free(graph->nodes);
+    path_index_free(&graph->index);
+    
+    memset(graph, 0, sizeof(IncludeGraph));
+}
+
+// Escape a path for a Make/Ninja depfile
+static void write_depfile_path(FILE *file, const char *path) {
+    for (const char *p = path; *p; p++) {
+        if (*p == ' ' || *p == '#') {
+            fputc('\\', file);
+        } else if (*p == '$') {
+            fputc('$', file);
+        }
+        fputc(*p, file);
+    }
+}
+
+bool include_graph_write_depfile(const IncludeGraph *graph, const char *target, const char *depfile_path) {
+    if (!graph || graph->count == 0 || !target || !depfile_path) return false;
+    
+    // Write next to the destination and rename, so a build system never
+    // reads a half-written depfile
+    char temp_path[MAX_INCLUDE_PATH_LEN + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", depfile_path);
+    
+    FILE *file = fopen(temp_path, "w");
+    if (!file) return false;
+    
+    write_depfile_path(file, target);
+    fputc(':', file);
+    for (int i = 0; i < graph->count; i++) {
+        fputs(" \\\n  ", file);
+        write_depfile_path(file, graph->nodes[i].path);
+    }
+    fputc('\n', file);
+    
+    // Phony rules for the includes keep make working after one is deleted
+    for (int i = 1; i < graph->count; i++) {
+        fputc('\n', file);
+        write_depfile_path(file, graph->nodes[i].path);
+        fputs(":\n", file);
+    }
+    
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temp_path, depfile_path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(temp_path, depfile_path) == 0;
+#endif
+    if (!ok) {
+        remove(temp_path);
+    }
+    return ok;
+}
+
+void include_file_list_free(IncludeFileList *list) {
+    if (!list) return;
+    
+    for (int i = 0; i < list->count; i++) {
+        free(list->files[i]);
+    }
+    free(list->files);
+    path_index_free(&list->index);
+    
+    list->files = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
@@ -0,0 +1,333 @@
+// dl_iterate_phdr and dladdr
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include "pawnc_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__APPLE__)
+#include <mach-o/getsect.h>
+#else
+#include <link.h>
+#endif
+#endif
+
+// Entry point exported by libpawnc (sc1.c)
+typedef int (*pc_compile_fn)(int argc, char **argv);
+
+#define MAX_LOADED_LIBRARIES 8
+#define MAX_SAVED_RANGES 4
+
+#ifndef _WIN32
+// A writable part of a library's image and its bytes as loaded
+typedef struct {
+    unsigned char *address;
+    size_t size;
+    unsigned char *saved;
+} SavedRange;
+
+typedef struct {
+    char path[1024];
+    void *handle;
+    pc_compile_fn entry;
+    SavedRange ranges[MAX_SAVED_RANGES];
+    int range_count;
+} LoadedLibrary;
+
+// Every version loaded stays loaded so that a long-running process (the
+// compile daemon) can switch between them without reloading
+static LoadedLibrary loaded_libraries[MAX_LOADED_LIBRARIES];
+static int loaded_count = 0;
+static LoadedLibrary *current_library = NULL;
+static pthread_mutex_t compile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool save_range(LoadedLibrary *library, uintptr_t start, uintptr_t end) {
+    if (start >= end) return true;
+    if (library->range_count == MAX_SAVED_RANGES) return false;
+
+    SavedRange *range = &library->ranges[library->range_count];
+    range->address = (unsigned char *)start;
+    range->size = (size_t)(end - start);
+    range->saved = malloc(range->size);
+    if (!range->saved) return false;
+    memcpy(range->saved, range->address, range->size);
+    library->range_count++;
+    return true;
+}
+
+#if defined(__APPLE__)
+// The compiler's globals live in __DATA,__data, __bss and __common
+static bool save_writable_ranges(LoadedLibrary *library) {
+    Dl_info info;
+    if (!dladdr(*(void **)&library->entry, &info)) return false;
+
+    static const char *const sections[] = {"__data", "__bss", "__common"};
+    for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+        unsigned long size = 0;
+        uint8_t *data = getsectiondata((const struct mach_header_64 *)info.dli_fbase, "__DATA", sections[i], &size);
+        if (data && !save_range(library, (uintptr_t)data, (uintptr_t)data + size)) {
+            return false;
+        }
+    }
+    return true;
+}
+#else
+typedef struct {
+    LoadedLibrary *library;
+    bool found;
+    bool ok;
+} WritableSearch;
+
+static int find_writable_ranges(struct dl_phdr_info *info, size_t size, void *data) {
+    (void)size;
+    WritableSearch *search = data;
+    uintptr_t entry = (uintptr_t)*(void **)&search->library->entry;
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t relro_start = 0, relro_end = 0;
+    bool contains_entry = false;
+
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        if (phdr->p_type == PT_LOAD && entry >= start && entry < start + phdr->p_memsz) {
+            contains_entry = true;
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            // Made read-only after relocation, in whole pages
+            relro_start = start & ~(page - 1);
+            relro_end = (start + phdr->p_memsz) & ~(page - 1);
+        }
+    }
+    if (!contains_entry) return 0;
+
+    search->found = true;
+    search->ok = true;
+    for (int i = 0; search->ok && i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type != PT_LOAD || !(phdr->p_flags & PF_W)) continue;
+
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+        uintptr_t end = start + phdr->p_memsz;
+        if (relro_start <= start && relro_end > start) {
+            start = relro_end;
+        }
+        search->ok = save_range(search->library, start, end);
+    }
+    return 1;
+}
+
+// The compiler's globals are in the writable PT_LOAD segments, past RELRO
+static bool save_writable_ranges(LoadedLibrary *library) {
+    WritableSearch search = {library, false, false};
+    dl_iterate_phdr(find_writable_ranges, &search);
+    return search.found && search.ok;
+}
+#endif
+
+static void free_saved_ranges(LoadedLibrary *library) {
+    for (int i = 0; i < library->range_count; i++) {
+        free(library->ranges[i].saved);
+    }
+    library->range_count = 0;
+}
+
+// Put the compiler's globals back as they were before its first compile
+static void restore_writable_ranges(const LoadedLibrary *library) {
+    for (int i = 0; i < library->range_count; i++) {
+        memcpy(library->ranges[i].address, library->ranges[i].saved, library->ranges[i].size);
+    }
+}
+
+typedef struct {
+    int fd;
+    PawncDiagnosticCallback callback;
+    void *user_data;
+} DiagnosticReader;
+
+// Hand the compiler's output to the callback a line at a time as it comes
+static void *read_diagnostics(void *arg) {
+    DiagnosticReader *reader = arg;
+    char line[2048];
+    size_t line_len = 0;
+    char chunk[4096];
+
+    for (;;) {
+        ssize_t n = read(reader->fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        for (ssize_t i = 0; i < n; i++) {
+            char c = chunk[i];
+            if (c == '\r') continue;
+
+            // Overlong lines are delivered in pieces
+            if (c == '\n' || line_len == sizeof(line) - 1) {
+                line[line_len] = '\0';
+                if (reader->callback) {
+                    reader->callback(line, reader->user_data);
+                }
+                line_len = 0;
+                if (c == '\n') continue;
+            }
+            line[line_len++] = c;
+        }
+    }
+
+    if (line_len > 0) {
+        line[line_len] = '\0';
+        if (reader->callback) {
+            reader->callback(line, reader->user_data);
+        }
+    }
+    return NULL;
+}
+#endif
+
+bool pawnc_in_process_supported(void) {
+#ifdef _WIN32
+    // pawnc.dll writes through its own C runtime, whose standard handles
+    // cannot be redirected once it is initialised
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool pawnc_library_load(const char *library_path) {
+#ifdef _WIN32
+    (void)library_path;
+    fprintf(stderr, "In-process compilation is not supported on Windows\n");
+    return false;
+#else
+    for (int i = 0; i < loaded_count; i++) {
+        if (strcmp(loaded_libraries[i].path, library_path) == 0) {
+            current_library = &loaded_libraries[i];
+            return true;
+        }
+    }
+    if (loaded_count == MAX_LOADED_LIBRARIES) {
+        pawnc_library_unload();
+    }
+
+    void *handle = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "Failed to load %s: %s\n", library_path, dlerror());
+        return false;
+    }
+
+    pc_compile_fn entry;
+    *(void **)(&entry) = dlsym(handle, "pc_compile");
+    if (!entry) {
+        fprintf(stderr, "pc_compile not found in %s\n", library_path);
+        dlclose(handle);
+        return false;
+    }
+
+    LoadedLibrary *library = &loaded_libraries[loaded_count];
+    memset(library, 0, sizeof(*library));
+    library->entry = entry;
+    if (!save_writable_ranges(library)) {
+        fprintf(stderr, "Failed to find the data of %s\n", library_path);
+        free_saved_ranges(library);
+        dlclose(handle);
+        return false;
+    }
+    snprintf(library->path, sizeof(library->path), "%s", library_path);
+    library->handle = handle;
+    loaded_count++;
+    current_library = library;
+    return true;
+#endif
+}
+
+int pawnc_compile(char *const args[], PawncDiagnosticCallback callback, void *user_data) {
+#ifdef _WIN32
+    (void)args;
+    (void)callback;
+    (void)user_data;
+    return -1;
+#else
+    if (!current_library) {
+        return -1;
+    }
+
+    int argc = 0;
+    while (args[argc] != NULL) {
+        argc++;
+    }
+
+    pthread_mutex_lock(&compile_lock);
+
+    // pc_compile reports through printf/fprintf, so collect the output by
+    // pointing stdout and stderr at a pipe for the duration of the call
+    int fds[2];
+    if (pipe(fds) != 0) {
+        pthread_mutex_unlock(&compile_lock);
+        fprintf(stderr, "Failed to create pipe\n");
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+
+    DiagnosticReader reader = {fds[0], callback, user_data};
+    pthread_t reader_thread;
+    if (saved_stdout < 0 || saved_stderr < 0 ||
+        pthread_create(&reader_thread, NULL, read_diagnostics, &reader) != 0) {
+        if (saved_stdout >= 0) close(saved_stdout);
+        if (saved_stderr >= 0) close(saved_stderr);
+        close(fds[0]);
+        close(fds[1]);
+        pthread_mutex_unlock(&compile_lock);
+        fprintf(stderr, "Failed to capture compiler output\n");
+        return -1;
+    }
+
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(fds[1]);
+
+    // The compiler keeps its state in globals that one compile leaves
+    // behind for the next, so each compile starts from them as loaded
+    restore_writable_ranges(current_library);
+    int result = current_library->entry(argc, (char **)args);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    // The write end is gone now, so the reader sees end of file
+    pthread_join(reader_thread, NULL);
+    close(fds[0]);
+
+    pthread_mutex_unlock(&compile_lock);
+    return result;
+#endif
+}
+
+void pawnc_library_unload(void) {
+#ifndef _WIN32
+    for (int i = 0; i < loaded_count; i++) {
+        free_saved_ranges(&loaded_libraries[i]);
+        dlclose(loaded_libraries[i].handle);
+    }
+    loaded_count = 0;
+    current_library = NULL;
+#endif
+}
@@ -14,6 +14,18 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#endif
+
+// Serialises pipe creation and process spawning so that a pipe created for
+// one child is never inherited by another child spawned concurrently, which
+// would keep the pipe open until both exit
+#ifdef _WIN32
+static SRWLOCK spawn_lock = SRWLOCK_INIT;
+#elif !defined(__ANDROID__)
+static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 int run_process(const char *command, char *const args[], bool wait_for_exit) {
@@ -302,6 +314,190 @@ int run_process(const char *command, char *const args[], bool wait_for_exit) {
 #endif
 }
 
+static bool append_output(char **buffer, size_t *length, size_t *capacity,
+                          const char *data, size_t data_len) {
+    if (*length + data_len + 1 > *capacity) {
+        size_t new_capacity = *capacity > 0 ? *capacity : 4096;
+        while (new_capacity < *length + data_len + 1) {
+            new_capacity *= 2;
+        }
+        char *grown = realloc(*buffer, new_capacity);
+        if (!grown) return false;
+        *buffer = grown;
+        *capacity = new_capacity;
+    }
+    
+    memcpy(*buffer + *length, data, data_len);
+    *length += data_len;
+    (*buffer)[*length] = '\0';
+    return true;
+}
+
+int run_process_capture(const char *command, char *const args[], char **output, bool echo_output) {
+    char *buffer = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    
+    *output = NULL;
+    
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES sa;
+    HANDLE read_pipe, write_pipe;
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+    
+    AcquireSRWLockExclusive(&spawn_lock);
+    if (!CreatePipe(&read_pipe, &write_pipe, &sa, 0)) {
+        ReleaseSRWLockExclusive(&spawn_lock);
+        fprintf(stderr, "CreatePipe failed (%lu)\n", GetLastError());
+        return -1;
+    }
+    SetHandleInformation(read_pipe, HANDLE_FLAG_INHERIT, 0);
+    
+    // args[0] is the program itself; quote anything containing spaces
+    char cmd_line[4096] = "";
+    for (int i = 0; args[i] != NULL; i++) {
+        if (i > 0) {
+            strcat_s(cmd_line, sizeof(cmd_line), " ");
+        }
+        if (strchr(args[i], ' ') && args[i][0] != '"') {
+            strcat_s(cmd_line, sizeof(cmd_line), "\"");
+            strcat_s(cmd_line, sizeof(cmd_line), args[i]);
+            strcat_s(cmd_line, sizeof(cmd_line), "\"");
+        } else {
+            strcat_s(cmd_line, sizeof(cmd_line), args[i]);
+        }
+    }
+    
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = write_pipe;
+    si.hStdError = write_pipe;
+    ZeroMemory(&pi, sizeof(pi));
+    
+    if (!CreateProcess(NULL, cmd_line, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+        fprintf(stderr, "CreateProcess failed (%lu)\n", GetLastError());
+        CloseHandle(read_pipe);
+        CloseHandle(write_pipe);
+        ReleaseSRWLockExclusive(&spawn_lock);
+        return -1;
+    }
+    CloseHandle(write_pipe);
+    ReleaseSRWLockExclusive(&spawn_lock);
+    
+    char chunk[4096];
+    DWORD bytes_read;
+    while (ReadFile(read_pipe, chunk, sizeof(chunk), &bytes_read, NULL) && bytes_read > 0) {
+        if (echo_output) {
+            fwrite(chunk, 1, bytes_read, stdout);
+            fflush(stdout);
+        }
+        append_output(&buffer, &length, &capacity, chunk, bytes_read);
+    }
+    CloseHandle(read_pipe);
+    
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD exit_code = 0;
+    GetExitCodeProcess(pi.hProcess, &exit_code);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    
+    if (!buffer) {
+        buffer = calloc(1, 1);
+    }
+    *output = buffer;
+    return (int)exit_code;
+#elif defined(__ANDROID__)
+    // The Android path runs through system() shells; output goes straight
+    // to the terminal and cannot be collected.
+    (void)buffer;
+    (void)length;
+    (void)capacity;
+    (void)echo_output;
+    return run_process(command, args, true);
+#else
+    int fds[2];
+    pthread_mutex_lock(&spawn_lock);
+    if (pipe(fds) != 0) {
+        pthread_mutex_unlock(&spawn_lock);
+        fprintf(stderr, "Failed to create pipe\n");
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        pthread_mutex_unlock(&spawn_lock);
+        fprintf(stderr, "Fork failed\n");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    } else if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[1]);
+        
+        if (access(command, F_OK) != 0 || access(command, X_OK) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        
+        execvp(command, args);
+        _exit(EXIT_FAILURE);
+    }
+    
+    close(fds[1]);
+    pthread_mutex_unlock(&spawn_lock);
+    
+    char chunk[4096];
+    for (;;) {
+        ssize_t n = read(fds[0], chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        
+        if (echo_output) {
+            fwrite(chunk, 1, (size_t)n, stdout);
+            fflush(stdout);
+        }
+        append_output(&buffer, &length, &capacity, chunk, (size_t)n);
+    }
+    close(fds[0]);
+    
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            free(buffer);
+            return -1;
+        }
+    }
+    
+    if (!buffer) {
+        buffer = calloc(1, 1);
+    }
+    *output = buffer;
+    
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
+
+int get_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
 bool is_process_running(const char *process_name) {
 #ifdef _WIN32
     // Windows implementation
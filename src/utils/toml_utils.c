@@ -2,178 +2,255 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
 
-#include "toml.h"
+#include "config_snapshot.h"
 
 #define DEFAULT_INPUT_FILE "gamemodes/main.pwn"
 #define DEFAULT_OUTPUT_FILE "gamemodes/main.amx"
 #define DEFAULT_COMPILER_VERSION "v3.10.11"
 
-static void safe_strcpy(char* dest, size_t dest_size, const char* src) {
-#ifdef _WIN32
-    strcpy_s(dest, dest_size, src ? src : "");
-#else
-    if (src)
-        strcpy(dest, src);
-    else
-        dest[0] = '\0';
-#endif
+static char* dup_string(const char* src) {
+    size_t len = strlen(src);
+    char* copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, src, len + 1);
+    }
+    return copy;
 }
 
-static char* get_toml_string(toml_table_t* table, const char* key, const char* default_value) {
-    static char result[256];
-    
-    safe_strcpy(result, sizeof(result), default_value);
-    
-    toml_datum_t datum = toml_string_in(table, key);
-    if (datum.ok) {
-        safe_strcpy(result, sizeof(result), datum.u.s);
-        free(datum.u.s);
+static void free_string_list(char** list, int count) {
+    if (!list) return;
+    for (int i = 0; i < count; i++) {
+        free(list[i]);
     }
-    
-    return result;
+    free(list);
 }
 
-static toml_table_t* parse_toml_file(const char* toml_path) {
-    FILE* file = fopen(toml_path, "r");
-    if (!file) {
-        return NULL;
-    }
+// Copy a NULL-terminated list of strings
+static char** dup_string_list(const char* const* src, int* count) {
+    *count = 0;
     
-    char errbuf[200];
-    toml_table_t* conf = toml_parse_file(file, errbuf, sizeof(errbuf));
-    fclose(file);
+    int n = 0;
+    while (src[n]) n++;
     
-    if (!conf) {
-        fprintf(stderr, "Error parsing TOML file: %s\n", errbuf);
+    char** list = calloc((size_t)n + 1, sizeof(char*));
+    if (!list) {
         return NULL;
     }
     
-    return conf;
+    for (int i = 0; i < n; i++) {
+        list[i] = dup_string(src[i]);
+        if (!list[i]) {
+            free_string_list(list, i);
+            return NULL;
+        }
+    }
+    
+    *count = n;
+    return list;
 }
 
-char* read_toml_entry_file(const char* toml_path) {
-    toml_table_t* conf = parse_toml_file(toml_path);
-    if (!conf) {
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_INPUT_FILE);
-        return default_value;
+static char* dup_bytes(const char* src, size_t length) {
+    char* copy = malloc(length + 1);
+    if (copy) {
+        memcpy(copy, src, length);
+        copy[length] = '\0';
     }
-    
-    toml_table_t* build = toml_table_in(conf, "build");
-    if (!build) {
-        toml_free(conf);
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_INPUT_FILE);
-        return default_value;
+    return copy;
+}
+
+typedef struct {
+    const char* path;
+    const ConfigSnapshot* snapshot;
+} ConfigReader;
+
+/**
+ * Read an optional string. *out receives a copy of default_value (or NULL
+ * if there is none) when the key is absent
+ *
+ * @return false if the key holds something other than a non-empty string
+ */
+static bool read_string(const ConfigReader* reader, const ConfigNode* table, const char* section,
+                        const char* key, const char* default_value, char** out) {
+    *out = NULL;
+    
+    const ConfigNode* node = config_node_get(reader->snapshot, table, key);
+    if (node) {
+        const char* value;
+        size_t length;
+        if (!config_node_string(reader->snapshot, node, &value, &length) || length == 0) {
+            fprintf(stderr, "Error: %s: %s.%s must be a non-empty string\n", reader->path, section, key);
+            return false;
+        }
+        *out = dup_bytes(value, length);
+    } else if (default_value) {
+        *out = dup_string(default_value);
+    } else {
+        return true;
     }
     
-    char* result = get_toml_string(build, "entry_file", DEFAULT_INPUT_FILE);
-    
-    toml_free(conf);
-    return result;
+    if (!*out) {
+        fprintf(stderr, "Error: Out of memory reading %s\n", reader->path);
+        return false;
+    }
+    return true;
 }
 
-char* read_toml_output_file(const char* toml_path) {
-    toml_table_t* conf = parse_toml_file(toml_path);
-    if (!conf) {
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_OUTPUT_FILE);
-        return default_value;
-    }
+/**
+ * Read a string array stored either directly as key = [...] or, like
+ * [build.includes] and [build.args], as a sub-table holding subkey = [...].
+ * The list is NULL-terminated; *list stays NULL when the key is absent
+ *
+ * @return false if the value is not an array of strings
+ */
+static bool read_string_list(const ConfigReader* reader, const ConfigNode* table, const char* section,
+                             const char* key, const char* subkey, char*** list, int* count) {
+    *list = NULL;
+    *count = 0;
     
-    toml_table_t* build = toml_table_in(conf, "build");
-    if (!build) {
-        toml_free(conf);
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_OUTPUT_FILE);
-        return default_value;
+    const ConfigNode* array = config_node_get(reader->snapshot, table, key);
+    if (!array) {
+        return true;
     }
     
-    char* result = get_toml_string(build, "output_file", DEFAULT_OUTPUT_FILE);
+    char name[128];
+    snprintf(name, sizeof(name), "%s.%s", section, key);
     
-    toml_free(conf);
-    return result;
-}
-
-char* read_toml_compiler_version(const char* toml_path) {
-    toml_table_t* conf = parse_toml_file(toml_path);
-    if (!conf) {
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_COMPILER_VERSION);
-        return default_value;
+    if (array->type == CONFIG_NODE_TABLE) {
+        array = config_node_get(reader->snapshot, array, subkey);
+        if (!array) {
+            return true;
+        }
+        snprintf(name, sizeof(name), "%s.%s.%s", section, key, subkey);
+    }
+    if (array->type != CONFIG_NODE_ARRAY) {
+        fprintf(stderr, "Error: %s: %s must be an array of strings\n", reader->path, name);
+        return false;
     }
     
-    toml_table_t* build = toml_table_in(conf, "build");
-    if (!build) {
-        toml_free(conf);
-        static char default_value[256];
-        safe_strcpy(default_value, sizeof(default_value), DEFAULT_COMPILER_VERSION);
-        return default_value;
+    int nelem = (int)array->count;
+    char** items = calloc((size_t)nelem + 1, sizeof(char*));
+    if (!items) {
+        fprintf(stderr, "Error: Out of memory reading %s\n", reader->path);
+        return false;
     }
     
-    char* result = get_toml_string(build, "compiler_version", DEFAULT_COMPILER_VERSION);
+    for (int i = 0; i < nelem; i++) {
+        const char* value;
+        size_t length;
+        if (!config_node_string(reader->snapshot, config_node_at(reader->snapshot, array, (uint32_t)i),
+                                &value, &length)) {
+            fprintf(stderr, "Error: %s: %s must be an array of strings\n", reader->path, name);
+            free_string_list(items, i);
+            return false;
+        }
+        items[i] = dup_bytes(value, length);
+        if (!items[i]) {
+            fprintf(stderr, "Error: Out of memory reading %s\n", reader->path);
+            free_string_list(items, i);
+            return false;
+        }
+    }
     
-    toml_free(conf);
-    return result;
+    *list = items;
+    *count = nelem;
+    return true;
 }
 
-char** read_toml_include_paths(const char* toml_path, int* count) {
-    static char* paths[32]; // Support up to 32 include paths
-    static char buffer[32][256]; // Each path can be up to 256 chars
-    *count = 0;
-    
-    toml_table_t* conf = parse_toml_file(toml_path);
-    if (!conf) {
-        return NULL;
+static void free_build_targets(BuildTarget* targets, int count) {
+    if (!targets) return;
+    
+    for (int i = 0; i < count; i++) {
+        free(targets[i].name);
+        free(targets[i].entry_file);
+        free(targets[i].output_file);
+        free_string_list(targets[i].include_paths, targets[i].include_count);
+        free_string_list(targets[i].args, targets[i].args_count);
     }
+    free(targets);
+}
+
+static bool read_build_target(const ConfigReader* reader, const ConfigNode* entry, int index, BuildTarget* target) {
+    char section[48];
+    snprintf(section, sizeof(section), "build.targets[%d]", index);
     
-    toml_table_t* build = toml_table_in(conf, "build");
-    if (!build) {
-        toml_free(conf);
-        return NULL;
+    if (!entry || entry->type != CONFIG_NODE_TABLE) {
+        fprintf(stderr, "Error: %s: %s must be a table\n", reader->path, section);
+        return false;
     }
     
-    toml_table_t* includes = toml_table_in(build, "includes");
-    if (!includes) {
-        toml_free(conf);
-        return NULL;
+    if (!config_node_get(reader->snapshot, entry, "entry_file")) {
+        fprintf(stderr, "Error: [[build.targets]] entry %d has no entry_file\n", index + 1);
+        return false;
     }
     
-    toml_array_t* paths_array = toml_array_in(includes, "paths");
-    if (!paths_array) {
-        toml_free(conf);
-        return NULL;
+    if (!read_string(reader, entry, section, "entry_file", NULL, &target->entry_file) ||
+        !read_string(reader, entry, section, "output_file", NULL, &target->output_file) ||
+        !read_string(reader, entry, section, "name", NULL, &target->name)) {
+        return false;
     }
     
-    // Get array size
-    int i;
-    for (i = 0; i < 32; i++) {
-        toml_datum_t datum = toml_string_at(paths_array, i);
-        if (!datum.ok) {
-            break;
+    if (!target->output_file) {
+        // Default to the entry file with an .amx extension
+        const char* dot = strrchr(target->entry_file, '.');
+        size_t stem_len = dot ? (size_t)(dot - target->entry_file) : strlen(target->entry_file);
+        target->output_file = malloc(stem_len + 5);
+        if (target->output_file) {
+            memcpy(target->output_file, target->entry_file, stem_len);
+            strcpy(target->output_file + stem_len, ".amx");
         }
-        
-        safe_strcpy(buffer[i], sizeof(buffer[i]), datum.u.s);
-        paths[i] = buffer[i];
-        free(datum.u.s);
     }
     
-    *count = i;
-    paths[*count] = NULL; // NULL terminate the array
+    if (!target->name) {
+        target->name = dup_string(target->entry_file);
+    }
+    
+    if (!target->output_file || !target->name) {
+        fprintf(stderr, "Error: Out of memory reading build targets\n");
+        return false;
+    }
     
-    toml_free(conf);
-    return paths;
+    return read_string_list(reader, entry, section, "includes", "paths",
+                            &target->include_paths, &target->include_count) &&
+           read_string_list(reader, entry, section, "args", "args",
+                            &target->args, &target->args_count);
 }
 
-char** read_toml_compiler_args(const char* toml_path, int* count) {
-    static char* args[32]; // Support up to 32 compiler arguments
-    static char buffer[32][256]; // Each argument can be up to 256 chars
-    *count = 0;
+static bool read_build_targets(const ConfigReader* reader, const ConfigNode* build, ProjectConfig* config) {
+    const ConfigNode* targets_array = config_node_get(reader->snapshot, build, "targets");
+    if (!targets_array) {
+        return true;
+    }
+    if (targets_array->type != CONFIG_NODE_ARRAY) {
+        fprintf(stderr, "Error: %s: build.targets must be an array of tables\n", reader->path);
+        return false;
+    }
+    
+    int nelem = (int)targets_array->count;
+    if (nelem <= 0) {
+        return true;
+    }
+    
+    config->targets = calloc((size_t)nelem, sizeof(BuildTarget));
+    if (!config->targets) {
+        fprintf(stderr, "Error: Out of memory reading build targets\n");
+        return false;
+    }
     
+    // Count every target handed out so a partial list is freed correctly
+    for (int i = 0; i < nelem; i++) {
+        config->target_count = i + 1;
+        const ConfigNode* entry = config_node_at(reader->snapshot, targets_array, (uint32_t)i);
+        if (!read_build_target(reader, entry, i, &config->targets[i])) {
+            return false;
+        }
+    }
     
-    const char* default_args[] = {
+    return true;
+}
+
+static bool read_build_section(const ConfigReader* reader, const ConfigNode* build, ProjectConfig* config) {
+    static const char* const default_args[] = {
         "-d3",
         "-;+",
         "-(+",
@@ -183,112 +260,141 @@ char** read_toml_compiler_args(const char* toml_path, int* count) {
         NULL
     };
     
-    // Set default values first
-    for (int i = 0; default_args[i] != NULL; i++) {
-        safe_strcpy(buffer[i], sizeof(buffer[i]), default_args[i]);
-        args[i] = buffer[i];
-        (*count)++;
+    if (build && build->type != CONFIG_NODE_TABLE) {
+        fprintf(stderr, "Error: %s: build must be a table\n", reader->path);
+        return false;
     }
     
-    toml_table_t* conf = parse_toml_file(toml_path);
-    if (!conf) {
-        return args;
+    if (!read_string(reader, build, "build", "entry_file", DEFAULT_INPUT_FILE, &config->entry_file) ||
+        !read_string(reader, build, "build", "output_file", DEFAULT_OUTPUT_FILE, &config->output_file) ||
+        !read_string(reader, build, "build", "compiler_version", DEFAULT_COMPILER_VERSION,
+                     &config->compiler_version)) {
+        return false;
     }
     
-    toml_table_t* build = toml_table_in(conf, "build");
-    if (!build) {
-        toml_free(conf);
-        return args;
+    const ConfigNode* cache_size = config_node_get(reader->snapshot, build, "include_cache_size");
+    if (cache_size) {
+        int64_t value;
+        if (!config_node_int(cache_size, &value) || value <= 0 || value > 1000000) {
+            fprintf(stderr, "Error: %s: build.include_cache_size must be an integer from 1 to 1000000\n",
+                    reader->path);
+            return false;
+        }
+        config->include_cache_size = (int)value;
     }
     
-    toml_table_t* build_args = toml_table_in(build, "args");
-    if (!build_args) {
-        toml_free(conf);
-        return args;
+    if (!read_string_list(reader, build, "build", "includes", "paths",
+                          &config->include_paths, &config->include_count) ||
+        !read_string_list(reader, build, "build", "args", "args",
+                          &config->compiler_args, &config->args_count)) {
+        return false;
     }
     
-    toml_array_t* args_array = toml_array_in(build_args, "args");
-    if (!args_array) {
-        toml_free(conf);
-        return args;
+    if (!config->compiler_args) {
+        config->compiler_args = dup_string_list(default_args, &config->args_count);
+        if (!config->compiler_args) {
+            fprintf(stderr, "Error: Out of memory reading %s\n", reader->path);
+            return false;
+        }
     }
     
+    return read_build_targets(reader, build, config);
+}
+
+ProjectConfig* project_config_load(const char* toml_path) {
+    ProjectConfig* config = calloc(1, sizeof(ProjectConfig));
+    if (!config) {
+        fprintf(stderr, "Error: Out of memory reading %s\n", toml_path);
+        return NULL;
+    }
     
-    *count = 0;
+    ConfigSnapshot snapshot;
+    ConfigSnapshotStatus status = config_snapshot_open(&snapshot, toml_path);
+    if (status == CONFIG_SNAPSHOT_ERROR) {
+        project_config_free(config);
+        return NULL;
+    }
     
-    // Get array size
-    for (int i = 0; i < 32; i++) {
-        toml_datum_t datum = toml_string_at(args_array, i);
-        if (!datum.ok) {
-            break;
+    if (status == CONFIG_SNAPSHOT_MISSING) {
+        // No project file: the defaults apply, without any include paths
+        // or compiler flags
+        config->entry_file = dup_string(DEFAULT_INPUT_FILE);
+        config->output_file = dup_string(DEFAULT_OUTPUT_FILE);
+        config->compiler_version = dup_string(DEFAULT_COMPILER_VERSION);
+        if (!config->entry_file || !config->output_file || !config->compiler_version) {
+            fprintf(stderr, "Error: Out of memory reading %s\n", toml_path);
+            project_config_free(config);
+            return NULL;
         }
-        
-        safe_strcpy(buffer[i], sizeof(buffer[i]), datum.u.s);
-        args[i] = buffer[i];
-        (*count)++;
-        free(datum.u.s);
+        return config;
     }
     
-    args[*count] = NULL;
+    ConfigReader reader = { toml_path, &snapshot };
+    config->found = true;
+    bool ok = read_build_section(&reader, config_node_get(&snapshot, config_snapshot_root(&snapshot), "build"),
+                                 config);
+    config_snapshot_close(&snapshot);
     
-    toml_free(conf);
-    return args;
+    if (!ok) {
+        project_config_free(config);
+        return NULL;
+    }
+    return config;
 }
 
-char* get_directory_path(const char* file_path) {
-    static char dir_path[512];
-    
-    // Copy the file path to work with
-    #ifdef _WIN32
-    strcpy_s(dir_path, sizeof(dir_path), file_path);
-    #else
-    strcpy(dir_path, file_path);
-    #endif
-    
-    // Find the last separator
-    char* last_sep = NULL;
+void project_config_free(ProjectConfig* config) {
+    if (!config) return;
+    
+    free(config->entry_file);
+    free(config->output_file);
+    free(config->compiler_version);
+    free_string_list(config->include_paths, config->include_count);
+    free_string_list(config->compiler_args, config->args_count);
+    free_build_targets(config->targets, config->target_count);
+    free(config);
+}
+
+// Length of the directory part of path, up to and including its last separator
+static size_t directory_length(const char* path) {
+    const char* last_sep = strrchr(path, '/');
     
     #ifdef _WIN32
     // Windows: check for both '/' and '\'
-    char* last_forward = strrchr(dir_path, '/');
-    char* last_backward = strrchr(dir_path, '\\');
-    
-    if (last_forward && last_backward) {
-        last_sep = (last_forward > last_backward) ? last_forward : last_backward;
-    } else if (last_forward) {
-        last_sep = last_forward;
-    } else {
+    const char* last_backward = strrchr(path, '\\');
+    if (!last_sep || (last_backward && last_backward > last_sep)) {
         last_sep = last_backward;
     }
-    #else
-    // Unix-like: only check for '/'
-    last_sep = strrchr(dir_path, '/');
     #endif
     
-    if (last_sep) {
-        // Terminate the string at the separator
-        *(last_sep + 1) = '\0';
-    } else {
+    return last_sep ? (size_t)(last_sep - path) + 1 : 0;
+}
+
+char* dup_directory_path(const char* file_path) {
+    size_t length = directory_length(file_path);
+    if (length == 0) {
         // No directory part, use current directory
         #ifdef _WIN32
-        strcpy_s(dir_path, sizeof(dir_path), ".\\");
+        return dup_string(".\\");
         #else
-        strcpy(dir_path, "./");
+        return dup_string("./");
         #endif
     }
-    
-    return dir_path;
+    return dup_bytes(file_path, length);
 }
 
-char* get_relative_include_path(const char* base_file, const char* include_file) {
-    static char rel_path[512];
-    char* base_dir = get_directory_path(base_file);
-    
-    #ifdef _WIN32
-    sprintf_s(rel_path, sizeof(rel_path), "%s%s", base_dir, include_file);
-    #else
-    sprintf(rel_path, "%s%s", base_dir, include_file);
-    #endif
+char* dup_relative_include_path(const char* base_file, const char* include_file) {
+    char* base_dir = dup_directory_path(base_file);
+    if (!base_dir) {
+        return NULL;
+    }
     
+    size_t dir_len = strlen(base_dir);
+    size_t include_len = strlen(include_file);
+    char* rel_path = malloc(dir_len + include_len + 1);
+    if (rel_path) {
+        memcpy(rel_path, base_dir, dir_len);
+        memcpy(rel_path + dir_len, include_file, include_len + 1);
+    }
+    free(base_dir);
     return rel_path;
-}
\ No newline at end of file
+}
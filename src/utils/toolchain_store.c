@@ -0,0 +1,238 @@
+#include "toolchain_store.h"
+
+#ifdef TOOLCHAIN_STORE_SUPPORTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "crypto_utils.h"
+
+// Deep enough for any release archive
+#define STORE_MAX_DEPTH 16
+
+// Plain copy of src to dst, which must not exist
+static bool copy_file_contents(const char *src, const char *dst) {
+    FILE *in = fopen(src, "rb");
+    if (!in) {
+        return false;
+    }
+    int fd = open(dst, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out) {
+        if (fd >= 0) close(fd);
+        fclose(in);
+        return false;
+    }
+
+    char buffer[64 * 1024];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, n, out) == n;
+    }
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        unlink(dst);
+    }
+    return ok;
+}
+
+/**
+ * Make path a hardlink to the stored object, replacing what is there in
+ * one step
+ *
+ * @return false if it cannot be linked; path is left alone
+ */
+static bool link_object(const char *object_path, const char *path) {
+    char temp_path[4096];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.store-link", path) >= (int)sizeof(temp_path)) {
+        return false;
+    }
+    unlink(temp_path);
+
+    if (link(object_path, temp_path) != 0) {
+        return false;
+    }
+    if (rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Add path to the store as object_path: the same inode where possible,
+ * otherwise a copy of it. A temporary name and a rename keep a concurrent
+ * install from seeing half an object
+ */
+static bool add_object(const char *object_path, const char *path, unsigned int mode) {
+    char temp_path[4096];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", object_path) >= (int)sizeof(temp_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    unlink(temp_path);
+
+    bool linked = link(path, temp_path) == 0;
+    if (!linked && !copy_file_contents(path, temp_path)) {
+        return false;
+    }
+    if (chmod(temp_path, mode) != 0 || rename(temp_path, object_path) != 0) {
+        unlink(temp_path);
+        return false;
+    }
+    if (!linked) {
+        // The installed copy becomes a link to the object, if it can
+        link_object(object_path, path);
+        chmod(path, mode);
+    }
+    return true;
+}
+
+static bool ensure_directory(const char *path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static bool adopt_file(const char *store_dir, const char *path, const struct stat *st, ToolchainStoreStats *stats) {
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    char hex[65];
+    if (!calculate_file_sha256(path, hash)) {
+        fprintf(stderr, "Warning: Cannot read %s into the toolchain store\n", path);
+        return false;
+    }
+    hash_to_hex_string(hash, hex);
+
+    // Links share their mode, so it is part of the key. Objects are
+    // read-only since every version linking them would see a change
+    unsigned int mode = (unsigned int)(st->st_mode & 0555);
+    char object_dir[4096];
+    char object_path[4096];
+    snprintf(object_dir, sizeof(object_dir), "%s/objects/%.2s", store_dir, hex);
+    snprintf(object_path, sizeof(object_path), "%s/objects/%.2s/%s-%03o", store_dir, hex, hex + 2, mode);
+    if (!ensure_directory(object_dir)) {
+        fprintf(stderr, "Warning: Cannot create %s: %s\n", object_dir, strerror(errno));
+        return false;
+    }
+
+    stats->files++;
+    struct stat object_st;
+    if (stat(object_path, &object_st) == 0 && S_ISREG(object_st.st_mode) && object_st.st_size == st->st_size) {
+        if (object_st.st_dev == st->st_dev && object_st.st_ino == st->st_ino) {
+            // Stored by an earlier run
+            return true;
+        }
+        if (link_object(object_path, path)) {
+            stats->shared++;
+            stats->shared_bytes += (uint64_t)st->st_size;
+            return true;
+        }
+        // Neither link kind works here; keep the copy
+        chmod(path, mode);
+        return true;
+    }
+
+    if (!add_object(object_path, path, mode)) {
+        fprintf(stderr, "Warning: Cannot add %s to the toolchain store: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool adopt_directory(const char *store_dir, const char *path, int depth, ToolchainStoreStats *stats) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char child_path[4096];
+        snprintf(child_path, sizeof(child_path), "%s/%s", path, name);
+
+        // Symlinks are left as they are
+        struct stat st;
+        if (lstat(child_path, &st) != 0) continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < STORE_MAX_DEPTH) {
+                ok = adopt_directory(store_dir, child_path, depth + 1, stats) && ok;
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            ok = adopt_file(store_dir, child_path, &st, stats) && ok;
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+bool toolchain_store_adopt_tree(const char *store_dir, const char *dir, ToolchainStoreStats *stats) {
+    char objects_dir[4096];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/objects", store_dir);
+    if (!ensure_directory(store_dir) || !ensure_directory(objects_dir)) {
+        fprintf(stderr, "Warning: Cannot create %s: %s\n", objects_dir, strerror(errno));
+        return false;
+    }
+    return adopt_directory(store_dir, dir, 0, stats);
+}
+
+uint64_t toolchain_store_sweep(const char *store_dir) {
+    char objects_dir[4096];
+    snprintf(objects_dir, sizeof(objects_dir), "%s/objects", store_dir);
+    DIR *objects = opendir(objects_dir);
+    if (!objects) {
+        return 0;
+    }
+
+    uint64_t removed = 0;
+    struct dirent *prefix;
+    while ((prefix = readdir(objects)) != NULL) {
+        if (prefix->d_name[0] == '.') continue;
+
+        char prefix_path[4096];
+        if (snprintf(prefix_path, sizeof(prefix_path), "%s/%s", objects_dir, prefix->d_name) >=
+            (int)sizeof(prefix_path)) {
+            continue;
+        }
+        DIR *dir = opendir(prefix_path);
+        if (!dir) continue;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            // Names with a dot are objects still being added
+            if (strchr(entry->d_name, '.')) continue;
+
+            char object_path[4096];
+            if (snprintf(object_path, sizeof(object_path), "%s/%s", prefix_path, entry->d_name) >=
+                (int)sizeof(object_path)) {
+                continue;
+            }
+            struct stat st;
+            if (lstat(object_path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink == 1 &&
+                unlink(object_path) == 0) {
+                removed++;
+            }
+        }
+        closedir(dir);
+    }
+    closedir(objects);
+    return removed;
+}
+
+#endif /* TOOLCHAIN_STORE_SUPPORTED */
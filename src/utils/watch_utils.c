@@ -0,0 +1,521 @@
+#include "watch_utils.h"
+#include "crypto_utils.h"
+#include "toml_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_POLL_INTERVAL_MS 500
+
+#ifdef __linux__
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                      IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MOVE_SELF)
+#endif
+
+typedef struct {
+    char *path;
+    bool is_dir;
+    bool exists;
+    time_t mtime;
+    long long size;
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    bool pending;           // changed during the build, report on the next wait
+#ifdef __linux__
+    int wd;                 // inotify watch on the entry's directory, -1 if none
+    const char *name;       // file name within that directory
+    bool ancestor;          // the directory is missing, wd is on an ancestor
+    bool dirty;             // named by an event since the last check
+    bool rewatch;           // wd has to be placed again before the check
+#endif
+} WatchEntry;
+
+// Entries are kept sorted by path
+struct FileWatcher {
+    WatchEntry *entries;
+    int count;
+#ifdef __linux__
+    int inotify_fd;
+    int *wds;               // distinct watches held, sorted
+    int wd_count;
+    int unwatched;          // entries nothing could be watched for
+#endif
+};
+
+static void sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+#endif
+}
+
+static void clear_entries(FileWatcher *watcher) {
+    for (int i = 0; i < watcher->count; i++) {
+        free(watcher->entries[i].path);
+    }
+    free(watcher->entries);
+    watcher->entries = NULL;
+    watcher->count = 0;
+}
+
+/**
+ * Refresh an entry from disk.
+ *
+ * @param hash_contents Rehash files even if size and mtime look unchanged
+ * @return true if the entry changed since it was last refreshed
+ */
+static bool refresh_entry(WatchEntry *entry, bool hash_contents) {
+    struct stat st;
+    bool exists = stat(entry->path, &st) == 0;
+
+    if (exists != entry->exists) {
+        entry->exists = exists;
+        if (exists) {
+            entry->mtime = st.st_mtime;
+            entry->size = (long long)st.st_size;
+            if (!entry->is_dir) {
+                calculate_file_sha256(entry->path, entry->hash);
+            }
+        }
+        return true;
+    }
+    if (!exists) {
+        return false;
+    }
+
+    bool stat_changed = st.st_mtime != entry->mtime || (long long)st.st_size != entry->size;
+    entry->mtime = st.st_mtime;
+    entry->size = (long long)st.st_size;
+
+    if (entry->is_dir) {
+        return stat_changed;
+    }
+
+    if (!stat_changed && !hash_contents) {
+        return false;
+    }
+
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    if (!calculate_file_sha256(entry->path, hash)) {
+        return false;
+    }
+    if (memcmp(hash, entry->hash, sizeof(hash)) == 0) {
+        return false;
+    }
+    memcpy(entry->hash, hash, sizeof(hash));
+    return true;
+}
+
+/**
+ * Refresh entries from disk and report the first one that changed.
+ *
+ * @param dirty_only Only refresh the entries named by inotify events
+ */
+static bool check_for_changes(FileWatcher *watcher, bool hash_contents, bool dirty_only, bool watch_dirs,
+                              char *changed_file, size_t changed_file_size) {
+    bool changed = false;
+
+    // Refresh every candidate so the recorded state is current for the next wait
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+#ifdef __linux__
+        if (dirty_only && !entry->dirty) {
+            continue;
+        }
+        entry->dirty = false;
+#else
+        (void)dirty_only;
+#endif
+        if (refresh_entry(entry, hash_contents) && (!entry->is_dir || watch_dirs)) {
+            if (!changed && changed_file && changed_file_size > 0) {
+                snprintf(changed_file, changed_file_size, "%s", entry->path);
+            }
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const WatchEntry *)a)->path, ((const WatchEntry *)b)->path);
+}
+
+static bool append_entries(WatchEntry *entries, int *count, const IncludeFileList *list, bool is_dir) {
+    for (int i = 0; list && i < list->count; i++) {
+        WatchEntry *entry = &entries[*count];
+        memset(entry, 0, sizeof(*entry));
+        entry->path = malloc(strlen(list->files[i]) + 1);
+        if (!entry->path) return false;
+        strcpy(entry->path, list->files[i]);
+        entry->is_dir = is_dir;
+        (*count)++;
+    }
+    return true;
+}
+
+/**
+ * Carry over the recorded state of an entry that was already watched, or
+ * record a baseline for a new one.
+ *
+ * The build that produced the new set compiled whatever was on disk when it
+ * started, so a change made since then is flagged to trigger another build
+ * rather than being taken as the baseline
+ */
+static void init_entry(WatchEntry *entry, const WatchEntry *previous, time_t since) {
+    if (previous) {
+        char *path = entry->path;
+        bool is_dir = entry->is_dir;
+        *entry = *previous;
+        entry->path = path;
+        entry->is_dir = is_dir;
+        // The mtime only has one-second granularity, so a file recorded
+        // less than a second before the build may have changed unnoticed
+        entry->pending = refresh_entry(entry, entry->mtime >= since - 1) || previous->pending;
+        return;
+    }
+
+    // Nothing was recorded before the build; only the mtime can tell
+    refresh_entry(entry, true);
+    entry->pending = entry->exists && entry->mtime >= since;
+}
+
+#ifdef __linux__
+/**
+ * Watch the directory an entry is in, or the entry itself for dirs. If that
+ * does not exist yet, watch the nearest ancestor that does instead, so the
+ * entry can be watched properly once its directory shows up
+ */
+static void watch_entry(FileWatcher *watcher, WatchEntry *entry) {
+    char *dir;
+    if (entry->is_dir) {
+        dir = malloc(strlen(entry->path) + 2);
+        if (dir) strcpy(dir, entry->path);
+    } else {
+        dir = dup_directory_path(entry->path);
+    }
+    const char *slash = strrchr(entry->path, '/');
+    entry->name = slash ? slash + 1 : entry->path;
+    entry->wd = -1;
+    entry->ancestor = false;
+    entry->rewatch = false;
+
+    while (dir) {
+        // Re-adding a directory already watched just returns its descriptor
+        entry->wd = inotify_add_watch(watcher->inotify_fd, dir, WATCH_EVENTS);
+        if (entry->wd >= 0 || (errno != ENOENT && errno != ENOTDIR)) {
+            break;
+        }
+
+        // Step up to the parent, ending at "." or "/"
+        size_t before = strlen(dir);
+        size_t length = before;
+        while (length > 1 && dir[length - 1] == '/') length--;
+        while (length > 0 && dir[length - 1] != '/') length--;
+        if (length == 0) {
+            if (strcmp(dir, ".") == 0) break;
+            strcpy(dir, ".");
+        } else {
+            if (length == before) break;
+            dir[length] = '\0';
+        }
+        entry->ancestor = true;
+    }
+    free(dir);
+}
+
+static int compare_wds(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Collect the watches the entries use and remove the ones no entry uses
+ * any more, such as the directories of files dropped from the set
+ */
+static void sync_watches(FileWatcher *watcher) {
+    int *wds = malloc(sizeof(int) * (watcher->count > 0 ? (size_t)watcher->count : 1));
+    if (!wds) {
+        return;
+    }
+
+    int wd_count = 0;
+    watcher->unwatched = 0;
+    for (int i = 0; i < watcher->count; i++) {
+        if (watcher->entries[i].wd < 0) {
+            watcher->unwatched++;
+        } else {
+            wds[wd_count++] = watcher->entries[i].wd;
+        }
+    }
+    qsort(wds, wd_count, sizeof(int), compare_wds);
+    int unique = 0;
+    for (int i = 0; i < wd_count; i++) {
+        if (unique == 0 || wds[unique - 1] != wds[i]) {
+            wds[unique++] = wds[i];
+        }
+    }
+
+    for (int i = 0; i < watcher->wd_count; i++) {
+        if (!bsearch(&watcher->wds[i], wds, unique, sizeof(int), compare_wds)) {
+            // Fails harmlessly if the directory is gone and the watch with it
+            inotify_rm_watch(watcher->inotify_fd, watcher->wds[i]);
+        }
+    }
+    free(watcher->wds);
+    watcher->wds = wds;
+    watcher->wd_count = unique;
+}
+
+// Place the watches of entries whose directory appeared or went away again
+static void rewatch_entries(FileWatcher *watcher) {
+    bool any = false;
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+        if (entry->rewatch) {
+            watch_entry(watcher, entry);
+            any = true;
+        }
+    }
+    if (any) {
+        sync_watches(watcher);
+    }
+}
+
+// Mark the entries an inotify event is about for the next check
+static void mark_event(FileWatcher *watcher, const struct inotify_event *event) {
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+        if (event->mask & IN_Q_OVERFLOW) {
+            // Events were lost; everything has to be looked at
+            entry->dirty = true;
+            if (entry->ancestor || entry->wd < 0) {
+                entry->rewatch = true;
+            }
+        } else if (entry->wd == event->wd) {
+            // Anything happening in an ancestor may be the missing
+            // directory being created, and IN_IGNORED or IN_MOVE_SELF mean
+            // the watched directory itself went away
+            if (entry->ancestor || (event->mask & (IN_IGNORED | IN_MOVE_SELF))) {
+                entry->dirty = true;
+                entry->rewatch = true;
+            } else if (entry->is_dir || (event->len > 0 && strcmp(entry->name, event->name) == 0)) {
+                entry->dirty = true;
+            }
+        }
+    }
+}
+
+// Mark the entries nothing could be watched for, to be polled instead
+static void mark_unwatched(FileWatcher *watcher) {
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+        if (entry->wd < 0) {
+            entry->dirty = true;
+            entry->rewatch = true;
+        }
+    }
+}
+
+/**
+ * Wait up to timeout_ms (-1 for ever) for inotify events and drain them,
+ * marking the entries they name
+ *
+ * @return true if any events arrived
+ */
+static bool wait_for_events(FileWatcher *watcher, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = watcher->inotify_fd;
+    pfd.events = POLLIN;
+
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready <= 0) {
+        return false;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(watcher->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            mark_event(watcher, event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return true;
+}
+#endif
+
+FileWatcher *file_watcher_create(void) {
+    FileWatcher *watcher = calloc(1, sizeof(FileWatcher));
+    if (!watcher) {
+        return NULL;
+    }
+
+#ifdef __linux__
+    watcher->inotify_fd = -1;
+#endif
+    return watcher;
+}
+
+bool file_watcher_set(FileWatcher *watcher, const IncludeFileList *files, const IncludeFileList *dirs,
+                      time_t since) {
+    int total = (files ? files->count : 0) + (dirs ? dirs->count : 0);
+    WatchEntry *entries = calloc(total > 0 ? (size_t)total : 1, sizeof(WatchEntry));
+    int count = 0;
+    if (!entries || !append_entries(entries, &count, files, false) ||
+        !append_entries(entries, &count, dirs, true)) {
+        for (int i = 0; entries && i < count; i++) {
+            free(entries[i].path);
+        }
+        free(entries);
+        return false;
+    }
+
+    // Sort and drop duplicates, then match against the previous set
+    qsort(entries, count, sizeof(WatchEntry), compare_entries);
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && strcmp(entries[unique - 1].path, entries[i].path) == 0) {
+            free(entries[i].path);
+            continue;
+        }
+        entries[unique] = entries[i];
+        const WatchEntry *previous = watcher->count > 0
+            ? bsearch(&entries[unique], watcher->entries, watcher->count, sizeof(WatchEntry), compare_entries)
+            : NULL;
+        init_entry(&entries[unique], previous, since);
+        unique++;
+    }
+
+    clear_entries(watcher);
+    watcher->entries = entries;
+    watcher->count = unique;
+
+#ifdef __linux__
+    // The descriptor is kept across builds so events that arrive while one
+    // runs are still there for the next wait
+    if (watcher->inotify_fd < 0) {
+        watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watcher->inotify_fd < 0) {
+            fprintf(stderr, "Warning: inotify unavailable, falling back to polling\n");
+            return true;
+        }
+    }
+
+    // Watch the directories rather than the files themselves, since editors
+    // commonly save by writing a new file and renaming it over the old one
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+        entry->dirty = false;
+        watch_entry(watcher, entry);
+    }
+    sync_watches(watcher);
+    if (watcher->unwatched > 0) {
+        fprintf(stderr, "Warning: %d watched paths could not be watched with inotify, polling them\n",
+                watcher->unwatched);
+    }
+#endif
+
+    return true;
+}
+
+bool file_watcher_wait(FileWatcher *watcher, int debounce_ms, bool watch_dirs,
+                       char *changed_file, size_t changed_file_size) {
+    // Changes made while the last build ran
+    bool pending = false;
+    for (int i = 0; i < watcher->count; i++) {
+        WatchEntry *entry = &watcher->entries[i];
+        if (entry->pending && !pending && (!entry->is_dir || watch_dirs)) {
+            if (changed_file && changed_file_size > 0) {
+                snprintf(changed_file, changed_file_size, "%s", entry->path);
+            }
+            pending = true;
+        }
+        entry->pending = false;
+    }
+    if (pending) {
+        return true;
+    }
+
+    for (;;) {
+#ifdef __linux__
+        if (watcher->inotify_fd >= 0) {
+            // Paths nothing could be watched for are polled between events
+            int timeout_ms = watcher->unwatched > 0 ? WATCH_POLL_INTERVAL_MS : -1;
+            bool hash_contents = wait_for_events(watcher, timeout_ms);
+            if (hash_contents) {
+                // Coalesce a burst of writes into one rebuild
+                while (wait_for_events(watcher, debounce_ms)) {
+                }
+            } else if (timeout_ms < 0) {
+                return false;
+            } else {
+                mark_unwatched(watcher);
+            }
+            rewatch_entries(watcher);
+
+            // mtime has one-second granularity, so hash the files the
+            // events named
+            if (check_for_changes(watcher, hash_contents, true, watch_dirs, changed_file, changed_file_size)) {
+                return true;
+            }
+            continue;
+        }
+#endif
+        sleep_ms(WATCH_POLL_INTERVAL_MS);
+
+        bool touched = false;
+        for (int i = 0; i < watcher->count && !touched; i++) {
+            struct stat st;
+            const WatchEntry *entry = &watcher->entries[i];
+            bool exists = stat(entry->path, &st) == 0;
+            touched = exists != entry->exists ||
+                      (exists && (st.st_mtime != entry->mtime || (long long)st.st_size != entry->size));
+        }
+        if (!touched) {
+            continue;
+        }
+
+        sleep_ms(debounce_ms);
+        if (check_for_changes(watcher, false, false, watch_dirs, changed_file, changed_file_size)) {
+            return true;
+        }
+    }
+}
+
+void file_watcher_destroy(FileWatcher *watcher) {
+    if (!watcher) return;
+
+    clear_entries(watcher);
+#ifdef __linux__
+    if (watcher->inotify_fd >= 0) {
+        close(watcher->inotify_fd);
+    }
+    free(watcher->wds);
+#endif
+    free(watcher);
+}